@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      exynos_format_desc.h
+ * \brief     V4L2 pixel format descriptors shared by libgscaler and libscaler
+ *
+ * One row per fourcc describes how the image is laid out in memory: the
+ * number of buffers (v4l2 planes), the colour components stored in them,
+ * the chroma subsampling and the alignment the gralloc allocations follow.
+ * exynos_fmt_get_layout() derives the stride, offset and buffer sizes from
+ * it, so every user sizes buffers the same way.
+ *
+ * Lookups go through a 64 slot table indexed by a multiplicative hash of
+ * the fourcc. The multiplier is picked once, under pthread_once(), so that
+ * the table has no collision; a lookup is then a multiply, a shift and one
+ * compare.
+ */
+
+#ifndef __EXYNOS_FORMAT_DESC_H__
+#define __EXYNOS_FORMAT_DESC_H__
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <linux/videodev2.h>
+
+#define EXYNOS_FMT_MAX_COMPONENTS   3
+#define EXYNOS_FMT_HASH_BITS        6
+#define EXYNOS_FMT_HASH_SLOTS       (1 << EXYNOS_FMT_HASH_BITS)
+
+#define EXYNOS_FMT_ALIGN(x, a)      (((x) + (a) - 1) & ~((a) - 1))
+
+struct ExynosFmtDesc {
+    uint32_t fourcc;
+    uint8_t  planes;        /* v4l2 planes, i.e. buffers */
+    uint8_t  components;    /* 1 packed, 2 semi-planar, 3 planar */
+    uint8_t  rgb;
+    uint8_t  hshift;        /* chroma subsampling, log2 */
+    uint8_t  vshift;
+    uint8_t  comp_bpp[EXYNOS_FMT_MAX_COMPONENTS]; /* bits per sample */
+    uint8_t  walign;        /* image width and height alignment, pixels */
+    uint8_t  halign;
+    uint8_t  salign;        /* stride alignment, bytes */
+};
+
+struct ExynosFmtLayout {
+    unsigned int stride[EXYNOS_FMT_MAX_COMPONENTS];
+    unsigned int offset[EXYNOS_FMT_MAX_COMPONENTS]; /* in its buffer */
+    unsigned int plane[EXYNOS_FMT_MAX_COMPONENTS];  /* buffer of component */
+    unsigned int plane_size[EXYNOS_FMT_MAX_COMPONENTS];
+};
+
+static const struct ExynosFmtDesc g_exynos_fmt_desc[] = {
+    /* fourcc                 planes comps rgb h v  bpp        walign halign salign */
+    { V4L2_PIX_FMT_RGB32,          1, 1, 1, 0, 0, {32, 0, 0},  1,  1,  1 },
+    { V4L2_PIX_FMT_BGR32,          1, 1, 1, 0, 0, {32, 0, 0},  1,  1,  1 },
+    { V4L2_PIX_FMT_RGB24,          1, 1, 1, 0, 0, {24, 0, 0},  1,  1,  1 },
+    { V4L2_PIX_FMT_RGB565,         1, 1, 1, 0, 0, {16, 0, 0},  1,  1,  1 },
+    { V4L2_PIX_FMT_RGB555X,        1, 1, 1, 0, 0, {16, 0, 0},  1,  1,  1 },
+    { V4L2_PIX_FMT_RGB444,         1, 1, 1, 0, 0, {16, 0, 0},  1,  1,  1 },
+    { V4L2_PIX_FMT_YUYV,           1, 1, 0, 1, 0, {16, 0, 0},  1,  1,  1 },
+    { V4L2_PIX_FMT_YVYU,           1, 1, 0, 1, 0, {16, 0, 0},  1,  1,  1 },
+    { V4L2_PIX_FMT_UYVY,           1, 1, 0, 1, 0, {16, 0, 0},  1,  1,  1 },
+    { V4L2_PIX_FMT_VYUY,           1, 1, 0, 1, 0, {16, 0, 0},  1,  1,  1 },
+    { V4L2_PIX_FMT_NV16,           1, 2, 0, 1, 0, { 8, 16, 0}, 1,  1,  1 },
+    { V4L2_PIX_FMT_NV61,           1, 2, 0, 1, 0, { 8, 16, 0}, 1,  1,  1 },
+    { V4L2_PIX_FMT_YUV422P,        1, 3, 0, 1, 0, { 8, 8, 8},  1,  1,  1 },
+    { V4L2_PIX_FMT_NV24,           1, 2, 0, 0, 0, { 8, 16, 0}, 1,  1,  1 },
+    { V4L2_PIX_FMT_NV42,           1, 2, 0, 0, 0, { 8, 16, 0}, 1,  1,  1 },
+    { V4L2_PIX_FMT_NV12,           1, 2, 0, 1, 1, { 8, 16, 0}, 1,  1,  1 },
+    { V4L2_PIX_FMT_NV21,           1, 2, 0, 1, 1, { 8, 16, 0}, 1,  1,  1 },
+    { V4L2_PIX_FMT_YUV420,         1, 3, 0, 1, 1, { 8, 8, 8},  1,  1,  1 },
+    /* YV12 of gralloc: 16 byte aligned luma and chroma strides */
+    { V4L2_PIX_FMT_YVU420,         1, 3, 0, 1, 1, { 8, 8, 8},  1,  1, 16 },
+    { V4L2_PIX_FMT_NV12M,          2, 2, 0, 1, 1, { 8, 16, 0}, 1,  1,  1 },
+    { V4L2_PIX_FMT_NV21M,          2, 2, 0, 1, 1, { 8, 16, 0}, 1,  1,  1 },
+    /* NV21M of older kernel headers; a duplicate of the above otherwise */
+    { v4l2_fourcc('N', 'M', '2', '1'), 2, 2, 0, 1, 1, { 8, 16, 0}, 1, 1, 1 },
+    /* V4L2_PIX_FMT_NV12MT_16X16: whole 16x16 tiles */
+    { v4l2_fourcc('V', 'M', '1', '2'), 2, 2, 0, 1, 1, { 8, 16, 0}, 16, 16, 1 },
+    { V4L2_PIX_FMT_YUV420M,        3, 3, 0, 1, 1, { 8, 8, 8},  1,  1,  1 },
+    { V4L2_PIX_FMT_YVU420M,        3, 3, 0, 1, 1, { 8, 8, 8},  1,  1, 16 },
+};
+
+#define EXYNOS_FMT_DESC_COUNT \
+    (sizeof(g_exynos_fmt_desc) / sizeof(g_exynos_fmt_desc[0]))
+
+struct ExynosFmtHash {
+    uint32_t mult;                          /* 0 if no multiplier fits */
+    uint8_t slot[EXYNOS_FMT_HASH_SLOTS];    /* row + 1, 0 if empty */
+};
+
+static inline unsigned int exynos_fmt_hash(uint32_t fourcc, uint32_t mult)
+{
+    return (fourcc * mult) >> (32 - EXYNOS_FMT_HASH_BITS);
+}
+
+static inline struct ExynosFmtHash *exynos_fmt_hash_storage(void)
+{
+    static struct ExynosFmtHash hash;
+
+    return &hash;
+}
+
+/*
+ * The fourccs depend on the kernel headers the HAL is built against, so
+ * the multiplier is searched for at run time rather than fixed here.
+ */
+static inline void exynos_fmt_hash_build(void)
+{
+    struct ExynosFmtHash *hash = exynos_fmt_hash_storage();
+    uint32_t mult = 0x9E3779B1;
+    unsigned int tries;
+    unsigned int i;
+
+    for (tries = 0; tries < 4096; tries++, mult += 2) {
+        memset(hash->slot, 0, sizeof(hash->slot));
+
+        for (i = 0; i < EXYNOS_FMT_DESC_COUNT; i++) {
+            unsigned int s = exynos_fmt_hash(g_exynos_fmt_desc[i].fourcc, mult);
+
+            if (hash->slot[s] == 0)
+                hash->slot[s] = i + 1;
+            else if (g_exynos_fmt_desc[hash->slot[s] - 1].fourcc !=
+                     g_exynos_fmt_desc[i].fourcc)
+                break;
+        }
+
+        if (i == EXYNOS_FMT_DESC_COUNT) {
+            hash->mult = mult;
+            return;
+        }
+    }
+}
+
+static inline struct ExynosFmtHash *exynos_fmt_hash_table(void)
+{
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+    pthread_once(&once, exynos_fmt_hash_build);
+
+    return exynos_fmt_hash_storage();
+}
+
+static inline const struct ExynosFmtDesc *exynos_fmt_find(uint32_t fourcc)
+{
+    struct ExynosFmtHash *hash = exynos_fmt_hash_table();
+    const struct ExynosFmtDesc *desc;
+    unsigned int idx;
+
+    if (hash->mult == 0) {
+        /* no collision free multiplier; not expected with this table */
+        for (idx = 0; idx < EXYNOS_FMT_DESC_COUNT; idx++) {
+            if (g_exynos_fmt_desc[idx].fourcc == fourcc)
+                return &g_exynos_fmt_desc[idx];
+        }
+        return NULL;
+    }
+
+    idx = hash->slot[exynos_fmt_hash(fourcc, hash->mult)];
+    if (idx == 0)
+        return NULL;
+
+    desc = &g_exynos_fmt_desc[idx - 1];
+
+    return (desc->fourcc == fourcc) ? desc : NULL;
+}
+
+/* bits of the given buffer per pixel of the image */
+static inline unsigned int exynos_fmt_plane_bpp(
+    const struct ExynosFmtDesc *desc, unsigned int plane)
+{
+    unsigned int bpp = 0;
+    unsigned int c;
+
+    for (c = 0; c < desc->components; c++) {
+        unsigned int p = (c < desc->planes) ? c : desc->planes - 1;
+
+        if (p != plane)
+            continue;
+        bpp += c ? desc->comp_bpp[c] >> (desc->hshift + desc->vshift) :
+                   desc->comp_bpp[c];
+    }
+
+    return bpp;
+}
+
+static inline void exynos_fmt_get_layout(const struct ExynosFmtDesc *desc,
+    unsigned int width, unsigned int height, struct ExynosFmtLayout *layout)
+{
+    unsigned int aw = EXYNOS_FMT_ALIGN(width, desc->walign);
+    unsigned int ah = EXYNOS_FMT_ALIGN(height, desc->halign);
+    unsigned int c;
+
+    memset(layout, 0, sizeof(*layout));
+
+    for (c = 0; c < desc->components; c++) {
+        unsigned int p = (c < desc->planes) ? c : desc->planes - 1;
+        /* odd sizes keep the last chroma sample */
+        unsigned int cw = c ? (aw + (1 << desc->hshift) - 1) >> desc->hshift : aw;
+        unsigned int ch = c ? (ah + (1 << desc->vshift) - 1) >> desc->vshift : ah;
+
+        layout->stride[c] = EXYNOS_FMT_ALIGN(cw * desc->comp_bpp[c] / 8,
+                                             desc->salign);
+        layout->plane[c] = p;
+        layout->offset[c] = layout->plane_size[p];
+        layout->plane_size[p] += layout->stride[c] * ch;
+    }
+}
+
+#endif /* __EXYNOS_FORMAT_DESC_H__ */
@@ -18,7 +18,7 @@ LOCAL_PATH:= $(call my-dir)
 include $(CLEAR_VARS)
 
 LOCAL_PRELINK_MODULE := false
-LOCAL_SHARED_LIBRARIES := liblog libutils libcutils libexynosutils libexynosv4l2 libexynosscaler
+LOCAL_SHARED_LIBRARIES := liblog libutils libcutils libsync libexynosutils libexynosv4l2 libexynosscaler
 
 # to talk to secure side
 LOCAL_SHARED_LIBRARIES += libMcClient
@@ -29,13 +29,22 @@ LOCAL_C_INCLUDES := \
 	$(LOCAL_PATH)/../include \
 	$(TOP)/hardware/samsung_slsi/exynos/include \
 	$(TOP)/hardware/samsung_slsi/exynos/libexynosutils \
-	$(TOP)/hardware/samsung_slsi/exynos/libmpp
+	$(TOP)/hardware/samsung_slsi/exynos/libmpp \
+	$(TOP)/system/core/libsync
 
 LOCAL_ADDITIONAL_DEPENDENCIES := \
 	$(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr
 
 LOCAL_SRC_FILES := \
 	libgscaler_obj.cpp \
+	libgscaler_arbiter.cpp \
+	libgscaler_ext.cpp \
+	libgscaler_trace.cpp \
+	libgscaler_csc.cpp \
+	libgscaler_tile.cpp \
+	libgscaler_stripe.cpp \
+	libgscaler_topology.cpp \
+	libgscaler_sched.cpp \
 	libgscaler.cpp
 
 LOCAL_MODULE_TAGS := eng
@@ -44,4 +53,6 @@ LOCAL_MODULE := libexynosgscaler
 include $(TOP)/hardware/samsung_slsi/exynos/BoardConfigCFlags.mk
 include $(BUILD_SHARED_LIBRARY)
 
+include $(LOCAL_PATH)/bench/Android.mk
+
 endif
@@ -0,0 +1,58 @@
+# Copyright (C) 2008 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+# libgscaler is built in against fake_v4l2.cpp instead of libexynosv4l2
+LOCAL_SHARED_LIBRARIES := liblog libutils libcutils libsync libexynosutils libexynosscaler
+
+# to talk to secure side
+LOCAL_SHARED_LIBRARIES += libMcClient
+LOCAL_STATIC_LIBRARIES := libsecurepath
+
+LOCAL_C_INCLUDES := \
+	$(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr/include \
+	$(LOCAL_PATH)/.. \
+	$(LOCAL_PATH)/../../include \
+	$(TOP)/hardware/samsung_slsi/exynos/include \
+	$(TOP)/hardware/samsung_slsi/exynos/libexynosutils \
+	$(TOP)/hardware/samsung_slsi/exynos/libmpp \
+	$(TOP)/system/core/libsync
+
+LOCAL_ADDITIONAL_DEPENDENCIES := \
+	$(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr
+
+LOCAL_SRC_FILES := \
+	../libgscaler_obj.cpp \
+	../libgscaler_arbiter.cpp \
+	../libgscaler_ext.cpp \
+	../libgscaler_trace.cpp \
+	../libgscaler_csc.cpp \
+	../libgscaler_tile.cpp \
+	../libgscaler_stripe.cpp \
+	../libgscaler_topology.cpp \
+	../libgscaler_sched.cpp \
+	../libgscaler.cpp \
+	fake_v4l2.cpp \
+	gscaler_bench.cpp
+
+# count the heap calls of everything linked in
+LOCAL_LDFLAGS := -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc
+
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE := gscaler_bench
+
+include $(TOP)/hardware/samsung_slsi/exynos/BoardConfigCFlags.mk
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,458 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      fake_v4l2.cpp
+ * \brief     user-space stand-in for the exynos_v4l2 G-Scaler m2m nodes
+ *
+ * gscaler_bench links the libgscaler sources against these definitions
+ * instead of libexynosv4l2, so no ioctl reaches the kernel. The media
+ * controller and subdev calls of the local path simply fail.
+ */
+
+#define LOG_TAG "fake_v4l2"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cutils/log.h>
+#include <utils/Mutex.h>
+
+#include <exynos_v4l2.h>
+
+#include "fake_v4l2.h"
+
+using namespace android;
+
+#define FAKE_MAX_FD     1024
+#define FAKE_MAX_BUFS   32
+
+struct FakeQueue {
+    bool         streaming;
+    unsigned int count;         /* from REQBUFS */
+    unsigned int pixels;        /* from S_FMT */
+    unsigned int crop;          /* from S_CROP, 0 for the whole frame */
+    unsigned int head;          /* oldest queued buffer */
+    unsigned int num;           /* queued buffers */
+    unsigned int scheduled;     /* queued buffers already given to the engine */
+    unsigned int index[FAKE_MAX_BUFS];
+    nsecs_t      done[FAKE_MAX_BUFS];
+};
+
+struct FakeNode {
+    bool      used;
+    nsecs_t   engine_free;
+    FakeQueue src;              /* V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE */
+    FakeQueue dst;              /* V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE */
+};
+
+static const char *g_ioc_name[FAKE_IOC_MAX] = {
+    "QUERYCAP", "S_CTRL", "S_FMT", "S_CROP", "REQBUFS",
+    "QBUF", "DQBUF", "STREAMON", "STREAMOFF",
+};
+
+static Mutex         g_lock;
+static FakeNode      g_node[FAKE_MAX_FD];
+static FakeV4l2Stats g_stats;
+static FakeV4l2Cost  g_cost = {
+    2000,           /* ioctl */
+    30000,          /* s_fmt */
+    60000,          /* reqbufs */
+    80000,          /* stream */
+    200000,         /* frame */
+    3300000,        /* per_mpixel: ~300 Mpixel/s */
+};
+
+static nsecs_t fake_now(void)
+{
+    return systemTime(SYSTEM_TIME_MONOTONIC);
+}
+
+static void fake_spin(nsecs_t cost)
+{
+    nsecs_t end = fake_now() + cost;
+
+    while (fake_now() < end)
+        ;
+}
+
+static FakeNode *fake_enter(int fd, int ioc, nsecs_t extra)
+{
+    {
+        Mutex::Autolock lock(g_lock);
+        g_stats.ioctls[ioc]++;
+    }
+
+    /* the cpu time of the call itself is not serialized between nodes */
+    fake_spin(g_cost.ioctl + extra);
+
+    if (fd < 0 || fd >= FAKE_MAX_FD || !g_node[fd].used) {
+        errno = EBADF;
+        return NULL;
+    }
+
+    return &g_node[fd];
+}
+
+static FakeQueue *fake_queue(FakeNode *node, unsigned int type)
+{
+    if (type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE)
+        return &node->src;
+    if (type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE)
+        return &node->dst;
+
+    errno = EINVAL;
+    return NULL;
+}
+
+static void fake_reset_queue(FakeQueue *q)
+{
+    q->head = 0;
+    q->num = 0;
+    q->scheduled = 0;
+}
+
+/* starts every frame that has both of its buffers queued */
+static void fake_schedule(FakeNode *node)
+{
+    FakeQueue *src = &node->src;
+    FakeQueue *dst = &node->dst;
+
+    if (!src->streaming || !dst->streaming)
+        return;
+
+    while (src->scheduled < src->num && dst->scheduled < dst->num) {
+        unsigned int src_pixels = src->crop ? src->crop : src->pixels;
+        unsigned int dst_pixels = dst->crop ? dst->crop : dst->pixels;
+        unsigned int pixels = (src_pixels > dst_pixels) ?
+                              src_pixels : dst_pixels;
+        nsecs_t start = fake_now();
+        nsecs_t end;
+
+        if (node->engine_free > start)
+            start = node->engine_free;
+        end = start + g_cost.frame +
+              (g_cost.per_mpixel * pixels) / 1000000;
+        node->engine_free = end;
+
+        src->done[(src->head + src->scheduled++) % FAKE_MAX_BUFS] = end;
+        dst->done[(dst->head + dst->scheduled++) % FAKE_MAX_BUFS] = end;
+        g_stats.frames++;
+    }
+}
+
+void fake_v4l2_set_cost(const FakeV4l2Cost *cost)
+{
+    Mutex::Autolock lock(g_lock);
+
+    g_cost = *cost;
+}
+
+void fake_v4l2_get_cost(FakeV4l2Cost *cost)
+{
+    Mutex::Autolock lock(g_lock);
+
+    *cost = g_cost;
+}
+
+void fake_v4l2_get_stats(FakeV4l2Stats *stats)
+{
+    Mutex::Autolock lock(g_lock);
+
+    *stats = g_stats;
+}
+
+void fake_v4l2_reset_stats(void)
+{
+    Mutex::Autolock lock(g_lock);
+
+    memset(&g_stats, 0, sizeof(g_stats));
+}
+
+const char *fake_v4l2_ioctl_name(int ioc)
+{
+    if (ioc < 0 || ioc >= FAKE_IOC_MAX)
+        return "?";
+
+    return g_ioc_name[ioc];
+}
+
+int exynos_v4l2_open(const char *filename, int oflag, ...)
+{
+    /* a real descriptor, so that the close() of libgscaler just works */
+    int fd = open("/dev/null", O_RDWR);
+
+    if (fd < 0 || fd >= FAKE_MAX_FD) {
+        ALOGE("%s::cannot stand in for %s", __func__, filename);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    Mutex::Autolock lock(g_lock);
+
+    memset(&g_node[fd], 0, sizeof(g_node[fd]));
+    g_node[fd].used = true;
+    g_stats.opens++;
+
+    return fd;
+}
+
+int exynos_v4l2_open_devname(const char *devname, int oflag, ...)
+{
+    return exynos_v4l2_open(devname, oflag);
+}
+
+int exynos_v4l2_close(int fd)
+{
+    {
+        Mutex::Autolock lock(g_lock);
+        if (fd >= 0 && fd < FAKE_MAX_FD)
+            g_node[fd].used = false;
+    }
+
+    return close(fd);
+}
+
+bool exynos_v4l2_querycap(int fd, unsigned int need_caps)
+{
+    return fake_enter(fd, FAKE_IOC_QUERYCAP, 0) != NULL;
+}
+
+int exynos_v4l2_s_ctrl(int fd, unsigned int id, int value)
+{
+    return fake_enter(fd, FAKE_IOC_S_CTRL, 0) ? 0 : -1;
+}
+
+int exynos_v4l2_s_fmt(int fd, struct v4l2_format *fmt)
+{
+    FakeNode *node = fake_enter(fd, FAKE_IOC_S_FMT, g_cost.s_fmt);
+    FakeQueue *q;
+
+    if (node == NULL)
+        return -1;
+
+    Mutex::Autolock lock(g_lock);
+
+    q = fake_queue(node, fmt->type);
+    if (q == NULL)
+        return -1;
+    if (q->streaming) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    q->pixels = fmt->fmt.pix_mp.width * fmt->fmt.pix_mp.height;
+    q->crop = 0;
+
+    return 0;
+}
+
+int exynos_v4l2_s_crop(int fd, struct v4l2_crop *crop)
+{
+    FakeNode *node = fake_enter(fd, FAKE_IOC_S_CROP, 0);
+    FakeQueue *q;
+
+    if (node == NULL)
+        return -1;
+
+    Mutex::Autolock lock(g_lock);
+
+    q = fake_queue(node, crop->type);
+    if (q == NULL)
+        return -1;
+
+    q->crop = crop->c.width * crop->c.height;
+
+    return 0;
+}
+
+int exynos_v4l2_reqbufs(int fd, struct v4l2_requestbuffers *req)
+{
+    FakeNode *node = fake_enter(fd, FAKE_IOC_REQBUFS, g_cost.reqbufs);
+    FakeQueue *q;
+
+    if (node == NULL)
+        return -1;
+
+    Mutex::Autolock lock(g_lock);
+
+    q = fake_queue(node, req->type);
+    if (q == NULL)
+        return -1;
+    if (q->streaming || req->count > FAKE_MAX_BUFS) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    q->count = req->count;
+    fake_reset_queue(q);
+
+    return 0;
+}
+
+int exynos_v4l2_qbuf(int fd, struct v4l2_buffer *buf)
+{
+    FakeNode *node = fake_enter(fd, FAKE_IOC_QBUF, 0);
+    FakeQueue *q;
+
+    if (node == NULL)
+        return -1;
+
+    Mutex::Autolock lock(g_lock);
+
+    q = fake_queue(node, buf->type);
+    if (q == NULL)
+        return -1;
+    if (buf->index >= q->count || q->num >= q->count) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    q->index[(q->head + q->num++) % FAKE_MAX_BUFS] = buf->index;
+    fake_schedule(node);
+
+    /* no release fence */
+    buf->reserved = -1;
+
+    return 0;
+}
+
+int exynos_v4l2_dqbuf(int fd, struct v4l2_buffer *buf)
+{
+    FakeNode *node = fake_enter(fd, FAKE_IOC_DQBUF, 0);
+    FakeQueue *q;
+    nsecs_t done;
+
+    if (node == NULL)
+        return -1;
+
+    {
+        Mutex::Autolock lock(g_lock);
+
+        q = fake_queue(node, buf->type);
+        if (q == NULL)
+            return -1;
+        if (q->scheduled == 0) {
+            /* the driver would block forever */
+            ALOGE("%s::no frame in flight on fd %d", __func__, fd);
+            errno = EINVAL;
+            return -1;
+        }
+
+        done = q->done[q->head];
+        buf->index = q->index[q->head];
+        q->head = (q->head + 1) % FAKE_MAX_BUFS;
+        q->num--;
+        q->scheduled--;
+    }
+
+    nsecs_t left = done - fake_now();
+    if (left > 0) {
+        struct timespec ts;
+        ts.tv_sec = left / 1000000000LL;
+        ts.tv_nsec = left % 1000000000LL;
+        nanosleep(&ts, NULL);
+    }
+
+    return 0;
+}
+
+int exynos_v4l2_streamon(int fd, enum v4l2_buf_type type)
+{
+    FakeNode *node = fake_enter(fd, FAKE_IOC_STREAMON, g_cost.stream);
+    FakeQueue *q;
+
+    if (node == NULL)
+        return -1;
+
+    Mutex::Autolock lock(g_lock);
+
+    q = fake_queue(node, type);
+    if (q == NULL)
+        return -1;
+
+    q->streaming = true;
+    fake_schedule(node);
+
+    return 0;
+}
+
+int exynos_v4l2_streamoff(int fd, enum v4l2_buf_type type)
+{
+    FakeNode *node = fake_enter(fd, FAKE_IOC_STREAMOFF, g_cost.stream);
+    FakeQueue *q;
+
+    if (node == NULL)
+        return -1;
+
+    Mutex::Autolock lock(g_lock);
+
+    q = fake_queue(node, type);
+    if (q == NULL)
+        return -1;
+
+    q->streaming = false;
+    fake_reset_queue(q);
+
+    return 0;
+}
+
+/* the local path is not modelled */
+struct media_device *exynos_media_open(const char *filename)
+{
+    errno = ENODEV;
+    return NULL;
+}
+
+void exynos_media_close(struct media_device *media)
+{
+}
+
+struct media_entity *exynos_media_get_entity_by_name(
+    struct media_device *media, const char *name, size_t length)
+{
+    return NULL;
+}
+
+int exynos_media_setup_link(struct media_device *media,
+    struct media_pad *source, struct media_pad *sink, __u32 flags)
+{
+    errno = ENODEV;
+    return -1;
+}
+
+int exynos_subdev_open_devname(const char *devname, int oflag, ...)
+{
+    errno = ENODEV;
+    return -1;
+}
+
+int exynos_subdev_s_fmt(int fd, struct v4l2_subdev_format *fmt)
+{
+    errno = ENODEV;
+    return -1;
+}
+
+int exynos_subdev_s_crop(int fd, struct v4l2_subdev_crop *crop)
+{
+    errno = ENODEV;
+    return -1;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      fake_v4l2.h
+ * \brief     header file for the user-space V4L2 stand-in of gscaler_bench
+ */
+
+#ifndef FAKE_V4L2_H_
+#define FAKE_V4L2_H_
+
+#include <utils/Timers.h>
+
+enum {
+    FAKE_IOC_QUERYCAP,
+    FAKE_IOC_S_CTRL,
+    FAKE_IOC_S_FMT,
+    FAKE_IOC_S_CROP,
+    FAKE_IOC_REQBUFS,
+    FAKE_IOC_QBUF,
+    FAKE_IOC_DQBUF,
+    FAKE_IOC_STREAMON,
+    FAKE_IOC_STREAMOFF,
+    FAKE_IOC_MAX,
+};
+
+/*
+ * Cost model of the stand-in. Every ioctl burns 'ioctl' of CPU time plus the
+ * extra cost of its kind. A frame starts on the engine once both queues
+ * hold a buffer and takes 'frame' plus 'per_mpixel' per million pixels of
+ * the larger crop; DQBUF sleeps until it is done. Every node has an engine
+ * of its own.
+ */
+struct FakeV4l2Cost {
+    nsecs_t ioctl;
+    nsecs_t s_fmt;
+    nsecs_t reqbufs;
+    nsecs_t stream;
+    nsecs_t frame;
+    nsecs_t per_mpixel;
+};
+
+struct FakeV4l2Stats {
+    unsigned int ioctls[FAKE_IOC_MAX];
+    unsigned int opens;
+    unsigned int frames;
+};
+
+void fake_v4l2_set_cost(const FakeV4l2Cost *cost);
+void fake_v4l2_get_cost(FakeV4l2Cost *cost);
+void fake_v4l2_get_stats(FakeV4l2Stats *stats);
+void fake_v4l2_reset_stats(void);
+const char *fake_v4l2_ioctl_name(int ioc);
+
+#endif /* FAKE_V4L2_H_ */
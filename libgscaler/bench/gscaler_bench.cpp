@@ -0,0 +1,790 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      gscaler_bench.cpp
+ * \brief     micro-benchmark of the libgscaler m2m path
+ *
+ * Drives exynos_gsc_config_exclusive()/exynos_gsc_run_exclusive() over a
+ * matrix of sizes, formats and rotations against the V4L2 stand-in of
+ * fake_v4l2.cpp and reports, per case, frames/s, ioctls per frame, the
+ * p50/p99 latency of both calls and the heap allocations per frame.
+ * With -s the frames are split over up to that many engines, on 1080p
+ * and 4K frames.
+ *
+ * With -c it times the software colour-space converter of libgscaler_csc
+ * instead, for every CSC setting, and checks its output bit for bit
+ * against the plain C reference below.
+ *
+ * With -t it times the NV12MT_16X16 detiler and retiler of libgscaler_tile
+ * on one thread and on GSC_TILE_MAX_THREADS, and checks both against the tile
+ * layout computed byte by byte below.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cutils/atomic.h>
+#include <utils/Timers.h>
+
+#include <exynos_format.h>
+#include <exynos_gscaler.h>
+
+#include "exynos_format_desc.h"
+#include "libgscaler_csc.h"
+#include "libgscaler_ext.h"
+#include "libgscaler_tile.h"
+#include "fake_v4l2.h"
+
+#define BENCH_DEFAULT_FRAMES    300
+
+struct BenchSize {
+    unsigned int w;
+    unsigned int h;
+};
+
+struct BenchFormat {
+    const char *name;
+    int         src;
+    int         dst;
+};
+
+struct BenchRot {
+    const char *name;
+    int         rot;
+};
+
+static const BenchSize g_size[] = {
+    {  720,  480 },
+    { 1280,  720 },
+    { 1920, 1080 },
+};
+
+static const BenchFormat g_format[] = {
+    { "NV12M>RGBX", HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M,
+                    HAL_PIXEL_FORMAT_RGBX_8888 },
+    { "RGBX>RGBX",  HAL_PIXEL_FORMAT_RGBX_8888,
+                    HAL_PIXEL_FORMAT_RGBX_8888 },
+    { "RGBX>NV21",  HAL_PIXEL_FORMAT_RGBX_8888,
+                    HAL_PIXEL_FORMAT_YCrCb_420_SP },
+};
+
+struct BenchCsc {
+    const char  *name;
+    unsigned int src;
+    unsigned int dst;
+    bool         semi;      /* interleaved chroma */
+    bool         rgb565;
+};
+
+static const BenchCsc g_csc[] = {
+    { "NV12M>RGBX",  V4L2_PIX_FMT_NV12M,   V4L2_PIX_FMT_RGB32,  true,  false },
+    { "NV12>RGB565", V4L2_PIX_FMT_NV12,    V4L2_PIX_FMT_RGB565, true,  true  },
+    { "YU12M>RGBX",  V4L2_PIX_FMT_YUV420M, V4L2_PIX_FMT_RGB32,  false, false },
+};
+
+/* frames large enough to be split by exynos_gsc_set_stripes() */
+static const BenchSize g_stripe_size[] = {
+    { 1920, 1080 },
+    { 3840, 2160 },
+};
+
+/* engines offered to exynos_gsc_set_stripes(); the handle's own is skipped */
+static const int g_stripe_dev[] = { 0, 1, 2, 3 };
+
+/* odd sizes to have the edge tiles cut in both directions */
+static const BenchSize g_tile_size[] = {
+    {   97,   61 },
+    {  176,  144 },
+    { 1279,  719 },
+    { 1920, 1080 },
+    { 3840, 2160 },
+};
+
+struct BenchTile {
+    const char  *name;
+    unsigned int lin;
+};
+
+static const BenchTile g_tile[] = {
+    { "NV12M",   V4L2_PIX_FMT_NV12M },
+    { "NV21",    V4L2_PIX_FMT_NV21 },
+    { "YU12M",   V4L2_PIX_FMT_YUV420M },
+    { "YV12",    V4L2_PIX_FMT_YVU420 },
+};
+
+static const BenchRot g_rot[] = {
+    { "0",   0 },
+    { "90",  HAL_TRANSFORM_ROT_90 },
+    { "180", HAL_TRANSFORM_ROT_180 },
+};
+
+/*
+ * Heap calls made by the code linked into this executable. The makefile
+ * routes malloc and friends through the wrappers below with --wrap.
+ */
+static volatile int32_t g_allocs;
+
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    android_atomic_inc(&g_allocs);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    android_atomic_inc(&g_allocs);
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    android_atomic_inc(&g_allocs);
+    return __real_realloc(ptr, size);
+}
+}
+
+void *operator new(size_t size)
+{
+    return __wrap_malloc(size);
+}
+
+void *operator new[](size_t size)
+{
+    return __wrap_malloc(size);
+}
+
+void operator delete(void *ptr)
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr)
+{
+    free(ptr);
+}
+
+static int compare_nsecs(const void *a, const void *b)
+{
+    nsecs_t x = *(const nsecs_t *)a;
+    nsecs_t y = *(const nsecs_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static nsecs_t percentile(nsecs_t *samples, unsigned int n, unsigned int pct)
+{
+    unsigned int idx = (n * pct) / 100;
+
+    if (idx >= n)
+        idx = n - 1;
+
+    return samples[idx];
+}
+
+static void fill_img(exynos_mpp_img *img, unsigned int w, unsigned int h,
+    int format, int rot, int fd)
+{
+    memset(img, 0, sizeof(*img));
+
+    img->x        = 0;
+    img->y        = 0;
+    img->w        = w;
+    img->h        = h;
+    img->fw       = w;
+    img->fh       = h;
+    img->format   = format;
+    /* the stand-in never touches the memory */
+    img->yaddr    = fd;
+    img->uaddr    = fd + 1;
+    img->vaddr    = fd + 2;
+    img->rot      = rot;
+    img->mem_type = V4L2_MEMORY_DMABUF;
+    img->acquireFenceFd = -1;
+    img->releaseFenceFd = -1;
+}
+
+static bool run_case(const BenchSize *size, const BenchFormat *format,
+    const BenchRot *rot, unsigned int frames, unsigned int depth,
+    unsigned int stripes, nsecs_t *config_lat, nsecs_t *run_lat)
+{
+    exynos_mpp_img src, dst;
+    FakeV4l2Stats stats;
+    unsigned int ioctls = 0;
+    unsigned int done = 0;
+    unsigned int dw = size->w;
+    unsigned int dh = size->h;
+    nsecs_t start, end;
+    int32_t allocs;
+    void *handle;
+
+    if (rot->rot & HAL_TRANSFORM_ROT_90) {
+        dw = size->h;
+        dh = size->w;
+    }
+
+    handle = exynos_gsc_create();
+    if (handle == NULL) {
+        fprintf(stderr, "exynos_gsc_create() fail\n");
+        return false;
+    }
+
+    if (exynos_gsc_set_m2m_depth(handle, depth) < 0) {
+        fprintf(stderr, "exynos_gsc_set_m2m_depth(%u) fail\n", depth);
+        exynos_gsc_destroy(handle);
+        return false;
+    }
+
+    if (stripes > 1 &&
+            exynos_gsc_set_stripes(handle, g_stripe_dev, stripes) < 0) {
+        fprintf(stderr, "exynos_gsc_set_stripes(%u) fail\n", stripes);
+        exynos_gsc_destroy(handle);
+        return false;
+    }
+
+    fake_v4l2_reset_stats();
+    allocs = android_atomic_acquire_load(&g_allocs);
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    for (unsigned int i = 0; i < frames; i++) {
+        nsecs_t t0, t1, t2;
+
+        /* a composer fills both descriptors afresh for every frame */
+        fill_img(&src, size->w, size->h, format->src, 0, 100 + 3 * (i % 3));
+        fill_img(&dst, dw, dh, format->dst, rot->rot, 200 + 3 * (i % 3));
+
+        t0 = systemTime(SYSTEM_TIME_MONOTONIC);
+        if (exynos_gsc_config_exclusive(handle, &src, &dst) < 0) {
+            fprintf(stderr, "exynos_gsc_config_exclusive() fail\n");
+            break;
+        }
+        t1 = systemTime(SYSTEM_TIME_MONOTONIC);
+        if (exynos_gsc_run_exclusive(handle, &src, &dst) < 0) {
+            fprintf(stderr, "exynos_gsc_run_exclusive() fail\n");
+            break;
+        }
+        t2 = systemTime(SYSTEM_TIME_MONOTONIC);
+
+        config_lat[i] = t1 - t0;
+        run_lat[i] = t2 - t1;
+        done++;
+    }
+
+    exynos_gsc_stop_exclusive(handle);
+    end = systemTime(SYSTEM_TIME_MONOTONIC);
+    allocs = android_atomic_acquire_load(&g_allocs) - allocs;
+    fake_v4l2_get_stats(&stats);
+
+    exynos_gsc_destroy(handle);
+
+    if (done < frames)
+        return false;
+
+    for (int i = 0; i < FAKE_IOC_MAX; i++)
+        ioctls += stats.ioctls[i];
+
+    qsort(config_lat, frames, sizeof(nsecs_t), compare_nsecs);
+    qsort(run_lat, frames, sizeof(nsecs_t), compare_nsecs);
+
+    printf("%4ux%-4u %-11s %-3s %8.1f %7.2f %7.2f %8lld %8lld %8lld %8lld %7.2f\n",
+            size->w, size->h, format->name, rot->name,
+            frames * 1000000000.0 / (end - start),
+            (double)ioctls / frames,
+            (double)(stats.ioctls[FAKE_IOC_S_FMT] +
+                     stats.ioctls[FAKE_IOC_REQBUFS]) / frames,
+            ns2us(percentile(config_lat, frames, 50)),
+            ns2us(percentile(config_lat, frames, 99)),
+            ns2us(percentile(run_lat, frames, 50)),
+            ns2us(percentile(run_lat, frames, 99)),
+            (double)allocs / frames);
+
+    return true;
+}
+
+static uint8_t csc_clamp(int v)
+{
+    return (v < 0) ? 0 : ((v > 255) ? 255 : v);
+}
+
+/* pixel by pixel conversion with the equation CGscCscSW::GetCoef() gives */
+static void csc_reference(const BenchCsc *csc, const GscCscCoef *k,
+    unsigned int w, unsigned int h, uint8_t * const plane[3], uint8_t *out)
+{
+    unsigned int cw = (w + 1) / 2;
+
+    for (unsigned int y = 0; y < h; y++) {
+        for (unsigned int x = 0; x < w; x++) {
+            unsigned int ci = (y / 2) * cw + x / 2;
+            int u = csc->semi ? plane[1][ci * 2] : plane[1][ci];
+            int v = csc->semi ? plane[1][ci * 2 + 1] : plane[2][ci];
+            int c = (plane[0][y * w + x] - k->y_offset) * k->y +
+                    (1 << (GSC_CSC_COEF_BITS - 1));
+            int r = csc_clamp((c + k->r_v * (v - 128)) >> GSC_CSC_COEF_BITS);
+            int g = csc_clamp((c - k->g_u * (u - 128) - k->g_v * (v - 128)) >>
+                              GSC_CSC_COEF_BITS);
+            int b = csc_clamp((c + k->b_u * (u - 128)) >> GSC_CSC_COEF_BITS);
+
+            if (csc->rgb565) {
+                uint16_t p = ((r & 0xf8) << 8) | ((g & 0xfc) << 3) | (b >> 3);
+                out[0] = p & 0xff;
+                out[1] = p >> 8;
+                out += 2;
+            } else {
+                out[0] = r;
+                out[1] = g;
+                out[2] = b;
+                out[3] = 0xff;
+                out += 4;
+            }
+        }
+    }
+}
+
+static bool run_csc_case(const BenchSize *size, const BenchCsc *csc,
+    unsigned int frames, nsecs_t *lat)
+{
+    unsigned int w = size->w;
+    unsigned int h = size->h;
+    size_t luma = w * h;
+    size_t chroma = ((w + 1) / 2) * ((h + 1) / 2);
+    size_t out_len = luma * (csc->rgb565 ? 2 : 4);
+    uint8_t *in = (uint8_t *)malloc(luma + 2 * chroma);
+    uint8_t *out = (uint8_t *)malloc(out_len);
+    uint8_t *ref = (uint8_t *)malloc(out_len);
+    uint8_t *plane[3];
+    GscCscFrame src, dst;
+    bool ok = (in != NULL && out != NULL && ref != NULL);
+
+    if (!ok)
+        fprintf(stderr, "cannot allocate %ux%u frames\n", w, h);
+
+    for (size_t i = 0; ok && i < luma + 2 * chroma; i++)
+        in[i] = (uint8_t)(i * 2654435761u >> 13);
+
+    plane[0] = in;
+    plane[1] = in + luma;
+    plane[2] = in + luma + chroma;
+
+    memset(&src, 0, sizeof(src));
+    src.width = w;
+    src.height = h;
+    src.v4l2_colorformat = csc->src;
+    src.addr[0] = in;
+    /* NV12 keeps its chroma in the luma buffer; NV12M and YUV420M do not */
+    if (csc->src != V4L2_PIX_FMT_NV12) {
+        src.addr[1] = plane[1];
+        src.addr[2] = plane[2];
+    }
+
+    memset(&dst, 0, sizeof(dst));
+    dst.width = w;
+    dst.height = h;
+    dst.v4l2_colorformat = csc->dst;
+    dst.addr[0] = out;
+
+    /* eq_auto, range_full and BT.601/BT.709, as SetCSCProperty takes them */
+    for (unsigned int mode = 0; ok && mode < 8; mode++) {
+        unsigned int eq_auto = mode & 1;
+        unsigned int range_full = (mode >> 1) & 1;
+        unsigned int colorspace = (mode & 4) ? V4L2_COLORSPACE_REC709 :
+                                               V4L2_COLORSPACE_SMPTE170M;
+        const GscCscCoef *k = CGscCscSW::GetCoef(eq_auto, range_full,
+                                                 colorspace, w);
+        CGscCscSW sw;
+        nsecs_t start, end;
+
+        sw.SetCSCProperty(eq_auto, range_full, colorspace);
+
+        start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (unsigned int i = 0; ok && i < frames; i++) {
+            nsecs_t t0 = systemTime(SYSTEM_TIME_MONOTONIC);
+
+            ok = sw.Convert(&src, &dst);
+            lat[i] = systemTime(SYSTEM_TIME_MONOTONIC) - t0;
+        }
+        end = systemTime(SYSTEM_TIME_MONOTONIC);
+
+        if (!ok) {
+            fprintf(stderr, "Convert() fail\n");
+            break;
+        }
+
+        csc_reference(csc, k, w, h, plane, ref);
+        if (memcmp(out, ref, out_len) != 0) {
+            fprintf(stderr, "%ux%u %s mode %u differs from the reference\n",
+                    w, h, csc->name, mode);
+            ok = false;
+            break;
+        }
+
+        qsort(lat, frames, sizeof(nsecs_t), compare_nsecs);
+
+        printf("%4ux%-4u %-11s %4s %-4s %-5s %8.1f %8lld %8lld\n",
+                w, h, csc->name, eq_auto ? "auto" : "-",
+                (k == CGscCscSW::GetCoef(0, range_full, V4L2_COLORSPACE_REC709, w)) ?
+                        "709" : "601",
+                range_full ? "full" : "lim",
+                frames * 1000000000.0 / (end - start),
+                ns2us(percentile(lat, frames, 50)),
+                ns2us(percentile(lat, frames, 99)));
+    }
+
+    free(in);
+    free(out);
+    free(ref);
+
+    return ok;
+}
+
+struct BenchFrame {
+    GscCscFrame    frame;
+    ExynosFmtLayout layout;
+    const ExynosFmtDesc *desc;
+};
+
+static bool alloc_frame(BenchFrame *f, unsigned int fourcc,
+    unsigned int w, unsigned int h)
+{
+    memset(f, 0, sizeof(*f));
+    f->desc = exynos_fmt_find(fourcc);
+    if (f->desc == NULL)
+        return false;
+
+    exynos_fmt_get_layout(f->desc, w, h, &f->layout);
+    f->frame.width = w;
+    f->frame.height = h;
+    f->frame.v4l2_colorformat = fourcc;
+    for (unsigned int p = 0; p < f->desc->planes; p++) {
+        f->frame.addr[p] = malloc(f->layout.plane_size[p]);
+        if (f->frame.addr[p] == NULL)
+            return false;
+    }
+
+    return true;
+}
+
+static void free_frame(BenchFrame *f)
+{
+    for (unsigned int p = 0; p < GSC_CSC_MAX_PLANES; p++)
+        free(f->frame.addr[p]);
+}
+
+/*
+ * Byte x, row y of component c of the frame. For the tiled frame the
+ * band, tile and row in the tile are worked out one at a time.
+ */
+static uint8_t *frame_byte(const BenchFrame *f, unsigned int c,
+    unsigned int x, unsigned int y)
+{
+    uint8_t *base = (uint8_t *)f->frame.addr[f->layout.plane[c]] +
+                    f->layout.offset[c];
+    unsigned int stride = f->layout.stride[c];
+
+    if (f->frame.v4l2_colorformat == v4l2_fourcc('V', 'M', '1', '2')) {
+        unsigned int ah = EXYNOS_FMT_ALIGN(f->frame.height, 16);
+        unsigned int rows = c ? ah / 2 : ah;
+        unsigned int y0 = y / 16 * 16;
+        unsigned int th = (rows - y0 < 16) ? rows - y0 : 16;
+
+        return base + y0 * stride + (x / 16) * 16 * th + (y % 16) * 16 + x % 16;
+    }
+
+    return base + y * stride + x;
+}
+
+/*
+ * Checks that the linear frame holds the image of the tiled one, and,
+ * with pad, that the padding of the tiled frame repeats the image edges.
+ */
+static bool tile_compare(const BenchFrame *tiled, const BenchFrame *lin,
+    bool pad)
+{
+    unsigned int w = tiled->frame.width;
+    unsigned int h = tiled->frame.height;
+    unsigned int aw = EXYNOS_FMT_ALIGN(w, 16);
+    unsigned int ah = EXYNOS_FMT_ALIGN(h, 16);
+    unsigned int cw = (w + 1) / 2;
+    unsigned int ch = (h + 1) / 2;
+    bool semi = (lin->desc->components == 2);
+    bool swap = (lin->frame.v4l2_colorformat == V4L2_PIX_FMT_NV21 ||
+                 lin->frame.v4l2_colorformat == V4L2_PIX_FMT_YVU420);
+
+    for (unsigned int y = 0; y < (pad ? ah : h); y++) {
+        for (unsigned int x = 0; x < (pad ? aw : w); x++) {
+            unsigned int sx = (x < w) ? x : w - 1;
+            unsigned int sy = (y < h) ? y : h - 1;
+
+            if (*frame_byte(tiled, 0, x, y) != *frame_byte(lin, 0, sx, sy))
+                return false;
+        }
+    }
+
+    for (unsigned int y = 0; y < (pad ? ah / 2 : ch); y++) {
+        for (unsigned int x = 0; x < (pad ? aw / 2 : cw); x++) {
+            unsigned int sx = (x < cw) ? x : cw - 1;
+            unsigned int sy = (y < ch) ? y : ch - 1;
+            uint8_t cb = *frame_byte(tiled, 1, x * 2, y);
+            uint8_t cr = *frame_byte(tiled, 1, x * 2 + 1, y);
+            uint8_t lcb, lcr;
+
+            if (semi) {
+                lcb = *frame_byte(lin, 1, sx * 2 + (swap ? 1 : 0), sy);
+                lcr = *frame_byte(lin, 1, sx * 2 + (swap ? 0 : 1), sy);
+            } else {
+                lcb = *frame_byte(lin, swap ? 2 : 1, sx, sy);
+                lcr = *frame_byte(lin, swap ? 1 : 2, sx, sy);
+            }
+
+            if (cb != lcb || cr != lcr)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+static void fill_frame(BenchFrame *f, uint32_t seed)
+{
+    for (unsigned int p = 0; p < f->desc->planes; p++) {
+        uint8_t *b = (uint8_t *)f->frame.addr[p];
+
+        for (unsigned int i = 0; i < f->layout.plane_size[p]; i++)
+            b[i] = (uint8_t)((i + seed) * 2654435761u >> 13);
+    }
+}
+
+static bool run_tile_case(const BenchSize *size, const BenchTile *tile,
+    unsigned int frames, nsecs_t *lat)
+{
+    BenchFrame tiled, lin;
+    bool ok;
+
+    ok = alloc_frame(&tiled, v4l2_fourcc('V', 'M', '1', '2'), size->w, size->h) &&
+         alloc_frame(&lin, tile->lin, size->w, size->h);
+    if (!ok)
+        fprintf(stderr, "cannot allocate %ux%u frames\n", size->w, size->h);
+
+    /* detile and retile, on one thread and on as many as may be used */
+    for (unsigned int mode = 0; ok && mode < 4; mode++) {
+        bool retile = mode & 1;
+        unsigned int threads = (mode & 2) ? GSC_TILE_MAX_THREADS : 1;
+        CGscTileSW sw;
+        nsecs_t start, end;
+
+        sw.SetThreads(threads);
+        fill_frame(&tiled, mode);
+        fill_frame(&lin, mode + 7);
+
+        start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (unsigned int i = 0; ok && i < frames; i++) {
+            nsecs_t t0 = systemTime(SYSTEM_TIME_MONOTONIC);
+
+            ok = retile ? sw.Retile(&lin.frame, &tiled.frame) :
+                          sw.Detile(&tiled.frame, &lin.frame);
+            lat[i] = systemTime(SYSTEM_TIME_MONOTONIC) - t0;
+        }
+        end = systemTime(SYSTEM_TIME_MONOTONIC);
+
+        if (!ok) {
+            fprintf(stderr, "%s() fail\n", retile ? "Retile" : "Detile");
+            break;
+        }
+
+        if (!tile_compare(&tiled, &lin, retile)) {
+            fprintf(stderr, "%ux%u %s %s differs from the reference\n",
+                    size->w, size->h, tile->name, retile ? "retile" : "detile");
+            ok = false;
+            break;
+        }
+
+        qsort(lat, frames, sizeof(nsecs_t), compare_nsecs);
+
+        printf("%4ux%-4u %-6s %-6s %4u %8.1f %8lld %8lld\n",
+                size->w, size->h, tile->name, retile ? "retile" : "detile",
+                threads,
+                frames * 1000000000.0 / (end - start),
+                ns2us(percentile(lat, frames, 50)),
+                ns2us(percentile(lat, frames, 99)));
+    }
+
+    free_frame(&tiled);
+    free_frame(&lin);
+
+    return ok;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "usage: %s [-n frames] [-d depth] [-s engines] [-i ioctl_ns] [-p ns_per_mpixel]\n"
+        "          [-c] [-t]\n"
+        "  -n frames per case (default %d)\n"
+        "  -d m2m pipeline depth, 1 ~ %d (default 1)\n"
+        "  -s split the frames over up to this many engines, 1 ~ %d (default 1)\n"
+        "  -i cpu cost of every ioctl in the stand-in\n"
+        "  -p engine time per million pixels in the stand-in\n"
+        "  -v print the ioctl breakdown of the stand-in cost model\n"
+        "  -c time and check the software colour-space converter instead\n"
+        "  -t time and check the NV12MT_16X16 detiler and retiler instead\n",
+        prog, BENCH_DEFAULT_FRAMES, GSC_M2M_MAX_DEPTH, GSC_STRIPE_MAX);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int frames = BENCH_DEFAULT_FRAMES;
+    unsigned int depth = 1;
+    unsigned int stripes = 1;
+    FakeV4l2Cost cost;
+    nsecs_t *config_lat, *run_lat;
+    bool verbose = false;
+    bool csc = false;
+    bool tile = false;
+    int ret = 0;
+    int opt;
+
+    fake_v4l2_get_cost(&cost);
+
+    while ((opt = getopt(argc, argv, "n:d:s:i:p:vcth")) != -1) {
+        switch (opt) {
+        case 'n':
+            frames = atoi(optarg);
+            break;
+        case 'd':
+            depth = atoi(optarg);
+            break;
+        case 's':
+            stripes = atoi(optarg);
+            break;
+        case 'i':
+            cost.ioctl = atoll(optarg);
+            break;
+        case 'p':
+            cost.per_mpixel = atoll(optarg);
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        case 'c':
+            csc = true;
+            break;
+        case 't':
+            tile = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (frames == 0 || depth < 1 || depth > GSC_M2M_MAX_DEPTH ||
+            stripes < 1 || stripes > GSC_STRIPE_MAX) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    fake_v4l2_set_cost(&cost);
+
+    if (verbose)
+        printf("cost: ioctl %lld s_fmt %lld reqbufs %lld stream %lld "
+               "frame %lld per_mpixel %lld (ns)\n",
+               cost.ioctl, cost.s_fmt, cost.reqbufs, cost.stream,
+               cost.frame, cost.per_mpixel);
+
+    config_lat = (nsecs_t *)malloc(sizeof(nsecs_t) * frames);
+    run_lat = (nsecs_t *)malloc(sizeof(nsecs_t) * frames);
+    if (config_lat == NULL || run_lat == NULL) {
+        fprintf(stderr, "cannot allocate %u samples\n", frames);
+        return 1;
+    }
+
+    if (csc) {
+        printf("%u frames per case, software CSC\n", frames);
+        printf("%-9s %-11s %4s %-4s %-5s %8s %8s %8s\n",
+                "size", "format", "eq", "csc", "range", "fps", "p50 us", "p99 us");
+
+        for (size_t s = 0; s < sizeof(g_size) / sizeof(g_size[0]); s++) {
+            for (size_t c = 0; c < sizeof(g_csc) / sizeof(g_csc[0]); c++) {
+                if (!run_csc_case(&g_size[s], &g_csc[c], frames, run_lat))
+                    ret = 1;
+            }
+        }
+
+        free(config_lat);
+        free(run_lat);
+
+        return ret;
+    }
+
+    if (tile) {
+        printf("%u frames per case, NV12MT_16X16 tiling\n", frames);
+        printf("%-9s %-6s %-6s %4s %8s %8s %8s\n",
+                "size", "format", "op", "thr", "fps", "p50 us", "p99 us");
+
+        for (size_t s = 0; s < sizeof(g_tile_size) / sizeof(g_tile_size[0]); s++) {
+            for (size_t t = 0; t < sizeof(g_tile) / sizeof(g_tile[0]); t++) {
+                if (!run_tile_case(&g_tile_size[s], &g_tile[t], frames, run_lat))
+                    ret = 1;
+            }
+        }
+
+        free(config_lat);
+        free(run_lat);
+
+        return ret;
+    }
+
+    printf("%u frames per case, depth %u, up to %u engines\n", frames, depth,
+            stripes);
+    printf("%-9s %-11s %-3s %8s %7s %7s %8s %8s %8s %8s %7s\n",
+            "size", "format", "rot", "fps", "ioc/f", "fmt/f",
+            "cfg p50", "cfg p99", "run p50", "run p99", "alloc/f");
+
+    const BenchSize *sizes = (stripes > 1) ? g_stripe_size : g_size;
+    size_t nsizes = (stripes > 1) ? sizeof(g_stripe_size) / sizeof(g_stripe_size[0]) :
+                                    sizeof(g_size) / sizeof(g_size[0]);
+
+    for (size_t s = 0; s < nsizes; s++) {
+        for (size_t f = 0; f < sizeof(g_format) / sizeof(g_format[0]); f++) {
+            for (size_t r = 0; r < sizeof(g_rot) / sizeof(g_rot[0]); r++) {
+                if (!run_case(&sizes[s], &g_format[f], &g_rot[r], frames,
+                              depth, stripes, config_lat, run_lat))
+                    ret = 1;
+            }
+        }
+    }
+
+    if (verbose) {
+        FakeV4l2Stats stats;
+
+        fake_v4l2_get_stats(&stats);
+        printf("last case: %u opens, %u frames\n", stats.opens, stats.frames);
+        for (int i = 0; i < FAKE_IOC_MAX; i++)
+            printf("  %-9s %u\n", fake_v4l2_ioctl_name(i), stats.ioctls[i]);
+    }
+
+    free(config_lat);
+    free(run_lat);
+
+    return ret;
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      libgscaler_arbiter.cpp
+ * \brief     source file for the in-process G-Scaler m2m arbiter
+ */
+
+#include "libgscaler_arbiter.h"
+
+CGscArbiter *CGscArbiter::getInstance()
+{
+    static CGscArbiter arbiter;
+
+    return &arbiter;
+}
+
+CGscArbiter::CGscArbiter()
+{
+    for (int i = 0; i < NUM_OF_GSC_HW; i++) {
+        m_node[i].fd = 0;
+        m_node[i].busy = false;
+    }
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+bool CGscArbiter::isCandidate(int gsc_id)
+{
+    /* same set m_gsc_find_and_create() has always searched */
+#ifndef USES_ONLY_GSC0_GSC1
+    return (gsc_id != 0 && gsc_id != 3);
+#else
+    return (gsc_id != 0);
+#endif
+}
+
+int CGscArbiter::acquire(CGscaler *gsc, int *gsc_id, nsecs_t timeout,
+    nsecs_t *waited)
+{
+    Mutex::Autolock lock(m_lock);
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    nsecs_t elapsed = 0;
+
+    while (true) {
+        for (int i = 0; i < NUM_OF_GSC_HW; i++) {
+            if (!isCandidate(i) || m_node[i].busy)
+                continue;
+
+            if (m_node[i].fd <= 0) {
+                /* may still be held by another process or the local path */
+                m_node[i].fd = gsc->m_gsc_m2m_create(i);
+                if (m_node[i].fd < 0) {
+                    m_node[i].fd = 0;
+                    continue;
+                }
+            }
+
+            m_node[i].busy = true;
+            *gsc_id = i;
+            *waited = elapsed;
+
+            m_stats.acquired++;
+            if (elapsed > 0) {
+                m_stats.waited++;
+                m_stats.total_wait += elapsed;
+                if (elapsed > m_stats.max_wait)
+                    m_stats.max_wait = elapsed;
+            }
+
+            return m_node[i].fd;
+        }
+
+        if (elapsed >= timeout)
+            break;
+
+        /*
+         * release() wakes us up for instances owned by this process. Nodes
+         * held elsewhere give no notification, so bound the wait by the old
+         * polling interval and probe them again.
+         */
+        nsecs_t slice = timeout - elapsed;
+        if (slice > us2ns(GSC_WAITING_TIME_FOR_TRYLOCK))
+            slice = us2ns(GSC_WAITING_TIME_FOR_TRYLOCK);
+        m_cond.waitRelative(m_lock, slice);
+
+        elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+        ALOGV("%s::waiting for the gscaler availability (%lld us)",
+                __func__, ns2us(elapsed));
+    }
+
+    m_stats.failed++;
+    *waited = elapsed;
+
+    return -1;
+}
+
+bool CGscArbiter::release(int fd)
+{
+    Mutex::Autolock lock(m_lock);
+
+    for (int i = 0; i < NUM_OF_GSC_HW; i++) {
+        if (m_node[i].busy && m_node[i].fd == fd) {
+            /* other processes and the local path may be waiting for it */
+            close(m_node[i].fd);
+            m_node[i].fd = 0;
+            m_node[i].busy = false;
+            m_cond.signal();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void CGscArbiter::getStats(GscArbiterStats *stats)
+{
+    Mutex::Autolock lock(m_lock);
+
+    *stats = m_stats;
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      libgscaler_arbiter.h
+ * \brief     header file for the in-process G-Scaler m2m arbiter
+ */
+
+#ifndef LIBGSCALER_ARBITER_H_
+#define LIBGSCALER_ARBITER_H_
+
+#include <utils/Mutex.h>
+#include <utils/Condition.h>
+#include <utils/Timers.h>
+
+#include "libgscaler_obj.h"
+
+using namespace android;
+
+struct GscArbiterStats {
+    unsigned int acquired;      /* successful acquisitions */
+    unsigned int failed;        /* acquisitions that timed out */
+    unsigned int waited;        /* acquisitions that had to wait */
+    nsecs_t      total_wait;    /* sum of imposed waits */
+    nsecs_t      max_wait;      /* longest imposed wait */
+};
+
+/*
+ * Hands out the m2m G-Scaler nodes that m_gsc_find_and_create() used to
+ * probe with open()/QUERYCAP and usleep(). A node is closed again when it
+ * is released, and waiters are woken as soon as an instance is.
+ */
+class CGscArbiter {
+public:
+    static CGscArbiter *getInstance();
+
+    /*
+     * Returns the fd of a free m2m G-Scaler and its id in *gsc_id, or -1 if
+     * none became available within timeout. *waited receives the time the
+     * caller was held back.
+     */
+    int  acquire(CGscaler *gsc, int *gsc_id, nsecs_t timeout, nsecs_t *waited);
+    /* Closes fd; returns false if it was not handed out by the arbiter */
+    bool release(int fd);
+    void getStats(GscArbiterStats *stats);
+
+private:
+    struct Node {
+        int  fd;
+        bool busy;
+    };
+
+    CGscArbiter();
+    bool isCandidate(int gsc_id);
+
+    Mutex           m_lock;
+    Condition       m_cond;
+    Node            m_node[NUM_OF_GSC_HW];
+    GscArbiterStats m_stats;
+};
+
+#endif /* LIBGSCALER_ARBITER_H_ */
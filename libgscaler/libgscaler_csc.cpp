@@ -0,0 +1,425 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      libgscaler_csc.cpp
+ * \brief     source file for the software colour-space converter
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "libgscaler_obj.h"
+#include "libgscaler_csc.h"
+#include "exynos_format_desc.h"
+
+/* what V4L2_CID_CSC_EQ_MODE picks BT.709 from, as the driver does */
+#define GSC_CSC_HD_WIDTH    1280
+
+enum {
+    GSC_CSC_OUT_RGBX,       /* R, G, B, X */
+    GSC_CSC_OUT_BGRX,       /* B, G, R, X */
+    GSC_CSC_OUT_RGB565,
+};
+
+struct GscCscSrcFormat {
+    unsigned int fourcc;
+    bool         swap;      /* Cr before Cb */
+};
+
+struct GscCscDstFormat {
+    unsigned int fourcc;
+    int          out;
+    unsigned int bpp;       /* bytes */
+};
+
+static const GscCscSrcFormat g_csc_src[] = {
+    { V4L2_PIX_FMT_NV12,    false },
+    { V4L2_PIX_FMT_NV21,    true  },
+    { V4L2_PIX_FMT_NV12M,   false },
+    { V4L2_PIX_FMT_NV21M,   true  },
+    { v4l2_fourcc('N', 'M', '2', '1'), true },
+    { V4L2_PIX_FMT_YUV420,  false },
+    { V4L2_PIX_FMT_YVU420,  true  },
+    { V4L2_PIX_FMT_YUV420M, false },
+    { V4L2_PIX_FMT_YVU420M, true  },
+};
+
+static const GscCscDstFormat g_csc_dst[] = {
+    { V4L2_PIX_FMT_RGB32,   GSC_CSC_OUT_RGBX,   4 },
+    { V4L2_PIX_FMT_BGR32,   GSC_CSC_OUT_BGRX,   4 },
+    { V4L2_PIX_FMT_RGB565,  GSC_CSC_OUT_RGB565, 2 },
+};
+
+/* [BT.709][full range] */
+static const GscCscCoef g_csc_coef[2][2] = {
+    {
+        { 16, 9539, 13075, 3209, 6660, 16525 },     /* BT.601 limited */
+        {  0, 8192, 11485, 2819, 5850, 14516 },     /* BT.601 full */
+    },
+    {
+        { 16, 9539, 14686, 1747, 4366, 17305 },     /* BT.709 limited */
+        {  0, 8192, 12901, 1535, 3835, 15201 },     /* BT.709 full */
+    },
+};
+
+static inline uint8_t gsc_csc_clamp(int v)
+{
+    return (v < 0) ? 0 : ((v > 255) ? 255 : v);
+}
+
+static void gsc_csc_store(uint8_t *dst, int out, int r, int g, int b)
+{
+    uint16_t p;
+
+    switch (out) {
+    case GSC_CSC_OUT_RGBX:
+        dst[0] = r;
+        dst[1] = g;
+        dst[2] = b;
+        dst[3] = 0xff;
+        break;
+    case GSC_CSC_OUT_BGRX:
+        dst[0] = b;
+        dst[1] = g;
+        dst[2] = r;
+        dst[3] = 0xff;
+        break;
+    case GSC_CSC_OUT_RGB565:
+        p = ((r & 0xf8) << 8) | ((g & 0xfc) << 3) | (b >> 3);
+        dst[0] = p & 0xff;
+        dst[1] = p >> 8;
+        break;
+    }
+}
+
+#if defined(__SSE2__) && !defined(__ARM_NEON__)
+/* a pair of 16 bit coefficients for pmaddwd */
+static inline __m128i gsc_csc_pair(int lo, int hi)
+{
+    return _mm_set1_epi32((lo & 0xffff) | (hi << 16));
+}
+#endif
+
+/*
+ * Converts one row. cb and cr point at the chroma of the first pixel,
+ * cstep is 2 for interleaved chroma and 1 for planar chroma.
+ */
+static void gsc_csc_row(const GscCscCoef *k, const uint8_t *y,
+        const uint8_t *cb, const uint8_t *cr, unsigned int cstep,
+        uint8_t *dst, int out, unsigned int bpp, unsigned int width)
+{
+    const int round = 1 << (GSC_CSC_COEF_BITS - 1);
+    unsigned int x = 0;
+
+#if defined(__ARM_NEON__)
+    const int16x8_t yoff = vdupq_n_s16(k->y_offset);
+    const int16x8_t c128 = vdupq_n_s16(128);
+    const int32x4_t rnd = vdupq_n_s32(round);
+
+    for (; x + 8 <= width; x += 8) {
+        uint8x8_t u8, v8;
+
+        if (cstep == 2) {
+            // CbCr or CrCb pairs of the 8 pixels, split and doubled
+            const uint8_t *c = (cb < cr) ? cb : cr;
+            uint8x8x2_t uv = vuzp_u8(vld1_u8(c + x), vld1_u8(c + x));
+            u8 = (cb < cr) ? uv.val[0] : uv.val[1];
+            v8 = (cb < cr) ? uv.val[1] : uv.val[0];
+        } else {
+            uint32_t u32, v32;
+            memcpy(&u32, cb + x / 2, sizeof(u32));
+            memcpy(&v32, cr + x / 2, sizeof(v32));
+            u8 = vreinterpret_u8_u32(vdup_n_u32(u32));
+            v8 = vreinterpret_u8_u32(vdup_n_u32(v32));
+        }
+        u8 = vzip_u8(u8, u8).val[0];
+        v8 = vzip_u8(v8, v8).val[0];
+
+        int16x8_t l = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(y + x))), yoff);
+        int16x8_t u = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u8)), c128);
+        int16x8_t v = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v8)), c128);
+
+        int32x4_t clo = vmlal_n_s16(rnd, vget_low_s16(l), k->y);
+        int32x4_t chi = vmlal_n_s16(rnd, vget_high_s16(l), k->y);
+
+        int32x4_t rlo = vmlal_n_s16(clo, vget_low_s16(v), k->r_v);
+        int32x4_t rhi = vmlal_n_s16(chi, vget_high_s16(v), k->r_v);
+        int32x4_t glo = vmlsl_n_s16(vmlsl_n_s16(clo, vget_low_s16(u), k->g_u),
+                                    vget_low_s16(v), k->g_v);
+        int32x4_t ghi = vmlsl_n_s16(vmlsl_n_s16(chi, vget_high_s16(u), k->g_u),
+                                    vget_high_s16(v), k->g_v);
+        int32x4_t blo = vmlal_n_s16(clo, vget_low_s16(u), k->b_u);
+        int32x4_t bhi = vmlal_n_s16(chi, vget_high_s16(u), k->b_u);
+
+        uint8x8_t r8 = vqmovun_s16(vcombine_s16(vqshrn_n_s32(rlo, GSC_CSC_COEF_BITS),
+                                                vqshrn_n_s32(rhi, GSC_CSC_COEF_BITS)));
+        uint8x8_t g8 = vqmovun_s16(vcombine_s16(vqshrn_n_s32(glo, GSC_CSC_COEF_BITS),
+                                                vqshrn_n_s32(ghi, GSC_CSC_COEF_BITS)));
+        uint8x8_t b8 = vqmovun_s16(vcombine_s16(vqshrn_n_s32(blo, GSC_CSC_COEF_BITS),
+                                                vqshrn_n_s32(bhi, GSC_CSC_COEF_BITS)));
+
+        if (out == GSC_CSC_OUT_RGB565) {
+            uint16x8_t p = vshlq_n_u16(vmovl_u8(vshr_n_u8(r8, 3)), 11);
+            p = vorrq_u16(p, vshlq_n_u16(vmovl_u8(vshr_n_u8(g8, 2)), 5));
+            p = vorrq_u16(p, vmovl_u8(vshr_n_u8(b8, 3)));
+            vst1q_u8(dst + x * bpp, vreinterpretq_u8_u16(p));
+        } else {
+            uint8x8x4_t px;
+            px.val[0] = (out == GSC_CSC_OUT_RGBX) ? r8 : b8;
+            px.val[1] = g8;
+            px.val[2] = (out == GSC_CSC_OUT_RGBX) ? b8 : r8;
+            px.val[3] = vdup_n_u8(0xff);
+            vst4_u8(dst + x * bpp, px);
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i alpha = _mm_set1_epi8(-1);
+    const __m128i yoff = _mm_set1_epi16(k->y_offset);
+    const __m128i c128 = _mm_set1_epi16(128);
+    const __m128i rnd = _mm_set1_epi32(round);
+    // (Y, Cr), (Y, Cb) and (Cr, 1) are multiplied in pairs by pmaddwd
+    const __m128i kr = gsc_csc_pair(k->y, k->r_v);
+    const __m128i kg = gsc_csc_pair(k->y, -k->g_u);
+    const __m128i kgv = gsc_csc_pair(-k->g_v, round);
+    const __m128i kb = gsc_csc_pair(k->y, k->b_u);
+
+    for (; x + 8 <= width; x += 8) {
+        __m128i u, v;
+
+        if (cstep == 2) {
+            // CbCr or CrCb pairs of the 8 pixels, split and doubled
+            const uint8_t *c = (cb < cr) ? cb : cr;
+            __m128i uv = _mm_unpacklo_epi8(_mm_loadl_epi64(
+                    reinterpret_cast<const __m128i *>(c + x)), zero);
+            __m128i even = _mm_shufflehi_epi16(_mm_shufflelo_epi16(uv,
+                    _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 2, 0, 0));
+            __m128i odd = _mm_shufflehi_epi16(_mm_shufflelo_epi16(uv,
+                    _MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+            u = (cb < cr) ? even : odd;
+            v = (cb < cr) ? odd : even;
+        } else {
+            int u32, v32;
+            memcpy(&u32, cb + x / 2, sizeof(u32));
+            memcpy(&v32, cr + x / 2, sizeof(v32));
+            u = _mm_unpacklo_epi8(_mm_cvtsi32_si128(u32), zero);
+            v = _mm_unpacklo_epi8(_mm_cvtsi32_si128(v32), zero);
+            u = _mm_unpacklo_epi16(u, u);
+            v = _mm_unpacklo_epi16(v, v);
+        }
+        u = _mm_sub_epi16(u, c128);
+        v = _mm_sub_epi16(v, c128);
+
+        __m128i l = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64(
+                reinterpret_cast<const __m128i *>(y + x)), zero), yoff);
+
+        __m128i lv_lo = _mm_unpacklo_epi16(l, v);
+        __m128i lv_hi = _mm_unpackhi_epi16(l, v);
+        __m128i lu_lo = _mm_unpacklo_epi16(l, u);
+        __m128i lu_hi = _mm_unpackhi_epi16(l, u);
+        __m128i v1_lo = _mm_unpacklo_epi16(v, ones);
+        __m128i v1_hi = _mm_unpackhi_epi16(v, ones);
+
+        __m128i r = _mm_packs_epi32(
+                _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(lv_lo, kr), rnd), GSC_CSC_COEF_BITS),
+                _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(lv_hi, kr), rnd), GSC_CSC_COEF_BITS));
+        __m128i g = _mm_packs_epi32(
+                _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(lu_lo, kg),
+                                             _mm_madd_epi16(v1_lo, kgv)), GSC_CSC_COEF_BITS),
+                _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(lu_hi, kg),
+                                             _mm_madd_epi16(v1_hi, kgv)), GSC_CSC_COEF_BITS));
+        __m128i b = _mm_packs_epi32(
+                _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(lu_lo, kb), rnd), GSC_CSC_COEF_BITS),
+                _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(lu_hi, kb), rnd), GSC_CSC_COEF_BITS));
+
+        // clamp to 0 ~ 255
+        r = _mm_packus_epi16(r, r);
+        g = _mm_packus_epi16(g, g);
+        b = _mm_packus_epi16(b, b);
+
+        if (out == GSC_CSC_OUT_RGB565) {
+            __m128i p = _mm_slli_epi16(_mm_srli_epi16(_mm_unpacklo_epi8(r, zero), 3), 11);
+            p = _mm_or_si128(p, _mm_slli_epi16(_mm_srli_epi16(_mm_unpacklo_epi8(g, zero), 2), 5));
+            p = _mm_or_si128(p, _mm_srli_epi16(_mm_unpacklo_epi8(b, zero), 3));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * bpp), p);
+        } else {
+            __m128i xg = _mm_unpacklo_epi8((out == GSC_CSC_OUT_RGBX) ? r : b, g);
+            __m128i xa = _mm_unpacklo_epi8((out == GSC_CSC_OUT_RGBX) ? b : r, alpha);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * bpp),
+                             _mm_unpacklo_epi16(xg, xa));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * bpp + 16),
+                             _mm_unpackhi_epi16(xg, xa));
+        }
+    }
+#endif
+
+    for (; x < width; x++) {
+        int c = (y[x] - k->y_offset) * k->y + round;
+        int u = cb[(x >> 1) * cstep] - 128;
+        int v = cr[(x >> 1) * cstep] - 128;
+
+        gsc_csc_store(dst + x * bpp, out,
+                      gsc_csc_clamp((c + k->r_v * v) >> GSC_CSC_COEF_BITS),
+                      gsc_csc_clamp((c - k->g_u * u - k->g_v * v) >> GSC_CSC_COEF_BITS),
+                      gsc_csc_clamp((c + k->b_u * u) >> GSC_CSC_COEF_BITS));
+    }
+}
+
+CGscCscSW::CGscCscSW()
+    : m_eqAuto(1), m_fullRange(0), m_colorspace(V4L2_COLORSPACE_REC709)
+{
+}
+
+void CGscCscSW::SetCSCProperty(unsigned int eqAuto, unsigned int fullRange,
+                               unsigned int colorspace)
+{
+    m_eqAuto = eqAuto;
+    m_fullRange = fullRange;
+    m_colorspace = colorspace;
+}
+
+/*
+ * V4L2_CID_CSC_EQ_MODE makes the driver choose BT.709 for HD sources and
+ * BT.601 below; otherwise V4L2_CID_CSC_EQ names the equation and anything
+ * but BT.709 means BT.601. V4L2_CID_CSC_RANGE selects full range YCbCr.
+ */
+const GscCscCoef *CGscCscSW::GetCoef(unsigned int eqAuto,
+        unsigned int fullRange, unsigned int colorspace, unsigned int width)
+{
+    bool bt709;
+
+    if (eqAuto)
+        bt709 = (width >= GSC_CSC_HD_WIDTH);
+    else
+        bt709 = (colorspace == V4L2_COLORSPACE_REC709);
+
+    return &g_csc_coef[bt709][fullRange != 0];
+}
+
+bool CGscCscSW::Convert(const GscCscFrame *src, const GscCscFrame *dst)
+{
+    const GscCscSrcFormat *sfmt = NULL;
+    const GscCscDstFormat *dfmt = NULL;
+    const ExynosFmtDesc *sdesc, *ddesc;
+    ExynosFmtLayout slayout, dlayout;
+
+    for (size_t i = 0; i < sizeof(g_csc_src) / sizeof(g_csc_src[0]); i++) {
+        if (g_csc_src[i].fourcc == src->v4l2_colorformat)
+            sfmt = &g_csc_src[i];
+    }
+    for (size_t i = 0; i < sizeof(g_csc_dst) / sizeof(g_csc_dst[0]); i++) {
+        if (g_csc_dst[i].fourcc == dst->v4l2_colorformat)
+            dfmt = &g_csc_dst[i];
+    }
+
+    sdesc = exynos_fmt_find(src->v4l2_colorformat);
+    ddesc = exynos_fmt_find(dst->v4l2_colorformat);
+    if (sfmt == NULL || dfmt == NULL || sdesc == NULL || ddesc == NULL) {
+        ALOGE("%s::unsupported conversion 0x%x -> 0x%x", __func__,
+                src->v4l2_colorformat, dst->v4l2_colorformat);
+        return false;
+    }
+
+    if (src->width == 0 || src->height == 0 ||
+            src->width != dst->width || src->height != dst->height) {
+        ALOGE("%s::invalid size %ux%u -> %ux%u", __func__,
+                src->width, src->height, dst->width, dst->height);
+        return false;
+    }
+
+    exynos_fmt_get_layout(sdesc, src->width, src->height, &slayout);
+    exynos_fmt_get_layout(ddesc, dst->width, dst->height, &dlayout);
+
+    for (unsigned int c = 0; c < sdesc->components; c++) {
+        if (src->addr[slayout.plane[c]] == NULL) {
+            ALOGE("%s::no address for source plane %u", __func__,
+                    slayout.plane[c]);
+            return false;
+        }
+    }
+    if (dst->addr[0] == NULL) {
+        ALOGE("%s::no destination address", __func__);
+        return false;
+    }
+
+    const GscCscCoef *k = GetCoef(m_eqAuto, m_fullRange, m_colorspace,
+                                  src->width);
+    const uint8_t *base[GSC_CSC_MAX_PLANES];
+    const uint8_t *cb, *cr;
+    unsigned int cstep;
+
+    for (unsigned int c = 0; c < sdesc->components; c++)
+        base[c] = reinterpret_cast<const uint8_t *>(src->addr[slayout.plane[c]]) +
+                  slayout.offset[c];
+
+    if (sdesc->components == 2) {
+        cb = base[1] + (sfmt->swap ? 1 : 0);
+        cr = base[1] + (sfmt->swap ? 0 : 1);
+        cstep = 2;
+    } else {
+        cb = sfmt->swap ? base[2] : base[1];
+        cr = sfmt->swap ? base[1] : base[2];
+        cstep = 1;
+    }
+
+    uint8_t *out = reinterpret_cast<uint8_t *>(dst->addr[0]) + dlayout.offset[0];
+
+    for (unsigned int row = 0; row < src->height; row++) {
+        unsigned int crow = row >> sdesc->vshift;
+        // Cb and Cr share a stride in every source format
+        unsigned int coff = crow * slayout.stride[1];
+
+        gsc_csc_row(k, base[0] + row * slayout.stride[0], cb + coff, cr + coff,
+                    cstep, out + row * dlayout.stride[0], dfmt->out, dfmt->bpp,
+                    src->width);
+    }
+
+    return true;
+}
+
+int exynos_gsc_sw_csc(void *handle, const GscCscFrame *src,
+                      const GscCscFrame *dst)
+{
+    CGscaler* gsc = GetGscaler(handle);
+    if (gsc == NULL) {
+        ALOGE("%s::handle == NULL() fail", __func__);
+        return -1;
+    }
+
+    if (src == NULL || dst == NULL) {
+        ALOGE("%s::frame == NULL() fail", __func__);
+        return -1;
+    }
+
+    CGscCscSW csc;
+
+    csc.SetCSCProperty(gsc->eq_auto, gsc->range_full, gsc->v4l2_colorspace);
+    if (!csc.Convert(src, dst)) {
+        ALOGE("%s::Convert() fail", __func__);
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      libgscaler_csc.h
+ * \brief     header file for the software colour-space converter
+ */
+
+#ifndef LIBGSCALER_CSC_H_
+#define LIBGSCALER_CSC_H_
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+
+#define GSC_CSC_MAX_PLANES  3
+#define GSC_CSC_COEF_BITS   13
+
+/*
+ * One frame given to the converter. addr[] holds one CPU address per v4l2
+ * plane, laid out as exynos_fmt_get_layout() says for the format.
+ */
+struct GscCscFrame {
+    unsigned int width;
+    unsigned int height;
+    unsigned int v4l2_colorformat;
+    void        *addr[GSC_CSC_MAX_PLANES];
+};
+
+/*
+ * YCbCr -> RGB equation in GSC_CSC_COEF_BITS fixed point:
+ *   c = (Y - y_offset) * y + round
+ *   R = (c + r_v * (Cr - 128)) >> GSC_CSC_COEF_BITS
+ *   G = (c - g_u * (Cb - 128) - g_v * (Cr - 128)) >> GSC_CSC_COEF_BITS
+ *   B = (c + b_u * (Cb - 128)) >> GSC_CSC_COEF_BITS
+ * each clamped to 0 ~ 255.
+ */
+struct GscCscCoef {
+    int16_t y_offset;
+    int16_t y;
+    int16_t r_v;
+    int16_t g_u;
+    int16_t g_v;
+    int16_t b_u;
+};
+
+/*
+ * CPU version of the colour conversion of the G-Scaler, for when no
+ * G-Scaler is free. It takes the CSC settings CGscaler::SetCSCProperty()
+ * takes, with the same meaning, and converts NV12, NV21, NV12M, NV21M,
+ * YUV420(M) and YVU420(M) to RGB32 (RGBX), BGR32 and RGB565 of the same
+ * size. Chroma is replicated, not interpolated.
+ *
+ * The NEON/SSE2 paths produce the very same output as the plain C path.
+ */
+class CGscCscSW {
+    unsigned int m_eqAuto;
+    unsigned int m_fullRange;
+    unsigned int m_colorspace;
+
+public:
+    CGscCscSW();
+
+    void SetCSCProperty(unsigned int eqAuto, unsigned int fullRange,
+                        unsigned int colorspace);
+    bool Convert(const GscCscFrame *src, const GscCscFrame *dst);
+
+    // equation the G-Scaler uses for these settings and a source this wide
+    static const GscCscCoef *GetCoef(unsigned int eqAuto,
+                                     unsigned int fullRange,
+                                     unsigned int colorspace,
+                                     unsigned int width);
+};
+
+__BEGIN_DECLS
+
+/*
+ * Converts src to dst on the CPU with the CSC settings last given to
+ * exynos_gsc_set_csc_property() for the handle.
+ */
+int exynos_gsc_sw_csc(void *handle, const GscCscFrame *src,
+                      const GscCscFrame *dst);
+
+__END_DECLS
+
+#endif /* LIBGSCALER_CSC_H_ */
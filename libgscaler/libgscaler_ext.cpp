@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      libgscaler_ext.cpp
+ * \brief     source file for per-handle state of the Gscaler HAL extensions
+ */
+
+#include <utils/Mutex.h>
+#include <utils/KeyedVector.h>
+
+#include "libgscaler_ext.h"
+
+using namespace android;
+
+static Mutex gExtLock;
+static KeyedVector<void *, GscExtInfo *> gExtInfo;
+
+GscExtInfo *GetGscExtInfo(void *handle)
+{
+    Mutex::Autolock lock(gExtLock);
+    GscExtInfo *ext;
+
+    ssize_t idx = gExtInfo.indexOfKey(handle);
+    if (idx >= 0)
+        return gExtInfo.valueAt(idx);
+
+    ext = new GscExtInfo;
+    memset(ext, 0, sizeof(*ext));
+    ext->m2m_depth = 1;
+    ext->out.policy = GSC_OUT_POLICY_FIXED;
+    ext->out.depth = MAX_BUFFERS_GSCALER_OUT;
+
+    gExtInfo.add(handle, ext);
+
+    return ext;
+}
+
+void PutGscExtInfo(void *handle)
+{
+    GscExtInfo *ext;
+
+    {
+        Mutex::Autolock lock(gExtLock);
+
+        ssize_t idx = gExtInfo.indexOfKey(handle);
+        if (idx < 0)
+            return;
+
+        ext = gExtInfo.valueAt(idx);
+        gExtInfo.removeItemsAt(idx);
+    }
+
+    /* the stripe engines have ext info of their own to put */
+    gsc_stripe_destroy(&ext->stripe);
+    delete ext;
+}
+
+int exynos_gsc_set_m2m_depth(void *handle, unsigned int depth)
+{
+    CGscaler* gsc = GetGscaler(handle);
+    if (gsc == NULL) {
+        ALOGE("%s::handle == NULL() fail", __func__);
+        return -1;
+    }
+
+    if (depth < 1 || depth > GSC_M2M_MAX_DEPTH) {
+        ALOGE("%s::invalid depth %u (1 ~ %d)", __func__, depth,
+                GSC_M2M_MAX_DEPTH);
+        return -1;
+    }
+
+    GscExtInfo *ext = GetGscExtInfo(handle);
+    if (ext->m2m_depth == depth)
+        return 0;
+
+    /* the rings have to be requested again with the new count */
+    if (gsc->m_gsc_m2m_stop(handle) < 0)
+        ALOGE("%s::m_gsc_m2m_stop() fail", __func__);
+
+    ext->m2m_depth = depth;
+    for (unsigned int i = 0; i < ext->stripe.count; i++)
+        exynos_gsc_set_m2m_depth(ext->stripe.helper[i], depth);
+    gsc->src_info.dirty = true;
+    gsc->dst_info.dirty = true;
+
+    return 0;
+}
+
+unsigned int gsc_out_buffer_count(const GscOutQueue *out)
+{
+    switch (out->policy) {
+    case GSC_OUT_POLICY_UI:
+        return GSC_OUT_MIN_DEPTH;
+    case GSC_OUT_POLICY_VIDEO:
+    case GSC_OUT_POLICY_ADAPTIVE:
+        return GSC_OUT_MAX_DEPTH;
+    default:
+        return out->depth;
+    }
+}
+
+void gsc_out_reset_limit(GscOutQueue *out)
+{
+    unsigned int limit = gsc_out_buffer_count(out);
+
+    if (out->policy == GSC_OUT_POLICY_ADAPTIVE)
+        limit = GSC_OUT_MIN_DEPTH;
+    if (out->count > 0 && limit > out->count)
+        limit = out->count;
+
+    out->limit = limit;
+    out->calm = 0;
+}
+
+int exynos_gsc_set_out_depth(void *handle, unsigned int depth)
+{
+    CGscaler* gsc = GetGscaler(handle);
+    if (gsc == NULL) {
+        ALOGE("%s::handle == NULL() fail", __func__);
+        return -1;
+    }
+
+    if (depth < GSC_OUT_MIN_DEPTH || depth > GSC_OUT_MAX_DEPTH) {
+        ALOGE("%s::invalid depth %u (%d ~ %d)", __func__, depth,
+                GSC_OUT_MIN_DEPTH, GSC_OUT_MAX_DEPTH);
+        return -1;
+    }
+
+    GscExtInfo *ext = GetGscExtInfo(handle);
+    ext->out.policy = GSC_OUT_POLICY_FIXED;
+    ext->out.depth = depth;
+    gsc_out_reset_limit(&ext->out);
+
+    return 0;
+}
+
+int exynos_gsc_set_out_policy(void *handle, int policy)
+{
+    CGscaler* gsc = GetGscaler(handle);
+    if (gsc == NULL) {
+        ALOGE("%s::handle == NULL() fail", __func__);
+        return -1;
+    }
+
+    if (policy < GSC_OUT_POLICY_FIXED || policy > GSC_OUT_POLICY_ADAPTIVE) {
+        ALOGE("%s::invalid policy %d", __func__, policy);
+        return -1;
+    }
+
+    GscExtInfo *ext = GetGscExtInfo(handle);
+    if (ext->out.policy == policy)
+        return 0;
+
+    ext->out.policy = policy;
+    gsc_out_reset_limit(&ext->out);
+
+    return 0;
+}
+
+int exynos_gsc_get_out_stats(void *handle, GscOutStats *stats)
+{
+    CGscaler* gsc = GetGscaler(handle);
+    if (gsc == NULL || stats == NULL) {
+        ALOGE("%s::handle == NULL() fail", __func__);
+        return -1;
+    }
+
+    GscExtInfo *ext = GetGscExtInfo(handle);
+    *stats = ext->out.stats;
+    stats->depth = ext->out.limit;
+
+    return 0;
+}
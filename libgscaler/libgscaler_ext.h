@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      libgscaler_ext.h
+ * \brief     header file for per-handle state of the Gscaler HAL extensions
+ */
+
+#ifndef LIBGSCALER_EXT_H_
+#define LIBGSCALER_EXT_H_
+
+#include <utils/Timers.h>
+
+#include "libgscaler_obj.h"
+
+/* deepest m2m pipeline exynos_gsc_set_m2m_depth() accepts */
+#define GSC_M2M_MAX_DEPTH   4
+
+/* most engines one m2m frame is split over, the handle's own included */
+#define GSC_STRIPE_MAX      4
+
+/* frames the output (local path) mode can keep queued to the display */
+#define GSC_OUT_MIN_DEPTH   2
+#define GSC_OUT_MAX_DEPTH   4
+
+/* how the output mode picks its queue depth */
+#define GSC_OUT_POLICY_FIXED    0   /* exynos_gsc_set_out_depth() */
+#define GSC_OUT_POLICY_UI       1   /* GSC_OUT_MIN_DEPTH, least latency */
+#define GSC_OUT_POLICY_VIDEO    2   /* GSC_OUT_MAX_DEPTH, most slack */
+#define GSC_OUT_POLICY_ADAPTIVE 3   /* grows on underruns, shrinks when calm */
+
+struct GscOutStats {
+    unsigned int depth;     /* frames queued before a run waits */
+    unsigned int frames;    /* runs queued */
+    unsigned int reclaimed; /* buffers taken back without waiting */
+    unsigned int waited;    /* runs that waited for the display to give one */
+    unsigned int late;      /* runs well after the stream's usual interval */
+    unsigned int underruns; /* late runs after the queue had run dry */
+};
+
+/* REQBUFS ring of one m2m queue */
+struct GscRing {
+    unsigned int depth;     /* buffers requested by REQBUFS */
+    unsigned int next;      /* index of the next QBUF */
+    unsigned int queued;    /* buffers owned by the driver */
+};
+
+/* which parts of a queue configuration differ from what the driver has */
+#define GSC_CFG_CTRL        (1 << 0)    /* ROTATE, VFLIP, HFLIP */
+#define GSC_CFG_FORMAT      (1 << 1)    /* S_FMT and REQBUFS */
+#define GSC_CFG_CROP        (1 << 2)    /* S_CROP */
+#define GSC_CFG_CACHEABLE   (1 << 3)    /* V4L2_CID_CACHEABLE */
+#define GSC_CFG_ALL         (GSC_CFG_CTRL | GSC_CFG_FORMAT | \
+                             GSC_CFG_CROP | GSC_CFG_CACHEABLE)
+
+/* last configuration m_gsc_set_format() applied to one m2m queue */
+struct GscQueueConfig {
+    bool         valid;
+    uint32_t     hash;
+    unsigned int width;
+    unsigned int height;
+    unsigned int v4l2_colorformat;
+    unsigned int mem_type;
+    unsigned int count;
+    unsigned int mode_drm;
+    unsigned int crop_left;
+    unsigned int crop_top;
+    unsigned int crop_width;
+    unsigned int crop_height;
+    int          rotation;
+    int          flip_horizontal;
+    int          flip_vertical;
+    unsigned int cacheable;
+};
+
+/* display queue of the output mode */
+struct GscOutQueue {
+    int          policy;
+    unsigned int depth;     /* depth of GSC_OUT_POLICY_FIXED */
+    unsigned int count;     /* buffers requested by m_gsc_out_config() */
+    unsigned int limit;     /* current depth */
+    unsigned int calm;      /* runs since the last underrun */
+    nsecs_t      last_run;
+    nsecs_t      interval;  /* average time between runs of a stream */
+    GscOutStats  stats;
+};
+
+/* engines of exynos_gsc_set_stripes() beside the one of the handle */
+struct GscStripeInfo {
+    unsigned int count;
+    void        *helper[GSC_STRIPE_MAX - 1];   /* exclusive m2m handles */
+    int          dev_num[GSC_STRIPE_MAX - 1];
+};
+
+/*
+ * State the Gscaler HAL extensions keep beside a CGscaler. It is created on
+ * first use and released by m_gsc_m2m_destroy()/m_gsc_out_destroy().
+ */
+struct GscExtInfo {
+    unsigned int m2m_depth; /* frames exynos_gsc_run may keep in flight */
+    GscRing      src;
+    GscRing      dst;
+
+    /* configuration cache, invalidated by m_gsc_m2m_stop() */
+    GscQueueConfig src_cfg;
+    GscQueueConfig dst_cfg;
+    bool         csc_valid;
+    int          eq_auto;
+    int          v4l2_colorspace;
+    int          range_full;
+    unsigned int cfg_skipped;   /* dirty runs that needed no ioctl */
+    unsigned int cfg_partial;   /* dirty runs served without REQBUFS */
+
+    GscStripeInfo stripe;
+    GscOutQueue  out;
+};
+
+GscExtInfo *GetGscExtInfo(void *handle);
+void        PutGscExtInfo(void *handle);
+
+/* queues one frame on the handle's own engine, as configured */
+int gsc_m2m_run_frame(void *handle, exynos_mpp_img *src_img,
+                      exynos_mpp_img *dst_img);
+/* the same, split over the stripe engines when the frame is worth it */
+int gsc_m2m_run_striped(void *handle, GscExtInfo *ext,
+                        exynos_mpp_img *src_img, exynos_mpp_img *dst_img);
+/* buffers m_gsc_out_config() requests for the policy of out */
+unsigned int gsc_out_buffer_count(const GscOutQueue *out);
+/* the depth the policy of out starts at, within the buffers there are */
+void gsc_out_reset_limit(GscOutQueue *out);
+/*
+ * merges release fence other into fence and closes both; waits for other
+ * when they cannot be merged
+ */
+int gsc_fence_merge(int fence, int other);
+/* stops and closes the stripe engines */
+void gsc_stripe_stop(GscStripeInfo *stripe);
+void gsc_stripe_destroy(GscStripeInfo *stripe);
+
+__BEGIN_DECLS
+
+/*
+ * Lets up to depth m2m frames be queued before exynos_gsc_run waits for the
+ * oldest one. depth 1 is the legacy behaviour. Changing the depth of a
+ * streaming handle stops it; the next run reconfigures the queues.
+ */
+int exynos_gsc_set_m2m_depth(void *handle, unsigned int depth);
+
+/*
+ * Splits the m2m frames of the handle that are large enough into vertical
+ * stripes, run at once on the handle's own engine and on those of the
+ * count in dev_num: G-Scaler ids, or HW_SCAL0 + n for the scalers. The
+ * engine of the handle and engines that cannot be opened are left out,
+ * and at most GSC_STRIPE_MAX engines are used in all. The release fences
+ * returned are those of the whole frame. count 0 goes back to one engine.
+ */
+int exynos_gsc_set_stripes(void *handle, const int *dev_num,
+                           unsigned int count);
+
+/*
+ * Keeps up to depth frames queued to the display in the output mode,
+ * GSC_OUT_MIN_DEPTH ~ GSC_OUT_MAX_DEPTH, and picks GSC_OUT_POLICY_FIXED.
+ * The default is MAX_BUFFERS_GSCALER_OUT. The buffers are requested by
+ * exynos_gsc_out_config(), so a queue deeper than the configured one takes
+ * effect from the next configuration.
+ */
+int exynos_gsc_set_out_depth(void *handle, unsigned int depth);
+
+/* Picks one of GSC_OUT_POLICY_* for the output mode queue */
+int exynos_gsc_set_out_policy(void *handle, int policy);
+
+int exynos_gsc_get_out_stats(void *handle, GscOutStats *stats);
+
+__END_DECLS
+
+#endif /* LIBGSCALER_EXT_H_ */
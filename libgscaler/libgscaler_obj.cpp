@@ -26,23 +26,33 @@
  *   Create
  */
 
+#include <errno.h>
+#include <stddef.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+
 #include "libgscaler_obj.h"
+#include "libgscaler_arbiter.h"
+#include "libgscaler_ext.h"
+#include "libgscaler_sched.h"
+#include "libgscaler_topology.h"
+#include "libgscaler_trace.h"
 #include "content_protect.h"
+#include "exynos_format_desc.h"
+
+static int  gsc_m2m_reap_frame(CGscaler *gsc, GscExtInfo *ext);
+static void gsc_m2m_get_config(GscInfo *info, unsigned int count,
+                               GscQueueConfig *cfg);
+static unsigned int gsc_m2m_config_diff(const GscQueueConfig *old,
+                                        const GscQueueConfig *cur);
+static bool gsc_m2m_set_format(int fd, GscInfo *info, unsigned int count,
+                               unsigned int changes);
+static bool gsc_m2m_set_addr(int fd, GscInfo *info, GscRing *ring);
 
 int CGscaler::m_gsc_output_create(void *handle, int dev_num, int out_mode)
 {
     Exynos_gsc_In();
 
-    struct media_device *media0;
-    struct media_entity *gsc_sd_entity;
-    struct media_entity *gsc_vd_entity;
-    struct media_entity *sink_sd_entity;
-    struct media_link *links;
-    char node[32];
-    char devname[32];
-    unsigned int cap;
-    int         i;
-    int         fd = 0;
     CGscaler* gsc = GetGscaler(handle);
     if (gsc == NULL) {
         ALOGE("%s::handle == NULL() fail", __func__);
@@ -63,148 +73,18 @@ int CGscaler::m_gsc_output_create(void *handle, int dev_num, int out_mode)
 #endif
         return -1;
 
-    /* media0 */
-    snprintf(node, sizeof(node), "%s%d", PFX_NODE_MEDIADEV, 0);
-    media0 = exynos_media_open(node);
-    if (media0 == NULL) {
-        ALOGE("%s::exynos_media_open failed (node=%s)", __func__, node);
-        return false;
-    }
-    gsc->mdev.media0 = media0;
-
-    /* Get the sink subdev entity by name and make the node of sink subdev*/
-    if (out_mode == GSC_OUT_FIMD)
-        snprintf(devname, sizeof(devname), PFX_FIMD_ENTITY, dev_num);
-    else
-        snprintf(devname, sizeof(devname), PFX_MXR_ENTITY, 0);
-
-    sink_sd_entity = exynos_media_get_entity_by_name(media0, devname,
-            strlen(devname));
-    if (!sink_sd_entity) {
-        ALOGE("%s:: failed to get the sink sd entity", __func__);
-        goto gsc_output_err;
-    }
-    gsc->mdev.sink_sd_entity = sink_sd_entity;
-
-    sink_sd_entity->fd = exynos_subdev_open_devname(devname, O_RDWR);
-    if (sink_sd_entity->fd < 0) {
-        ALOGE("%s:: failed to open sink subdev node", __func__);
-        goto gsc_output_err;
-    }
-
-    /* get GSC video dev & sub dev entity by name*/
-#if defined(USES_DT)
-    switch (dev_num) {
-    case 0:
-        snprintf(devname, sizeof(devname), PFX_GSC_VIDEODEV_ENTITY0);
-        break;
-    case 1:
-        snprintf(devname, sizeof(devname), PFX_GSC_VIDEODEV_ENTITY1);
-        break;
-    case 2:
-        snprintf(devname, sizeof(devname), PFX_GSC_VIDEODEV_ENTITY2);
-        break;
-    }
-#else
-    snprintf(devname, sizeof(devname), PFX_GSC_VIDEODEV_ENTITY, dev_num);
-#endif
-    gsc_vd_entity = exynos_media_get_entity_by_name(media0, devname,
-            strlen(devname));
-    if (!gsc_vd_entity) {
-        ALOGE("%s:: failed to get the gsc vd entity", __func__);
-        goto gsc_output_err;
-    }
-    gsc->mdev.gsc_vd_entity = gsc_vd_entity;
-
-    snprintf(devname, sizeof(devname), PFX_GSC_SUBDEV_ENTITY, dev_num);
-    gsc_sd_entity = exynos_media_get_entity_by_name(media0, devname,
-            strlen(devname));
-    if (!gsc_sd_entity) {
-        ALOGE("%s:: failed to get the gsc sd entity", __func__);
-        goto gsc_output_err;
-    }
-    gsc->mdev.gsc_sd_entity = gsc_sd_entity;
-
-    /* gsc sub-dev open */
-    snprintf(devname, sizeof(devname), PFX_GSC_SUBDEV_ENTITY, dev_num);
-    gsc_sd_entity->fd = exynos_subdev_open_devname(devname, O_RDWR);
-    if (gsc_sd_entity->fd < 0) {
-        ALOGE("%s: gsc sub-dev open fail", __func__);
-        goto gsc_output_err;
-    }
-
-    /* setup link : GSC : video device --> sub device */
-    for (i = 0; i < (int) gsc_vd_entity->num_links; i++) {
-        links = &gsc_vd_entity->links[i];
-
-        if (links == NULL ||
-            links->source->entity != gsc_vd_entity ||
-            links->sink->entity   != gsc_sd_entity) {
-            continue;
-        } else if (exynos_media_setup_link(media0, links->source,
-                    links->sink, MEDIA_LNK_FL_ENABLED) < 0) {
-            ALOGE("%s::exynos_media_setup_link \
-                    [src.entity=%d->sink.entity=%d] failed",
-                    __func__, links->source->entity->info.id,
-                    links->sink->entity->info.id);
-            return -1;
-        }
-    }
-
-    /* setup link : GSC: sub device --> sink device */
-    for (i = 0; i < (int) gsc_sd_entity->num_links; i++) {
-        links = &gsc_sd_entity->links[i];
-
-        if (links == NULL || links->source->entity != gsc_sd_entity ||
-                             links->sink->entity != sink_sd_entity) {
-            continue;
-        } else if (exynos_media_setup_link(media0, links->source,
-                    links->sink, MEDIA_LNK_FL_ENABLED) < 0) {
-            ALOGE("%s::exynos_media_setup_link \
-                    [src.entity=%d->sink.entity=%d] failed",
-                    __func__, links->source->entity->info.id,
-                    links->sink->entity->info.id);
-            return -1;
-        }
-    }
-
-    /* gsc video-dev open */
-#if defined(USES_DT)
-    switch (dev_num) {
-    case 0:
-        snprintf(devname, sizeof(devname), PFX_GSC_VIDEODEV_ENTITY0);
-        break;
-    case 1:
-        snprintf(devname, sizeof(devname), PFX_GSC_VIDEODEV_ENTITY1);
-        break;
-    case 2:
-        snprintf(devname, sizeof(devname), PFX_GSC_VIDEODEV_ENTITY2);
-        break;
-    }
-#else
-    snprintf(devname, sizeof(devname), PFX_GSC_VIDEODEV_ENTITY, dev_num);
-#endif
-    gsc_vd_entity->fd = exynos_v4l2_open_devname(devname, O_RDWR);
-    if (gsc_vd_entity->fd < 0) {
-        ALOGE("%s: gsc video-dev open fail", __func__);
-        goto gsc_output_err;
-    }
-
-    cap = V4L2_CAP_STREAMING | V4L2_CAP_VIDEO_OUTPUT_MPLANE;
-
-    if (exynos_v4l2_querycap(gsc_vd_entity->fd, cap) == false) {
-        ALOGE("%s::exynos_v4l2_querycap() fail", __func__);
-        goto gsc_output_err;
+    /*
+     * only media0, the entity lookups and the subdev fds are kept between
+     * overlays; the sink link and the video node are set up here
+     */
+    if (!CGscTopology::getInstance()->acquire(dev_num, out_mode, &gsc->mdev)) {
+        ALOGE("%s::gsc%d output route setup fail", __func__, dev_num);
+        return -1;
     }
 
     Exynos_gsc_Out();
 
     return 0;
-
-gsc_output_err:
-    gsc->m_gsc_out_destroy(handle);
-
-    return -1;
 }
 
 int CGscaler::m_gsc_out_stop(void *handle)
@@ -243,8 +123,6 @@ bool CGscaler::m_gsc_out_destroy(void *handle)
 {
     Exynos_gsc_In();
 
-    struct media_link * links;
-    int i;
     CGscaler* gsc = GetGscaler(handle);
     if (gsc == NULL) {
         ALOGE("%s::handle == NULL() fail", __func__);
@@ -258,48 +136,11 @@ bool CGscaler::m_gsc_out_destroy(void *handle)
             gsc->src_info.stream_on = false;
     }
 
-    if (gsc->mdev.media0 && gsc->mdev.gsc_sd_entity &&
-        gsc->mdev.gsc_vd_entity && gsc->mdev.sink_sd_entity) {
-
-        /* unlink : gscaler-out --> fimd */
-        for (i = 0; i < (int) gsc->mdev.gsc_sd_entity->num_links; i++) {
-            links = &gsc->mdev.gsc_sd_entity->links[i];
-            if (links == NULL ||
-                links->source->entity != gsc->mdev.gsc_sd_entity ||
-                links->sink->entity != gsc->mdev.sink_sd_entity) {
-                continue;
-            } else if (exynos_media_setup_link(gsc->mdev.media0,
-                links->source, links->sink, 0) < 0) {
-                ALOGE("%s::exynos_media_setup_unlink \
-                        [src.entity=%d->sink.entity=%d] failed",
-                        __func__, links->source->entity->info.id,
-                        links->sink->entity->info.id);
-            }
-        }
-    }
-
-    if (gsc->mdev.gsc_vd_entity && gsc->mdev.gsc_vd_entity->fd > 0) {
-        close(gsc->mdev.gsc_vd_entity->fd);
-        gsc->mdev.gsc_vd_entity->fd = -1;
-    }
-
-    if (gsc->mdev.gsc_sd_entity && gsc->mdev.gsc_sd_entity->fd > 0) {
-        close(gsc->mdev.gsc_sd_entity->fd);
-        gsc->mdev.gsc_sd_entity->fd = -1;
-    }
-
-    if (gsc->mdev.sink_sd_entity && gsc->mdev.sink_sd_entity->fd > 0) {
-        close(gsc->mdev.sink_sd_entity->fd);
-        gsc->mdev.sink_sd_entity->fd = -1;
-    }
-
+    /* unlinks the sink and closes the video node, for m2m to use */
     if (gsc->mdev.media0)
-        exynos_media_close(gsc->mdev.media0);
+        CGscTopology::getInstance()->release(&gsc->mdev);
 
-    gsc->mdev.media0 = NULL;
-    gsc->mdev.gsc_sd_entity = NULL;
-    gsc->mdev.gsc_vd_entity = NULL;
-    gsc->mdev.sink_sd_entity = NULL;
+    PutGscExtInfo(handle);
 
     Exynos_gsc_Out();
     return true;
@@ -362,50 +203,29 @@ bool CGscaler::m_gsc_find_and_create(void *handle)
 {
     Exynos_gsc_In();
 
-    int          i                 = 0;
-    bool         flag_find_new_gsc = false;
-    unsigned int total_sleep_time  = 0;
+    nsecs_t      waited = 0;
     CGscaler* gsc = GetGscaler(handle);
     if (gsc == NULL) {
         ALOGE("%s::handle == NULL() fail", __func__);
         return false;
     }
 
-    do {
-        for (i = 0; i < NUM_OF_GSC_HW; i++) {
-#ifndef USES_ONLY_GSC0_GSC1
-            if (i == 0 || i == 3)
-#else
-            if (i == 0)
-#endif
-                continue;
-
-            gsc->gsc_id = i;
-            gsc->gsc_fd = gsc->m_gsc_m2m_create(i);
-            if (gsc->gsc_fd < 0) {
-                gsc->gsc_fd = 0;
-                continue;
-            }
-
-            flag_find_new_gsc = true;
-            break;
-        }
-
-        if (flag_find_new_gsc == false) {
-            usleep(GSC_WAITING_TIME_FOR_TRYLOCK);
-            total_sleep_time += GSC_WAITING_TIME_FOR_TRYLOCK;
-            ALOGV("%s::waiting for the gscaler availability", __func__);
-        }
-
-    } while(flag_find_new_gsc == false
-            && total_sleep_time < MAX_GSC_WAITING_TIME_FOR_TRYLOCK);
+    gsc->gsc_fd = CGscArbiter::getInstance()->acquire(gsc, &gsc->gsc_id,
+            us2ns(MAX_GSC_WAITING_TIME_FOR_TRYLOCK), &waited);
+    if (gsc->gsc_fd < 0) {
+        gsc->gsc_fd = 0;
+        ALOGE("%s::we don't have any available gsc.. fail (waited %lld us)",
+                __func__, ns2us(waited));
+        return false;
+    }
 
-    if (flag_find_new_gsc == false)
-        ALOGE("%s::we don't have any available gsc.. fail", __func__);
+    if (waited > 0)
+        ALOGD("%s::gsc%d acquired after %lld us", __func__, gsc->gsc_id,
+                ns2us(waited));
 
     Exynos_gsc_Out();
 
-    return flag_find_new_gsc;
+    return true;
 }
 
 bool CGscaler::m_gsc_m2m_destroy(void *handle)
@@ -424,13 +244,17 @@ bool CGscaler::m_gsc_m2m_destroy(void *handle)
      */
     gsc->m_gsc_m2m_stop(handle);
 
+    gsc_sched_forget(handle);
+    PutGscExtInfo(handle);
+
     if (gsc->gsc_id >= HW_SCAL0) {
         bool ret = exynos_sc_free_and_close(gsc->scaler);
         Exynos_gsc_Out();
         return ret;
     }
 
-    if (0 < gsc->gsc_fd)
+    /* nodes handed out by the arbiter are closed by it */
+    if (0 < gsc->gsc_fd && !CGscArbiter::getInstance()->release(gsc->gsc_fd))
         close(gsc->gsc_fd);
     gsc->gsc_fd = 0;
 
@@ -445,12 +269,18 @@ int CGscaler::m_gsc_m2m_stop(void *handle)
 
     struct v4l2_requestbuffers req_buf;
     int ret = 0;
+    GscExtInfo *ext;
     CGscaler* gsc = GetGscaler(handle);
     if (gsc == NULL) {
         ALOGE("%s::handle == NULL() fail", __func__);
         return -1;
     }
 
+    gsc_sched_flush(handle);
+
+    ext = GetGscExtInfo(handle);
+    gsc_stripe_stop(&ext->stripe);
+
     if (!gsc->src_info.stream_on && !gsc->dst_info.stream_on) {
         /* wasn't streaming, return success */
         return 0;
@@ -469,6 +299,7 @@ int CGscaler::m_gsc_m2m_stop(void *handle)
      * the other one off correctly.
      */
     if (gsc->src_info.stream_on == true) {
+        GSC_TRACE(GSC_TRACE_STREAMOFF, gsc->gsc_fd);
         if (exynos_v4l2_streamoff(gsc->gsc_fd,
             gsc->src_info.buf.buf_type) < 0) {
             ALOGE("%s::exynos_v4l2_streamoff(src) fail", __func__);
@@ -478,6 +309,7 @@ int CGscaler::m_gsc_m2m_stop(void *handle)
     }
 
     if (gsc->dst_info.stream_on == true) {
+        GSC_TRACE(GSC_TRACE_STREAMOFF, gsc->gsc_fd);
         if (exynos_v4l2_streamoff(gsc->gsc_fd,
             gsc->dst_info.buf.buf_type) < 0) {
             ALOGE("%s::exynos_v4l2_streamoff(dst) fail", __func__);
@@ -488,6 +320,7 @@ int CGscaler::m_gsc_m2m_stop(void *handle)
 
     /* if drm is enabled */
     if (gsc->allow_drm && gsc->protection_enabled) {
+        GSC_TRACE(GSC_TRACE_CP_DISABLE, gsc->gsc_fd);
         unsigned int protect_id = 0;
 
         if (gsc->gsc_id == 0)
@@ -510,6 +343,15 @@ int CGscaler::m_gsc_m2m_stop(void *handle)
         ret = -1;
     }
 
+    /* streamoff has returned every buffer to us */
+    memset(&ext->src, 0, sizeof(ext->src));
+    memset(&ext->dst, 0, sizeof(ext->dst));
+    ext->src_cfg.valid = false;
+    ext->dst_cfg.valid = false;
+    ext->csc_valid = false;
+    gsc->src_info.buf.buffer_queued = false;
+    gsc->dst_info.buf.buffer_queued = false;
+
     /* src: clear_buf */
     req_buf.count  = 0;
     req_buf.type   = gsc->src_info.buf.buf_type;
@@ -538,14 +380,21 @@ int CGscaler::m_gsc_m2m_run_core(void *handle)
     Exynos_gsc_In();
 
     unsigned int rotate, hflip, vflip;
+    unsigned int src_changes = 0, dst_changes = 0;
     bool is_dirty;
     bool is_drm;
+    bool reformat;
+    bool csc_changed;
+    GscExtInfo *ext;
+    GscQueueConfig src_cfg, dst_cfg;
     CGscaler* gsc = GetGscaler(handle);
     if (gsc == NULL) {
         ALOGE("%s::handle == NULL() fail", __func__);
         return -1;
     }
 
+    GSC_TRACE(GSC_TRACE_RUN, gsc->gsc_fd);
+
     is_dirty = gsc->src_info.dirty || gsc->dst_info.dirty;
     is_drm = gsc->src_info.mode_drm;
 
@@ -580,11 +429,54 @@ int CGscaler::m_gsc_m2m_run_core(void *handle)
         return -1;
     }
 
-    /* dequeue buffers from previous work if necessary */
+    ext = GetGscExtInfo(handle);
+
+    /*
+     * a dirty queue is only pushed to the driver for the parts that differ
+     * from what was applied last time
+     */
+    if (gsc->src_info.dirty) {
+        gsc_m2m_get_config(&gsc->src_info, ext->m2m_depth, &src_cfg);
+        src_changes = gsc_m2m_config_diff(&ext->src_cfg, &src_cfg);
+        gsc->src_info.dirty = (src_changes != 0);
+    }
+
+    if (gsc->dst_info.dirty) {
+        gsc_m2m_get_config(&gsc->dst_info, ext->m2m_depth, &dst_cfg);
+        dst_changes = gsc_m2m_config_diff(&ext->dst_cfg, &dst_cfg);
+        gsc->dst_info.dirty = (dst_changes != 0);
+    }
+
+    csc_changed = is_dirty && (!ext->csc_valid ||
+            ext->eq_auto != gsc->eq_auto ||
+            ext->v4l2_colorspace != gsc->v4l2_colorspace ||
+            ext->range_full != gsc->range_full);
+    reformat = ((src_changes | dst_changes) & GSC_CFG_FORMAT) != 0;
+
+    if (is_dirty) {
+        if (!src_changes && !dst_changes && !csc_changed)
+            ext->cfg_skipped++;
+        else if (!reformat)
+            ext->cfg_partial++;
+    }
+    is_dirty = src_changes || dst_changes || csc_changed;
+
+    /*
+     * dequeue buffers from previous work if necessary: everything before a
+     * reconfiguration, otherwise only the oldest frame once the ring is full
+     */
     if (gsc->src_info.stream_on == true) {
-        if (gsc->m_gsc_m2m_wait_frame_done(handle) < 0) {
-            ALOGE("%s::exynos_gsc_m2m_wait_frame_done fail", __func__);
-            return -1;
+        if (is_dirty) {
+            if (gsc->m_gsc_m2m_wait_frame_done(handle) < 0) {
+                ALOGE("%s::exynos_gsc_m2m_wait_frame_done fail", __func__);
+                return -1;
+            }
+        } else if (ext->src.queued >= ext->src.depth ||
+                   ext->dst.queued >= ext->dst.depth) {
+            if (gsc_m2m_reap_frame(gsc, ext) < 0) {
+                ALOGE("%s::gsc_m2m_reap_frame fail", __func__);
+                return -1;
+            }
         }
     }
 
@@ -592,7 +484,7 @@ int CGscaler::m_gsc_m2m_run_core(void *handle)
      * need to set the content protection flag before doing reqbufs
      * in set_format
      */
-    if (is_dirty && gsc->allow_drm && is_drm) {
+    if (reformat && gsc->allow_drm && is_drm) {
         if (exynos_v4l2_s_ctrl(gsc->gsc_fd,
                V4L2_CID_CONTENT_PROTECTION, is_drm) < 0) {
             ALOGE("%s::exynos_v4l2_s_ctrl() fail", __func__);
@@ -606,25 +498,37 @@ int CGscaler::m_gsc_m2m_run_core(void *handle)
      */
 
     if (gsc->src_info.dirty) {
-        if (CGscaler::m_gsc_set_format(gsc->gsc_fd, &gsc->src_info) == false) {
+        if (gsc_m2m_set_format(gsc->gsc_fd, &gsc->src_info,
+                    ext->m2m_depth, src_changes) == false) {
             ALOGE("%s::m_gsc_set_format(src) fail", __func__);
             goto done;
         }
         gsc->src_info.dirty = false;
+        ext->src_cfg = src_cfg;
+        if (src_changes & GSC_CFG_FORMAT) {
+            ext->src.depth = ext->m2m_depth;
+            ext->src.next = 0;
+        }
     }
 
     if (gsc->dst_info.dirty) {
-        if (CGscaler::m_gsc_set_format(gsc->gsc_fd, &gsc->dst_info) == false) {
+        if (gsc_m2m_set_format(gsc->gsc_fd, &gsc->dst_info,
+                    ext->m2m_depth, dst_changes) == false) {
             ALOGE("%s::m_gsc_set_format(dst) fail", __func__);
             goto done;
         }
         gsc->dst_info.dirty = false;
+        ext->dst_cfg = dst_cfg;
+        if (dst_changes & GSC_CFG_FORMAT) {
+            ext->dst.depth = ext->m2m_depth;
+            ext->dst.next = 0;
+        }
     }
 
     /*
      * set up csc equation property
      */
-    if (is_dirty) {
+    if (csc_changed) {
         if (exynos_v4l2_s_ctrl(gsc->gsc_fd,
                V4L2_CID_CSC_EQ_MODE, gsc->eq_auto) < 0) {
             ALOGE("%s::exynos_v4l2_s_ctrl(V4L2_CID_CSC_EQ_MODE) fail", __func__);
@@ -642,13 +546,19 @@ int CGscaler::m_gsc_m2m_run_core(void *handle)
             ALOGE("%s::exynos_v4l2_s_ctrl(V4L2_CID_CSC_RANGE) fail", __func__);
             return -1;
         }
+
+        ext->eq_auto = gsc->eq_auto;
+        ext->v4l2_colorspace = gsc->v4l2_colorspace;
+        ext->range_full = gsc->range_full;
+        ext->csc_valid = true;
     }
 
     /* if we are enabling drm, make sure to enable hw protection.
      * Need to do this before queuing buffers so that the mmu is reserved
      * and power domain is kept on.
      */
-    if (is_dirty && gsc->allow_drm && is_drm) {
+    if (reformat && gsc->allow_drm && is_drm) {
+        GSC_TRACE(GSC_TRACE_CP_ENABLE, gsc->gsc_fd);
         unsigned int protect_id = 0;
 
         if (gsc->gsc_id == 0) {
@@ -672,17 +582,18 @@ int CGscaler::m_gsc_m2m_run_core(void *handle)
         gsc->protection_enabled = true;
     }
 
-    if (gsc->m_gsc_set_addr(gsc->gsc_fd, &gsc->src_info) == false) {
+    if (gsc_m2m_set_addr(gsc->gsc_fd, &gsc->src_info, &ext->src) == false) {
         ALOGE("%s::m_gsc_set_addr(src) fail", __func__);
         goto done;
     }
 
-    if (gsc->m_gsc_set_addr(gsc->gsc_fd, &gsc->dst_info) == false) {
+    if (gsc_m2m_set_addr(gsc->gsc_fd, &gsc->dst_info, &ext->dst) == false) {
         ALOGE("%s::m_gsc_set_addr(dst) fail", __func__);
         goto done;
     }
 
     if (gsc->src_info.stream_on == false) {
+        GSC_TRACE(GSC_TRACE_STREAMON, gsc->gsc_fd);
         if (exynos_v4l2_streamon(gsc->gsc_fd, gsc->src_info.buf.buf_type) < 0) {
             ALOGE("%s::exynos_v4l2_streamon(src) fail", __func__);
             goto done;
@@ -691,6 +602,7 @@ int CGscaler::m_gsc_m2m_run_core(void *handle)
     }
 
     if (gsc->dst_info.stream_on == false) {
+        GSC_TRACE(GSC_TRACE_STREAMON, gsc->gsc_fd);
         if (exynos_v4l2_streamon(gsc->gsc_fd, gsc->dst_info.buf.buf_type) < 0) {
             ALOGE("%s::exynos_v4l2_streamon(dst) fail", __func__);
             goto done;
@@ -784,10 +696,42 @@ int CGscaler::m_gsc_multiple_of_n(int number, int N)
     return result;
 }
 
+static int gsc_m2m_dqbuf(int fd, GscInfo *info, GscRing *ring)
+{
+    if (ring->queued == 0)
+        return 0;
+
+    GSC_TRACE(GSC_TRACE_DQBUF, fd);
+    if (exynos_v4l2_dqbuf(fd, &info->buf.buffer) < 0)
+        return -1;
+
+    ring->queued--;
+    info->buf.buffer_queued = (ring->queued > 0);
+
+    return 0;
+}
+
+/* dequeues the oldest frame of the src and dst rings */
+static int gsc_m2m_reap_frame(CGscaler *gsc, GscExtInfo *ext)
+{
+    if (gsc_m2m_dqbuf(gsc->gsc_fd, &gsc->src_info, &ext->src) < 0) {
+        ALOGE("%s::exynos_v4l2_dqbuf(src) fail", __func__);
+        return -1;
+    }
+
+    if (gsc_m2m_dqbuf(gsc->gsc_fd, &gsc->dst_info, &ext->dst) < 0) {
+        ALOGE("%s::exynos_v4l2_dqbuf(dst) fail", __func__);
+        return -1;
+    }
+
+    return 0;
+}
+
 int CGscaler::m_gsc_m2m_wait_frame_done(void *handle)
 {
     Exynos_gsc_In();
 
+    GscExtInfo *ext;
     CGscaler* gsc = GetGscaler(handle);
     if (gsc == NULL) {
         ALOGE("%s::handle == NULL() fail", __func__);
@@ -800,20 +744,11 @@ int CGscaler::m_gsc_m2m_wait_frame_done(void *handle)
         return -1;
     }
 
-    if (gsc->src_info.buf.buffer_queued) {
-        if (exynos_v4l2_dqbuf(gsc->gsc_fd, &gsc->src_info.buf.buffer) < 0) {
-            ALOGE("%s::exynos_v4l2_dqbuf(src) fail", __func__);
-            return -1;
-        }
-        gsc->src_info.buf.buffer_queued = false;
-    }
+    ext = GetGscExtInfo(handle);
 
-    if (gsc->dst_info.buf.buffer_queued) {
-        if (exynos_v4l2_dqbuf(gsc->gsc_fd, &gsc->dst_info.buf.buffer) < 0) {
-            ALOGE("%s::exynos_v4l2_dqbuf(dst) fail", __func__);
+    while (gsc->src_info.buf.buffer_queued || gsc->dst_info.buf.buffer_queued) {
+        if (gsc_m2m_reap_frame(gsc, ext) < 0)
             return -1;
-        }
-        gsc->dst_info.buf.buffer_queued = false;
     }
 
     Exynos_gsc_Out();
@@ -822,67 +757,159 @@ int CGscaler::m_gsc_m2m_wait_frame_done(void *handle)
 }
 
 bool CGscaler::m_gsc_set_format(int fd, GscInfo *info)
+{
+    return gsc_m2m_set_format(fd, info, 1, GSC_CFG_ALL);
+}
+
+static void gsc_m2m_get_config(GscInfo *info, unsigned int count,
+    GscQueueConfig *cfg)
+{
+    const uint8_t *p;
+    size_t len;
+
+    memset(cfg, 0, sizeof(*cfg));
+
+    cfg->width            = info->width;
+    cfg->height           = info->height;
+    cfg->v4l2_colorformat = info->v4l2_colorformat;
+    cfg->mem_type         = info->buf.mem_type;
+    cfg->count            = count;
+    cfg->mode_drm         = info->mode_drm;
+    cfg->crop_left        = info->crop_left;
+    cfg->crop_top         = info->crop_top;
+    cfg->crop_width       = info->crop_width;
+    cfg->crop_height      = info->crop_height;
+    cfg->rotation         = info->rotation;
+    cfg->flip_horizontal  = info->flip_horizontal;
+    cfg->flip_vertical    = info->flip_vertical;
+    cfg->cacheable        = info->cacheable;
+
+    /* FNV-1a over everything after the hash itself */
+    p = (const uint8_t *)&cfg->width;
+    len = sizeof(*cfg) - offsetof(GscQueueConfig, width);
+    cfg->hash = 2166136261U;
+    while (len--) {
+        cfg->hash ^= *p++;
+        cfg->hash *= 16777619U;
+    }
+    cfg->valid = true;
+}
+
+static unsigned int gsc_m2m_config_diff(const GscQueueConfig *old,
+    const GscQueueConfig *cur)
+{
+    unsigned int changes = 0;
+
+    if (!old->valid)
+        return GSC_CFG_ALL;
+
+    if (old->hash == cur->hash &&
+        !memcmp(&old->width, &cur->width,
+                sizeof(*cur) - offsetof(GscQueueConfig, width)))
+        return 0;
+
+    if (old->rotation != cur->rotation ||
+        old->flip_horizontal != cur->flip_horizontal ||
+        old->flip_vertical != cur->flip_vertical)
+        changes |= GSC_CFG_CTRL;
+
+    if (old->width != cur->width || old->height != cur->height ||
+        old->v4l2_colorformat != cur->v4l2_colorformat ||
+        old->mem_type != cur->mem_type || old->count != cur->count ||
+        old->mode_drm != cur->mode_drm)
+        changes |= GSC_CFG_FORMAT;
+
+    if (old->crop_left != cur->crop_left || old->crop_top != cur->crop_top ||
+        old->crop_width != cur->crop_width ||
+        old->crop_height != cur->crop_height)
+        changes |= GSC_CFG_CROP;
+
+    if (old->cacheable != cur->cacheable)
+        changes |= GSC_CFG_CACHEABLE;
+
+    return changes;
+}
+
+static bool gsc_m2m_set_format(int fd, GscInfo *info, unsigned int count,
+    unsigned int changes)
 {
     Exynos_gsc_In();
 
     struct v4l2_requestbuffers req_buf;
     int                        plane_count;
 
-    plane_count = m_gsc_get_plane_count(info->v4l2_colorformat);
+    /* a new format resets the crop in the driver, so push everything */
+    if (changes & GSC_CFG_FORMAT)
+        changes = GSC_CFG_ALL;
+
+    plane_count = CGscaler::m_gsc_get_plane_count(info->v4l2_colorformat);
     if (plane_count < 0) {
         ALOGE("%s::not supported v4l2_colorformat", __func__);
         return false;
     }
 
-    if (exynos_v4l2_s_ctrl(fd, V4L2_CID_ROTATE, info->rotation) < 0) {
-        ALOGE("%s::exynos_v4l2_s_ctrl(V4L2_CID_ROTATE) fail", __func__);
-        return false;
-    }
+    if (changes & GSC_CFG_CTRL) {
+        if (exynos_v4l2_s_ctrl(fd, V4L2_CID_ROTATE, info->rotation) < 0) {
+            ALOGE("%s::exynos_v4l2_s_ctrl(V4L2_CID_ROTATE) fail", __func__);
+            return false;
+        }
 
-    if (exynos_v4l2_s_ctrl(fd, V4L2_CID_VFLIP, info->flip_horizontal) < 0) {
-        ALOGE("%s::exynos_v4l2_s_ctrl(V4L2_CID_VFLIP) fail", __func__);
-        return false;
-    }
+        if (exynos_v4l2_s_ctrl(fd, V4L2_CID_VFLIP, info->flip_horizontal) < 0) {
+            ALOGE("%s::exynos_v4l2_s_ctrl(V4L2_CID_VFLIP) fail", __func__);
+            return false;
+        }
 
-    if (exynos_v4l2_s_ctrl(fd, V4L2_CID_HFLIP, info->flip_vertical) < 0) {
-        ALOGE("%s::exynos_v4l2_s_ctrl(V4L2_CID_HFLIP) fail", __func__);
-        return false;
+        if (exynos_v4l2_s_ctrl(fd, V4L2_CID_HFLIP, info->flip_vertical) < 0) {
+            ALOGE("%s::exynos_v4l2_s_ctrl(V4L2_CID_HFLIP) fail", __func__);
+            return false;
+        }
     }
 
-    info->format.type = info->buf.buf_type;
-    info->format.fmt.pix_mp.width       = info->width;
-    info->format.fmt.pix_mp.height      = info->height;
-    info->format.fmt.pix_mp.pixelformat = info->v4l2_colorformat;
-    info->format.fmt.pix_mp.field       = V4L2_FIELD_ANY;
-    info->format.fmt.pix_mp.num_planes  = plane_count;
+    if (changes & GSC_CFG_FORMAT) {
+        GSC_TRACE(GSC_TRACE_S_FMT, fd);
+        info->format.type = info->buf.buf_type;
+        info->format.fmt.pix_mp.width       = info->width;
+        info->format.fmt.pix_mp.height      = info->height;
+        info->format.fmt.pix_mp.pixelformat = info->v4l2_colorformat;
+        info->format.fmt.pix_mp.field       = V4L2_FIELD_ANY;
+        info->format.fmt.pix_mp.num_planes  = plane_count;
 
-    if (exynos_v4l2_s_fmt(fd, &info->format) < 0) {
-        ALOGE("%s::exynos_v4l2_s_fmt() fail", __func__);
-        return false;
+        if (exynos_v4l2_s_fmt(fd, &info->format) < 0) {
+            ALOGE("%s::exynos_v4l2_s_fmt() fail", __func__);
+            return false;
+        }
     }
 
-    info->crop.type     = info->buf.buf_type;
-    info->crop.c.left   = info->crop_left;
-    info->crop.c.top    = info->crop_top;
-    info->crop.c.width  = info->crop_width;
-    info->crop.c.height = info->crop_height;
+    if (changes & GSC_CFG_CROP) {
+        GSC_TRACE(GSC_TRACE_S_CROP, fd);
+        info->crop.type     = info->buf.buf_type;
+        info->crop.c.left   = info->crop_left;
+        info->crop.c.top    = info->crop_top;
+        info->crop.c.width  = info->crop_width;
+        info->crop.c.height = info->crop_height;
 
-    if (exynos_v4l2_s_crop(fd, &info->crop) < 0) {
-        ALOGE("%s::exynos_v4l2_s_crop() fail", __func__);
-        return false;
+        if (exynos_v4l2_s_crop(fd, &info->crop) < 0) {
+            ALOGE("%s::exynos_v4l2_s_crop() fail", __func__);
+            return false;
+        }
     }
 
-    if (exynos_v4l2_s_ctrl(fd, V4L2_CID_CACHEABLE, info->cacheable) < 0) {
-        ALOGE("%s::exynos_v4l2_s_ctrl() fail", __func__);
-        return false;
+    if (changes & GSC_CFG_CACHEABLE) {
+        if (exynos_v4l2_s_ctrl(fd, V4L2_CID_CACHEABLE, info->cacheable) < 0) {
+            ALOGE("%s::exynos_v4l2_s_ctrl() fail", __func__);
+            return false;
+        }
     }
 
-    req_buf.count  = 1;
-    req_buf.type   = info->buf.buf_type;
-    req_buf.memory = info->buf.mem_type;
-    if (exynos_v4l2_reqbufs(fd, &req_buf) < 0) {
-        ALOGE("%s::exynos_v4l2_reqbufs() fail", __func__);
-        return false;
+    if (changes & GSC_CFG_FORMAT) {
+        GSC_TRACE(GSC_TRACE_REQBUFS, fd);
+        req_buf.count  = count;
+        req_buf.type   = info->buf.buf_type;
+        req_buf.memory = info->buf.mem_type;
+        if (exynos_v4l2_reqbufs(fd, &req_buf) < 0) {
+            ALOGE("%s::exynos_v4l2_reqbufs() fail", __func__);
+            return false;
+        }
     }
 
     Exynos_gsc_Out();
@@ -892,54 +919,35 @@ bool CGscaler::m_gsc_set_format(int fd, GscInfo *info)
 
 unsigned int CGscaler::m_gsc_get_plane_count(int v4l_pixel_format)
 {
-    int plane_count = 0;
-
-    switch (v4l_pixel_format) {
-    case V4L2_PIX_FMT_RGB32:
-    case V4L2_PIX_FMT_BGR32:
-    case V4L2_PIX_FMT_RGB24:
-    case V4L2_PIX_FMT_RGB565:
-    case V4L2_PIX_FMT_RGB555X:
-    case V4L2_PIX_FMT_RGB444:
-    case V4L2_PIX_FMT_YUYV:
-    case V4L2_PIX_FMT_UYVY:
-    case V4L2_PIX_FMT_NV16:
-    case V4L2_PIX_FMT_NV61:
-    case V4L2_PIX_FMT_YVU420:
-    case V4L2_PIX_FMT_YUV420:
-    case V4L2_PIX_FMT_NV12:
-    case V4L2_PIX_FMT_NV21:
-    case V4L2_PIX_FMT_YUV422P:
-        plane_count = 1;
-        break;
-    case V4L2_PIX_FMT_NV12M:
-    case V4L2_PIX_FMT_NV12MT_16X16:
-    case V4L2_PIX_FMT_NV21M:
-        plane_count = 2;
-        break;
-    case V4L2_PIX_FMT_YVU420M:
-    case V4L2_PIX_FMT_YUV420M:
-        plane_count = 3;
-        break;
-    default:
+    const ExynosFmtDesc *desc = exynos_fmt_find(v4l_pixel_format);
+
+    if (desc == NULL) {
         ALOGE("%s::unmatched v4l_pixel_format color_space(0x%x)\n",
              __func__, v4l_pixel_format);
-        plane_count = -1;
-        break;
+        return -1;
     }
 
-    return plane_count;
+    return desc->planes;
 }
 
 bool CGscaler::m_gsc_set_addr(int fd, GscInfo *info)
+{
+    GscRing ring = { 1, 0, 0 };
+
+    return gsc_m2m_set_addr(fd, info, &ring);
+}
+
+static bool gsc_m2m_set_addr(int fd, GscInfo *info, GscRing *ring)
 {
     unsigned int i;
     unsigned int plane_size[NUM_OF_GSC_PLANES];
 
+    GSC_TRACE(GSC_TRACE_QBUF, fd);
+
     CGscaler::m_gsc_get_plane_size(plane_size, info->width,
                          info->height, info->v4l2_colorformat);
 
-    info->buf.buffer.index    = 0;
+    info->buf.buffer.index    = ring->next;
     info->buf.buffer.flags    = V4L2_BUF_FLAG_USE_SYNC;
     info->buf.buffer.type     = info->buf.buf_type;
     info->buf.buffer.memory   = info->buf.mem_type;
@@ -962,6 +970,9 @@ bool CGscaler::m_gsc_set_addr(int fd, GscInfo *info)
         return false;
     }
     info->buf.buffer_queued = true;
+    ring->queued++;
+    if (ring->depth > 0)
+        ring->next = (ring->next + 1) % ring->depth;
 
     info->releaseFenceFd = info->buf.buffer.reserved;
 
@@ -974,80 +985,19 @@ unsigned int CGscaler::m_gsc_get_plane_size(
     unsigned int  height,
     int           v4l_pixel_format)
 {
-    switch (v4l_pixel_format) {
-    /* 1 plane */
-    case V4L2_PIX_FMT_RGB32:
-    case V4L2_PIX_FMT_BGR32:
-        plane_size[0] = width * height * 4;
-        plane_size[1] = 0;
-        plane_size[2] = 0;
-        break;
-    case V4L2_PIX_FMT_RGB24:
-        plane_size[0] = width * height * 3;
-        plane_size[1] = 0;
-        plane_size[2] = 0;
-        break;
-    case V4L2_PIX_FMT_RGB565:
-    case V4L2_PIX_FMT_RGB555X:
-    case V4L2_PIX_FMT_RGB444:
-    case V4L2_PIX_FMT_YUYV:
-    case V4L2_PIX_FMT_UYVY:
-        plane_size[0] = width * height * 2;
-        plane_size[1] = 0;
-        plane_size[2] = 0;
-        break;
-    /* 2 planes */
-    case V4L2_PIX_FMT_NV12M:
-    case V4L2_PIX_FMT_NV21M:
-        plane_size[0] = width * height;
-        plane_size[1] = width * (height / 2);
-        plane_size[2] = 0;
-        break;
-    case V4L2_PIX_FMT_NV12:
-    case V4L2_PIX_FMT_NV21:
-        plane_size[0] = width * height * 3 / 2;
-        plane_size[1] = 0;
-        plane_size[2] = 0;
-	break;
-    case V4L2_PIX_FMT_NV16:
-    case V4L2_PIX_FMT_NV61:
-    case V4L2_PIX_FMT_YUV422P:
-        plane_size[0] = width * height * 2;
-        plane_size[1] = 0;
-        plane_size[2] = 0;
-        break;
-    case V4L2_PIX_FMT_NV12MT_16X16:
-        plane_size[0] = ALIGN(width, 16) * ALIGN(height, 16);
-        plane_size[1] = ALIGN(width, 16) * ALIGN(height / 2, 8);
-        plane_size[2] = 0;
-        break;
-    /* 3 planes */
-    case V4L2_PIX_FMT_YUV420M:
-        plane_size[0] = width * height;
-        plane_size[1] = (width / 2) * (height / 2);
-        plane_size[2] = (width / 2) * (height / 2);
-        break;
-    case V4L2_PIX_FMT_YVU420:
-        plane_size[0] = ALIGN(width, 16) * height + ALIGN(width / 2, 16) * height;
-        plane_size[1] = 0;
-        plane_size[2] = 0;
-        break;
-    case V4L2_PIX_FMT_YUV420:
-        plane_size[0] = width * height * 3 / 2;
-        plane_size[1] = 0;
-        plane_size[2] = 0;
-        break;
-    case V4L2_PIX_FMT_YVU420M:
-        plane_size[0] = ALIGN(width, 16) * height;
-        plane_size[1] = ALIGN(width / 2, 16) * (height / 2);
-        plane_size[2] = plane_size[1];
-        break;
-    default:
+    const ExynosFmtDesc *desc = exynos_fmt_find(v4l_pixel_format);
+    ExynosFmtLayout layout;
+
+    if (desc == NULL) {
         ALOGE("%s::unmatched v4l_pixel_format color_space(0x%x)\n",
              __func__, v4l_pixel_format);
         return -1;
     }
 
+    exynos_fmt_get_layout(desc, width, height, &layout);
+    for (int i = 0; i < NUM_OF_GSC_PLANES; i++)
+        plane_size[i] = layout.plane_size[i];
+
     return 0;
 }
 
@@ -1068,6 +1018,8 @@ int CGscaler::m_gsc_m2m_config(void *handle,
         return -1;
     }
 
+    GSC_TRACE(GSC_TRACE_CONFIG, gsc->gsc_fd);
+
     if ((src_img->drmMode && !gsc->allow_drm) ||
         (src_img->drmMode != dst_img->drmMode)) {
         ALOGE("%s::invalid drm state request for gsc%d (s=%d d=%d)",
@@ -1123,6 +1075,8 @@ int CGscaler::m_gsc_out_config(void *handle,
     unsigned int vflip;
     unsigned int plane_size[NUM_OF_GSC_PLANES];
     bool rgb;
+    const ExynosFmtDesc *dst_desc;
+    GscOutQueue *out;
 
     struct v4l2_rect dst_rect;
     int32_t      src_color_space;
@@ -1135,6 +1089,8 @@ int CGscaler::m_gsc_out_config(void *handle,
         return -1;
     }
 
+    GSC_TRACE(GSC_TRACE_CONFIG, gsc->mdev.gsc_vd_entity->fd);
+
     if (gsc->src_info.stream_on != false) {
         ALOGE("Error: Src is already streamed on !!!!");
         return -1;
@@ -1146,7 +1102,8 @@ int CGscaler::m_gsc_out_config(void *handle,
     dst_color_space = HAL_PIXEL_FORMAT_2_V4L2_PIX(dst_img->format);
     src_planes = m_gsc_get_plane_count(src_color_space);
     src_planes = (src_planes == -1) ? 1 : src_planes;
-    rgb = get_yuv_planes(dst_color_space) == -1;
+    dst_desc = exynos_fmt_find(dst_color_space);
+    rgb = (dst_desc == NULL) || dst_desc->rgb;
     CGscaler::rotateValueHAL2GSC(dst_img->rot, &rotate, &hflip, &vflip);
 
     if (CGscaler::m_gsc_check_src_size(&gsc->src_img.fw,
@@ -1336,14 +1293,18 @@ int CGscaler::m_gsc_out_config(void *handle,
         return -1;
     }
 
+    /* enough buffers for the deepest queue the policy may go to */
+    out = &GetGscExtInfo(handle)->out;
     reqbuf.type   = fmt.type;
     reqbuf.memory = V4L2_MEMORY_DMABUF;
-    reqbuf.count  = MAX_BUFFERS_GSCALER_OUT;
+    reqbuf.count  = gsc_out_buffer_count(out);
 
     if (exynos_v4l2_reqbufs(gsc->mdev.gsc_vd_entity->fd, &reqbuf) < 0) {
         ALOGE("%s::request buffers failed", __func__);
         return -1;
     }
+    out->count = reqbuf.count;
+    gsc_out_reset_limit(out);
 
     Exynos_gsc_Out();
 
@@ -1392,11 +1353,29 @@ int CGscaler::m_gsc_m2m_run(void *handle,
 {
     Exynos_gsc_In();
 
+    GscExtInfo *ext;
+    int ret;
     CGscaler* gsc = GetGscaler(handle);
     if (gsc == NULL) {
         ALOGE("%s::handle == NULL() fail", __func__);
         return -1;
     }
+
+    ext = GetGscExtInfo(handle);
+    if (ext->stripe.count > 0)
+        ret = gsc_m2m_run_striped(handle, ext, src_img, dst_img);
+    else
+        ret = gsc_m2m_run_frame(handle, src_img, dst_img);
+
+    Exynos_gsc_Out();
+
+    return ret;
+}
+
+int gsc_m2m_run_frame(void *handle,
+    exynos_mpp_img *src_img, exynos_mpp_img *dst_img)
+{
+    CGscaler* gsc = GetGscaler(handle);
     void *addr[3] = {NULL, NULL, NULL};
     int ret = 0;
 
@@ -1443,7 +1422,127 @@ int CGscaler::m_gsc_m2m_run(void *handle,
     src_img->releaseFenceFd = gsc->src_info.releaseFenceFd;
     dst_img->releaseFenceFd = gsc->dst_info.releaseFenceFd;
 
-    Exynos_gsc_Out();
+    return 0;
+}
+
+/* runs further apart than this are not a stream the display starves on */
+#define GSC_OUT_IDLE_NS     ms2ns(100)
+/* runs without an underrun before an adaptive queue gets shallower */
+#define GSC_OUT_CALM_RUNS   300
+
+/*
+ * Dequeues the oldest buffer the display is done with. The video node is
+ * non-blocking: returns 0 if there is none yet, unless wait is set, in
+ * which case it waits for one. Returns 1 when a buffer was taken back.
+ */
+static int gsc_out_dqbuf(CGscaler *gsc, bool wait)
+{
+    struct v4l2_plane  planes[NUM_OF_GSC_PLANES];
+    struct v4l2_buffer buf;
+    struct pollfd      pfd;
+    int32_t      src_planes;
+    int          fd = gsc->mdev.gsc_vd_entity->fd;
+
+    memset(&buf, 0, sizeof(struct v4l2_buffer));
+    memset(planes, 0, sizeof(planes));
+
+    src_planes = CGscaler::m_gsc_get_plane_count(
+            HAL_PIXEL_FORMAT_2_V4L2_PIX(gsc->src_img.format));
+    src_planes = (src_planes == -1) ? 1 : src_planes;
+
+    buf.type     = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    buf.memory   = V4L2_MEMORY_DMABUF;
+    buf.m.planes = planes;
+    buf.length   = src_planes;
+
+    GSC_TRACE(GSC_TRACE_DQBUF, fd);
+    /* not exynos_v4l2_dqbuf(), which logs every EAGAIN as a failure */
+    while (ioctl(fd, VIDIOC_DQBUF, &buf) < 0) {
+        if (errno == EINTR)
+            continue;
+        if (errno != EAGAIN) {
+            ALOGE("%s::dequeue buffer failed (index=%d)(queued=%d)",
+                    __func__, gsc->src_info.buf.src_buf_idx,
+                    gsc->src_info.qbuf_cnt);
+            return -1;
+        }
+        if (!wait)
+            return 0;
+
+        pfd.fd = fd;
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+            ALOGE("%s::poll() fail", __func__);
+            return -1;
+        }
+    }
+    gsc->src_info.qbuf_cnt--;
+
+    return 1;
+}
+
+/*
+ * Takes back what the display is done with and makes room for one more
+ * frame, waiting only when the queue is as deep as the policy allows.
+ *
+ * A run is late when it comes well after the average interval of the
+ * stream, and an underrun when the queue had nothing left behind the frame
+ * on screen by then, so the display showed a frame again. The adaptive
+ * policy grows the queue on underruns and shrinks it after a calm stretch.
+ */
+static int gsc_out_reclaim(CGscaler *gsc, GscOutQueue *out)
+{
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    nsecs_t gap = now - out->last_run;
+    bool late = false;
+
+    if (out->count == 0) {
+        ALOGE("%s::output is not configured", __func__);
+        return -1;
+    }
+
+    out->last_run = now;
+    if (gsc->src_info.stream_on && gap < GSC_OUT_IDLE_NS) {
+        late = out->interval > 0 && gap > out->interval * 3 / 2;
+        out->interval += (gap - out->interval) / 8;
+    }
+
+    while (gsc->src_info.qbuf_cnt > 0) {
+        int ret = gsc_out_dqbuf(gsc, false);
+        if (ret < 0)
+            return -1;
+        if (ret == 0)
+            break;
+        out->stats.reclaimed++;
+    }
+
+    if (late) {
+        out->stats.late++;
+        /* the frame on screen is held until the next one replaces it */
+        if (gsc->src_info.qbuf_cnt <= 1) {
+            out->stats.underruns++;
+            if (out->policy == GSC_OUT_POLICY_ADAPTIVE &&
+                    out->limit < out->count)
+                out->limit++;
+            out->calm = 0;
+        }
+    }
+
+    if (out->policy == GSC_OUT_POLICY_ADAPTIVE &&
+            ++out->calm >= GSC_OUT_CALM_RUNS) {
+        if (out->limit > GSC_OUT_MIN_DEPTH)
+            out->limit--;
+        out->calm = 0;
+    }
+
+    /* All buffers the policy allows have been queued, dequeue */
+    if (gsc->src_info.qbuf_cnt >= (int)out->limit)
+        out->stats.waited++;
+    while (gsc->src_info.qbuf_cnt >= (int)out->limit) {
+        if (gsc_out_dqbuf(gsc, true) < 0)
+            return -1;
+    }
 
     return 0;
 }
@@ -1456,36 +1555,18 @@ int CGscaler::m_gsc_out_run(void *handle, exynos_mpp_img *src_img)
     int32_t      src_planes;
     unsigned int i;
     unsigned int plane_size[NUM_OF_GSC_PLANES];
+    GscOutQueue *out;
     CGscaler* gsc = GetGscaler(handle);
     if (gsc == NULL) {
         ALOGE("%s::handle == NULL() fail", __func__);
         return -1;
     }
 
-    /* All buffers have been queued, dequeue one */
-    if (gsc->src_info.qbuf_cnt == MAX_BUFFERS_GSCALER_OUT) {
-        memset(&buf, 0, sizeof(struct v4l2_buffer));
-        for (i = 0; i < NUM_OF_GSC_PLANES; i++)
-            memset(&planes[i], 0, sizeof(struct v4l2_plane));
-
-        buf.type     = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
-        buf.memory   = V4L2_MEMORY_DMABUF;
-        buf.m.planes = planes;
+    GSC_TRACE(GSC_TRACE_RUN, gsc->mdev.gsc_vd_entity->fd);
 
-        src_color_space = HAL_PIXEL_FORMAT_2_V4L2_PIX(gsc->src_img.format);
-        src_planes = m_gsc_get_plane_count(src_color_space);
-        src_planes = (src_planes == -1) ? 1 : src_planes;
-        buf.length   = src_planes;
-
-
-        if (exynos_v4l2_dqbuf(gsc->mdev.gsc_vd_entity->fd, &buf) < 0) {
-            ALOGE("%s::dequeue buffer failed (index=%d)(mSrcBufNum=%d)",
-                    __func__, gsc->src_info.buf.src_buf_idx,
-                    MAX_BUFFERS_GSCALER_OUT);
-            return -1;
-        }
-        gsc->src_info.qbuf_cnt--;
-    }
+    out = &GetGscExtInfo(handle)->out;
+    if (gsc_out_reclaim(gsc, out) < 0)
+        return -1;
 
     memset(&buf, 0, sizeof(struct v4l2_buffer));
     for (i = 0; i < NUM_OF_GSC_PLANES; i++)
@@ -1521,15 +1602,16 @@ int CGscaler::m_gsc_out_run(void *handle, exynos_mpp_img *src_img)
 
     /* Queue the buf */
     if (exynos_v4l2_qbuf(gsc->mdev.gsc_vd_entity->fd, &buf) < 0) {
-        ALOGE("%s::queue buffer failed (index=%d)(mSrcBufNum=%d)",
-                __func__, gsc->src_info.buf.src_buf_idx,
-                MAX_BUFFERS_GSCALER_OUT);
+        ALOGE("%s::queue buffer failed (index=%d)(mSrcBufNum=%u)",
+                __func__, gsc->src_info.buf.src_buf_idx, out->count);
         return -1;
     }
+    /* buffers come back in order, so the next index is never queued */
     gsc->src_info.buf.src_buf_idx++;
     gsc->src_info.buf.src_buf_idx =
-        gsc->src_info.buf.src_buf_idx % MAX_BUFFERS_GSCALER_OUT;
+        gsc->src_info.buf.src_buf_idx % out->count;
     gsc->src_info.qbuf_cnt++;
+    out->stats.frames++;
 
     if (gsc->src_info.stream_on == false) {
         if (exynos_v4l2_streamon(gsc->mdev.gsc_vd_entity->fd,
@@ -1547,60 +1629,19 @@ int CGscaler::m_gsc_out_run(void *handle, exynos_mpp_img *src_img)
 bool CGscaler::tmp_get_plane_size(int V4L2_PIX,
     unsigned int * size, unsigned int width, unsigned int height, int src_planes)
 {
-    unsigned int frame_ratio = 1;
-    int src_bpp    = get_yuv_bpp(V4L2_PIX);
-    unsigned int frame_size = width * height;
-
     src_planes = (src_planes == -1) ? 1 : src_planes;
-    frame_ratio = 8 * (src_planes -1) / (src_bpp - 8);
+    if (src_planes < 1 || src_planes > NUM_OF_GSC_PLANES) {
+        ALOGE("%s::invalid plane count (%d)", __func__, src_planes);
+        return false;
+    }
 
-    switch (src_planes) {
-    case 1:
-        switch (V4L2_PIX) {
-        case V4L2_PIX_FMT_BGR32:
-        case V4L2_PIX_FMT_RGB32:
-            size[0] = frame_size << 2;
-            break;
-	case V4L2_PIX_FMT_RGB565:
-        case V4L2_PIX_FMT_NV16:
-        case V4L2_PIX_FMT_NV61:
-        case V4L2_PIX_FMT_YUYV:
-        case V4L2_PIX_FMT_UYVY:
-        case V4L2_PIX_FMT_VYUY:
-        case V4L2_PIX_FMT_YVYU:
-            size[0] = frame_size << 1;
-            break;
-        case V4L2_PIX_FMT_YUV420:
-        case V4L2_PIX_FMT_NV12:
-        case V4L2_PIX_FMT_NV21:
-        case V4L2_PIX_FMT_NV21M:
-            size[0] = (frame_size * 3) >> 1;
-            break;
-        case V4L2_PIX_FMT_YVU420:
-            size[0] = frame_size + (ALIGN((width >> 1), 16) * ((height >> 1) * 2));
-            break;
-        default:
-            ALOGE("%s::invalid color type (%x)", __func__, V4L2_PIX);
-            return false;
-            break;
-        }
-        size[1] = 0;
-        size[2] = 0;
-        break;
-    case 2:
-        size[0] = frame_size;
-        size[1] = frame_size / frame_ratio;
-        size[2] = 0;
-        break;
-    case 3:
-        size[0] = frame_size;
-        size[1] = frame_size / frame_ratio;
-        size[2] = frame_size / frame_ratio;
-        break;
-    default:
-        ALOGE("%s::invalid color foarmt", __func__);
+    if (m_gsc_get_plane_size(size, width, height, V4L2_PIX) != 0)
         return false;
-        break;
+
+    /* the buffers past src_planes are queued as part of the last one */
+    for (int i = src_planes; i < NUM_OF_GSC_PLANES; i++) {
+        size[src_planes - 1] += size[i];
+        size[i] = 0;
     }
 
     return true;
@@ -0,0 +1,524 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      libgscaler_sched.cpp
+ * \brief     source file for the fence-aware m2m submission thread
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sync/sync.h>
+#include <sw_sync.h>
+
+#include "libgscaler_sched.h"
+#include "libgscaler_ext.h"
+#include "libgscaler_trace.h"
+
+#define GSC_SCHED_EVENTS    16
+
+CGscScheduler *CGscScheduler::getInstance()
+{
+    static CGscScheduler sched;
+
+    return &sched;
+}
+
+CGscScheduler::CGscScheduler()
+{
+    m_started = false;
+    m_exit = false;
+    m_epoll = -1;
+    m_wake = -1;
+    m_seq = 0;
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+bool CGscScheduler::start()
+{
+    Mutex::Autolock lock(m_lock);
+    struct epoll_event ev;
+
+    if (m_started)
+        return true;
+
+    m_epoll = epoll_create(GSC_SCHED_EVENTS);
+    if (m_epoll < 0) {
+        ALOGE("%s::epoll_create() fail", __func__);
+        return false;
+    }
+
+    m_wake = eventfd(0, 0);
+    if (m_wake < 0) {
+        ALOGE("%s::eventfd() fail", __func__);
+        goto err;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wake, &ev) < 0) {
+        ALOGE("%s::epoll_ctl(eventfd) fail", __func__);
+        goto err;
+    }
+
+    m_exit = false;
+    if (pthread_create(&m_thread, NULL, threadMain, this) != 0) {
+        ALOGE("%s::pthread_create() fail", __func__);
+        goto err;
+    }
+    m_started = true;
+
+    return true;
+
+err:
+    if (m_wake >= 0)
+        close(m_wake);
+    close(m_epoll);
+    m_wake = -1;
+    m_epoll = -1;
+
+    return false;
+}
+
+void CGscScheduler::stop()
+{
+    uint64_t one = 1;
+
+    {
+        Mutex::Autolock lock(m_lock);
+
+        if (!m_started || m_exit || pthread_equal(pthread_self(), m_thread))
+            return;
+
+        while (busy())
+            m_cond.wait(m_lock);
+        m_exit = true;
+    }
+
+    if (write(m_wake, &one, sizeof(one)) < 0)
+        ALOGE("%s::write(eventfd) fail", __func__);
+    pthread_join(m_thread, NULL);
+
+    Mutex::Autolock lock(m_lock);
+    close(m_wake);
+    close(m_epoll);
+    m_wake = -1;
+    m_epoll = -1;
+    m_started = false;
+    m_exit = false;
+}
+
+/* the jobs in order on the calling thread, when there is no scheduler */
+static int gsc_sched_run_now(GscSchedJob *jobs, unsigned int count,
+    int *batch_fence)
+{
+    for (unsigned int i = 0; i < count; i++) {
+        if (exynos_gsc_config_exclusive(jobs[i].handle, &jobs[i].src,
+                                        &jobs[i].dst) < 0) {
+            ALOGE("%s::exynos_gsc_config_exclusive() fail", __func__);
+            return -1;
+        }
+        if (exynos_gsc_run_exclusive(jobs[i].handle, &jobs[i].src,
+                                     &jobs[i].dst) < 0) {
+            ALOGE("%s::exynos_gsc_run_exclusive() fail", __func__);
+            return -1;
+        }
+
+        if (batch_fence && jobs[i].dst.releaseFenceFd >= 0)
+            *batch_fence = gsc_fence_merge(*batch_fence,
+                                           dup(jobs[i].dst.releaseFenceFd));
+    }
+
+    return 0;
+}
+
+int CGscScheduler::submit(GscSchedJob *jobs, unsigned int count,
+    int *batch_fence)
+{
+    uint64_t one = 1;
+    unsigned int i;
+
+    if (batch_fence)
+        *batch_fence = -1;
+
+    {
+        Mutex::Autolock lock(m_lock);
+
+        if (m_started && !m_exit) {
+            /* every handle has a lane before any job is taken over */
+            for (i = 0; i < count; i++) {
+                if (GetGscaler(jobs[i].handle) == NULL ||
+                        getLane(jobs[i].handle) == NULL)
+                    return -1;
+            }
+
+            for (i = 0; i < count; i++) {
+                Lane *lane = getLane(jobs[i].handle);
+                int timeline;
+                int fence;
+
+                /* the rest stays with the caller if any of these fails */
+                timeline = sw_sync_timeline_create();
+                if (timeline < 0) {
+                    ALOGE("%s::sw_sync_timeline_create() fail", __func__);
+                    break;
+                }
+                fence = sw_sync_fence_create(timeline, "gsc_sched", 1);
+                if (fence < 0) {
+                    ALOGE("%s::sw_sync_fence_create() fail", __func__);
+                    close(timeline);
+                    break;
+                }
+
+                Job *job = new Job;
+                job->lane = lane;
+                job->timeline = timeline;
+                job->next = NULL;
+                job->src = jobs[i].src;
+                job->dst = jobs[i].dst;
+                job->seq = m_seq++;
+                job->running = false;
+                job->failed = false;
+                job->waits = 0;
+                job->wait[0].fd = -1;
+                job->wait[1].fd = -1;
+
+                if (lane->tail)
+                    lane->tail->next = job;
+                else
+                    lane->head = job;
+                lane->tail = job;
+
+                addWait(job, jobs[i].src.acquireFenceFd);
+                if (jobs[i].dst.acquireFenceFd != jobs[i].src.acquireFenceFd)
+                    addWait(job, jobs[i].dst.acquireFenceFd);
+                job->src.acquireFenceFd = -1;
+                job->dst.acquireFenceFd = -1;
+
+                jobs[i].src.acquireFenceFd = -1;
+                jobs[i].dst.acquireFenceFd = -1;
+                jobs[i].src.releaseFenceFd = fence;
+                jobs[i].dst.releaseFenceFd = dup(fence);
+                if (batch_fence)
+                    *batch_fence = gsc_fence_merge(*batch_fence, dup(fence));
+
+                m_stats.submitted++;
+            }
+
+            if (write(m_wake, &one, sizeof(one)) < 0)
+                ALOGE("%s::write(eventfd) fail", __func__);
+
+            return (i == count) ? 0 : -1;
+        }
+    }
+
+    return gsc_sched_run_now(jobs, count, batch_fence);
+}
+
+CGscScheduler::Lane *CGscScheduler::getLane(void *handle)
+{
+    ssize_t idx = m_lanes.indexOfKey(handle);
+    if (idx >= 0)
+        return m_lanes.valueAt(idx);
+
+    Lane *lane = new Lane;
+    lane->handle = handle;
+    lane->head = NULL;
+    lane->tail = NULL;
+
+    m_lanes.add(handle, lane);
+
+    return lane;
+}
+
+/* takes fd over and wakes the thread when it signals */
+void CGscScheduler::addWait(Job *job, int fd)
+{
+    struct epoll_event ev;
+    Wait *wait;
+
+    if (fd < 0)
+        return;
+
+    wait = (job->wait[0].fd < 0) ? &job->wait[0] : &job->wait[1];
+    wait->job = job;
+    wait->fd = fd;
+    wait->since = GscTraceOn() ? systemTime(SYSTEM_TIME_MONOTONIC) : 0;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = wait;
+    if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        /* not as early as it could, but never too early */
+        ALOGE("%s::epoll_ctl(fence) fail, waiting", __func__);
+        {
+            GSC_TRACE(GSC_TRACE_FENCE_WAIT, fd);
+            if (sync_wait(fd, -1) < 0 && job->running)
+                job->failed = true;
+        }
+        close(fd);
+        wait->fd = -1;
+        return;
+    }
+
+    job->waits++;
+}
+
+void CGscScheduler::signaled(Wait *wait, uint32_t events)
+{
+    Job *job = wait->job;
+
+    /* the engine could not finish the frame */
+    if ((events & EPOLLERR) && job->running)
+        job->failed = true;
+
+    if (wait->since)
+        GscTraceRecord(GSC_TRACE_FENCE_WAIT, wait->fd, wait->since,
+                       systemTime(SYSTEM_TIME_MONOTONIC));
+
+    epoll_ctl(m_epoll, EPOLL_CTL_DEL, wait->fd, NULL);
+    close(wait->fd);
+    wait->fd = -1;
+
+    if (--job->waits == 0 && job->running)
+        done(job, !job->failed);
+}
+
+void *CGscScheduler::threadMain(void *arg)
+{
+    static_cast<CGscScheduler *>(arg)->loop();
+
+    return NULL;
+}
+
+void CGscScheduler::loop()
+{
+    struct epoll_event ev[GSC_SCHED_EVENTS];
+    uint64_t value;
+
+    while (true) {
+        int n = epoll_wait(m_epoll, ev, GSC_SCHED_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            ALOGE("%s::epoll_wait() fail", __func__);
+            break;
+        }
+
+        Mutex::Autolock lock(m_lock);
+
+        for (int i = 0; i < n; i++) {
+            if (ev[i].data.ptr == NULL) {
+                if (read(m_wake, &value, sizeof(value)) < 0)
+                    ALOGE("%s::read(eventfd) fail", __func__);
+            } else {
+                signaled(static_cast<Wait *>(ev[i].data.ptr), ev[i].events);
+            }
+        }
+
+        if (m_exit)
+            break;
+
+        dispatch();
+    }
+}
+
+/*
+ * Runs the first job of every handle that is idle and whose fences have
+ * signaled, the oldest of those first.
+ */
+void CGscScheduler::dispatch()
+{
+    while (true) {
+        Job *ready = NULL;
+        size_t i;
+
+        for (i = 0; i < m_lanes.size(); i++) {
+            Job *job = m_lanes.valueAt(i)->head;
+
+            if (job == NULL || job->running || job->waits > 0)
+                continue;
+            if (ready == NULL || job->seq < ready->seq)
+                ready = job;
+        }
+
+        if (ready == NULL)
+            return;
+
+        /* overtaking a job that is still waiting for its fences */
+        for (i = 0; i < m_lanes.size(); i++) {
+            Job *job = m_lanes.valueAt(i)->head;
+
+            if (job && !job->running && job->seq < ready->seq) {
+                m_stats.reordered++;
+                break;
+            }
+        }
+
+        ready->running = true;
+        run(ready);
+    }
+}
+
+/* called with m_lock held, which is let go during the run */
+void CGscScheduler::run(Job *job)
+{
+    void *handle = job->lane->handle;
+    int ret;
+
+    job->src.releaseFenceFd = -1;
+    job->dst.releaseFenceFd = -1;
+
+    m_lock.unlock();
+    ret = exynos_gsc_config_exclusive(handle, &job->src, &job->dst);
+    if (ret < 0)
+        ALOGE("%s::exynos_gsc_config_exclusive() fail", __func__);
+    else if ((ret = exynos_gsc_run_exclusive(handle, &job->src,
+                                             &job->dst)) < 0)
+        ALOGE("%s::exynos_gsc_run_exclusive() fail", __func__);
+    m_lock.lock();
+
+    if (ret < 0) {
+        if (job->src.releaseFenceFd >= 0)
+            close(job->src.releaseFenceFd);
+        if (job->dst.releaseFenceFd >= 0)
+            close(job->dst.releaseFenceFd);
+        done(job, false);
+        return;
+    }
+
+    /* the job is done when the engine gives the buffers back */
+    addWait(job, job->src.releaseFenceFd);
+    addWait(job, job->dst.releaseFenceFd);
+    if (job->waits == 0)
+        done(job, !job->failed);
+}
+
+/* a timeline closed before its point signals the fences with an error */
+void CGscScheduler::done(Job *job, bool ok)
+{
+    Lane *lane = job->lane;
+
+    if (!ok)
+        m_stats.failed++;
+    if (ok && sw_sync_timeline_inc(job->timeline, 1) < 0)
+        ALOGE("%s::sw_sync_timeline_inc() fail", __func__);
+    close(job->timeline);
+
+    lane->head = job->next;
+    if (lane->head == NULL)
+        lane->tail = NULL;
+    delete job;
+
+    m_cond.broadcast();
+}
+
+bool CGscScheduler::busy()
+{
+    for (size_t i = 0; i < m_lanes.size(); i++) {
+        if (m_lanes.valueAt(i)->head != NULL)
+            return true;
+    }
+
+    return false;
+}
+
+void CGscScheduler::flush(void *handle)
+{
+    Mutex::Autolock lock(m_lock);
+
+    /* the thread stops handles in the middle of its own runs */
+    if (m_started && pthread_equal(pthread_self(), m_thread))
+        return;
+
+    ssize_t idx = m_lanes.indexOfKey(handle);
+    if (idx < 0)
+        return;
+
+    Lane *lane = m_lanes.valueAt(idx);
+    while (lane->head != NULL)
+        m_cond.wait(m_lock);
+}
+
+void CGscScheduler::forget(void *handle)
+{
+    flush(handle);
+
+    Mutex::Autolock lock(m_lock);
+
+    ssize_t idx = m_lanes.indexOfKey(handle);
+    if (idx < 0)
+        return;
+
+    Lane *lane = m_lanes.valueAt(idx);
+    if (lane->head != NULL)
+        return;
+
+    m_lanes.removeItemsAt(idx);
+    delete lane;
+}
+
+void CGscScheduler::getStats(GscSchedStats *stats)
+{
+    Mutex::Autolock lock(m_lock);
+
+    *stats = m_stats;
+}
+
+void gsc_sched_flush(void *handle)
+{
+    CGscScheduler::getInstance()->flush(handle);
+}
+
+void gsc_sched_forget(void *handle)
+{
+    CGscScheduler::getInstance()->forget(handle);
+}
+
+int exynos_gsc_sched_start(void)
+{
+    return CGscScheduler::getInstance()->start() ? 0 : -1;
+}
+
+void exynos_gsc_sched_stop(void)
+{
+    CGscScheduler::getInstance()->stop();
+}
+
+int exynos_gsc_sched_submit(GscSchedJob *jobs, unsigned int count,
+    int *batch_fence)
+{
+    if (jobs == NULL && count > 0) {
+        ALOGE("%s::jobs == NULL() fail", __func__);
+        return -1;
+    }
+
+    return CGscScheduler::getInstance()->submit(jobs, count, batch_fence);
+}
+
+int exynos_gsc_sched_get_stats(GscSchedStats *stats)
+{
+    if (stats == NULL)
+        return -1;
+
+    CGscScheduler::getInstance()->getStats(stats);
+
+    return 0;
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      libgscaler_sched.h
+ * \brief     header file for the fence-aware m2m submission thread
+ */
+
+#ifndef LIBGSCALER_SCHED_H_
+#define LIBGSCALER_SCHED_H_
+
+#include <sys/cdefs.h>
+#include <pthread.h>
+#include <utils/Mutex.h>
+#include <utils/Condition.h>
+#include <utils/Timers.h>
+#include <utils/KeyedVector.h>
+
+#include "libgscaler_obj.h"
+
+using namespace android;
+
+/* one m2m frame of exynos_gsc_sched_submit() */
+struct GscSchedJob {
+    void          *handle;  /* exclusive m2m handle, configured when run */
+    exynos_mpp_img src;
+    exynos_mpp_img dst;
+};
+
+struct GscSchedStats {
+    unsigned int submitted; /* jobs handed to the thread */
+    unsigned int reordered; /* jobs run before an older one of another handle */
+    unsigned int failed;    /* jobs the engine refused or failed */
+};
+
+/*
+ * Runs the m2m frames of several handles from one thread, each as soon as
+ * its acquire fences signal rather than in the order they were submitted,
+ * so that a layer waiting on the GPU does not hold up the others.
+ *
+ * The frames of one handle keep their order, and a handle gets its next
+ * frame only once the previous one is done, so that the run never blocks
+ * the thread. The thread configures the handle for each frame before it
+ * runs it. Every job has a sw_sync timeline of its own; the release fences
+ * returned at submission are its first point, advanced when the engine's
+ * own release fences signal. The timeline of a job the engine refuses, or
+ * whose release fences signal with an error, is closed instead, which
+ * signals its fences with an error (-ENOENT).
+ */
+class CGscScheduler {
+public:
+    static CGscScheduler *getInstance();
+
+    bool start();
+    /* waits for the jobs submitted so far, then ends the thread */
+    void stop();
+    int  submit(GscSchedJob *jobs, unsigned int count, int *batch_fence);
+    /* waits for the jobs of handle; a no-op on the thread itself */
+    void flush(void *handle);
+    /* flushes handle and drops its lane */
+    void forget(void *handle);
+    void getStats(GscSchedStats *stats);
+
+private:
+    struct Lane;
+    struct Job;
+
+    /* one fence a job is waiting for */
+    struct Wait {
+        Job    *job;
+        int     fd;
+        nsecs_t since;      /* when it was armed, if tracing */
+    };
+
+    struct Job {
+        Lane          *lane;
+        Job           *next;        /* in the lane */
+        exynos_mpp_img src;
+        exynos_mpp_img dst;
+        int            timeline;    /* of the release fences */
+        unsigned int   seq;         /* submission order */
+        bool           running;
+        bool           failed;      /* a release fence signaled an error */
+        unsigned int   waits;       /* fences not signaled yet */
+        Wait           wait[2];
+    };
+
+    struct Lane {
+        void        *handle;
+        Job         *head;
+        Job         *tail;
+    };
+
+    CGscScheduler();
+    static void *threadMain(void *arg);
+    void loop();
+    Lane *getLane(void *handle);
+    void addWait(Job *job, int fd);
+    void signaled(Wait *wait, uint32_t events);
+    void dispatch();
+    void run(Job *job);
+    void done(Job *job, bool ok);
+    bool busy();
+
+    Mutex            m_lock;
+    Condition        m_cond;
+    pthread_t        m_thread;
+    bool             m_started;
+    bool             m_exit;
+    int              m_epoll;
+    int              m_wake;        /* eventfd */
+    unsigned int     m_seq;
+    KeyedVector<void *, Lane *> m_lanes;
+    GscSchedStats    m_stats;
+};
+
+/* waits for the scheduled jobs of handle; see CGscScheduler::flush() */
+void gsc_sched_flush(void *handle);
+void gsc_sched_forget(void *handle);
+
+__BEGIN_DECLS
+
+/*
+ * Starts the submission thread of the process. Until then, and after
+ * exynos_gsc_sched_stop(), exynos_gsc_sched_submit() runs the jobs on the
+ * calling thread in order.
+ */
+int  exynos_gsc_sched_start(void);
+void exynos_gsc_sched_stop(void);
+
+/*
+ * Queues count m2m frames as one batch and returns at once. The acquire
+ * fences of the jobs are taken over. Each job gets release fences of its
+ * own in src.releaseFenceFd and dst.releaseFenceFd, and *batch_fence, if
+ * not NULL, signals when all of them have. The fences of a job that fails
+ * to configure or run signal with an error status, so sync_wait() on them
+ * fails. A handle with scheduled jobs
+ * must not be run directly; stopping or destroying it waits for them.
+ */
+int exynos_gsc_sched_submit(GscSchedJob *jobs, unsigned int count,
+                            int *batch_fence);
+
+int exynos_gsc_sched_get_stats(GscSchedStats *stats);
+
+__END_DECLS
+
+#endif /* LIBGSCALER_SCHED_H_ */
@@ -0,0 +1,352 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      libgscaler_stripe.cpp
+ * \brief     source file for splitting m2m frames over several engines
+ *
+ * A frame is cut into vertical stripes, one per engine, and every engine
+ * scales its stripe of the source crop into its stripe of the destination
+ * crop at the ratio of the whole frame. The stripes are queued one after
+ * the other without waiting, so the engines run at once, and the release
+ * fences of the frame are the merge of those of all engines.
+ *
+ * An engine only reads the source crop it is given, so the filter taps at
+ * a stripe edge repeat the edge pixel instead of reading the neighbour
+ * stripe, and overlapping the stripes would make two engines write the
+ * same destination pixels. Stripe edges are only placed where the
+ * destination pixel falls on a whole, even source pixel, so every stripe
+ * scales at exactly the ratio of the frame and starts on the filter phase
+ * the frame has there. What remains is a seam of the few pixels next to
+ * each edge, where the taps of the neighbour stripe are missing; frames
+ * whose ratio leaves no such edge run on one engine.
+ */
+
+#include <stdint.h>
+#include <sync/sync.h>
+
+#include "libgscaler_obj.h"
+#include "libgscaler_ext.h"
+#include "libgscaler_trace.h"
+
+/* frames smaller than this are not worth the setup of several engines */
+#define GSC_STRIPE_MIN_PIXELS   (1280 * 720)
+/* narrowest stripe, on both sides */
+#define GSC_STRIPE_MIN_WIDTH    128
+/* destination stripe widths, in pixels */
+#define GSC_STRIPE_ALIGN        16
+
+struct GscStripeRect {
+    unsigned int src_x;
+    unsigned int src_w;
+    unsigned int dst_x;
+    unsigned int dst_w;
+};
+
+static uint64_t gsc_stripe_gcd(uint64_t a, uint64_t b)
+{
+    while (b != 0) {
+        uint64_t t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+/*
+ * Cuts the configured crops into at most 'engines' stripes. Returns the
+ * number of stripes, 1 if the frame has to run on one engine: rotated,
+ * flipped or protected frames, small frames and crops that are too narrow
+ * to be cut.
+ */
+static unsigned int gsc_stripe_plan(CGscaler *gsc, unsigned int engines,
+    GscStripeRect *rect)
+{
+    GscInfo *src = &gsc->src_info;
+    GscInfo *dst = &gsc->dst_info;
+    unsigned int n = engines;
+
+    if (dst->rotation != 0 || dst->flip_horizontal || dst->flip_vertical ||
+            src->mode_drm)
+        return 1;
+
+    if (src->crop_width * src->crop_height < GSC_STRIPE_MIN_PIXELS)
+        return 1;
+
+    if (n > dst->crop_width / GSC_STRIPE_MIN_WIDTH)
+        n = dst->crop_width / GSC_STRIPE_MIN_WIDTH;
+    if (n > src->crop_width / GSC_STRIPE_MIN_WIDTH)
+        n = src->crop_width / GSC_STRIPE_MIN_WIDTH;
+    if (n < 2)
+        return 1;
+
+    /*
+     * Destination widths that are a whole and even number of source
+     * pixels: multiples of the destination length of one source pixel
+     * pair, and of the alignment.
+     */
+    uint64_t g = gsc_stripe_gcd(src->crop_width, dst->crop_width);
+    uint64_t step = dst->crop_width / g;
+    if ((src->crop_width / g) & 1)
+        step *= 2;
+    uint64_t unit = step / gsc_stripe_gcd(step, GSC_STRIPE_ALIGN) *
+                    GSC_STRIPE_ALIGN;
+
+    unsigned int dst_end = dst->crop_left + dst->crop_width;
+    unsigned int src_end = src->crop_left + src->crop_width;
+    unsigned int dst_x = dst->crop_left;
+    unsigned int src_x = src->crop_left;
+
+    for (unsigned int k = 0; k < n; k++) {
+        unsigned int dst_edge = dst_end;
+        unsigned int src_edge = src_end;
+
+        if (k + 1 < n) {
+            uint64_t even = (uint64_t)dst->crop_width * (k + 1) / n;
+            uint64_t lo = even / unit * unit;
+            uint64_t edge = 0;
+
+            /* the nearest of the two around the even split that fits */
+            for (uint64_t e = lo; e <= lo + unit; e += unit) {
+                if (e < dst_x - dst->crop_left + GSC_STRIPE_MIN_WIDTH ||
+                        e + GSC_STRIPE_MIN_WIDTH > dst->crop_width)
+                    continue;
+                if (edge == 0 || e - even < even - edge)
+                    edge = e;
+            }
+
+            if (edge == 0)
+                return 1;
+
+            dst_edge = dst->crop_left + edge;
+            src_edge = src->crop_left +
+                       edge * src->crop_width / dst->crop_width;
+        }
+
+        if (src_edge < src_x + GSC_STRIPE_MIN_WIDTH)
+            return 1;
+
+        rect[k].dst_x = dst_x;
+        rect[k].dst_w = dst_edge - dst_x;
+        rect[k].src_x = src_x;
+        rect[k].src_w = src_edge - src_x;
+
+        dst_x = dst_edge;
+        src_x = src_edge;
+    }
+
+    return n;
+}
+
+int gsc_fence_merge(int fence, int other)
+{
+    int merged;
+
+    if (other < 0)
+        return fence;
+    if (fence < 0)
+        return other;
+
+    merged = sync_merge("gsc", fence, other);
+    if (merged < 0) {
+        /* better late than a fence that signals too early */
+        ALOGE("%s::sync_merge() fail, waiting", __func__);
+        {
+            GSC_TRACE(GSC_TRACE_FENCE_WAIT, other);
+            sync_wait(other, -1);
+        }
+        close(other);
+        return fence;
+    }
+
+    close(fence);
+    close(other);
+
+    return merged;
+}
+
+int gsc_m2m_run_striped(void *handle, GscExtInfo *ext,
+    exynos_mpp_img *src_img, exynos_mpp_img *dst_img)
+{
+    CGscaler* gsc = GetGscaler(handle);
+    GscStripeInfo *stripe = &ext->stripe;
+    GscStripeRect rect[GSC_STRIPE_MAX];
+    exynos_mpp_img src[GSC_STRIPE_MAX];
+    exynos_mpp_img dst[GSC_STRIPE_MAX];
+    unsigned int n;
+    unsigned int i;
+    int ret = 0;
+
+    n = gsc_stripe_plan(gsc, stripe->count + 1, rect);
+    if (n < 2)
+        return gsc_m2m_run_frame(handle, src_img, dst_img);
+
+    /*
+     * the stripes past the first go to the helpers. All of them are
+     * configured before any is queued, so that a helper that cannot take
+     * its stripe costs a whole frame on this engine, not a torn one.
+     */
+    for (i = 1; i < n; i++) {
+        void *helper = stripe->helper[i - 1];
+
+        src[i] = *src_img;
+        src[i].x = rect[i].src_x;
+        src[i].w = rect[i].src_w;
+        dst[i] = *dst_img;
+        dst[i].x = rect[i].dst_x;
+        dst[i].w = rect[i].dst_w;
+
+        exynos_gsc_set_csc_property(helper, gsc->eq_auto, gsc->range_full,
+                                    gsc->v4l2_colorspace);
+        if (exynos_gsc_config_exclusive(helper, &src[i], &dst[i]) < 0) {
+            ALOGE("%s::exynos_gsc_config_exclusive(dev %d) fail", __func__,
+                    stripe->dev_num[i - 1]);
+            return gsc_m2m_run_frame(handle, src_img, dst_img);
+        }
+    }
+
+    for (i = 1; i < n; i++) {
+        /* every engine waits for the buffers, and closes what it is given */
+        src[i].acquireFenceFd = (src_img->acquireFenceFd >= 0) ?
+                                dup(src_img->acquireFenceFd) : -1;
+        dst[i].acquireFenceFd = (dst_img->acquireFenceFd >= 0) ?
+                                dup(dst_img->acquireFenceFd) : -1;
+        src[i].releaseFenceFd = -1;
+        dst[i].releaseFenceFd = -1;
+
+        if (exynos_gsc_run_exclusive(stripe->helper[i - 1], &src[i], &dst[i]) < 0) {
+            ALOGE("%s::exynos_gsc_run_exclusive(dev %d) fail", __func__,
+                    stripe->dev_num[i - 1]);
+            if (src[i].acquireFenceFd >= 0)
+                close(src[i].acquireFenceFd);
+            if (dst[i].acquireFenceFd >= 0)
+                close(dst[i].acquireFenceFd);
+            ret = -1;
+            break;
+        }
+    }
+
+    /* the first stripe on this engine, through the configured crops */
+    unsigned int src_left = gsc->src_info.crop_left;
+    unsigned int src_width = gsc->src_info.crop_width;
+    unsigned int dst_left = gsc->dst_info.crop_left;
+    unsigned int dst_width = gsc->dst_info.crop_width;
+
+    if (ret == 0) {
+        gsc->src_info.crop_left = rect[0].src_x;
+        gsc->src_info.crop_width = rect[0].src_w;
+        gsc->dst_info.crop_left = rect[0].dst_x;
+        gsc->dst_info.crop_width = rect[0].dst_w;
+        gsc->src_info.dirty = true;
+        gsc->dst_info.dirty = true;
+
+        ret = gsc_m2m_run_frame(handle, src_img, dst_img);
+
+        /* left dirty so that an unsplit frame pushes its own crops again */
+        gsc->src_info.crop_left = src_left;
+        gsc->src_info.crop_width = src_width;
+        gsc->dst_info.crop_left = dst_left;
+        gsc->dst_info.crop_width = dst_width;
+        gsc->src_info.dirty = true;
+        gsc->dst_info.dirty = true;
+    }
+
+    if (ret < 0) {
+        for (unsigned int j = 1; j < i; j++) {
+            if (src[j].releaseFenceFd >= 0)
+                close(src[j].releaseFenceFd);
+            if (dst[j].releaseFenceFd >= 0)
+                close(dst[j].releaseFenceFd);
+        }
+        return -1;
+    }
+
+    /* the frame is done when every stripe is */
+    for (i = 1; i < n; i++) {
+        src_img->releaseFenceFd = gsc_fence_merge(src_img->releaseFenceFd,
+                                                  src[i].releaseFenceFd);
+        dst_img->releaseFenceFd = gsc_fence_merge(dst_img->releaseFenceFd,
+                                                  dst[i].releaseFenceFd);
+    }
+
+    return 0;
+}
+
+void gsc_stripe_stop(GscStripeInfo *stripe)
+{
+    for (unsigned int i = 0; i < stripe->count; i++) {
+        if (exynos_gsc_stop_exclusive(stripe->helper[i]) < 0)
+            ALOGE("%s::exynos_gsc_stop_exclusive(dev %d) fail", __func__,
+                    stripe->dev_num[i]);
+    }
+}
+
+void gsc_stripe_destroy(GscStripeInfo *stripe)
+{
+    for (unsigned int i = 0; i < stripe->count; i++)
+        exynos_gsc_destroy(stripe->helper[i]);
+    stripe->count = 0;
+}
+
+int exynos_gsc_set_stripes(void *handle, const int *dev_num,
+                           unsigned int count)
+{
+    CGscaler* gsc = GetGscaler(handle);
+    if (gsc == NULL) {
+        ALOGE("%s::handle == NULL() fail", __func__);
+        return -1;
+    }
+
+    if (count > GSC_STRIPE_MAX || (count > 0 && dev_num == NULL)) {
+        ALOGE("%s::invalid engines (%u, up to %d)", __func__, count,
+                GSC_STRIPE_MAX);
+        return -1;
+    }
+
+    GscExtInfo *ext = GetGscExtInfo(handle);
+    GscStripeInfo *stripe = &ext->stripe;
+
+    gsc_stripe_destroy(stripe);
+
+    for (unsigned int i = 0; i < count && stripe->count < GSC_STRIPE_MAX - 1; i++) {
+        void *helper;
+
+        if (dev_num[i] == gsc->gsc_id)
+            continue;
+
+        helper = exynos_gsc_create_exclusive(dev_num[i], GSC_M2M_MODE,
+                                             0, 0);
+        if (helper == NULL) {
+            ALOGE("%s::exynos_gsc_create_exclusive(dev %d) fail", __func__,
+                    dev_num[i]);
+            continue;
+        }
+
+        exynos_gsc_set_m2m_depth(helper, ext->m2m_depth);
+        stripe->helper[stripe->count] = helper;
+        stripe->dev_num[stripe->count] = dev_num[i];
+        stripe->count++;
+    }
+
+    if (count > 0 && stripe->count == 0)
+        return -1;
+
+    ALOGD("%s::frames split over %u engines", __func__, stripe->count + 1);
+
+    return 0;
+}
@@ -0,0 +1,457 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      libgscaler_tile.cpp
+ * \brief     source file for the NV12MT_16X16 tiling converter
+ */
+
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "libgscaler_obj.h"
+#include "libgscaler_tile.h"
+#include "exynos_format_desc.h"
+
+/* V4L2_PIX_FMT_NV12MT_16X16, not in every kernel header */
+#define GSC_TILE_FOURCC         v4l2_fourcc('V', 'M', '1', '2')
+/* bands a thread is worth starting for */
+#define GSC_TILE_MIN_BANDS      16
+
+enum {
+    GSC_TILE_COPY,          /* same bytes on both sides */
+    GSC_TILE_SWAP,          /* CbCr pairs <-> CrCb pairs */
+    GSC_TILE_SPLIT,         /* CbCr pairs <-> Cb and Cr planes */
+};
+
+struct GscTileLinFormat {
+    unsigned int fourcc;
+    int          mode;      /* of the chroma */
+    bool         swap;      /* Cr plane before Cb plane */
+};
+
+/* one buffer of the tiled frame and where its image is in the linear one */
+struct GscTilePlane {
+    uint8_t     *tiled;
+    unsigned int width;     /* bytes, a multiple of GSC_TILE_SIZE */
+    unsigned int rows;
+    uint8_t     *lin[2];    /* Cb and Cr planes with GSC_TILE_SPLIT */
+    unsigned int stride;
+    unsigned int vw;        /* bytes and rows of the image in the buffer */
+    unsigned int vh;
+    unsigned int unit;      /* bytes of one sample: 1 for Y, 2 for CbCr */
+    int          mode;
+};
+
+struct GscTileJob {
+    const GscTilePlane *plane;
+    unsigned int        planes;
+    bool                retile;
+    unsigned int        index;
+    unsigned int        count;
+    pthread_t           thread;
+};
+
+static const GscTileLinFormat g_tile_lin[] = {
+    { V4L2_PIX_FMT_NV12,    GSC_TILE_COPY,  false },
+    { V4L2_PIX_FMT_NV21,    GSC_TILE_SWAP,  false },
+    { V4L2_PIX_FMT_NV12M,   GSC_TILE_COPY,  false },
+    { V4L2_PIX_FMT_NV21M,   GSC_TILE_SWAP,  false },
+    { v4l2_fourcc('N', 'M', '2', '1'), GSC_TILE_SWAP, false },
+    { V4L2_PIX_FMT_YUV420,  GSC_TILE_SPLIT, false },
+    { V4L2_PIX_FMT_YVU420,  GSC_TILE_SPLIT, true  },
+    { V4L2_PIX_FMT_YUV420M, GSC_TILE_SPLIT, false },
+    { V4L2_PIX_FMT_YVU420M, GSC_TILE_SPLIT, true  },
+};
+
+static inline unsigned int gsc_tile_min(unsigned int a, unsigned int b)
+{
+    return (a < b) ? a : b;
+}
+
+/* one whole row of a tile, GSC_TILE_SIZE bytes, to the linear frame */
+static inline void gsc_tile_detile_row(int mode, const uint8_t *t,
+        uint8_t *l0, uint8_t *l1)
+{
+#if defined(__ARM_NEON__)
+    if (mode == GSC_TILE_COPY) {
+        vst1q_u8(l0, vld1q_u8(t));
+    } else if (mode == GSC_TILE_SWAP) {
+        vst1q_u8(l0, vrev16q_u8(vld1q_u8(t)));
+    } else {
+        uint8x8x2_t c = vld2_u8(t);
+        vst1_u8(l0, c.val[0]);
+        vst1_u8(l1, c.val[1]);
+    }
+#elif defined(__SSE2__)
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(t));
+
+    if (mode == GSC_TILE_COPY) {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(l0), x);
+    } else if (mode == GSC_TILE_SWAP) {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(l0),
+                _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8)));
+    } else {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i even = _mm_and_si128(x, _mm_set1_epi16(0xff));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(l0),
+                _mm_packus_epi16(even, zero));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(l1),
+                _mm_packus_epi16(_mm_srli_epi16(x, 8), zero));
+    }
+#else
+    if (mode == GSC_TILE_COPY) {
+        memcpy(l0, t, GSC_TILE_SIZE);
+    } else if (mode == GSC_TILE_SWAP) {
+        for (unsigned int i = 0; i < GSC_TILE_SIZE; i++)
+            l0[i] = t[i ^ 1];
+    } else {
+        for (unsigned int i = 0; i < GSC_TILE_SIZE / 2; i++) {
+            l0[i] = t[i * 2];
+            l1[i] = t[i * 2 + 1];
+        }
+    }
+#endif
+}
+
+/* and the way back */
+static inline void gsc_tile_retile_row(int mode, uint8_t *t,
+        const uint8_t *l0, const uint8_t *l1)
+{
+#if defined(__ARM_NEON__)
+    if (mode == GSC_TILE_COPY) {
+        vst1q_u8(t, vld1q_u8(l0));
+    } else if (mode == GSC_TILE_SWAP) {
+        vst1q_u8(t, vrev16q_u8(vld1q_u8(l0)));
+    } else {
+        uint8x8x2_t c;
+        c.val[0] = vld1_u8(l0);
+        c.val[1] = vld1_u8(l1);
+        vst2_u8(t, c);
+    }
+#elif defined(__SSE2__)
+    if (mode == GSC_TILE_COPY) {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(t),
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(l0)));
+    } else if (mode == GSC_TILE_SWAP) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(l0));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(t),
+                _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8)));
+    } else {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(t), _mm_unpacklo_epi8(
+                _mm_loadl_epi64(reinterpret_cast<const __m128i *>(l0)),
+                _mm_loadl_epi64(reinterpret_cast<const __m128i *>(l1))));
+    }
+#else
+    if (mode == GSC_TILE_COPY) {
+        memcpy(t, l0, GSC_TILE_SIZE);
+    } else if (mode == GSC_TILE_SWAP) {
+        for (unsigned int i = 0; i < GSC_TILE_SIZE; i++)
+            t[i] = l0[i ^ 1];
+    } else {
+        for (unsigned int i = 0; i < GSC_TILE_SIZE / 2; i++) {
+            t[i * 2] = l0[i];
+            t[i * 2 + 1] = l1[i];
+        }
+    }
+#endif
+}
+
+/* linear addresses of byte x of row y of the tiled buffer */
+static inline void gsc_tile_lin(const GscTilePlane *p, unsigned int x,
+        unsigned int y, uint8_t **l0, uint8_t **l1)
+{
+    if (p->mode == GSC_TILE_SPLIT) {
+        *l0 = p->lin[0] + y * p->stride + x / 2;
+        *l1 = p->lin[1] + y * p->stride + x / 2;
+    } else {
+        *l0 = p->lin[0] + y * p->stride + x;
+        *l1 = NULL;
+    }
+}
+
+/*
+ * A tile cut by the right or bottom edge of the image: n bytes of its rows
+ * and vrows of its th rows are image. Byte by byte, as there are few.
+ */
+static void gsc_tile_edge(const GscTilePlane *p, bool retile, uint8_t *t,
+        unsigned int x0, unsigned int y0, unsigned int th,
+        unsigned int n, unsigned int vrows)
+{
+    for (unsigned int r = 0; r < (retile ? th : vrows); r++, t += GSC_TILE_SIZE) {
+        uint8_t *l[2];
+
+        // padding rows repeat the last row of the image
+        gsc_tile_lin(p, x0, y0 + gsc_tile_min(r, vrows - 1), &l[0], &l[1]);
+
+        for (unsigned int i = 0; i < (retile ? GSC_TILE_SIZE : n); i++) {
+            // and padding samples the last sample of the row
+            unsigned int s = (i < n) ? i : n - p->unit + (i % p->unit);
+            uint8_t *b;
+
+            if (p->mode == GSC_TILE_SPLIT)
+                b = l[s & 1] + (s >> 1);
+            else if (p->mode == GSC_TILE_SWAP)
+                b = l[0] + (s ^ 1);
+            else
+                b = l[0] + s;
+
+            if (retile)
+                t[i] = *b;
+            else
+                *b = t[i];
+        }
+    }
+}
+
+/*
+ * One band, tile by tile. The tiles are read or written in the order they
+ * are in memory, and the 16 linear rows of the band stay in the cache
+ * while it is done.
+ */
+static void gsc_tile_band(const GscTilePlane *p, unsigned int band, bool retile)
+{
+    unsigned int y0 = band * GSC_TILE_SIZE;
+    unsigned int th = gsc_tile_min(GSC_TILE_SIZE, p->rows - y0);
+    unsigned int vrows = (p->vh > y0) ? gsc_tile_min(th, p->vh - y0) : 0;
+    uint8_t *t = p->tiled + y0 * p->width;
+
+    if (vrows == 0)
+        return;
+
+    for (unsigned int x0 = 0; x0 < p->width; x0 += GSC_TILE_SIZE) {
+        unsigned int n = (p->vw > x0) ? gsc_tile_min(GSC_TILE_SIZE, p->vw - x0) : 0;
+
+        if (n == 0)
+            break;
+
+        if (n < GSC_TILE_SIZE || vrows < th) {
+            gsc_tile_edge(p, retile, t, x0, y0, th, n, vrows);
+        } else {
+            uint8_t *l0, *l1;
+            uint8_t *row = t;
+
+            gsc_tile_lin(p, x0, y0, &l0, &l1);
+            for (unsigned int r = 0; r < th; r++, row += GSC_TILE_SIZE) {
+                if (retile)
+                    gsc_tile_retile_row(p->mode, row, l0, l1);
+                else
+                    gsc_tile_detile_row(p->mode, row, l0, l1);
+                l0 += p->stride;
+                if (l1 != NULL)
+                    l1 += p->stride;
+            }
+        }
+
+        t += GSC_TILE_SIZE * th;
+    }
+}
+
+static void *gsc_tile_worker(void *arg)
+{
+    GscTileJob *job = reinterpret_cast<GscTileJob *>(arg);
+
+    for (unsigned int i = 0; i < job->planes; i++) {
+        const GscTilePlane *p = &job->plane[i];
+        unsigned int bands = (p->rows + GSC_TILE_SIZE - 1) / GSC_TILE_SIZE;
+        unsigned int first = bands * job->index / job->count;
+        unsigned int last = bands * (job->index + 1) / job->count;
+
+        for (unsigned int b = first; b < last; b++)
+            gsc_tile_band(p, b, job->retile);
+    }
+
+    return NULL;
+}
+
+/*
+ * Finds where every component of both frames is, and runs the bands of
+ * the Y and CbCr buffers on the threads.
+ */
+static bool gsc_tile_run(const GscCscFrame *tiled, const GscCscFrame *lin,
+        bool retile, unsigned int threads)
+{
+    const GscTileLinFormat *lfmt = NULL;
+    const ExynosFmtDesc *tdesc, *ldesc;
+    ExynosFmtLayout tlayout, llayout;
+
+    for (size_t i = 0; i < sizeof(g_tile_lin) / sizeof(g_tile_lin[0]); i++) {
+        if (g_tile_lin[i].fourcc == lin->v4l2_colorformat)
+            lfmt = &g_tile_lin[i];
+    }
+
+    tdesc = exynos_fmt_find(tiled->v4l2_colorformat);
+    ldesc = exynos_fmt_find(lin->v4l2_colorformat);
+    if (tiled->v4l2_colorformat != GSC_TILE_FOURCC || lfmt == NULL ||
+            tdesc == NULL || ldesc == NULL) {
+        ALOGE("%s::unsupported conversion 0x%x <-> 0x%x", __func__,
+                tiled->v4l2_colorformat, lin->v4l2_colorformat);
+        return false;
+    }
+
+    if (tiled->width == 0 || tiled->height == 0 ||
+            tiled->width != lin->width || tiled->height != lin->height) {
+        ALOGE("%s::invalid size %ux%u <-> %ux%u", __func__,
+                tiled->width, tiled->height, lin->width, lin->height);
+        return false;
+    }
+
+    exynos_fmt_get_layout(tdesc, tiled->width, tiled->height, &tlayout);
+    exynos_fmt_get_layout(ldesc, lin->width, lin->height, &llayout);
+
+    for (unsigned int c = 0; c < tdesc->components; c++) {
+        if (tiled->addr[tlayout.plane[c]] == NULL) {
+            ALOGE("%s::no address for tiled plane %u", __func__,
+                    tlayout.plane[c]);
+            return false;
+        }
+    }
+    for (unsigned int c = 0; c < ldesc->components; c++) {
+        if (lin->addr[llayout.plane[c]] == NULL) {
+            ALOGE("%s::no address for linear plane %u", __func__,
+                    llayout.plane[c]);
+            return false;
+        }
+    }
+
+    uint8_t *lbase[GSC_CSC_MAX_PLANES];
+    unsigned int ah = EXYNOS_FMT_ALIGN(tiled->height, tdesc->halign);
+    GscTilePlane plane[2];
+
+    for (unsigned int c = 0; c < ldesc->components; c++)
+        lbase[c] = reinterpret_cast<uint8_t *>(lin->addr[llayout.plane[c]]) +
+                   llayout.offset[c];
+
+    for (unsigned int c = 0; c < 2; c++) {
+        GscTilePlane *p = &plane[c];
+
+        p->tiled = reinterpret_cast<uint8_t *>(tiled->addr[tlayout.plane[c]]) +
+                   tlayout.offset[c];
+        p->width = tlayout.stride[c];
+        p->rows = c ? ah / 2 : ah;
+        p->stride = llayout.stride[c];
+        p->vw = c ? (tiled->width + 1) / 2 * 2 : tiled->width;
+        p->vh = c ? (tiled->height + 1) / 2 : tiled->height;
+        p->unit = c ? 2 : 1;
+        p->mode = c ? lfmt->mode : GSC_TILE_COPY;
+        p->lin[0] = lbase[c];
+        p->lin[1] = NULL;
+    }
+
+    if (lfmt->mode == GSC_TILE_SPLIT) {
+        plane[1].lin[0] = lfmt->swap ? lbase[2] : lbase[1];
+        plane[1].lin[1] = lfmt->swap ? lbase[1] : lbase[2];
+    }
+
+    if (threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (cpus > 0) ? cpus : 1;
+    }
+    threads = gsc_tile_min(threads, GSC_TILE_MAX_THREADS);
+    threads = gsc_tile_min(threads, ah / GSC_TILE_SIZE / GSC_TILE_MIN_BANDS);
+    if (threads == 0)
+        threads = 1;
+
+    GscTileJob job[GSC_TILE_MAX_THREADS];
+    bool started[GSC_TILE_MAX_THREADS];
+
+    for (unsigned int i = 0; i < threads; i++) {
+        job[i].plane = plane;
+        job[i].planes = 2;
+        job[i].retile = retile;
+        job[i].index = i;
+        job[i].count = threads;
+        started[i] = (i > 0) &&
+            (pthread_create(&job[i].thread, NULL, gsc_tile_worker, &job[i]) == 0);
+    }
+
+    // the calling thread takes the first share, and any a thread was not
+    // started for
+    for (unsigned int i = 0; i < threads; i++) {
+        if (!started[i])
+            gsc_tile_worker(&job[i]);
+    }
+
+    for (unsigned int i = 1; i < threads; i++) {
+        if (started[i])
+            pthread_join(job[i].thread, NULL);
+    }
+
+    return true;
+}
+
+CGscTileSW::CGscTileSW()
+    : m_threads(0)
+{
+}
+
+void CGscTileSW::SetThreads(unsigned int threads)
+{
+    m_threads = gsc_tile_min(threads, GSC_TILE_MAX_THREADS);
+}
+
+bool CGscTileSW::Detile(const GscCscFrame *src, const GscCscFrame *dst)
+{
+    return gsc_tile_run(src, dst, false, m_threads);
+}
+
+bool CGscTileSW::Retile(const GscCscFrame *src, const GscCscFrame *dst)
+{
+    return gsc_tile_run(dst, src, true, m_threads);
+}
+
+int exynos_gsc_sw_detile(const GscCscFrame *src, const GscCscFrame *dst)
+{
+    CGscTileSW tile;
+
+    if (src == NULL || dst == NULL) {
+        ALOGE("%s::frame == NULL() fail", __func__);
+        return -1;
+    }
+
+    if (!tile.Detile(src, dst)) {
+        ALOGE("%s::Detile() fail", __func__);
+        return -1;
+    }
+
+    return 0;
+}
+
+int exynos_gsc_sw_retile(const GscCscFrame *src, const GscCscFrame *dst)
+{
+    CGscTileSW tile;
+
+    if (src == NULL || dst == NULL) {
+        ALOGE("%s::frame == NULL() fail", __func__);
+        return -1;
+    }
+
+    if (!tile.Retile(src, dst)) {
+        ALOGE("%s::Retile() fail", __func__);
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      libgscaler_tile.h
+ * \brief     header file for the NV12MT_16X16 tiling converter
+ */
+
+#ifndef LIBGSCALER_TILE_H_
+#define LIBGSCALER_TILE_H_
+
+#include <sys/cdefs.h>
+
+#include "libgscaler_csc.h"
+
+#define GSC_TILE_SIZE           16
+#define GSC_TILE_MAX_THREADS    4
+
+/*
+ * CPU conversion between V4L2_PIX_FMT_NV12MT_16X16, the tiled output of
+ * the MFC, and NV12, NV21, NV12M, NV21M, YUV420(M) and YVU420(M) of the
+ * same size, for consumers that would otherwise need a G-Scaler pass to
+ * read a decoded frame.
+ *
+ * The tiled frame has the buffers exynos_fmt_get_layout() gives for the
+ * format: Y then CbCr, both as wide as the width aligned to 16 and as
+ * tall as the aligned height and half of it. Each buffer is cut into
+ * bands of 16 rows, and a band holds its 16 byte wide tiles one after the
+ * other, a tile being its rows one after the other. The last CbCr band is
+ * only 8 rows tall when the aligned height is not a multiple of 32, and so
+ * are its tiles.
+ *
+ * Only the width x height image is read from or written to the linear
+ * frame. Retile() fills the padding of the edge tiles with the last
+ * column and row of the image.
+ *
+ * The bands are spread over up to GSC_TILE_MAX_THREADS threads, the
+ * calling one included; small frames stay on the calling thread.
+ */
+class CGscTileSW {
+    unsigned int m_threads;
+
+public:
+    CGscTileSW();
+
+    // 0 picks the number of online CPUs, up to GSC_TILE_MAX_THREADS
+    void SetThreads(unsigned int threads);
+    bool Detile(const GscCscFrame *src, const GscCscFrame *dst);
+    bool Retile(const GscCscFrame *src, const GscCscFrame *dst);
+};
+
+__BEGIN_DECLS
+
+/* NV12MT_16X16 src to the linear dst */
+int exynos_gsc_sw_detile(const GscCscFrame *src, const GscCscFrame *dst);
+/* linear src to NV12MT_16X16 dst */
+int exynos_gsc_sw_retile(const GscCscFrame *src, const GscCscFrame *dst);
+
+__END_DECLS
+
+#endif /* LIBGSCALER_TILE_H_ */
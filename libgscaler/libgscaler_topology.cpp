@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      libgscaler_topology.cpp
+ * \brief     source file for the cached media topology of the output path
+ */
+
+#include "libgscaler_topology.h"
+
+CGscTopology *CGscTopology::getInstance()
+{
+    static CGscTopology topology;
+
+    return &topology;
+}
+
+CGscTopology::CGscTopology()
+{
+    m_media = NULL;
+    for (int i = 0; i < NUM_OF_GSC_HW; i++) {
+        m_route[i].vd = NULL;
+        m_route[i].sd = NULL;
+        m_route[i].sink = NULL;
+        m_route[i].vd_linked = false;
+        m_route[i].busy = false;
+        m_fimd[i] = NULL;
+    }
+    m_mixer = NULL;
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+/* looks name up once; a subdev is opened along with it */
+media_entity *CGscTopology::findEntity(const char *name, bool subdev)
+{
+    media_entity *entity;
+
+    m_stats.lookups++;
+    entity = exynos_media_get_entity_by_name(m_media, name, strlen(name));
+    if (!entity) {
+        ALOGE("%s:: failed to get the %s entity", __func__, name);
+        return NULL;
+    }
+
+    if (subdev) {
+        entity->fd = exynos_subdev_open_devname(name, O_RDWR);
+        if (entity->fd < 0) {
+            ALOGE("%s:: failed to open the %s subdev", __func__, name);
+            entity->fd = -1;
+            return NULL;
+        }
+        m_stats.opens++;
+    }
+
+    return entity;
+}
+
+media_entity *CGscTopology::getSink(int dev_num, int out_mode)
+{
+    char devname[32];
+    media_entity **sink;
+
+    if (out_mode == GSC_OUT_FIMD) {
+        /* GSCX => FIMD_WINX */
+        sink = &m_fimd[dev_num];
+        snprintf(devname, sizeof(devname), PFX_FIMD_ENTITY, dev_num);
+    } else {
+        sink = &m_mixer;
+        snprintf(devname, sizeof(devname), PFX_MXR_ENTITY, 0);
+    }
+
+    if (*sink == NULL)
+        *sink = findEntity(devname, true);
+
+    return *sink;
+}
+
+/* sets every link from source to sink */
+bool CGscTopology::setupLinks(media_entity *source, media_entity *sink,
+    bool enable)
+{
+    struct media_link *links;
+
+    for (int i = 0; i < (int) source->num_links; i++) {
+        links = &source->links[i];
+
+        if (links == NULL ||
+            links->source->entity != source ||
+            links->sink->entity   != sink) {
+            continue;
+        } else if (exynos_media_setup_link(m_media, links->source,
+                    links->sink, enable ? MEDIA_LNK_FL_ENABLED : 0) < 0) {
+            ALOGE("%s::exynos_media_setup_link \
+                    [src.entity=%d->sink.entity=%d] failed",
+                    __func__, links->source->entity->info.id,
+                    links->sink->entity->info.id);
+            return false;
+        }
+        m_stats.links++;
+    }
+
+    return true;
+}
+
+bool CGscTopology::acquire(int dev_num, int out_mode, GscMdev *mdev)
+{
+    Mutex::Autolock lock(m_lock);
+    char devname[32];
+    unsigned int cap;
+
+    if (dev_num < 0 || dev_num >= NUM_OF_GSC_HW)
+        return false;
+
+    Route *route = &m_route[dev_num];
+    if (route->busy) {
+        ALOGE("%s::gsc%d output is in use", __func__, dev_num);
+        return false;
+    }
+
+    /* media0 */
+    if (m_media == NULL) {
+        snprintf(devname, sizeof(devname), "%s%d", PFX_NODE_MEDIADEV, 0);
+        m_media = exynos_media_open(devname);
+        if (m_media == NULL) {
+            ALOGE("%s::exynos_media_open failed (node=%s)", __func__, devname);
+            return false;
+        }
+        m_stats.opens++;
+    }
+
+    /* get GSC video dev & sub dev entity by name */
+#if defined(USES_DT)
+    switch (dev_num) {
+    case 0:
+        snprintf(devname, sizeof(devname), PFX_GSC_VIDEODEV_ENTITY0);
+        break;
+    case 1:
+        snprintf(devname, sizeof(devname), PFX_GSC_VIDEODEV_ENTITY1);
+        break;
+    case 2:
+        snprintf(devname, sizeof(devname), PFX_GSC_VIDEODEV_ENTITY2);
+        break;
+    }
+#else
+    snprintf(devname, sizeof(devname), PFX_GSC_VIDEODEV_ENTITY, dev_num);
+#endif
+    if (route->vd == NULL) {
+        route->vd = findEntity(devname, false);
+        if (route->vd == NULL)
+            return false;
+        route->vd->fd = -1;
+    }
+
+    if (route->sd == NULL) {
+        char sdname[32];
+
+        snprintf(sdname, sizeof(sdname), PFX_GSC_SUBDEV_ENTITY, dev_num);
+        route->sd = findEntity(sdname, true);
+        if (route->sd == NULL)
+            return false;
+    }
+
+    media_entity *sink = getSink(dev_num, out_mode);
+    if (sink == NULL)
+        return false;
+
+    /* setup link : GSC : video device --> sub device */
+    if (!route->vd_linked) {
+        if (!setupLinks(route->vd, route->sd, true))
+            return false;
+        route->vd_linked = true;
+    }
+
+    /*
+     * setup link : GSC: sub device --> sink device; an unlink that failed
+     * may have left it linked, possibly to the other sink
+     */
+    if (route->sink != sink) {
+        if (route->sink != NULL) {
+            if (!setupLinks(route->sd, route->sink, false))
+                return false;
+            route->sink = NULL;
+        }
+        if (!setupLinks(route->sd, sink, true))
+            return false;
+        route->sink = sink;
+    }
+
+    /* gsc video-dev open */
+    if (route->vd->fd < 0) {
+        /* DQBUF only blocks where the output path waits with poll() */
+        route->vd->fd = exynos_v4l2_open_devname(devname,
+                                                 O_RDWR | O_NONBLOCK);
+        if (route->vd->fd < 0) {
+            ALOGE("%s: gsc video-dev open fail", __func__);
+            route->vd->fd = -1;
+            goto err_unlink;
+        }
+        m_stats.opens++;
+
+        cap = V4L2_CAP_STREAMING | V4L2_CAP_VIDEO_OUTPUT_MPLANE;
+
+        if (exynos_v4l2_querycap(route->vd->fd, cap) == false) {
+            ALOGE("%s::exynos_v4l2_querycap() fail", __func__);
+            close(route->vd->fd);
+            route->vd->fd = -1;
+            goto err_unlink;
+        }
+    }
+
+    route->busy = true;
+    m_stats.acquired++;
+
+    mdev->media0 = m_media;
+    mdev->gsc_vd_entity = route->vd;
+    mdev->gsc_sd_entity = route->sd;
+    mdev->sink_sd_entity = route->sink;
+
+    return true;
+
+err_unlink:
+    /* unlink : gscaler-out --> fimd, it is kept only if this fails */
+    if (setupLinks(route->sd, route->sink, false))
+        route->sink = NULL;
+    return false;
+}
+
+void CGscTopology::release(GscMdev *mdev)
+{
+    Mutex::Autolock lock(m_lock);
+
+    for (int i = 0; i < NUM_OF_GSC_HW; i++) {
+        Route *route = &m_route[i];
+
+        if (!route->busy || route->vd != mdev->gsc_vd_entity)
+            continue;
+
+        /* unlink : gscaler-out --> fimd, so the node is free for m2m */
+        if (route->sink != NULL) {
+            setupLinks(route->sd, route->sink, false);
+            route->sink = NULL;
+        }
+
+        if (route->vd->fd >= 0) {
+            close(route->vd->fd);
+            route->vd->fd = -1;
+        }
+
+        route->busy = false;
+        break;
+    }
+
+    mdev->media0 = NULL;
+    mdev->gsc_sd_entity = NULL;
+    mdev->gsc_vd_entity = NULL;
+    mdev->sink_sd_entity = NULL;
+}
+
+void CGscTopology::getStats(GscTopologyStats *stats)
+{
+    Mutex::Autolock lock(m_lock);
+
+    *stats = m_stats;
+}
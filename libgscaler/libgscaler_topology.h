@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      libgscaler_topology.h
+ * \brief     header file for the cached media topology of the output path
+ */
+
+#ifndef LIBGSCALER_TOPOLOGY_H_
+#define LIBGSCALER_TOPOLOGY_H_
+
+#include <utils/Mutex.h>
+
+#include "libgscaler_obj.h"
+
+using namespace android;
+
+struct GscTopologyStats {
+    unsigned int acquired;      /* routes handed out */
+    unsigned int lookups;       /* entities searched for by name */
+    unsigned int opens;         /* media device, subdev and video opens */
+    unsigned int links;         /* link state changes */
+};
+
+/*
+ * Keeps the media device of the local output path open for the process,
+ * with the G-Scaler and sink entities it resolved and their subdevs, which
+ * m_gsc_output_create() used to do over for every overlay. The video node
+ * and the link to the sink are only held while the route is in use, so
+ * that an idle G-Scaler is free for m2m.
+ */
+class CGscTopology {
+public:
+    static CGscTopology *getInstance();
+
+    /*
+     * Fills mdev with the route from G-Scaler dev_num to the sink of
+     * out_mode, opened and linked. Returns false if it cannot be set up or
+     * is in use.
+     */
+    bool acquire(int dev_num, int out_mode, GscMdev *mdev);
+    /* Unlinks the route of mdev, closes its video node and clears mdev */
+    void release(GscMdev *mdev);
+    void getStats(GscTopologyStats *stats);
+
+private:
+    struct Route {
+        media_entity *vd;       /* G-Scaler video device */
+        media_entity *sd;       /* G-Scaler subdev */
+        media_entity *sink;     /* sink the subdev is linked to, if any */
+        bool          vd_linked;
+        bool          busy;
+    };
+
+    CGscTopology();
+    media_entity *findEntity(const char *name, bool subdev);
+    media_entity *getSink(int dev_num, int out_mode);
+    bool setupLinks(media_entity *source, media_entity *sink, bool enable);
+
+    Mutex            m_lock;
+    media_device    *m_media;
+    Route            m_route[NUM_OF_GSC_HW];
+    media_entity    *m_fimd[NUM_OF_GSC_HW];
+    media_entity    *m_mixer;
+    GscTopologyStats m_stats;
+};
+
+#endif /* LIBGSCALER_TOPOLOGY_H_ */
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      libgscaler_trace.cpp
+ * \brief     source file for the Gscaler HAL stage tracing
+ */
+
+#define LOG_TAG "libexynosgscaler"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cutils/atomic.h>
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include "libgscaler_trace.h"
+
+struct GscTraceEvent {
+    volatile int32_t seq;   /* 0 while being written, else gsc_trace_seq() */
+    int32_t          id;
+    int32_t          tid;
+    int32_t          fd;
+    int64_t          start;
+    int64_t          dur;
+};
+
+static const char *g_trace_name[GSC_TRACE_MAX] = {
+    "config", "run", "S_FMT", "S_CROP", "REQBUFS", "QBUF", "DQBUF",
+    "STREAMON", "STREAMOFF", "cp_enable", "cp_disable", "fence_wait",
+};
+
+static GscTraceEvent     g_trace[GSC_TRACE_EVENTS];
+static volatile uint32_t g_trace_head;  /* wraps; compared modulo 2^32 */
+static pthread_key_t    g_trace_tid_key;
+static pthread_once_t   g_trace_once = PTHREAD_ONCE_INIT;
+
+/* off until gsc_trace_init() has read the property */
+volatile int32_t gGscTraceOn;
+
+static void gsc_trace_init(void)
+{
+    char value[PROPERTY_VALUE_MAX];
+
+    pthread_key_create(&g_trace_tid_key, NULL);
+
+    property_get("debug.gscaler.trace", value, "1");
+    if (atoi(value) != 0)
+        android_atomic_release_store(1, &gGscTraceOn);
+}
+
+void GscTraceInit(void)
+{
+    pthread_once(&g_trace_once, gsc_trace_init);
+}
+
+/*
+ * The lap of idx around the ring with the low bit set: tells the events of
+ * one slot apart and is never 0, whatever the value of idx.
+ */
+static inline int32_t gsc_trace_seq(uint32_t idx)
+{
+    return (int32_t)((idx & ~(uint32_t)(GSC_TRACE_EVENTS - 1)) | 1);
+}
+
+/* gettid() is a system call, so remember it per thread */
+static int32_t gsc_trace_tid(void)
+{
+    int32_t tid;
+
+    GscTraceInit();
+
+    tid = (int32_t)(intptr_t)pthread_getspecific(g_trace_tid_key);
+    if (tid == 0) {
+        tid = gettid();
+        pthread_setspecific(g_trace_tid_key, (void *)(intptr_t)tid);
+    }
+
+    return tid;
+}
+
+void GscTraceRecord(int id, int fd, nsecs_t start, nsecs_t end)
+{
+    int32_t tid = gsc_trace_tid();
+    uint32_t idx = (uint32_t)android_atomic_inc(
+                            (volatile int32_t *)&g_trace_head);
+    GscTraceEvent *ev = &g_trace[idx & (GSC_TRACE_EVENTS - 1)];
+
+    ev->seq = 0;
+    android_memory_barrier();
+
+    ev->id    = id;
+    ev->tid   = tid;
+    ev->fd    = fd;
+    ev->start = start;
+    ev->dur   = end - start;
+
+    android_atomic_release_store(gsc_trace_seq(idx), &ev->seq);
+}
+
+void exynos_gsc_trace_enable(int enable)
+{
+    GscTraceInit();
+
+    android_atomic_release_store(enable ? 1 : 0, &gGscTraceOn);
+}
+
+int exynos_gsc_trace_dump(int fd)
+{
+    uint32_t head = (uint32_t)android_atomic_acquire_load(
+                            (volatile int32_t *)&g_trace_head);
+    pid_t pid = getpid();
+    int count = 0;
+
+    if (dprintf(fd, "{\"traceEvents\":[") < 0) {
+        ALOGE("%s::write fail", __func__);
+        return -1;
+    }
+
+    /*
+     * The last GSC_TRACE_EVENTS indexes before head; those never recorded
+     * yet, or being rewritten by a concurrent record, fail the seq check.
+     */
+    for (uint32_t n = 0; n < GSC_TRACE_EVENTS; n++) {
+        uint32_t i = head - GSC_TRACE_EVENTS + n;
+        GscTraceEvent *slot = &g_trace[i & (GSC_TRACE_EVENTS - 1)];
+        GscTraceEvent ev;
+
+        ev.seq = android_atomic_acquire_load(&slot->seq);
+        if (ev.seq != gsc_trace_seq(i))
+            continue;
+        ev.id    = slot->id;
+        ev.tid   = slot->tid;
+        ev.fd    = slot->fd;
+        ev.start = slot->start;
+        ev.dur   = slot->dur;
+        android_memory_barrier();
+        if (slot->seq != ev.seq || ev.id < 0 || ev.id >= GSC_TRACE_MAX)
+            continue;
+
+        dprintf(fd, "%s\n{\"name\":\"%s\",\"cat\":\"gscaler\",\"ph\":\"X\","
+                "\"ts\":%lld.%03lld,\"dur\":%lld.%03lld,\"pid\":%d,\"tid\":%d,"
+                "\"args\":{\"fd\":%d}}",
+                count ? "," : "", g_trace_name[ev.id],
+                ev.start / 1000, ev.start % 1000,
+                ev.dur / 1000, ev.dur % 1000,
+                pid, ev.tid, ev.fd);
+        count++;
+    }
+
+    dprintf(fd, "\n]}\n");
+
+    return count;
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      libgscaler_trace.h
+ * \brief     header file for the Gscaler HAL stage tracing
+ */
+
+#ifndef LIBGSCALER_TRACE_H_
+#define LIBGSCALER_TRACE_H_
+
+#include <sys/cdefs.h>
+#include <utils/Timers.h>
+
+/* events kept by the per-process ring; must be a power of 2 */
+#define GSC_TRACE_EVENTS    4096
+
+enum {
+    GSC_TRACE_CONFIG,
+    GSC_TRACE_RUN,
+    GSC_TRACE_S_FMT,
+    GSC_TRACE_S_CROP,
+    GSC_TRACE_REQBUFS,
+    GSC_TRACE_QBUF,
+    GSC_TRACE_DQBUF,
+    GSC_TRACE_STREAMON,
+    GSC_TRACE_STREAMOFF,
+    GSC_TRACE_CP_ENABLE,
+    GSC_TRACE_CP_DISABLE,
+    GSC_TRACE_FENCE_WAIT,   /* from arming a fence to its signal */
+    GSC_TRACE_MAX,
+};
+
+extern volatile int32_t gGscTraceOn;
+
+/* reads debug.gscaler.trace once, before the first event */
+void GscTraceInit(void);
+void GscTraceRecord(int id, int fd, nsecs_t start, nsecs_t end);
+
+static inline bool GscTraceOn(void)
+{
+    GscTraceInit();
+    return gGscTraceOn != 0;
+}
+
+/*
+ * Records one complete event of the enclosing scope. Recording costs two
+ * clock reads, an atomic add and a 32 byte store; nothing is logged.
+ */
+class GscTraceScope {
+public:
+    GscTraceScope(int id, int fd) : m_id(id), m_fd(fd), m_start(0) {
+        if (GscTraceOn())
+            m_start = systemTime(SYSTEM_TIME_MONOTONIC);
+    }
+    ~GscTraceScope() {
+        if (m_start)
+            GscTraceRecord(m_id, m_fd, m_start,
+                           systemTime(SYSTEM_TIME_MONOTONIC));
+    }
+
+private:
+    int     m_id;
+    int     m_fd;
+    nsecs_t m_start;
+};
+
+#define GSC_TRACE_CAT2(a, b) a##b
+#define GSC_TRACE_CAT(a, b)  GSC_TRACE_CAT2(a, b)
+#define GSC_TRACE(id, fd) \
+    GscTraceScope GSC_TRACE_CAT(gsc_trace_, __LINE__)(id, fd)
+
+__BEGIN_DECLS
+
+/* tracing is on by default; debug.gscaler.trace=0 turns it off at start */
+void exynos_gsc_trace_enable(int enable);
+
+/*
+ * Writes the events in the ring to fd as Chrome trace JSON, oldest first.
+ * Returns the number of events written or -1.
+ */
+int exynos_gsc_trace_dump(int fd);
+
+__END_DECLS
+
+#endif /* LIBGSCALER_TRACE_H_ */
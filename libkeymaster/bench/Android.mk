@@ -0,0 +1,43 @@
+# Copyright (C) 2012 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH := $(call my-dir)
+
+
+include $(CLEAR_VARS)
+
+MOBICORE_PATH := hardware/samsung_slsi/$(TARGET_SOC)/mobicore
+
+# the HAL is built in against fake_mobicore.cpp instead of libMcClient
+LOCAL_MODULE := keymaster_bench
+LOCAL_SRC_FILES := \
+	../keymaster_mobicore.cpp \
+	../tlcTeeKeymaster_if.c \
+	fake_mobicore.cpp \
+	fake_trustlet.cpp \
+	keymaster_bench.cpp
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/.. \
+	$(MOBICORE_PATH)/daemon/ClientLib/public \
+	$(MOBICORE_PATH)/common/MobiCore/inc/ \
+	system/keymaster/include
+LOCAL_CFLAGS := -Wall -Werror
+LOCAL_SHARED_LIBRARIES := libcrypto-host
+LOCAL_STATIC_LIBRARIES := libutils liblog libcutils
+LOCAL_LDLIBS := -lpthread -lrt
+LOCAL_MODULE_TAGS := optional
+# the connector hands the trustlet 32 bit addresses, as on the device
+LOCAL_MULTILIB := 32
+
+include $(BUILD_HOST_EXECUTABLE)
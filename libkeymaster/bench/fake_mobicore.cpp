@@ -0,0 +1,383 @@
+/*
+ * Copyright (C) 2012 Samsung Electronics Co., LTD
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * User-space stand-in for libMcClient. keymaster_bench links the keymaster
+ * HAL against these definitions, so the TCI commands of the connector are
+ * served in-process by the software trustlet of fake_trustlet.cpp.
+ *
+ * Bulk mappings get secure addresses of their own, like on the device, and
+ * the trustlet only reaches the memory of a command through them.
+ */
+
+#define LOG_TAG "fake_mobicore"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <cutils/log.h>
+#include <utils/Mutex.h>
+
+#include "MobiCoreDriverApi.h"
+#include "fake_mobicore.h"
+
+using namespace android;
+
+#define FAKE_MC_MAX_SESSIONS    16
+#define FAKE_MC_MAX_MAPS        32
+#define FAKE_MC_PAGE_SIZE       4096
+/* first secure address given to a bulk mapping */
+#define FAKE_MC_SADDR_BASE      0x00100000
+
+struct FakeMcMap {
+    bool     used;
+    uint8_t  *buf;
+    uint32_t len;
+    uint32_t sAddr;
+};
+
+struct FakeMcSession {
+    bool         used;
+    tciMessage_t *tci;
+    uint32_t     tciLen;
+    bool         notified;      /* the trustlet answered since last wait */
+    uint32_t     nextAddr;
+    FakeMcMap    map[FAKE_MC_MAX_MAPS];
+};
+
+static Mutex         g_lock;
+/* the one secure world, running one command at a time */
+static Mutex         g_secure;
+static unsigned int  g_device_refs;
+static unsigned int  g_max_sessions = FAKE_MC_MAX_SESSIONS;
+static FakeMcSession g_session[FAKE_MC_MAX_SESSIONS];
+static FakeMcStats   g_stats;
+static FakeMcCost    g_cost = {
+    500000,         /* open_device */
+    2000000,        /* open_session: loading and starting the trustlet */
+    20000,          /* map */
+    40000,          /* notify */
+};
+
+static void fake_mc_spin(nsecs_t cost)
+{
+    nsecs_t end = systemTime(SYSTEM_TIME_MONOTONIC) + cost;
+
+    while (systemTime(SYSTEM_TIME_MONOTONIC) < end)
+        ;
+}
+
+/* called with g_lock held */
+static FakeMcSession *fake_mc_session(const mcSessionHandle_t *session)
+{
+    if (session == NULL || g_device_refs == 0 ||
+            session->sessionId == 0 || session->sessionId > FAKE_MC_MAX_SESSIONS)
+        return NULL;
+
+    FakeMcSession *s = &g_session[session->sessionId - 1];
+
+    return s->used ? s : NULL;
+}
+
+/* runs in the secure world, with g_secure held */
+static void *fake_mc_translate(void *session, uint32_t sAddr, uint32_t len)
+{
+    FakeMcSession *s = reinterpret_cast<FakeMcSession *>(session);
+    Mutex::Autolock lock(g_lock);
+
+    for (int i = 0; i < FAKE_MC_MAX_MAPS; i++) {
+        FakeMcMap *m = &s->map[i];
+
+        if (!m->used || sAddr < m->sAddr || sAddr - m->sAddr > m->len ||
+                len > m->len - (sAddr - m->sAddr))
+            continue;
+
+        return m->buf + (sAddr - m->sAddr);
+    }
+
+    return NULL;
+}
+
+void fake_mc_set_cost(const FakeMcCost *cost)
+{
+    Mutex::Autolock lock(g_lock);
+    g_cost = *cost;
+}
+
+void fake_mc_get_cost(FakeMcCost *cost)
+{
+    Mutex::Autolock lock(g_lock);
+    *cost = g_cost;
+}
+
+void fake_mc_get_stats(FakeMcStats *stats)
+{
+    Mutex::Autolock lock(g_lock);
+    *stats = g_stats;
+}
+
+void fake_mc_reset_stats(void)
+{
+    Mutex::Autolock lock(g_lock);
+    memset(&g_stats, 0, sizeof(g_stats));
+}
+
+void fake_mc_set_max_sessions(unsigned int max)
+{
+    Mutex::Autolock lock(g_lock);
+    g_max_sessions = (max < FAKE_MC_MAX_SESSIONS) ? max : FAKE_MC_MAX_SESSIONS;
+}
+
+mcResult_t mcOpenDevice(uint32_t deviceId)
+{
+    if (deviceId != MC_DEVICE_ID_DEFAULT)
+        return MC_DRV_ERR_UNKNOWN_DEVICE;
+
+    fake_mc_spin(g_cost.open_device);
+
+    Mutex::Autolock lock(g_lock);
+    g_device_refs++;
+    g_stats.device_opens++;
+
+    return MC_DRV_OK;
+}
+
+mcResult_t mcCloseDevice(uint32_t deviceId)
+{
+    Mutex::Autolock lock(g_lock);
+
+    if (deviceId != MC_DEVICE_ID_DEFAULT || g_device_refs == 0)
+        return MC_DRV_ERR_UNKNOWN_DEVICE;
+
+    if (g_device_refs == 1) {
+        for (int i = 0; i < FAKE_MC_MAX_SESSIONS; i++) {
+            if (g_session[i].used)
+                return MC_DRV_ERR_SESSION_PENDING;
+        }
+    }
+
+    g_device_refs--;
+
+    return MC_DRV_OK;
+}
+
+mcResult_t mcMallocWsm(uint32_t deviceId, uint32_t, uint32_t len,
+        uint8_t **wsm, uint32_t)
+{
+    if (deviceId != MC_DEVICE_ID_DEFAULT || wsm == NULL || len == 0)
+        return MC_DRV_ERR_INVALID_PARAMETER;
+
+    {
+        Mutex::Autolock lock(g_lock);
+        if (g_device_refs == 0)
+            return MC_DRV_ERR_UNKNOWN_DEVICE;
+        g_stats.wsm_allocs++;
+    }
+
+    *wsm = reinterpret_cast<uint8_t *>(calloc(1, len));
+
+    return (*wsm != NULL) ? MC_DRV_OK : MC_DRV_ERR_NO_FREE_MEMORY;
+}
+
+mcResult_t mcFreeWsm(uint32_t deviceId, uint8_t *wsm)
+{
+    if (deviceId != MC_DEVICE_ID_DEFAULT || wsm == NULL)
+        return MC_DRV_ERR_INVALID_PARAMETER;
+
+    free(wsm);
+
+    return MC_DRV_OK;
+}
+
+mcResult_t mcOpenSession(mcSessionHandle_t *session, const mcUuid_t *uuid,
+        uint8_t *tci, uint32_t tciLen)
+{
+    static const mcUuid_t tl_uuid = TEE_KEYMASTER_TL_UUID;
+
+    if (session == NULL || uuid == NULL || tci == NULL ||
+            tciLen < sizeof(tciMessage_t))
+        return MC_DRV_ERR_INVALID_PARAMETER;
+
+    if (memcmp(uuid, &tl_uuid, sizeof(tl_uuid)) != 0)
+        return MC_DRV_ERR_INVALID_OPERATION;
+
+    fake_mc_spin(g_cost.open_session);
+
+    Mutex::Autolock lock(g_lock);
+
+    if (g_device_refs == 0)
+        return MC_DRV_ERR_UNKNOWN_DEVICE;
+
+    unsigned int open = 0;
+    for (int i = 0; i < FAKE_MC_MAX_SESSIONS; i++) {
+        if (g_session[i].used)
+            open++;
+    }
+    if (open >= g_max_sessions)
+        return MC_DRV_ERR_OUT_OF_RESOURCES;
+
+    for (int i = 0; i < FAKE_MC_MAX_SESSIONS; i++) {
+        FakeMcSession *s = &g_session[i];
+
+        if (s->used)
+            continue;
+
+        memset(s, 0, sizeof(*s));
+        s->used = true;
+        s->tci = reinterpret_cast<tciMessage_t *>(tci);
+        s->tciLen = tciLen;
+        s->nextAddr = FAKE_MC_SADDR_BASE;
+        session->sessionId = i + 1;
+        g_stats.session_opens++;
+
+        return MC_DRV_OK;
+    }
+
+    return MC_DRV_ERR_OUT_OF_RESOURCES;
+}
+
+mcResult_t mcCloseSession(mcSessionHandle_t *session)
+{
+    /* the trustlet instance goes away with the session */
+    Mutex::Autolock secure(g_secure);
+    Mutex::Autolock lock(g_lock);
+
+    FakeMcSession *s = fake_mc_session(session);
+    if (s == NULL)
+        return MC_DRV_ERR_UNKNOWN_SESSION;
+
+    for (int i = 0; i < FAKE_MC_MAX_MAPS; i++) {
+        if (s->map[i].used)
+            ALOGW("session %u closed with %u bytes mapped at 0x%08x",
+                    session->sessionId, s->map[i].len, s->map[i].sAddr);
+    }
+
+    fake_tl_close(s);
+    s->used = false;
+
+    return MC_DRV_OK;
+}
+
+mcResult_t mcNotify(mcSessionHandle_t *session)
+{
+    FakeMcSession *s;
+
+    {
+        Mutex::Autolock lock(g_lock);
+
+        s = fake_mc_session(session);
+        if (s == NULL)
+            return MC_DRV_ERR_UNKNOWN_SESSION;
+        g_stats.notifies++;
+    }
+
+    /* the trustlet answers before the world switch returns */
+    {
+        Mutex::Autolock secure(g_secure);
+
+        fake_mc_spin(g_cost.notify);
+        fake_tl_handle(s->tci, fake_mc_translate, s);
+    }
+
+    Mutex::Autolock lock(g_lock);
+    s->notified = true;
+
+    return MC_DRV_OK;
+}
+
+mcResult_t mcWaitNotification(mcSessionHandle_t *session, int32_t)
+{
+    Mutex::Autolock lock(g_lock);
+
+    FakeMcSession *s = fake_mc_session(session);
+    if (s == NULL)
+        return MC_DRV_ERR_UNKNOWN_SESSION;
+
+    /* nothing runs in the background, so waiting longer would not help */
+    if (!s->notified)
+        return MC_DRV_ERR_TIMEOUT;
+
+    s->notified = false;
+
+    return MC_DRV_OK;
+}
+
+mcResult_t mcMap(mcSessionHandle_t *session, void *buf, uint32_t len,
+        mcBulkMap_t *mapInfo)
+{
+    if (buf == NULL || len == 0 || mapInfo == NULL)
+        return MC_DRV_ERR_INVALID_PARAMETER;
+
+    fake_mc_spin(g_cost.map);
+
+    Mutex::Autolock lock(g_lock);
+
+    FakeMcSession *s = fake_mc_session(session);
+    if (s == NULL)
+        return MC_DRV_ERR_UNKNOWN_SESSION;
+
+    for (int i = 0; i < FAKE_MC_MAX_MAPS; i++) {
+        FakeMcMap *m = &s->map[i];
+        uint32_t offset = reinterpret_cast<uintptr_t>(buf) & (FAKE_MC_PAGE_SIZE - 1);
+
+        if (m->used)
+            continue;
+
+        /* whole pages are mapped; the offset into the first one is kept */
+        m->used = true;
+        m->buf = reinterpret_cast<uint8_t *>(buf);
+        m->len = len;
+        m->sAddr = s->nextAddr + offset;
+        s->nextAddr += (offset + len + FAKE_MC_PAGE_SIZE - 1) & ~(FAKE_MC_PAGE_SIZE - 1);
+
+        mapInfo->sVirtualAddr = reinterpret_cast<void *>(static_cast<uintptr_t>(m->sAddr));
+        mapInfo->sVirtualLen = len;
+        g_stats.maps++;
+
+        return MC_DRV_OK;
+    }
+
+    return MC_DRV_ERR_BULK_MAPPING;
+}
+
+mcResult_t mcUnmap(mcSessionHandle_t *session, void *buf, mcBulkMap_t *mapInfo)
+{
+    if (buf == NULL || mapInfo == NULL)
+        return MC_DRV_ERR_INVALID_PARAMETER;
+
+    fake_mc_spin(g_cost.map);
+
+    Mutex::Autolock lock(g_lock);
+
+    FakeMcSession *s = fake_mc_session(session);
+    if (s == NULL)
+        return MC_DRV_ERR_UNKNOWN_SESSION;
+
+    uint32_t sAddr = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(mapInfo->sVirtualAddr));
+
+    for (int i = 0; i < FAKE_MC_MAX_MAPS; i++) {
+        FakeMcMap *m = &s->map[i];
+
+        if (m->used && m->buf == buf && m->sAddr == sAddr) {
+            m->used = false;
+            g_stats.unmaps++;
+            return MC_DRV_OK;
+        }
+    }
+
+    return MC_DRV_ERR_BULK_UNMAPPING;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2012 Samsung Electronics Co., LTD
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * In-process stand-in for libMcClient and the TEE Keymaster trustlet,
+ * used by keymaster_bench to run the keymaster HAL off the device.
+ */
+
+#ifndef FAKE_MOBICORE_H_
+#define FAKE_MOBICORE_H_
+
+#include <stdint.h>
+
+#include <utils/Timers.h>
+
+#include "tlTeeKeymaster_Api.h"
+
+/*
+ * Cost model of the stand-in, burnt on the calling thread. 'notify' is a
+ * round trip to the secure world and is paid with the secure world held,
+ * as there is a single one for all sessions, together with the time the
+ * software trustlet takes for the command.
+ */
+struct FakeMcCost {
+    nsecs_t open_device;
+    nsecs_t open_session;
+    nsecs_t map;
+    nsecs_t notify;
+};
+
+struct FakeMcStats {
+    unsigned int device_opens;
+    unsigned int session_opens;
+    unsigned int maps;
+    unsigned int unmaps;
+    unsigned int notifies;
+    unsigned int wsm_allocs;
+};
+
+void fake_mc_set_cost(const FakeMcCost *cost);
+void fake_mc_get_cost(FakeMcCost *cost);
+void fake_mc_get_stats(FakeMcStats *stats);
+void fake_mc_reset_stats(void);
+/* sessions the TEE lets be open at once */
+void fake_mc_set_max_sessions(unsigned int max);
+
+/*
+ * Software trustlet, fake_trustlet.cpp. fake_tl_map() gives the normal
+ * world address of 'len' bytes at secure address 'sAddr' of the session,
+ * or NULL if they are not mapped.
+ */
+typedef void *(*FakeTlMapFn)(void *session, uint32_t sAddr, uint32_t len);
+
+void fake_tl_handle(tciMessage_t *msg, FakeTlMapFn fake_tl_map, void *session);
+/* drops what the trustlet instance of the session holds */
+void fake_tl_close(void *session);
+
+#endif /* FAKE_MOBICORE_H_ */
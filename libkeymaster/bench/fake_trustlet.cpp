@@ -0,0 +1,1247 @@
+/*
+ * Copyright (C) 2012 Samsung Electronics Co., LTD
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Software TEE Keymaster trustlet serving the CMD_ID_TEE_* commands of
+ * tlTeeKeymaster_Api.h with OpenSSL, for keymaster_bench.
+ *
+ * The secure objects it hands out are NOT encrypted: they are the key in
+ * the layout of TEE_KeyImport() or TEE_ECKeyImport() behind a small
+ * header. The stand-in is there to measure the normal world side, not
+ * to keep keys.
+ */
+
+#define LOG_TAG "fake_trustlet"
+
+#include <string.h>
+
+#include <openssl/bn.h>
+#include <openssl/crypto.h>
+#include <openssl/ec.h>
+#include <openssl/ecdsa.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/objects.h>
+#include <openssl/rand.h>
+#include <openssl/rsa.h>
+#include <openssl/sha.h>
+
+#include <cutils/log.h>
+
+#include "tlcTeeKeymaster_if.h"
+#include "fake_mobicore.h"
+
+#define FAKE_SO_MAGIC           0x4f534b46      /* "FKSO" */
+#define FAKE_SO_RSA             1
+#define FAKE_SO_HMAC            2
+#define FAKE_SO_EC              3
+
+#define FAKE_HMAC_KEY_SIZE      32
+/* as RSA_KEY_BUFFER_SIZE and RSA_KEY_MAX_SIZE of the HAL */
+#define FAKE_RSA_KEY_BUFFER     1536
+#define FAKE_RSA_MAX_BYTES      (2048 >> 3)
+/* metadata, P-521 point and private value */
+#define FAKE_EC_KEY_BUFFER      256
+/* streamed operations open at once, over all sessions */
+#define FAKE_TL_MAX_OPS         16
+
+struct FakeSoHeader {
+    uint32_t magic;
+    uint32_t kind;
+    uint32_t len;               /* of the key following the header */
+};
+
+/* wraps the key at 'key' into a secure object at 'so' */
+static uint32_t fake_tl_wrap(uint32_t kind, const uint8_t *key, uint32_t keyLen,
+        uint8_t *so, uint32_t *soLen)
+{
+    FakeSoHeader hdr;
+
+    if (*soLen < sizeof(hdr) + keyLen)
+        return RET_ERR_INVALID_LENGTH;
+
+    hdr.magic = FAKE_SO_MAGIC;
+    hdr.kind = kind;
+    hdr.len = keyLen;
+
+    memmove(so + sizeof(hdr), key, keyLen);
+    memcpy(so, &hdr, sizeof(hdr));
+    *soLen = sizeof(hdr) + keyLen;
+
+    return RET_OK;
+}
+
+static const uint8_t *fake_tl_unwrap(uint32_t kind, const uint8_t *so,
+        uint32_t soLen, uint32_t *keyLen)
+{
+    FakeSoHeader hdr;
+
+    if (soLen < sizeof(hdr))
+        return NULL;
+
+    memcpy(&hdr, so, sizeof(hdr));
+    if (hdr.magic != FAKE_SO_MAGIC || hdr.kind != kind ||
+            hdr.len > soLen - sizeof(hdr))
+        return NULL;
+
+    *keyLen = hdr.len;
+
+    return so + sizeof(hdr);
+}
+
+static BIGNUM *fake_tl_bn(const uint8_t **p, uint32_t len, const uint8_t *end)
+{
+    if (len > (uint32_t)(end - *p))
+        return NULL;
+
+    BIGNUM *bn = BN_bin2bn(*p, len, NULL);
+    *p += len;
+
+    return bn;
+}
+
+/* builds the RSA key of the TEE_KeyImport() layout */
+static RSA *fake_tl_rsa_from_key(const uint8_t *key, uint32_t keyLen)
+{
+    const uint8_t *end = key + keyLen;
+    const uint8_t *p = key;
+    teeRsaKeyMeta_t meta;
+
+    if (keyLen < sizeof(meta))
+        return NULL;
+
+    memcpy(&meta, key, sizeof(meta));
+    p += sizeof(meta);
+
+    RSA *rsa = RSA_new();
+    if (rsa == NULL)
+        return NULL;
+
+    rsa->n = fake_tl_bn(&p, meta.lenpubmod, end);
+    rsa->e = fake_tl_bn(&p, meta.lenpubexp, end);
+    if (meta.keytype == TEE_KEYPAIR_RSACRT) {
+        rsa->p = fake_tl_bn(&p, meta.rsacrtpriv.lenp, end);
+        rsa->q = fake_tl_bn(&p, meta.rsacrtpriv.lenq, end);
+        rsa->dmp1 = fake_tl_bn(&p, meta.rsacrtpriv.lendp, end);
+        rsa->dmq1 = fake_tl_bn(&p, meta.rsacrtpriv.lendq, end);
+        rsa->iqmp = fake_tl_bn(&p, meta.rsacrtpriv.lenqinv, end);
+    } else {
+        rsa->d = fake_tl_bn(&p, meta.rsapriv.lenpriexp, end);
+    }
+
+    if (rsa->n == NULL || rsa->e == NULL ||
+            (meta.keytype == TEE_KEYPAIR_RSACRT &&
+             (rsa->p == NULL || rsa->q == NULL || rsa->dmp1 == NULL ||
+              rsa->dmq1 == NULL || rsa->iqmp == NULL)) ||
+            (meta.keytype != TEE_KEYPAIR_RSACRT && rsa->d == NULL)) {
+        RSA_free(rsa);
+        return NULL;
+    }
+
+    /* CRT keys carry no private exponent; not every libcrypto copes */
+    if (rsa->d == NULL) {
+        BN_CTX *ctx = BN_CTX_new();
+        BIGNUM *p1 = BN_new();
+        BIGNUM *q1 = BN_new();
+        BIGNUM *phi = BN_new();
+
+        rsa->d = BN_new();
+        if (ctx == NULL || p1 == NULL || q1 == NULL || phi == NULL || rsa->d == NULL ||
+                !BN_sub(p1, rsa->p, BN_value_one()) ||
+                !BN_sub(q1, rsa->q, BN_value_one()) ||
+                !BN_mul(phi, p1, q1, ctx) ||
+                !BN_mod_inverse(rsa->d, rsa->e, phi, ctx)) {
+            RSA_free(rsa);
+            rsa = NULL;
+        }
+
+        BN_free(phi);
+        BN_free(q1);
+        BN_free(p1);
+        BN_CTX_free(ctx);
+    }
+
+    return rsa;
+}
+
+/* the reverse of fake_tl_rsa_from_key(), as exynos_km_import_keypair() */
+static uint32_t fake_tl_rsa_to_key(const RSA *rsa, uint32_t keyType,
+        uint8_t *key, uint32_t *keyLen)
+{
+    const BIGNUM *crt[5] = { rsa->p, rsa->q, rsa->dmp1, rsa->dmq1, rsa->iqmp };
+    uint32_t *crtLen[5];
+    teeRsaKeyMeta_t meta;
+    uint32_t len = sizeof(meta);
+
+    memset(&meta, 0, sizeof(meta));
+    crtLen[0] = &meta.rsacrtpriv.lenp;
+    crtLen[1] = &meta.rsacrtpriv.lenq;
+    crtLen[2] = &meta.rsacrtpriv.lendp;
+    crtLen[3] = &meta.rsacrtpriv.lendq;
+    crtLen[4] = &meta.rsacrtpriv.lenqinv;
+
+    uint32_t need = len + BN_num_bytes(rsa->n) + BN_num_bytes(rsa->e);
+    if (keyType == TEE_KEYPAIR_RSACRT) {
+        for (int i = 0; i < 5; i++)
+            need += BN_num_bytes(crt[i]);
+    } else {
+        need += BN_num_bytes(rsa->d);
+    }
+    if (need > *keyLen)
+        return RET_ERR_INVALID_LENGTH;
+
+    meta.keytype = keyType;
+    meta.keysize = BN_num_bits(rsa->n);
+    meta.lenpubmod = BN_bn2bin(rsa->n, key + len);
+    len += meta.lenpubmod;
+    meta.lenpubexp = BN_bn2bin(rsa->e, key + len);
+    len += meta.lenpubexp;
+
+    if (keyType == TEE_KEYPAIR_RSACRT) {
+        for (int i = 0; i < 5; i++) {
+            *crtLen[i] = BN_bn2bin(crt[i], key + len);
+            len += *crtLen[i];
+        }
+    } else {
+        meta.rsapriv.lenpriexp = BN_bn2bin(rsa->d, key + len);
+        len += meta.rsapriv.lenpriexp;
+    }
+
+    memcpy(key, &meta, sizeof(meta));
+    *keyLen = len;
+
+    return RET_OK;
+}
+
+static RSA *fake_tl_rsa_from_so(const uint8_t *so, uint32_t soLen)
+{
+    uint32_t keyLen;
+    const uint8_t *key = fake_tl_unwrap(FAKE_SO_RSA, so, soLen, &keyLen);
+
+    return (key != NULL) ? fake_tl_rsa_from_key(key, keyLen) : NULL;
+}
+
+static uint32_t fake_tl_rsa_gen(tciMessage_t *msg, FakeTlMapFn map, void *session)
+{
+    rsagenkey_t *cmd = &msg->rsagenkey;
+    uint8_t key[FAKE_RSA_KEY_BUFFER];
+    uint32_t keyLen = sizeof(key);
+    uint32_t ret = RET_ERR_KEY_GENERATION;
+
+    uint8_t *so = reinterpret_cast<uint8_t *>(map(session, cmd->keydata, cmd->keydatalen));
+    if (so == NULL)
+        return RET_ERR_INVALID_BUFFER;
+
+    if (cmd->keysize != TEE_RSA_KEY_SIZE_512 && cmd->keysize != TEE_RSA_KEY_SIZE_1024 &&
+            cmd->keysize != TEE_RSA_KEY_SIZE_2048)
+        return RET_ERR_INVALID_KEY_SIZE;
+    if (cmd->type != TEE_KEYPAIR_RSA && cmd->type != TEE_KEYPAIR_RSACRT)
+        return RET_ERR_INVALID_KEY_TYPE;
+    if (cmd->exponent < 3 || !(cmd->exponent & 1))
+        return RET_ERR_INVALID_EXPONENT;
+
+    RSA *rsa = RSA_new();
+    BIGNUM *e = BN_new();
+
+    if (rsa != NULL && e != NULL && BN_set_word(e, cmd->exponent) &&
+            RSA_generate_key_ex(rsa, cmd->keysize, e, NULL)) {
+        /* the trustlet wants p > q, see exynos_km_import_keypair() */
+        if (BN_cmp(rsa->p, rsa->q) < 0) {
+            BIGNUM *tmp = rsa->p;
+            BN_CTX *ctx = BN_CTX_new();
+
+            rsa->p = rsa->q;
+            rsa->q = tmp;
+            tmp = rsa->dmp1;
+            rsa->dmp1 = rsa->dmq1;
+            rsa->dmq1 = tmp;
+            if (ctx == NULL || !BN_mod_inverse(rsa->iqmp, rsa->q, rsa->p, ctx))
+                keyLen = 0;
+            BN_CTX_free(ctx);
+        }
+
+        if (keyLen != 0)
+            ret = fake_tl_rsa_to_key(rsa, cmd->type, key, &keyLen);
+    }
+
+    BN_free(e);
+    RSA_free(rsa);
+
+    if (ret == RET_OK) {
+        cmd->solen = cmd->keydatalen;
+        ret = fake_tl_wrap(FAKE_SO_RSA, key, keyLen, so, &cmd->solen);
+    }
+    OPENSSL_cleanse(key, sizeof(key));
+
+    return ret;
+}
+
+static const EVP_MD *fake_tl_rsa_md(uint32_t algorithm)
+{
+    switch (algorithm) {
+    case TEE_RSA_SHA_PKCS1:
+    case TEE_RSA_SHA1_PSS:
+        return EVP_sha1();
+    case TEE_RSA_SHA256_PSS:
+    case TEE_RSA_SHA256_PKCS1:
+        return EVP_sha256();
+    default:
+        return NULL;
+    }
+}
+
+static bool fake_tl_rsa_pkcs1(uint32_t algorithm)
+{
+    return algorithm == TEE_RSA_SHA_PKCS1 || algorithm == TEE_RSA_SHA256_PKCS1;
+}
+
+/* pads the digest for the algorithm and signs it into RSA_size() bytes at 'sig' */
+static uint32_t fake_tl_rsa_sign_hash(RSA *rsa, uint32_t algorithm,
+        const uint8_t *hash, unsigned int hashLen, uint8_t *sig)
+{
+    const EVP_MD *md = fake_tl_rsa_md(algorithm);
+    uint32_t size = RSA_size(rsa);
+    uint8_t em[FAKE_RSA_MAX_BYTES];
+
+    if (fake_tl_rsa_pkcs1(algorithm)) {
+        unsigned int sigLen = 0;
+
+        if (RSA_sign(EVP_MD_type(md), hash, hashLen, sig, &sigLen, rsa) && sigLen == size)
+            return RET_OK;
+    } else if (size <= sizeof(em) &&
+            RSA_padding_add_PKCS1_PSS(rsa, em, hash, md, -1) &&
+            RSA_private_encrypt(size, em, sig, rsa, RSA_NO_PADDING) == (int)size) {
+        return RET_OK;
+    }
+
+    return RET_ERR_SIGN;
+}
+
+static uint32_t fake_tl_rsa_verify_hash(RSA *rsa, uint32_t algorithm,
+        const uint8_t *hash, unsigned int hashLen,
+        const uint8_t *sig, uint32_t sigLen, bool *validity)
+{
+    const EVP_MD *md = fake_tl_rsa_md(algorithm);
+    uint32_t size = RSA_size(rsa);
+    uint8_t em[FAKE_RSA_MAX_BYTES];
+
+    if (sigLen != size || size > sizeof(em))
+        return RET_ERR_INVALID_LENGTH;
+
+    if (fake_tl_rsa_pkcs1(algorithm)) {
+        *validity = RSA_verify(EVP_MD_type(md), hash, hashLen, sig, size, rsa) == 1;
+        return RET_OK;
+    }
+
+    if (RSA_public_decrypt(size, sig, em, rsa, RSA_NO_PADDING) != (int)size)
+        return RET_ERR_VERIFY;
+
+    *validity = RSA_verify_PKCS1_PSS(rsa, hash, md, em, -1) == 1;
+
+    return RET_OK;
+}
+
+/* 'hash' receives the digest of the plaintext for the hashing algorithms */
+static uint32_t fake_tl_rsa_digest(uint32_t algorithm, const uint8_t *plain,
+        uint32_t plainLen, uint8_t *hash, unsigned int *hashLen)
+{
+    const EVP_MD *md = fake_tl_rsa_md(algorithm);
+
+    if (algorithm == TEE_RSA_NODIGEST_NOPADDING)
+        return RET_OK;
+    if (md == NULL)
+        return RET_ERR_NOT_SUPPORTED;
+
+    return EVP_Digest(plain, plainLen, hash, hashLen, md, NULL) ? RET_OK : RET_ERR_DIGEST;
+}
+
+static uint32_t fake_tl_rsa_sign(tciMessage_t *msg, FakeTlMapFn map, void *session)
+{
+    rsasign_t *cmd = &msg->rsasign;
+    uint8_t hash[EVP_MAX_MD_SIZE];
+    unsigned int hashLen = 0;
+    uint32_t ret;
+
+    const uint8_t *so = reinterpret_cast<uint8_t *>(map(session, cmd->keydata, cmd->keydatalen));
+    const uint8_t *plain = reinterpret_cast<uint8_t *>(map(session, cmd->plaindata, cmd->plaindatalen));
+    uint8_t *sig = reinterpret_cast<uint8_t *>(map(session, cmd->signaturedata, cmd->signaturedatalen));
+    if (so == NULL || plain == NULL || sig == NULL)
+        return RET_ERR_INVALID_BUFFER;
+
+    ret = fake_tl_rsa_digest(cmd->algorithm, plain, cmd->plaindatalen, hash, &hashLen);
+    if (ret != RET_OK)
+        return ret;
+
+    RSA *rsa = fake_tl_rsa_from_so(so, cmd->keydatalen);
+    if (rsa == NULL)
+        return RET_ERR_SECURE_OBJECT;
+
+    uint32_t size = RSA_size(rsa);
+    if (cmd->signaturedatalen < size) {
+        RSA_free(rsa);
+        return RET_ERR_INVALID_LENGTH;
+    }
+
+    if (cmd->algorithm != TEE_RSA_NODIGEST_NOPADDING)
+        ret = fake_tl_rsa_sign_hash(rsa, cmd->algorithm, hash, hashLen, sig);
+    else if (cmd->plaindatalen != size)
+        ret = RET_ERR_INVALID_LENGTH;
+    else if (RSA_private_encrypt(size, plain, sig, rsa, RSA_NO_PADDING) == (int)size)
+        ret = RET_OK;
+    else
+        ret = RET_ERR_SIGN;
+
+    RSA_free(rsa);
+
+    if (ret == RET_OK)
+        cmd->signaturedatalen = size;
+
+    return ret;
+}
+
+static uint32_t fake_tl_rsa_verify(tciMessage_t *msg, FakeTlMapFn map, void *session)
+{
+    rsaverify_t *cmd = &msg->rsaverify;
+    uint8_t hash[EVP_MAX_MD_SIZE];
+    unsigned int hashLen = 0;
+    uint32_t ret;
+
+    cmd->validity = false;
+
+    const uint8_t *so = reinterpret_cast<uint8_t *>(map(session, cmd->keydata, cmd->keydatalen));
+    const uint8_t *plain = reinterpret_cast<uint8_t *>(map(session, cmd->plaindata, cmd->plaindatalen));
+    const uint8_t *sig = reinterpret_cast<uint8_t *>(map(session, cmd->signaturedata, cmd->signaturedatalen));
+    if (so == NULL || plain == NULL || sig == NULL)
+        return RET_ERR_INVALID_BUFFER;
+
+    ret = fake_tl_rsa_digest(cmd->algorithm, plain, cmd->plaindatalen, hash, &hashLen);
+    if (ret != RET_OK)
+        return ret;
+
+    RSA *rsa = fake_tl_rsa_from_so(so, cmd->keydatalen);
+    if (rsa == NULL)
+        return RET_ERR_SECURE_OBJECT;
+
+    uint32_t size = RSA_size(rsa);
+    uint8_t em[FAKE_RSA_MAX_BYTES];
+    bool validity = false;
+
+    ret = RET_OK;
+    if (cmd->algorithm != TEE_RSA_NODIGEST_NOPADDING) {
+        ret = fake_tl_rsa_verify_hash(rsa, cmd->algorithm, hash, hashLen,
+                                      sig, cmd->signaturedatalen, &validity);
+        cmd->validity = validity;
+    } else if (cmd->signaturedatalen != size || size > sizeof(em)) {
+        ret = RET_ERR_INVALID_LENGTH;
+    } else if (RSA_public_decrypt(size, sig, em, rsa, RSA_NO_PADDING) != (int)size) {
+        ret = RET_ERR_VERIFY;
+    } else {
+        cmd->validity = (cmd->plaindatalen == size) && !CRYPTO_memcmp(em, plain, size);
+    }
+
+    RSA_free(rsa);
+
+    return ret;
+}
+
+/*
+ * Streamed RSA and HMAC operations. A trustlet instance runs per session,
+ * so an operation only answers to the session that started it. Handlers
+ * run one at a time with the secure world held.
+ */
+struct FakeTlOp {
+    void        *session;       /* NULL if the slot is free */
+    uint32_t    handle;
+    uint32_t    algorithm;
+    bool        verify;
+    RSA         *rsa;
+    EVP_PKEY    *mac;           /* HMAC key, NULL for RSA */
+    EVP_MD_CTX  *md;
+};
+
+static FakeTlOp g_op[FAKE_TL_MAX_OPS];
+static uint32_t g_next_handle = 1;
+
+static void fake_tl_op_free(FakeTlOp *op)
+{
+    RSA_free(op->rsa);
+    EVP_PKEY_free(op->mac);
+    if (op->md != NULL)
+        EVP_MD_CTX_destroy(op->md);
+    memset(op, 0, sizeof(*op));
+}
+
+static FakeTlOp *fake_tl_op_find(void *session, uint32_t handle, bool hmac)
+{
+    for (int i = 0; i < FAKE_TL_MAX_OPS; i++) {
+        if (g_op[i].session == session && g_op[i].handle == handle)
+            return ((g_op[i].mac != NULL) == hmac) ? &g_op[i] : NULL;
+    }
+
+    return NULL;
+}
+
+static FakeTlOp *fake_tl_op_alloc(void)
+{
+    return fake_tl_op_find(NULL, 0, false);
+}
+
+static uint32_t fake_tl_rsa_digest_init(tciMessage_t *msg, FakeTlMapFn map, void *session)
+{
+    rsadigestinit_t *cmd = &msg->rsadigestinit;
+    const EVP_MD *md = fake_tl_rsa_md(cmd->algorithm);
+    FakeTlOp *op = fake_tl_op_alloc();
+
+    const uint8_t *so = reinterpret_cast<uint8_t *>(map(session, cmd->keydata, cmd->keydatalen));
+    if (so == NULL)
+        return RET_ERR_INVALID_BUFFER;
+    if (md == NULL)
+        return RET_ERR_NOT_SUPPORTED;
+    if (op == NULL)
+        return RET_ERR_INTERNAL_ERROR;
+
+    op->rsa = fake_tl_rsa_from_so(so, cmd->keydatalen);
+    if (op->rsa == NULL)
+        return RET_ERR_SECURE_OBJECT;
+
+    op->md = EVP_MD_CTX_create();
+    if (op->md == NULL || !EVP_DigestInit_ex(op->md, md, NULL)) {
+        fake_tl_op_free(op);
+        return RET_ERR_DIGEST;
+    }
+
+    op->session = session;
+    op->handle = g_next_handle++;
+    op->algorithm = cmd->algorithm;
+    op->verify = cmd->verify != 0;
+    cmd->handle = op->handle;
+
+    return RET_OK;
+}
+
+static uint32_t fake_tl_rsa_digest_update(tciMessage_t *msg, FakeTlMapFn map, void *session)
+{
+    rsadigestupdate_t *cmd = &msg->rsadigestupdate;
+
+    FakeTlOp *op = fake_tl_op_find(session, cmd->handle, false);
+    if (op == NULL)
+        return RET_ERR_INVALID_BUFFER;
+
+    const uint8_t *plain = reinterpret_cast<uint8_t *>(map(session, cmd->plaindata, cmd->plaindatalen));
+    if (plain == NULL) {
+        fake_tl_op_free(op);
+        return RET_ERR_INVALID_BUFFER;
+    }
+
+    if (!EVP_DigestUpdate(op->md, plain, cmd->plaindatalen)) {
+        fake_tl_op_free(op);
+        return RET_ERR_DIGEST;
+    }
+
+    return RET_OK;
+}
+
+static uint32_t fake_tl_rsa_digest_final(tciMessage_t *msg, FakeTlMapFn map, void *session)
+{
+    rsadigestfinal_t *cmd = &msg->rsadigestfinal;
+    uint8_t hash[EVP_MAX_MD_SIZE];
+    unsigned int hashLen = 0;
+    bool validity = false;
+    uint32_t ret;
+
+    FakeTlOp *op = fake_tl_op_find(session, cmd->handle, false);
+    if (op == NULL)
+        return RET_ERR_INVALID_BUFFER;
+
+    uint8_t *sig = reinterpret_cast<uint8_t *>(map(session, cmd->signaturedata, cmd->signaturedatalen));
+    uint32_t size = RSA_size(op->rsa);
+
+    if (sig == NULL)
+        ret = RET_ERR_INVALID_BUFFER;
+    else if (!EVP_DigestFinal_ex(op->md, hash, &hashLen))
+        ret = RET_ERR_DIGEST;
+    else if (op->verify)
+        ret = fake_tl_rsa_verify_hash(op->rsa, op->algorithm, hash, hashLen,
+                                      sig, cmd->signaturedatalen, &validity);
+    else if (cmd->signaturedatalen < size)
+        ret = RET_ERR_INVALID_LENGTH;
+    else
+        ret = fake_tl_rsa_sign_hash(op->rsa, op->algorithm, hash, hashLen, sig);
+
+    if (ret == RET_OK && op->verify)
+        cmd->validity = validity;
+    else if (ret == RET_OK)
+        cmd->signaturedatalen = size;
+
+    fake_tl_op_free(op);
+
+    return ret;
+}
+
+static uint32_t fake_tl_rsa_digest_abort(tciMessage_t *msg, FakeTlMapFn, void *session)
+{
+    FakeTlOp *op = fake_tl_op_find(session, msg->rsadigestfinal.handle, false);
+    if (op == NULL)
+        return RET_ERR_INVALID_BUFFER;
+
+    fake_tl_op_free(op);
+
+    return RET_OK;
+}
+
+void fake_tl_close(void *session)
+{
+    for (int i = 0; i < FAKE_TL_MAX_OPS; i++) {
+        if (g_op[i].session == session)
+            fake_tl_op_free(&g_op[i]);
+    }
+}
+
+static uint32_t fake_tl_hmac_gen(tciMessage_t *msg, FakeTlMapFn map, void *session)
+{
+    hmacgenkey_t *cmd = &msg->hmacgenkey;
+    uint8_t key[FAKE_HMAC_KEY_SIZE];
+    uint32_t ret;
+
+    uint8_t *so = reinterpret_cast<uint8_t *>(map(session, cmd->keydata, cmd->keydatalen));
+    if (so == NULL)
+        return RET_ERR_INVALID_BUFFER;
+
+    if (RAND_bytes(key, sizeof(key)) != 1)
+        return RET_ERR_KEY_GENERATION;
+
+    cmd->solen = cmd->keydatalen;
+    ret = fake_tl_wrap(FAKE_SO_HMAC, key, sizeof(key), so, &cmd->solen);
+    OPENSSL_cleanse(key, sizeof(key));
+
+    return ret;
+}
+
+static const EVP_MD *fake_tl_hmac_md(uint32_t digest)
+{
+    if (digest == TEE_DIGEST_SHA1)
+        return EVP_sha1();
+    if (digest == TEE_DIGEST_SHA256)
+        return EVP_sha256();
+
+    return NULL;
+}
+
+static uint32_t fake_tl_hmac(uint32_t digest, const uint8_t *so, uint32_t soLen,
+        const uint8_t *plain, uint32_t plainLen, uint8_t *mac, unsigned int *macLen)
+{
+    const EVP_MD *md = fake_tl_hmac_md(digest);
+    uint32_t keyLen;
+
+    if (md == NULL)
+        return RET_ERR_DIGEST;
+
+    const uint8_t *key = fake_tl_unwrap(FAKE_SO_HMAC, so, soLen, &keyLen);
+    if (key == NULL)
+        return RET_ERR_SECURE_OBJECT;
+
+    if (HMAC(md, key, keyLen, plain, plainLen, mac, macLen) == NULL)
+        return RET_ERR_INTERNAL_ERROR;
+
+    return RET_OK;
+}
+
+static uint32_t fake_tl_hmac_sign(tciMessage_t *msg, FakeTlMapFn map, void *session)
+{
+    hmacsign_t *cmd = &msg->hmacsign;
+    uint8_t mac[EVP_MAX_MD_SIZE];
+    unsigned int macLen = 0;
+
+    const uint8_t *so = reinterpret_cast<uint8_t *>(map(session, cmd->keydata, cmd->keydatalen));
+    const uint8_t *plain = reinterpret_cast<uint8_t *>(map(session, cmd->plaindata, cmd->plaindatalen));
+    uint8_t *sig = reinterpret_cast<uint8_t *>(map(session, cmd->signaturedata, cmd->signaturedatalen));
+    if (so == NULL || plain == NULL || sig == NULL)
+        return RET_ERR_INVALID_BUFFER;
+
+    uint32_t ret = fake_tl_hmac(cmd->digest, so, cmd->keydatalen, plain, cmd->plaindatalen,
+                                mac, &macLen);
+    if (ret != RET_OK)
+        return ret;
+    if (cmd->signaturedatalen < macLen)
+        return RET_ERR_INVALID_LENGTH;
+
+    memcpy(sig, mac, macLen);
+    cmd->signaturedatalen = macLen;
+
+    return RET_OK;
+}
+
+static uint32_t fake_tl_hmac_verify(tciMessage_t *msg, FakeTlMapFn map, void *session)
+{
+    hmacverify_t *cmd = &msg->hmacverify;
+    uint8_t mac[EVP_MAX_MD_SIZE];
+    unsigned int macLen = 0;
+
+    cmd->validity = false;
+
+    const uint8_t *so = reinterpret_cast<uint8_t *>(map(session, cmd->keydata, cmd->keydatalen));
+    const uint8_t *plain = reinterpret_cast<uint8_t *>(map(session, cmd->plaindata, cmd->plaindatalen));
+    const uint8_t *sig = reinterpret_cast<uint8_t *>(map(session, cmd->signaturedata, cmd->signaturedatalen));
+    if (so == NULL || plain == NULL || sig == NULL)
+        return RET_ERR_INVALID_BUFFER;
+
+    uint32_t ret = fake_tl_hmac(cmd->digest, so, cmd->keydatalen, plain, cmd->plaindatalen,
+                                mac, &macLen);
+    if (ret != RET_OK)
+        return ret;
+
+    cmd->validity = (cmd->signaturedatalen == macLen) && !CRYPTO_memcmp(mac, sig, macLen);
+
+    return RET_OK;
+}
+
+static uint32_t fake_tl_hmac_init(tciMessage_t *msg, FakeTlMapFn map, void *session)
+{
+    hmacinit_t *cmd = &msg->hmacinit;
+    const EVP_MD *md = fake_tl_hmac_md(cmd->digest);
+    FakeTlOp *op = fake_tl_op_alloc();
+    uint32_t keyLen;
+
+    const uint8_t *so = reinterpret_cast<uint8_t *>(map(session, cmd->keydata, cmd->keydatalen));
+    if (so == NULL)
+        return RET_ERR_INVALID_BUFFER;
+    if (md == NULL)
+        return RET_ERR_DIGEST;
+    if (op == NULL)
+        return RET_ERR_INTERNAL_ERROR;
+
+    const uint8_t *key = fake_tl_unwrap(FAKE_SO_HMAC, so, cmd->keydatalen, &keyLen);
+    if (key == NULL)
+        return RET_ERR_SECURE_OBJECT;
+
+    op->mac = EVP_PKEY_new_mac_key(EVP_PKEY_HMAC, NULL, key, keyLen);
+    op->md = EVP_MD_CTX_create();
+    if (op->mac == NULL || op->md == NULL ||
+            !EVP_DigestSignInit(op->md, NULL, md, NULL, op->mac)) {
+        fake_tl_op_free(op);
+        return RET_ERR_INTERNAL_ERROR;
+    }
+
+    op->session = session;
+    op->handle = g_next_handle++;
+    op->algorithm = cmd->digest;
+    op->verify = cmd->verify != 0;
+    cmd->handle = op->handle;
+
+    return RET_OK;
+}
+
+static uint32_t fake_tl_hmac_update(tciMessage_t *msg, FakeTlMapFn map, void *session)
+{
+    hmacupdate_t *cmd = &msg->hmacupdate;
+
+    FakeTlOp *op = fake_tl_op_find(session, cmd->handle, true);
+    if (op == NULL)
+        return RET_ERR_INVALID_BUFFER;
+
+    const uint8_t *plain = reinterpret_cast<uint8_t *>(map(session, cmd->plaindata, cmd->plaindatalen));
+    if (plain == NULL) {
+        fake_tl_op_free(op);
+        return RET_ERR_INVALID_BUFFER;
+    }
+
+    if (!EVP_DigestSignUpdate(op->md, plain, cmd->plaindatalen)) {
+        fake_tl_op_free(op);
+        return RET_ERR_INTERNAL_ERROR;
+    }
+
+    return RET_OK;
+}
+
+static uint32_t fake_tl_hmac_final(tciMessage_t *msg, FakeTlMapFn map, void *session)
+{
+    hmacfinal_t *cmd = &msg->hmacfinal;
+    uint8_t mac[EVP_MAX_MD_SIZE];
+    size_t macLen = sizeof(mac);
+    uint32_t ret = RET_OK;
+
+    FakeTlOp *op = fake_tl_op_find(session, cmd->handle, true);
+    if (op == NULL)
+        return RET_ERR_INVALID_BUFFER;
+
+    uint8_t *sig = reinterpret_cast<uint8_t *>(map(session, cmd->signaturedata, cmd->signaturedatalen));
+
+    if (sig == NULL)
+        ret = RET_ERR_INVALID_BUFFER;
+    else if (!EVP_DigestSignFinal(op->md, mac, &macLen))
+        ret = RET_ERR_INTERNAL_ERROR;
+    else if (op->verify)
+        cmd->validity = (cmd->signaturedatalen == macLen) && !CRYPTO_memcmp(mac, sig, macLen);
+    else if (cmd->signaturedatalen < macLen)
+        ret = RET_ERR_INVALID_LENGTH;
+    else {
+        memcpy(sig, mac, macLen);
+        cmd->signaturedatalen = macLen;
+    }
+
+    OPENSSL_cleanse(mac, sizeof(mac));
+    fake_tl_op_free(op);
+
+    return ret;
+}
+
+static uint32_t fake_tl_hmac_abort(tciMessage_t *msg, FakeTlMapFn, void *session)
+{
+    FakeTlOp *op = fake_tl_op_find(session, msg->hmacfinal.handle, true);
+    if (op == NULL)
+        return RET_ERR_INVALID_BUFFER;
+
+    fake_tl_op_free(op);
+
+    return RET_OK;
+}
+
+static uint32_t fake_tl_key_import(tciMessage_t *msg, FakeTlMapFn map, void *session)
+{
+    keyimport_t *cmd = &msg->keyimport;
+
+    const uint8_t *key = reinterpret_cast<uint8_t *>(map(session, cmd->keydata, cmd->keydatalen));
+    uint8_t *so = reinterpret_cast<uint8_t *>(map(session, cmd->sodata, cmd->sodatalen));
+    if (key == NULL || so == NULL)
+        return RET_ERR_INVALID_BUFFER;
+
+    /* only well formed keys are wrapped */
+    RSA *rsa = fake_tl_rsa_from_key(key, cmd->keydatalen);
+    if (rsa == NULL)
+        return RET_ERR_INVALID_BUFFER;
+    RSA_free(rsa);
+
+    return fake_tl_wrap(FAKE_SO_RSA, key, cmd->keydatalen, so, &cmd->sodatalen);
+}
+
+static uint32_t fake_tl_get_pub_key(tciMessage_t *msg, FakeTlMapFn map, void *session)
+{
+    getpubkey_t *cmd = &msg->getpubkey;
+    uint32_t ret = RET_OK;
+
+    const uint8_t *so = reinterpret_cast<uint8_t *>(map(session, cmd->keydata, cmd->keydatalen));
+    uint8_t *mod = reinterpret_cast<uint8_t *>(map(session, cmd->modulus, cmd->moduluslen));
+    uint8_t *exp = reinterpret_cast<uint8_t *>(map(session, cmd->exponent, cmd->exponentlen));
+    if (so == NULL || mod == NULL || exp == NULL)
+        return RET_ERR_INVALID_BUFFER;
+
+    RSA *rsa = fake_tl_rsa_from_so(so, cmd->keydatalen);
+    if (rsa == NULL)
+        return RET_ERR_SECURE_OBJECT;
+
+    if ((uint32_t)BN_num_bytes(rsa->n) > cmd->moduluslen ||
+            (uint32_t)BN_num_bytes(rsa->e) > cmd->exponentlen) {
+        ret = RET_ERR_INVALID_LENGTH;
+    } else {
+        cmd->moduluslen = BN_bn2bin(rsa->n, mod);
+        cmd->exponentlen = BN_bn2bin(rsa->e, exp);
+    }
+
+    RSA_free(rsa);
+
+    return ret;
+}
+
+static int fake_tl_ec_nid(uint32_t curve)
+{
+    switch (curve) {
+    case TEE_ECC_CURVE_NIST_P192:
+        return NID_X9_62_prime192v1;
+    case TEE_ECC_CURVE_NIST_P224:
+        return NID_secp224r1;
+    case TEE_ECC_CURVE_NIST_P256:
+        return NID_X9_62_prime256v1;
+    case TEE_ECC_CURVE_NIST_P384:
+        return NID_secp384r1;
+    case TEE_ECC_CURVE_NIST_P521:
+        return NID_secp521r1;
+    default:
+        return NID_undef;
+    }
+}
+
+/* builds the EC key of the TEE_ECKeyImport() layout */
+static EC_KEY *fake_tl_ec_from_key(const uint8_t *key, uint32_t keyLen, uint32_t *curve)
+{
+    teeEcKeyMeta_t meta;
+
+    if (keyLen < sizeof(meta))
+        return NULL;
+
+    memcpy(&meta, key, sizeof(meta));
+    if (meta.lenpub > keyLen - sizeof(meta) ||
+            meta.lenpriv > keyLen - sizeof(meta) - meta.lenpub)
+        return NULL;
+
+    int nid = fake_tl_ec_nid(meta.curve);
+    if (nid == NID_undef)
+        return NULL;
+
+    EC_KEY *ec = EC_KEY_new_by_curve_name(nid);
+    if (ec == NULL)
+        return NULL;
+
+    const uint8_t *pub = key + sizeof(meta);
+    EC_POINT *point = EC_POINT_new(EC_KEY_get0_group(ec));
+    BIGNUM *priv = BN_bin2bn(pub + meta.lenpub, meta.lenpriv, NULL);
+    bool ok = point != NULL && priv != NULL &&
+              EC_POINT_oct2point(EC_KEY_get0_group(ec), point, pub, meta.lenpub, NULL) &&
+              EC_KEY_set_public_key(ec, point) &&
+              EC_KEY_set_private_key(ec, priv) &&
+              EC_KEY_check_key(ec);
+
+    BN_clear_free(priv);
+    EC_POINT_free(point);
+
+    if (!ok) {
+        EC_KEY_free(ec);
+        return NULL;
+    }
+
+    *curve = meta.curve;
+
+    return ec;
+}
+
+/* the reverse of fake_tl_ec_from_key(), as exynos_km_import_keypair() */
+static uint32_t fake_tl_ec_to_key(const EC_KEY *ec, uint32_t curve,
+        uint8_t *key, uint32_t *keyLen)
+{
+    teeEcKeyMeta_t meta;
+    const EC_GROUP *group = EC_KEY_get0_group(ec);
+    const BIGNUM *priv = EC_KEY_get0_private_key(ec);
+
+    size_t pubLen = EC_POINT_point2oct(group, EC_KEY_get0_public_key(ec),
+                                       POINT_CONVERSION_UNCOMPRESSED, NULL, 0, NULL);
+    if (pubLen == 0 || sizeof(meta) + pubLen + BN_num_bytes(priv) > *keyLen)
+        return RET_ERR_INVALID_LENGTH;
+
+    meta.curve = curve;
+    meta.lenpub = EC_POINT_point2oct(group, EC_KEY_get0_public_key(ec),
+                                     POINT_CONVERSION_UNCOMPRESSED,
+                                     key + sizeof(meta), pubLen, NULL);
+    meta.lenpriv = BN_bn2bin(priv, key + sizeof(meta) + meta.lenpub);
+
+    memcpy(key, &meta, sizeof(meta));
+    *keyLen = sizeof(meta) + meta.lenpub + meta.lenpriv;
+
+    return RET_OK;
+}
+
+static EC_KEY *fake_tl_ec_from_so(const uint8_t *so, uint32_t soLen, uint32_t *curve)
+{
+    uint32_t keyLen;
+    const uint8_t *key = fake_tl_unwrap(FAKE_SO_EC, so, soLen, &keyLen);
+
+    return (key != NULL) ? fake_tl_ec_from_key(key, keyLen, curve) : NULL;
+}
+
+static uint32_t fake_tl_ec_gen(tciMessage_t *msg, FakeTlMapFn map, void *session)
+{
+    ecgenkey_t *cmd = &msg->ecgenkey;
+    uint8_t key[FAKE_EC_KEY_BUFFER];
+    uint32_t keyLen = sizeof(key);
+    uint32_t ret;
+
+    uint8_t *so = reinterpret_cast<uint8_t *>(map(session, cmd->keydata, cmd->keydatalen));
+    if (so == NULL)
+        return RET_ERR_INVALID_BUFFER;
+
+    int nid = fake_tl_ec_nid(cmd->curve);
+    if (nid == NID_undef)
+        return RET_ERR_INVALID_KEY_TYPE;
+
+    EC_KEY *ec = EC_KEY_new_by_curve_name(nid);
+    if (ec == NULL)
+        return RET_ERR_INTERNAL_ERROR;
+
+    if (!EC_KEY_generate_key(ec)) {
+        EC_KEY_free(ec);
+        return RET_ERR_KEY_GENERATION;
+    }
+
+    ret = fake_tl_ec_to_key(ec, cmd->curve, key, &keyLen);
+    EC_KEY_free(ec);
+    if (ret == RET_OK) {
+        cmd->solen = cmd->keydatalen;
+        ret = fake_tl_wrap(FAKE_SO_EC, key, keyLen, so, &cmd->solen);
+    }
+    OPENSSL_cleanse(key, sizeof(key));
+
+    return ret;
+}
+
+static uint32_t fake_tl_ec_sign(tciMessage_t *msg, FakeTlMapFn map, void *session)
+{
+    ecsign_t *cmd = &msg->ecsign;
+    uint32_t curve;
+
+    const uint8_t *so = reinterpret_cast<uint8_t *>(map(session, cmd->keydata, cmd->keydatalen));
+    const uint8_t *digest = reinterpret_cast<uint8_t *>(map(session, cmd->plaindata, cmd->plaindatalen));
+    uint8_t *sig = reinterpret_cast<uint8_t *>(map(session, cmd->signaturedata, cmd->signaturedatalen));
+    if (so == NULL || digest == NULL || sig == NULL)
+        return RET_ERR_INVALID_BUFFER;
+
+    EC_KEY *ec = fake_tl_ec_from_so(so, cmd->keydatalen, &curve);
+    if (ec == NULL)
+        return RET_ERR_SECURE_OBJECT;
+
+    uint32_t ret = RET_OK;
+    unsigned int sigLen = 0;
+
+    if (cmd->signaturedatalen < (uint32_t)ECDSA_size(ec))
+        ret = RET_ERR_INVALID_LENGTH;
+    else if (!ECDSA_sign(0, digest, cmd->plaindatalen, sig, &sigLen, ec))
+        ret = RET_ERR_SIGN;
+    else
+        cmd->signaturedatalen = sigLen;
+
+    EC_KEY_free(ec);
+
+    return ret;
+}
+
+static uint32_t fake_tl_ec_verify(tciMessage_t *msg, FakeTlMapFn map, void *session)
+{
+    ecverify_t *cmd = &msg->ecverify;
+    uint32_t curve;
+
+    cmd->validity = false;
+
+    const uint8_t *so = reinterpret_cast<uint8_t *>(map(session, cmd->keydata, cmd->keydatalen));
+    const uint8_t *digest = reinterpret_cast<uint8_t *>(map(session, cmd->plaindata, cmd->plaindatalen));
+    const uint8_t *sig = reinterpret_cast<uint8_t *>(map(session, cmd->signaturedata, cmd->signaturedatalen));
+    if (so == NULL || digest == NULL || sig == NULL)
+        return RET_ERR_INVALID_BUFFER;
+
+    EC_KEY *ec = fake_tl_ec_from_so(so, cmd->keydatalen, &curve);
+    if (ec == NULL)
+        return RET_ERR_SECURE_OBJECT;
+
+    /* a malformed signature is an invalid one */
+    cmd->validity = ECDSA_verify(0, digest, cmd->plaindatalen, sig, cmd->signaturedatalen, ec) == 1;
+
+    EC_KEY_free(ec);
+
+    return RET_OK;
+}
+
+static uint32_t fake_tl_ec_key_import(tciMessage_t *msg, FakeTlMapFn map, void *session)
+{
+    keyimport_t *cmd = &msg->keyimport;
+    uint32_t curve;
+
+    const uint8_t *key = reinterpret_cast<uint8_t *>(map(session, cmd->keydata, cmd->keydatalen));
+    uint8_t *so = reinterpret_cast<uint8_t *>(map(session, cmd->sodata, cmd->sodatalen));
+    if (key == NULL || so == NULL)
+        return RET_ERR_INVALID_BUFFER;
+
+    /* only well formed keys are wrapped */
+    EC_KEY *ec = fake_tl_ec_from_key(key, cmd->keydatalen, &curve);
+    if (ec == NULL)
+        return RET_ERR_INVALID_BUFFER;
+    EC_KEY_free(ec);
+
+    return fake_tl_wrap(FAKE_SO_EC, key, cmd->keydatalen, so, &cmd->sodatalen);
+}
+
+static uint32_t fake_tl_ec_get_pub_key(tciMessage_t *msg, FakeTlMapFn map, void *session)
+{
+    ecgetpubkey_t *cmd = &msg->ecgetpubkey;
+    uint32_t ret = RET_OK;
+    uint32_t curve;
+
+    const uint8_t *so = reinterpret_cast<uint8_t *>(map(session, cmd->keydata, cmd->keydatalen));
+    uint8_t *point = reinterpret_cast<uint8_t *>(map(session, cmd->point, cmd->pointlen));
+    if (so == NULL || point == NULL)
+        return RET_ERR_INVALID_BUFFER;
+
+    EC_KEY *ec = fake_tl_ec_from_so(so, cmd->keydatalen, &curve);
+    if (ec == NULL)
+        return RET_ERR_SECURE_OBJECT;
+
+    size_t len = EC_POINT_point2oct(EC_KEY_get0_group(ec), EC_KEY_get0_public_key(ec),
+                                    POINT_CONVERSION_UNCOMPRESSED, point, cmd->pointlen, NULL);
+    if (len == 0) {
+        ret = RET_ERR_INVALID_LENGTH;
+    } else {
+        cmd->curve = curve;
+        cmd->pointlen = len;
+    }
+
+    EC_KEY_free(ec);
+
+    return ret;
+}
+
+/*
+ * Batch commands run the single message handler for every entry, on a
+ * command of its own pointing into the batch buffer.
+ */
+static uint32_t fake_tl_batch(tciMessage_t *msg, FakeTlMapFn map, void *session)
+{
+    signbatch_t *cmd = &msg->signbatch;
+    uint32_t cmdId = msg->command.header.commandId;
+
+    if (cmd->count == 0 || cmd->count > cmd->batchdatalen / sizeof(batchentry_t))
+        return RET_ERR_INVALID_LENGTH;
+
+    batchentry_t *entry = reinterpret_cast<batchentry_t *>(
+            map(session, cmd->batchdata, cmd->count * sizeof(batchentry_t)));
+    if (entry == NULL)
+        return RET_ERR_INVALID_BUFFER;
+
+    for (uint32_t i = 0; i < cmd->count; i++) {
+        batchentry_t *e = &entry[i];
+        tciMessage_t one;
+
+        memset(&one, 0, sizeof(one));
+
+        /* the entry must lie in the batch buffer */
+        if (e->plainoffset > cmd->batchdatalen ||
+                e->plaindatalen > cmd->batchdatalen - e->plainoffset ||
+                e->signatureoffset > cmd->batchdatalen ||
+                e->signaturedatalen > cmd->batchdatalen - e->signatureoffset) {
+            e->result = RET_ERR_INVALID_BUFFER;
+            continue;
+        }
+
+        switch (cmdId) {
+        case CMD_ID_TEE_RSA_SIGN_BATCH:
+        case CMD_ID_TEE_RSA_VERIFY_BATCH:
+            /* rsasign_t is the head of rsaverify_t */
+            one.rsasign.keydata = cmd->keydata;
+            one.rsasign.keydatalen = cmd->keydatalen;
+            one.rsasign.plaindata = cmd->batchdata + e->plainoffset;
+            one.rsasign.plaindatalen = e->plaindatalen;
+            one.rsasign.signaturedata = cmd->batchdata + e->signatureoffset;
+            one.rsasign.signaturedatalen = e->signaturedatalen;
+            one.rsasign.algorithm = cmd->algorithm;
+            if (cmdId == CMD_ID_TEE_RSA_SIGN_BATCH) {
+                e->result = fake_tl_rsa_sign(&one, map, session);
+                e->signaturedatalen = one.rsasign.signaturedatalen;
+            } else {
+                e->result = fake_tl_rsa_verify(&one, map, session);
+                e->validity = one.rsaverify.validity;
+            }
+            break;
+        default:
+            one.hmacsign.keydata = cmd->keydata;
+            one.hmacsign.keydatalen = cmd->keydatalen;
+            one.hmacsign.plaindata = cmd->batchdata + e->plainoffset;
+            one.hmacsign.plaindatalen = e->plaindatalen;
+            one.hmacsign.signaturedata = cmd->batchdata + e->signatureoffset;
+            one.hmacsign.signaturedatalen = e->signaturedatalen;
+            one.hmacsign.digest = cmd->algorithm;
+            if (cmdId == CMD_ID_TEE_HMAC_SIGN_BATCH) {
+                e->result = fake_tl_hmac_sign(&one, map, session);
+                e->signaturedatalen = one.hmacsign.signaturedatalen;
+            } else {
+                e->result = fake_tl_hmac_verify(&one, map, session);
+                e->validity = one.hmacverify.validity;
+            }
+            break;
+        }
+    }
+
+    return RET_OK;
+}
+
+void fake_tl_handle(tciMessage_t *msg, FakeTlMapFn map, void *session)
+{
+    uint32_t cmd = msg->command.header.commandId;
+    uint32_t ret;
+
+    switch (cmd) {
+    case CMD_ID_TEE_RSA_GEN_KEY_PAIR:
+        ret = fake_tl_rsa_gen(msg, map, session);
+        break;
+    case CMD_ID_TEE_RSA_SIGN:
+        ret = fake_tl_rsa_sign(msg, map, session);
+        break;
+    case CMD_ID_TEE_RSA_VERIFY:
+        ret = fake_tl_rsa_verify(msg, map, session);
+        break;
+    case CMD_ID_TEE_HMAC_GEN_KEY:
+        ret = fake_tl_hmac_gen(msg, map, session);
+        break;
+    case CMD_ID_TEE_HMAC_SIGN:
+        ret = fake_tl_hmac_sign(msg, map, session);
+        break;
+    case CMD_ID_TEE_HMAC_VERIFY:
+        ret = fake_tl_hmac_verify(msg, map, session);
+        break;
+    case CMD_ID_TEE_KEY_IMPORT:
+        ret = fake_tl_key_import(msg, map, session);
+        break;
+    case CMD_ID_TEE_GET_PUB_KEY:
+        ret = fake_tl_get_pub_key(msg, map, session);
+        break;
+    case CMD_ID_TEE_RSA_SIGN_BATCH:
+    case CMD_ID_TEE_RSA_VERIFY_BATCH:
+    case CMD_ID_TEE_HMAC_SIGN_BATCH:
+    case CMD_ID_TEE_HMAC_VERIFY_BATCH:
+        ret = fake_tl_batch(msg, map, session);
+        break;
+    case CMD_ID_TEE_EC_GEN_KEY_PAIR:
+        ret = fake_tl_ec_gen(msg, map, session);
+        break;
+    case CMD_ID_TEE_EC_SIGN:
+        ret = fake_tl_ec_sign(msg, map, session);
+        break;
+    case CMD_ID_TEE_EC_VERIFY:
+        ret = fake_tl_ec_verify(msg, map, session);
+        break;
+    case CMD_ID_TEE_EC_KEY_IMPORT:
+        ret = fake_tl_ec_key_import(msg, map, session);
+        break;
+    case CMD_ID_TEE_EC_GET_PUB_KEY:
+        ret = fake_tl_ec_get_pub_key(msg, map, session);
+        break;
+    case CMD_ID_TEE_RSA_DIGEST_INIT:
+        ret = fake_tl_rsa_digest_init(msg, map, session);
+        break;
+    case CMD_ID_TEE_RSA_DIGEST_UPDATE:
+        ret = fake_tl_rsa_digest_update(msg, map, session);
+        break;
+    case CMD_ID_TEE_RSA_DIGEST_FINAL:
+        ret = fake_tl_rsa_digest_final(msg, map, session);
+        break;
+    case CMD_ID_TEE_RSA_DIGEST_ABORT:
+        ret = fake_tl_rsa_digest_abort(msg, map, session);
+        break;
+    case CMD_ID_TEE_HMAC_INIT:
+        ret = fake_tl_hmac_init(msg, map, session);
+        break;
+    case CMD_ID_TEE_HMAC_UPDATE:
+        ret = fake_tl_hmac_update(msg, map, session);
+        break;
+    case CMD_ID_TEE_HMAC_FINAL:
+        ret = fake_tl_hmac_final(msg, map, session);
+        break;
+    case CMD_ID_TEE_HMAC_ABORT:
+        ret = fake_tl_hmac_abort(msg, map, session);
+        break;
+    default:
+        ALOGW("unknown command %u", cmd);
+        ret = RET_ERR_UNKNOWN_CMD;
+        break;
+    }
+
+    msg->response.header.responseId = RSP_ID(cmd);
+    msg->response.header.returnCode = ret;
+}
@@ -0,0 +1,639 @@
+/*
+ * Copyright (C) 2012 Samsung Electronics Co., LTD
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Throughput benchmark of the keymaster HAL. The HAL and its connector are
+ * linked against the MobiCore stand-in of fake_mobicore.cpp, so it runs off
+ * the device. For generate_keypair, sign_data, verify_data and
+ * get_keypair_public it starts the requested number of threads and
+ * reports ops/s, the p50/p90/p99 latency and the world switches, bulk
+ * mappings and session opens per operation.
+ *
+ * With -e the keys are EC keys of the given field size instead of RSA
+ * ones.
+ *
+ * signbatch and verifybatch call the batch functions of the connector
+ * directly, for RSA keys only. Their ops/s and per operation counts are per message, the
+ * latency is that of a whole batch.
+ *
+ * signstream and verifystream hash and pad a message of -z bytes in the
+ * TEE with the streamed RSA functions of the connector, for RSA keys only.
+ * hmacstream computes the HMAC-SHA256 of that message with the streamed
+ * HMAC functions and checks it against a one-shot TEE_HMACSign.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <hardware/hardware.h>
+#include <hardware/keymaster0.h>
+
+#include <utils/Timers.h>
+
+#include "fake_mobicore.h"
+#include "tlcTeeKeymaster_if.h"
+
+#define BENCH_DEFAULT_OPS       200
+#define BENCH_DEFAULT_GENS      4
+#define BENCH_MAX_THREADS       64
+#define BENCH_DEFAULT_BATCH     16
+#define BENCH_MAX_BATCH         64
+#define BENCH_DEFAULT_MESSAGE   (64 * 1024)
+#define BENCH_HMAC_KEY_BUFFER   256
+#define BENCH_HMAC_SIZE         32
+/* what keystore hands sign_data for an EC key */
+#define BENCH_EC_DIGEST_SIZE    32
+
+enum {
+    BENCH_OP_GENERATE,
+    BENCH_OP_SIGN,
+    BENCH_OP_VERIFY,
+    BENCH_OP_PUBKEY,
+    BENCH_OP_SIGN_BATCH,
+    BENCH_OP_VERIFY_BATCH,
+    BENCH_OP_SIGN_STREAM,
+    BENCH_OP_VERIFY_STREAM,
+    BENCH_OP_HMAC_STREAM,
+    BENCH_OP_MAX,
+};
+
+static const char *g_op_name[BENCH_OP_MAX] = {
+    "generate", "sign", "verify", "pubkey", "signbatch", "verifybatch",
+    "signstream", "verifystream", "hmacstream",
+};
+
+extern struct keystore_module HAL_MODULE_INFO_SYM;
+
+struct BenchKey {
+    bool     ec;
+    uint8_t *blob;
+    size_t   blob_length;
+    uint8_t *data;              /* RSA: modulus sized, below the modulus */
+    size_t   data_length;
+    uint8_t *signature;
+    size_t   signature_length;
+    uint8_t *message;           /* RSA: streamed, SHA-256 with PKCS#1 */
+    size_t   message_length;
+    uint8_t *message_signature;
+    uint8_t  hmac_key[BENCH_HMAC_KEY_BUFFER];
+    uint32_t hmac_key_length;
+    uint8_t  message_hmac[BENCH_HMAC_SIZE];
+};
+
+struct BenchThread {
+    pthread_t            thread;
+    keymaster0_device_t *dev;
+    int                  op;
+    unsigned int         ops;
+    unsigned int         bits;          /* modulus or field size */
+    bool                 ec;
+    unsigned int         batch;         /* messages per call */
+    const BenchKey      *key;
+    nsecs_t             *lat;
+    bool                 failed;
+};
+
+static int bench_generate(keymaster0_device_t *dev, unsigned int bits, bool ec,
+    uint8_t **blob, size_t *blob_length)
+{
+    keymaster_rsa_keygen_params_t params;
+    keymaster_ec_keygen_params_t ec_params;
+
+    if (ec) {
+        ec_params.field_size = bits;
+        return dev->generate_keypair(dev, TYPE_EC, &ec_params, blob, blob_length);
+    }
+
+    params.modulus_size = bits;
+    params.public_exponent = 65537;
+
+    return dev->generate_keypair(dev, TYPE_RSA, &params, blob, blob_length);
+}
+
+static int bench_batch(BenchThread *t)
+{
+    teeBatchItem_t items[BENCH_MAX_BATCH];
+    const BenchKey *key = t->key;
+    bool sign = (t->op == BENCH_OP_SIGN_BATCH);
+    uint8_t *sigs = NULL;
+    teeResult_t ret;
+
+    if (sign) {
+        sigs = (uint8_t *)malloc(t->batch * key->signature_length);
+        if (sigs == NULL)
+            return -1;
+    }
+
+    for (unsigned int i = 0; i < t->batch; i++) {
+        items[i].data = key->data;
+        items[i].dataLength = key->data_length;
+        items[i].signature = sign ? sigs + i * key->signature_length : key->signature;
+        items[i].signatureLength = key->signature_length;
+        items[i].result = TEE_ERR_FAIL;
+        items[i].validity = false;
+    }
+
+    if (sign)
+        ret = TEE_RSASignBatch(key->blob, key->blob_length, items, t->batch,
+                               TEE_RSA_NODIGEST_NOPADDING);
+    else
+        ret = TEE_RSAVerifyBatch(key->blob, key->blob_length, items, t->batch,
+                                 TEE_RSA_NODIGEST_NOPADDING);
+
+    for (unsigned int i = 0; ret == TEE_ERR_NONE && i < t->batch; i++) {
+        if (items[i].result != TEE_ERR_NONE)
+            ret = items[i].result;
+        else if (sign && memcmp(items[i].signature, key->signature, key->signature_length))
+            ret = TEE_ERR_FAIL;
+        else if (!sign && !items[i].validity)
+            ret = TEE_ERR_FAIL;
+    }
+
+    free(sigs);
+
+    return (ret == TEE_ERR_NONE) ? 0 : -1;
+}
+
+static teeResult_t bench_stream_sign(const BenchKey *key, uint8_t *sig, uint32_t *sigLen)
+{
+    teeRsaOperation_t *op;
+    teeResult_t ret;
+
+    ret = TEE_RSASignInit(key->blob, key->blob_length, TEE_RSA_SHA256_PKCS1, &op);
+    if (ret != TEE_ERR_NONE)
+        return ret;
+
+    ret = TEE_RSAUpdate(op, key->message, key->message_length);
+    if (ret != TEE_ERR_NONE) {
+        TEE_RSAAbort(op);
+        return ret;
+    }
+
+    return TEE_RSASignFinal(op, sig, sigLen);
+}
+
+static int bench_stream(BenchThread *t)
+{
+    const BenchKey *key = t->key;
+    teeRsaOperation_t *op;
+    bool validity = false;
+    teeResult_t ret;
+
+    if (t->op == BENCH_OP_SIGN_STREAM) {
+        uint8_t *sig = (uint8_t *)malloc(key->signature_length);
+        uint32_t sigLen = key->signature_length;
+
+        if (sig == NULL)
+            return -1;
+
+        ret = bench_stream_sign(key, sig, &sigLen);
+        if (ret == TEE_ERR_NONE &&
+                (sigLen != key->signature_length ||
+                 memcmp(sig, key->message_signature, sigLen)))
+            ret = TEE_ERR_FAIL;
+
+        free(sig);
+
+        return (ret == TEE_ERR_NONE) ? 0 : -1;
+    }
+
+    ret = TEE_RSAVerifyInit(key->blob, key->blob_length, TEE_RSA_SHA256_PKCS1, &op);
+    if (ret != TEE_ERR_NONE)
+        return -1;
+
+    ret = TEE_RSAUpdate(op, key->message, key->message_length);
+    if (ret != TEE_ERR_NONE) {
+        TEE_RSAAbort(op);
+        return -1;
+    }
+
+    ret = TEE_RSAVerifyFinal(op, key->message_signature, key->signature_length, &validity);
+
+    return (ret == TEE_ERR_NONE && validity) ? 0 : -1;
+}
+
+static int bench_hmac_stream(BenchThread *t)
+{
+    const BenchKey *key = t->key;
+    uint8_t mac[BENCH_HMAC_SIZE];
+    uint32_t macLen = sizeof(mac);
+    teeHmacOperation_t *op;
+    teeResult_t ret;
+
+    ret = TEE_HMACSignInit(key->hmac_key, key->hmac_key_length, TEE_DIGEST_SHA256, &op);
+    if (ret != TEE_ERR_NONE)
+        return -1;
+
+    ret = TEE_HMACUpdate(op, key->message, key->message_length);
+    if (ret != TEE_ERR_NONE) {
+        TEE_HMACAbort(op);
+        return -1;
+    }
+
+    ret = TEE_HMACSignFinal(op, mac, &macLen);
+    if (ret != TEE_ERR_NONE || macLen != sizeof(mac) ||
+            memcmp(mac, key->message_hmac, sizeof(mac)))
+        return -1;
+
+    return 0;
+}
+
+static int bench_one(BenchThread *t)
+{
+    keymaster_rsa_sign_params_t rsa_params;
+    keymaster_ec_sign_params_t ec_params;
+    const BenchKey *key = t->key;
+    const void *sign_params;
+    uint8_t *out = NULL;
+    size_t out_length = 0;
+    int ret = -1;
+
+    rsa_params.digest_type = DIGEST_NONE;
+    rsa_params.padding_type = PADDING_NONE;
+    ec_params.digest_type = DIGEST_NONE;
+    sign_params = key->ec ? (const void *)&ec_params : (const void *)&rsa_params;
+
+    switch (t->op) {
+    case BENCH_OP_GENERATE:
+        ret = bench_generate(t->dev, t->bits, t->ec, &out, &out_length);
+        break;
+    case BENCH_OP_SIGN:
+        ret = t->dev->sign_data(t->dev, sign_params, key->blob, key->blob_length,
+                                key->data, key->data_length, &out, &out_length);
+        break;
+    case BENCH_OP_VERIFY:
+        ret = t->dev->verify_data(t->dev, sign_params, key->blob, key->blob_length,
+                                  key->data, key->data_length,
+                                  key->signature, key->signature_length);
+        break;
+    case BENCH_OP_PUBKEY:
+        ret = t->dev->get_keypair_public(t->dev, key->blob, key->blob_length,
+                                         &out, &out_length);
+        break;
+    case BENCH_OP_SIGN_BATCH:
+    case BENCH_OP_VERIFY_BATCH:
+        ret = bench_batch(t);
+        break;
+    case BENCH_OP_SIGN_STREAM:
+    case BENCH_OP_VERIFY_STREAM:
+        ret = bench_stream(t);
+        break;
+    case BENCH_OP_HMAC_STREAM:
+        ret = bench_hmac_stream(t);
+        break;
+    }
+
+    free(out);
+
+    return ret;
+}
+
+static void *bench_thread(void *arg)
+{
+    BenchThread *t = reinterpret_cast<BenchThread *>(arg);
+
+    for (unsigned int i = 0; i < t->ops; i++) {
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+
+        if (bench_one(t) != 0) {
+            fprintf(stderr, "%s fail\n", g_op_name[t->op]);
+            t->failed = true;
+            break;
+        }
+
+        t->lat[i] = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    }
+
+    return NULL;
+}
+
+static int compare_nsecs(const void *a, const void *b)
+{
+    nsecs_t x = *(const nsecs_t *)a;
+    nsecs_t y = *(const nsecs_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static nsecs_t percentile(nsecs_t *samples, unsigned int n, unsigned int pct)
+{
+    unsigned int idx = (n * pct) / 100;
+
+    if (idx >= n)
+        idx = n - 1;
+
+    return samples[idx];
+}
+
+static bool run_op(keymaster0_device_t *dev, int op, unsigned int threads,
+    unsigned int ops, unsigned int bits, unsigned int batch, const BenchKey *key)
+{
+    BenchThread t[BENCH_MAX_THREADS];
+    unsigned int calls;
+    unsigned int total;
+    FakeMcStats stats;
+    nsecs_t start, end;
+    nsecs_t *lat;
+    bool ok = true;
+
+    if (op != BENCH_OP_SIGN_BATCH && op != BENCH_OP_VERIFY_BATCH)
+        batch = 1;
+    calls = (ops + batch - 1) / batch;
+    total = threads * calls;
+
+    lat = (nsecs_t *)malloc(sizeof(nsecs_t) * total);
+    if (lat == NULL) {
+        fprintf(stderr, "cannot allocate %u samples\n", total);
+        return false;
+    }
+
+    fake_mc_reset_stats();
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    for (unsigned int i = 0; i < threads; i++) {
+        t[i].dev = dev;
+        t[i].op = op;
+        t[i].ops = calls;
+        t[i].bits = bits;
+        t[i].ec = key->ec;
+        t[i].batch = batch;
+        t[i].key = key;
+        t[i].lat = lat + i * calls;
+        t[i].failed = false;
+        if (pthread_create(&t[i].thread, NULL, bench_thread, &t[i]) != 0) {
+            fprintf(stderr, "pthread_create() fail\n");
+            threads = i;
+            ok = false;
+            break;
+        }
+    }
+
+    for (unsigned int i = 0; i < threads; i++) {
+        pthread_join(t[i].thread, NULL);
+        if (t[i].failed)
+            ok = false;
+    }
+
+    end = systemTime(SYSTEM_TIME_MONOTONIC);
+    fake_mc_get_stats(&stats);
+
+    if (ok) {
+        qsort(lat, total, sizeof(nsecs_t), compare_nsecs);
+
+        printf("%-12s %3u %8.1f %9lld %9lld %9lld %7.2f %7.2f %6u\n",
+                g_op_name[op], threads,
+                total * batch * 1000000000.0 / (end - start),
+                (long long)ns2us(percentile(lat, total, 50)),
+                (long long)ns2us(percentile(lat, total, 90)),
+                (long long)ns2us(percentile(lat, total, 99)),
+                (double)stats.notifies / (total * batch),
+                (double)stats.maps / (total * batch),
+                stats.session_opens);
+    }
+
+    free(lat);
+
+    return ok;
+}
+
+/* one key the sign, verify and pubkey runs share */
+static bool make_key(keymaster0_device_t *dev, unsigned int bits, bool ec,
+    size_t message_length, BenchKey *key)
+{
+    keymaster_rsa_sign_params_t sign_params;
+    keymaster_ec_sign_params_t ec_params;
+
+    memset(key, 0, sizeof(*key));
+    key->ec = ec;
+
+    if (bench_generate(dev, bits, ec, &key->blob, &key->blob_length) != 0) {
+        fprintf(stderr, "generate_keypair(%u) fail\n", bits);
+        return false;
+    }
+
+    key->data_length = ec ? BENCH_EC_DIGEST_SIZE : bits / 8;
+    key->data = (uint8_t *)malloc(key->data_length);
+    if (key->data == NULL)
+        return false;
+    for (size_t i = 0; i < key->data_length; i++)
+        key->data[i] = (uint8_t)(i * 131 + 7);
+    key->data[0] = 0;
+
+    sign_params.digest_type = DIGEST_NONE;
+    sign_params.padding_type = PADDING_NONE;
+    ec_params.digest_type = DIGEST_NONE;
+    if (dev->sign_data(dev, ec ? (const void *)&ec_params : (const void *)&sign_params,
+                       key->blob, key->blob_length,
+                       key->data, key->data_length,
+                       &key->signature, &key->signature_length) != 0) {
+        fprintf(stderr, "sign_data() fail\n");
+        return false;
+    }
+
+    if (ec)
+        return true;
+
+    key->message_length = message_length;
+    key->message = (uint8_t *)malloc(message_length);
+    key->message_signature = (uint8_t *)malloc(key->signature_length);
+    if (key->message == NULL || key->message_signature == NULL)
+        return false;
+    for (size_t i = 0; i < message_length; i++)
+        key->message[i] = (uint8_t)(i * 61 + 3);
+
+    uint32_t sigLen = key->signature_length;
+    if (bench_stream_sign(key, key->message_signature, &sigLen) != TEE_ERR_NONE ||
+            sigLen != key->signature_length) {
+        fprintf(stderr, "TEE_RSASignFinal() fail\n");
+        return false;
+    }
+
+    uint32_t macLen = sizeof(key->message_hmac);
+    if (TEE_HMACKeyGenerate(key->hmac_key, sizeof(key->hmac_key),
+                            &key->hmac_key_length) != TEE_ERR_NONE ||
+            TEE_HMACSign(key->hmac_key, key->hmac_key_length,
+                         key->message, key->message_length,
+                         key->message_hmac, &macLen, TEE_DIGEST_SHA256) != TEE_ERR_NONE) {
+        fprintf(stderr, "TEE_HMACSign() fail\n");
+        return false;
+    }
+
+    return true;
+}
+
+static void free_key(BenchKey *key)
+{
+    free(key->blob);
+    free(key->data);
+    free(key->signature);
+    free(key->message);
+    free(key->message_signature);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "usage: %s [-t threads] [-n ops] [-g gens] [-b bits] [-e bits] [-o op] "
+        "[-k batch] [-z bytes] [-w notify_ns] [-m map_ns] [-s session_ns] [-l sessions] [-v]\n"
+        "  -t concurrent callers, 1 ~ %d (default 1)\n"
+        "  -n operations per thread (default %d)\n"
+        "  -g generate_keypair calls per thread (default %d)\n"
+        "  -b RSA key size: 512, 1024 or 2048 (default 2048)\n"
+        "  -e EC keys of this field size instead: 192, 224, 256, 384 or 521\n"
+        "  -o only run generate, sign, verify, pubkey, signbatch, verifybatch,\n"
+        "     signstream, verifystream or hmacstream\n"
+        "  -k messages per signbatch and verifybatch call, 1 ~ %d (default %d)\n"
+        "  -z message size of signstream, verifystream and hmacstream (default %d)\n"
+        "  -w world switch time of every notification in the stand-in\n"
+        "  -m time of every bulk map and unmap in the stand-in\n"
+        "  -s time to open a session in the stand-in\n"
+        "  -l sessions the stand-in lets be open at once\n"
+        "  -v print the stand-in cost model\n",
+        prog, BENCH_MAX_THREADS, BENCH_DEFAULT_OPS, BENCH_DEFAULT_GENS,
+        BENCH_MAX_BATCH, BENCH_DEFAULT_BATCH, BENCH_DEFAULT_MESSAGE);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int threads = 1;
+    unsigned int ops = BENCH_DEFAULT_OPS;
+    unsigned int gens = BENCH_DEFAULT_GENS;
+    unsigned int bits = 2048;
+    unsigned int ec_bits = 0;
+    unsigned int sessions = 0;
+    unsigned int batch = BENCH_DEFAULT_BATCH;
+    unsigned int message = BENCH_DEFAULT_MESSAGE;
+    const char *only = NULL;
+    keymaster0_device_t *dev;
+    hw_device_t *hw_dev;
+    FakeMcCost cost;
+    bool verbose = false;
+    BenchKey key;
+    int ret = 0;
+    int opt;
+
+    fake_mc_get_cost(&cost);
+
+    while ((opt = getopt(argc, argv, "t:n:g:b:e:o:k:z:w:m:s:l:vh")) != -1) {
+        switch (opt) {
+        case 't':
+            threads = atoi(optarg);
+            break;
+        case 'n':
+            ops = atoi(optarg);
+            break;
+        case 'g':
+            gens = atoi(optarg);
+            break;
+        case 'b':
+            bits = atoi(optarg);
+            break;
+        case 'e':
+            ec_bits = atoi(optarg);
+            break;
+        case 'o':
+            only = optarg;
+            break;
+        case 'k':
+            batch = atoi(optarg);
+            break;
+        case 'z':
+            message = atoi(optarg);
+            break;
+        case 'w':
+            cost.notify = atoll(optarg);
+            break;
+        case 'm':
+            cost.map = atoll(optarg);
+            break;
+        case 's':
+            cost.open_session = atoll(optarg);
+            break;
+        case 'l':
+            sessions = atoi(optarg);
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (threads < 1 || threads > BENCH_MAX_THREADS || ops == 0 ||
+            batch < 1 || batch > BENCH_MAX_BATCH || message == 0 ||
+            (bits != 512 && bits != 1024 && bits != 2048) ||
+            (ec_bits != 0 && ec_bits != 192 && ec_bits != 224 && ec_bits != 256 &&
+             ec_bits != 384 && ec_bits != 521)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    fake_mc_set_cost(&cost);
+    if (sessions)
+        fake_mc_set_max_sessions(sessions);
+
+    if (verbose)
+        printf("cost: open_device %lld open_session %lld map %lld notify %lld (ns)\n",
+               (long long)cost.open_device, (long long)cost.open_session,
+               (long long)cost.map, (long long)cost.notify);
+
+    if (HAL_MODULE_INFO_SYM.common.methods->open(&HAL_MODULE_INFO_SYM.common,
+                                                 KEYSTORE_KEYMASTER, &hw_dev) != 0) {
+        fprintf(stderr, "cannot open the keymaster device\n");
+        return 1;
+    }
+    dev = reinterpret_cast<keymaster0_device_t *>(hw_dev);
+
+    if (ec_bits)
+        bits = ec_bits;
+
+    if (!make_key(dev, bits, ec_bits != 0, message, &key)) {
+        hw_dev->close(hw_dev);
+        return 1;
+    }
+
+    printf("%s-%u, %u ops per thread, %u generate_keypair per thread\n",
+            ec_bits ? "EC" : "RSA", bits, ops, gens);
+    printf("%-12s %3s %8s %9s %9s %9s %7s %7s %6s\n",
+            "op", "thr", "ops/s", "p50 us", "p90 us", "p99 us",
+            "wsw/op", "map/op", "opens");
+
+    for (int op = 0; op < BENCH_OP_MAX; op++) {
+        if (only != NULL && strcmp(only, g_op_name[op]) != 0)
+            continue;
+        if (op == BENCH_OP_GENERATE && gens == 0)
+            continue;
+        if ((op == BENCH_OP_SIGN_BATCH || op == BENCH_OP_VERIFY_BATCH ||
+             op == BENCH_OP_SIGN_STREAM || op == BENCH_OP_VERIFY_STREAM ||
+             op == BENCH_OP_HMAC_STREAM) && ec_bits)
+            continue;
+
+        if (!run_op(dev, op, threads, (op == BENCH_OP_GENERATE) ? gens : ops,
+                    bits, batch, &key))
+            ret = 1;
+    }
+
+    free_key(&key);
+    hw_dev->close(hw_dev);
+
+    return ret;
+}
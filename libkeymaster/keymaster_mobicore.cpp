@@ -18,6 +18,7 @@
 #include <errno.h>
 #include <string.h>
 #include <stdint.h>
+#include <pthread.h>
 
 #include <hardware/hardware.h>
 #include <hardware/keymaster0.h>
@@ -25,8 +26,10 @@
 #include <openssl/evp.h>
 #include <openssl/bio.h>
 #include <openssl/rsa.h>
+#include <openssl/ec.h>
 #include <openssl/err.h>
 #include <openssl/x509.h>
+#include <openssl/sha.h>
 
 #include <keymaster/UniquePtr.h>
 
@@ -38,6 +41,16 @@
 #define RSA_KEY_BUFFER_SIZE   1536
 #define RSA_KEY_MAX_SIZE      (2048 >> 3)
 
+#define EC_KEY_BUFFER_SIZE    512
+/* uncompressed P-521 point */
+#define EC_POINT_MAX_SIZE     (1 + 2 * 66)
+/* DER encoded ECDSA signature of P-521 */
+#define EC_SIGNATURE_MAX_SIZE 144
+
+/* public keys of recently used key blobs, as returned to keystore */
+#define PUBKEY_CACHE_ENTRIES  16
+#define PUBKEY_CACHE_MAX_DATA 1024
+
 using keymaster::UniquePtr;
 
 struct BIGNUM_Delete {
@@ -68,6 +81,20 @@ struct RSA_Delete {
 };
 typedef UniquePtr<RSA, RSA_Delete> Unique_RSA;
 
+struct EC_KEY_Delete {
+    void operator()(EC_KEY* p) const {
+        EC_KEY_free(p);
+    }
+};
+typedef UniquePtr<EC_KEY, EC_KEY_Delete> Unique_EC_KEY;
+
+struct EC_POINT_Delete {
+    void operator()(EC_POINT* p) const {
+        EC_POINT_free(p);
+    }
+};
+typedef UniquePtr<EC_POINT, EC_POINT_Delete> Unique_EC_POINT;
+
 typedef UniquePtr<keymaster0_device_t> Unique_keymaster0_device_t;
 
 /**
@@ -94,12 +121,179 @@ static void logOpenSSLError(const char* location) {
     ERR_remove_state(0);
 }
 
+/*
+ * RSA key blobs are the bare secure object of the trustlet, as they have
+ * always been. EC key blobs carry this magic in front of it, which no
+ * secure object starts with, to be told apart.
+ */
+static const uint8_t ec_blob_magic[4] = { 'K', 'M', 'E', 'C' };
+
+static bool is_ec_blob(const uint8_t* blob, size_t blob_length) {
+    return blob_length > sizeof(ec_blob_magic) &&
+            !memcmp(blob, ec_blob_magic, sizeof(ec_blob_magic));
+}
+
+static const struct {
+    uint32_t field_size;
+    int nid;
+    teeEcCurve_t curve;
+} ec_curves[] = {
+    { 192, NID_X9_62_prime192v1, TEE_ECC_CURVE_NIST_P192 },
+    { 224, NID_secp224r1, TEE_ECC_CURVE_NIST_P224 },
+    { 256, NID_X9_62_prime256v1, TEE_ECC_CURVE_NIST_P256 },
+    { 384, NID_secp384r1, TEE_ECC_CURVE_NIST_P384 },
+    { 521, NID_secp521r1, TEE_ECC_CURVE_NIST_P521 },
+};
+
+/* field_size or nid picks the curve; the other is 0 */
+static bool ec_curve_find(uint32_t field_size, int nid, teeEcCurve_t* curve) {
+    for (size_t i = 0; i < sizeof(ec_curves) / sizeof(ec_curves[0]); i++) {
+        if ((field_size != 0 && ec_curves[i].field_size == field_size) ||
+                (nid != 0 && ec_curves[i].nid == nid)) {
+            *curve = ec_curves[i].curve;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static int ec_curve_nid(teeEcCurve_t curve) {
+    for (size_t i = 0; i < sizeof(ec_curves) / sizeof(ec_curves[0]); i++) {
+        if (ec_curves[i].curve == curve)
+            return ec_curves[i].nid;
+    }
+
+    return NID_undef;
+}
+
+/*
+ * The public half of a key blob never changes, so its X.509 encoding is
+ * kept here by the SHA-256 of the blob and handed out again without going
+ * to the trustlet. The least recently used entry makes room for a new one.
+ */
+struct PubKeyCacheEntry {
+    uint8_t blob_hash[SHA256_DIGEST_LENGTH];
+    uint8_t x509[PUBKEY_CACHE_MAX_DATA];
+    size_t x509_length;
+    unsigned long last_used;
+    bool valid;
+};
+
+static PubKeyCacheEntry pubkey_cache[PUBKEY_CACHE_ENTRIES];
+static unsigned long pubkey_cache_clock;
+static pthread_mutex_t pubkey_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static PubKeyCacheEntry* pubkey_cache_find(const uint8_t* blob_hash) {
+    for (int i = 0; i < PUBKEY_CACHE_ENTRIES; i++) {
+        if (pubkey_cache[i].valid &&
+                !memcmp(pubkey_cache[i].blob_hash, blob_hash, SHA256_DIGEST_LENGTH))
+            return &pubkey_cache[i];
+    }
+
+    return NULL;
+}
+
+/* returns a copy of the cached public key to be freed by the caller */
+static bool pubkey_cache_get(const uint8_t* blob_hash,
+        uint8_t** x509_data, size_t* x509_data_length) {
+    bool found = false;
+
+    pthread_mutex_lock(&pubkey_cache_lock);
+
+    PubKeyCacheEntry* entry = pubkey_cache_find(blob_hash);
+    if (entry != NULL) {
+        uint8_t* data = reinterpret_cast<uint8_t*>(malloc(entry->x509_length));
+        if (data != NULL) {
+            memcpy(data, entry->x509, entry->x509_length);
+            entry->last_used = ++pubkey_cache_clock;
+            *x509_data = data;
+            *x509_data_length = entry->x509_length;
+            found = true;
+        }
+    }
+
+    pthread_mutex_unlock(&pubkey_cache_lock);
+
+    return found;
+}
+
+static void pubkey_cache_put(const uint8_t* blob_hash,
+        const uint8_t* x509_data, size_t x509_data_length) {
+    if (x509_data_length > PUBKEY_CACHE_MAX_DATA)
+        return;
+
+    pthread_mutex_lock(&pubkey_cache_lock);
+
+    PubKeyCacheEntry* entry = pubkey_cache_find(blob_hash);
+    if (entry == NULL) {
+        entry = &pubkey_cache[0];
+        for (int i = 1; i < PUBKEY_CACHE_ENTRIES && entry->valid; i++) {
+            if (!pubkey_cache[i].valid || pubkey_cache[i].last_used < entry->last_used)
+                entry = &pubkey_cache[i];
+        }
+    }
+
+    memcpy(entry->blob_hash, blob_hash, SHA256_DIGEST_LENGTH);
+    memcpy(entry->x509, x509_data, x509_data_length);
+    entry->x509_length = x509_data_length;
+    entry->last_used = ++pubkey_cache_clock;
+    entry->valid = true;
+
+    pthread_mutex_unlock(&pubkey_cache_lock);
+}
+
+/* blob_hash NULL drops every entry */
+static void pubkey_cache_remove(const uint8_t* blob_hash) {
+    pthread_mutex_lock(&pubkey_cache_lock);
+
+    for (int i = 0; i < PUBKEY_CACHE_ENTRIES; i++) {
+        if (blob_hash == NULL ||
+                !memcmp(pubkey_cache[i].blob_hash, blob_hash, SHA256_DIGEST_LENGTH))
+            pubkey_cache[i].valid = false;
+    }
+
+    pthread_mutex_unlock(&pubkey_cache_lock);
+}
+
+static int generate_ec_keypair(const keymaster_ec_keygen_params_t* ec_params,
+        uint8_t** keyBlob, size_t* keyBlobLength) {
+    teeEcCurve_t curve;
+    uint32_t so_len = 0;
+    teeResult_t ret = TEE_ERR_NONE;
+
+    if (!ec_curve_find(ec_params->field_size, 0, &curve)) {
+        ALOGE("field size(%d) is not supported\n", ec_params->field_size);
+        return -1;
+    }
+
+    UniquePtr<uint8_t> keyDataPtr(reinterpret_cast<uint8_t*>(
+            malloc(sizeof(ec_blob_magic) + EC_KEY_BUFFER_SIZE)));
+    if (keyDataPtr.get() == NULL) {
+        ALOGE("memory allocation is failed");
+        return -1;
+    }
+
+    ret = TEE_ECGenerateKeyPair(curve, keyDataPtr.get() + sizeof(ec_blob_magic),
+                                EC_KEY_BUFFER_SIZE, &so_len);
+    if (ret != TEE_ERR_NONE) {
+        ALOGE("TEE_ECGenerateKeyPair() is failed: %d", ret);
+        return -1;
+    }
+
+    memcpy(keyDataPtr.get(), ec_blob_magic, sizeof(ec_blob_magic));
+    *keyBlobLength = sizeof(ec_blob_magic) + so_len;
+    *keyBlob = keyDataPtr.release();
+
+    return 0;
+}
+
 static int exynos_km_generate_keypair(const keymaster0_device_t*,
         const keymaster_keypair_t key_type, const void* key_params,
         uint8_t** keyBlob, size_t* keyBlobLength) {
     teeResult_t ret = TEE_ERR_NONE;
 
-    if (key_type != TYPE_RSA) {
+    if (key_type != TYPE_RSA && key_type != TYPE_EC) {
         ALOGE("Unsupported key type %d", key_type);
         return -1;
     } else if (key_params == NULL) {
@@ -107,6 +301,10 @@ static int exynos_km_generate_keypair(const keymaster0_device_t*,
         return -1;
     }
 
+    if (key_type == TYPE_EC)
+        return generate_ec_keypair((const keymaster_ec_keygen_params_t*) key_params,
+                                   keyBlob, keyBlobLength);
+
     keymaster_rsa_keygen_params_t* rsa_params = (keymaster_rsa_keygen_params_t*) key_params;
 
     if ((rsa_params->modulus_size != 512) &&
@@ -135,6 +333,71 @@ static int exynos_km_generate_keypair(const keymaster0_device_t*,
     return 0;
 }
 
+static int import_ec_keypair(EVP_PKEY* pkey,
+        uint8_t** key_blob, size_t* key_blob_length) {
+    uint8_t kbuf[EC_KEY_BUFFER_SIZE];
+    teeEcKeyMeta_t metadata;
+    teeEcCurve_t curve;
+    uint32_t so_len;
+    teeResult_t ret = TEE_ERR_NONE;
+
+    Unique_EC_KEY ec(EVP_PKEY_get1_EC_KEY(pkey));
+    if (ec.get() == NULL) {
+        logOpenSSLError("get ec key format");
+        return -1;
+    }
+
+    const EC_GROUP* group = EC_KEY_get0_group(ec.get());
+    const EC_POINT* pub = EC_KEY_get0_public_key(ec.get());
+    const BIGNUM* priv = EC_KEY_get0_private_key(ec.get());
+    if (group == NULL || pub == NULL || priv == NULL) {
+        ALOGE("EC key is incomplete");
+        return -1;
+    }
+
+    if (!ec_curve_find(0, EC_GROUP_get_curve_name(group), &curve)) {
+        ALOGE("EC curve(%d) is not supported\n", EC_GROUP_get_curve_name(group));
+        return -1;
+    }
+
+    metadata.curve = curve;
+    metadata.lenpub = EC_POINT_point2oct(group, pub, POINT_CONVERSION_UNCOMPRESSED,
+                                         kbuf + sizeof(metadata),
+                                         sizeof(kbuf) - sizeof(metadata), NULL);
+    if (metadata.lenpub == 0 ||
+            (size_t)BN_num_bytes(priv) > sizeof(kbuf) - sizeof(metadata) - metadata.lenpub) {
+        logOpenSSLError("encode ec key");
+        return -1;
+    }
+    metadata.lenpriv = BN_bn2bin(priv, kbuf + sizeof(metadata) + metadata.lenpub);
+
+    memcpy(kbuf, &metadata, sizeof(metadata));
+
+    UniquePtr<uint8_t> outPtr(reinterpret_cast<uint8_t*>(
+            malloc(sizeof(ec_blob_magic) + EC_KEY_BUFFER_SIZE)));
+    if (outPtr.get() == NULL) {
+        ALOGE("memory allocation is failed");
+        OPENSSL_cleanse(kbuf, sizeof(kbuf));
+        return -1;
+    }
+
+    so_len = EC_KEY_BUFFER_SIZE;
+
+    ret = TEE_ECKeyImport(kbuf, sizeof(metadata) + metadata.lenpub + metadata.lenpriv,
+                          outPtr.get() + sizeof(ec_blob_magic), &so_len);
+    OPENSSL_cleanse(kbuf, sizeof(kbuf));
+    if (ret != TEE_ERR_NONE) {
+        ALOGE("TEE_ECKeyImport() is failed: %d", ret);
+        return -1;
+    }
+
+    memcpy(outPtr.get(), ec_blob_magic, sizeof(ec_blob_magic));
+    *key_blob_length = sizeof(ec_blob_magic) + so_len;
+    *key_blob = outPtr.release();
+
+    return 0;
+}
+
 static int exynos_km_import_keypair(const keymaster0_device_t*,
         const uint8_t* key, const size_t key_length,
         uint8_t** key_blob, size_t* key_blob_length) {
@@ -168,6 +431,9 @@ static int exynos_km_import_keypair(const keymaster0_device_t*,
     }
     OWNERSHIP_TRANSFERRED(pkcs8);
 
+    if (EVP_PKEY_type(pkey->type) == EVP_PKEY_EC)
+        return import_ec_keypair(pkey.get(), key_blob, key_blob_length);
+
     /* change key format */
     Unique_RSA rsa(EVP_PKEY_get1_RSA(pkey.get()));
     if (rsa.get() == NULL) {
@@ -256,28 +522,22 @@ static int exynos_km_import_keypair(const keymaster0_device_t*,
     return 0;
 }
 
-static int exynos_km_get_keypair_public(const struct keymaster0_device*,
-        const uint8_t* key_blob, const size_t key_blob_length,
-        uint8_t** x509_data, size_t* x509_data_length) {
+/* the public key of an RSA key blob */
+static EVP_PKEY* rsa_blob_public(const uint8_t* key_blob, const size_t key_blob_length) {
     uint32_t bin_mod_len;
     uint32_t bin_exp_len;
     teeResult_t ret = TEE_ERR_NONE;
 
-    if (x509_data == NULL || x509_data_length == NULL) {
-        ALOGE("output public key buffer == NULL");
-        return -1;
-    }
-
     UniquePtr<uint8_t> binModPtr(reinterpret_cast<uint8_t*>(malloc(RSA_KEY_MAX_SIZE)));
     if (binModPtr.get() == NULL) {
         ALOGE("memory allocation is failed");
-        return -1;
+        return NULL;
     }
 
     UniquePtr<uint8_t> binExpPtr(reinterpret_cast<uint8_t*>(malloc(sizeof(uint32_t))));
     if (binExpPtr.get() == NULL) {
         ALOGE("memory allocation is failed");
-        return -1;
+        return NULL;
     }
 
     bin_mod_len = RSA_KEY_MAX_SIZE;
@@ -287,19 +547,19 @@ static int exynos_km_get_keypair_public(const struct keymaster0_device*,
 			&bin_exp_len);
     if (ret != TEE_ERR_NONE) {
         ALOGE("TEE_GetPubKey() is failed: %d", ret);
-        return -1;
+        return NULL;
     }
 
     Unique_BIGNUM bn_mod(BN_new());
     if (bn_mod.get() == NULL) {
         ALOGE("memory allocation is failed");
-        return -1;
+        return NULL;
     }
 
     Unique_BIGNUM bn_exp(BN_new());
     if (bn_exp.get() == NULL) {
         ALOGE("memory allocation is failed");
-        return -1;
+        return NULL;
     }
 
     BN_bin2bn(binModPtr.get(), bin_mod_len, bn_mod.get());
@@ -309,7 +569,7 @@ static int exynos_km_get_keypair_public(const struct keymaster0_device*,
     Unique_RSA rsa(RSA_new());
     if (rsa.get() == NULL) {
         logOpenSSLError("rsa.get");
-        return -1;
+        return NULL;
     }
 
     RSA* rsa_tmp = rsa.get();
@@ -321,15 +581,91 @@ static int exynos_km_get_keypair_public(const struct keymaster0_device*,
     Unique_EVP_PKEY pkey(EVP_PKEY_new());
     if (pkey.get() == NULL) {
         logOpenSSLError("allocate EVP_PKEY");
-        return -1;
+        return NULL;
     }
 
     if (EVP_PKEY_assign_RSA(pkey.get(), rsa.get()) == 0) {
         logOpenSSLError("assing RSA to EVP_PKEY");
-        return -1;
+        return NULL;
     }
     OWNERSHIP_TRANSFERRED(rsa);
 
+    return pkey.release();
+}
+
+/* the public key of an EC key blob */
+static EVP_PKEY* ec_blob_public(const uint8_t* key_blob, const size_t key_blob_length) {
+    uint8_t point[EC_POINT_MAX_SIZE];
+    uint32_t point_len = sizeof(point);
+    teeEcCurve_t curve;
+    teeResult_t ret = TEE_ERR_NONE;
+
+    ret = TEE_ECGetPubKey(key_blob + sizeof(ec_blob_magic),
+                          key_blob_length - sizeof(ec_blob_magic),
+                          &curve, point, &point_len);
+    if (ret != TEE_ERR_NONE) {
+        ALOGE("TEE_ECGetPubKey() is failed: %d", ret);
+        return NULL;
+    }
+
+    Unique_EC_KEY ec(EC_KEY_new_by_curve_name(ec_curve_nid(curve)));
+    if (ec.get() == NULL) {
+        logOpenSSLError("ec.get");
+        return NULL;
+    }
+
+    /* name the curve in the X.509 encoding rather than spell it out */
+    EC_KEY_set_asn1_flag(ec.get(), OPENSSL_EC_NAMED_CURVE);
+
+    Unique_EC_POINT pub(EC_POINT_new(EC_KEY_get0_group(ec.get())));
+    if (pub.get() == NULL ||
+            !EC_POINT_oct2point(EC_KEY_get0_group(ec.get()), pub.get(), point, point_len, NULL) ||
+            !EC_KEY_set_public_key(ec.get(), pub.get())) {
+        logOpenSSLError("decode ec public key");
+        return NULL;
+    }
+
+    /* assign to EVP */
+    Unique_EVP_PKEY pkey(EVP_PKEY_new());
+    if (pkey.get() == NULL) {
+        logOpenSSLError("allocate EVP_PKEY");
+        return NULL;
+    }
+
+    if (EVP_PKEY_assign_EC_KEY(pkey.get(), ec.get()) == 0) {
+        logOpenSSLError("assign EC_KEY to EVP_PKEY");
+        return NULL;
+    }
+    OWNERSHIP_TRANSFERRED(ec);
+
+    return pkey.release();
+}
+
+static int exynos_km_get_keypair_public(const struct keymaster0_device*,
+        const uint8_t* key_blob, const size_t key_blob_length,
+        uint8_t** x509_data, size_t* x509_data_length) {
+    uint8_t blob_hash[SHA256_DIGEST_LENGTH];
+
+    if (x509_data == NULL || x509_data_length == NULL) {
+        ALOGE("output public key buffer == NULL");
+        return -1;
+    }
+
+    if (key_blob == NULL) {
+        ALOGE("key blob == NULL");
+        return -1;
+    }
+
+    SHA256(key_blob, key_blob_length, blob_hash);
+    if (pubkey_cache_get(blob_hash, x509_data, x509_data_length))
+        return 0;
+
+    Unique_EVP_PKEY pkey(is_ec_blob(key_blob, key_blob_length) ?
+                         ec_blob_public(key_blob, key_blob_length) :
+                         rsa_blob_public(key_blob, key_blob_length));
+    if (pkey.get() == NULL)
+        return -1;
+
     /* change to x.509 format */
     int len = i2d_PUBKEY(pkey.get(), NULL);
     if (len <= 0) {
@@ -349,12 +685,68 @@ static int exynos_km_get_keypair_public(const struct keymaster0_device*,
         return -1;
     }
 
+    pubkey_cache_put(blob_hash, key.get(), len);
+
     *x509_data_length = len;
     *x509_data = key.release();
 
     return 0;
 }
 
+static int exynos_km_delete_keypair(const struct keymaster0_device*,
+        const uint8_t* key_blob, const size_t key_blob_length) {
+    uint8_t blob_hash[SHA256_DIGEST_LENGTH];
+
+    if (key_blob == NULL) {
+        ALOGE("key blob == NULL");
+        return -1;
+    }
+
+    /* the blob is the key; keystore deletes its file, we forget its public half */
+    SHA256(key_blob, key_blob_length, blob_hash);
+    pubkey_cache_remove(blob_hash);
+
+    return 0;
+}
+
+static int exynos_km_delete_all(const struct keymaster0_device*) {
+    pubkey_cache_remove(NULL);
+
+    return 0;
+}
+
+static int sign_data_ec(const keymaster_ec_sign_params_t* sign_params,
+        const uint8_t* keyBlob, const size_t keyBlobLength,
+        const uint8_t* data, const size_t dataLength,
+        uint8_t** signedData, size_t* signedDataLength) {
+    uint32_t sig_len = EC_SIGNATURE_MAX_SIZE;
+    teeResult_t ret = TEE_ERR_NONE;
+
+    if (sign_params->digest_type != DIGEST_NONE) {
+        ALOGE("Cannot handle digest type %d", sign_params->digest_type);
+        return -1;
+    }
+
+    UniquePtr<uint8_t> signedDataPtr(reinterpret_cast<uint8_t*>(malloc(EC_SIGNATURE_MAX_SIZE)));
+    if (signedDataPtr.get() == NULL) {
+        ALOGE("memory allocation is failed");
+        return -1;
+    }
+
+    /* the data is the digest; ECDSA takes as many of its bits as the curve has */
+    ret = TEE_ECSign(keyBlob + sizeof(ec_blob_magic), keyBlobLength - sizeof(ec_blob_magic),
+                     data, dataLength, signedDataPtr.get(), &sig_len);
+    if (ret != TEE_ERR_NONE) {
+        ALOGE("TEE_ECSign() is failed: %d", ret);
+        return -1;
+    }
+
+    *signedDataLength = sig_len;
+    *signedData = signedDataPtr.release();
+
+    return 0;
+}
+
 static int exynos_km_sign_data(const keymaster0_device_t*,
         const void* params,
         const uint8_t* keyBlob, const size_t keyBlobLength,
@@ -370,6 +762,10 @@ static int exynos_km_sign_data(const keymaster0_device_t*,
         return -1;
     }
 
+    if (is_ec_blob(keyBlob, keyBlobLength))
+        return sign_data_ec((const keymaster_ec_sign_params_t*) params, keyBlob, keyBlobLength,
+                            data, dataLength, signedData, signedDataLength);
+
     keymaster_rsa_sign_params_t* sign_params = (keymaster_rsa_sign_params_t*) params;
     if (sign_params->digest_type != DIGEST_NONE) {
         ALOGE("Cannot handle digest type %d", sign_params->digest_type);
@@ -387,12 +783,12 @@ static int exynos_km_sign_data(const keymaster0_device_t*,
 
     *signedDataLength = RSA_KEY_MAX_SIZE;
 
-    /* binder gives us read-only mappings we can't use with mobicore */
-    void *tmpData = malloc(dataLength);
-    memcpy(tmpData, data, dataLength);
-    ret = TEE_RSASign(keyBlob, keyBlobLength, (const uint8_t *)tmpData, dataLength, signedDataPtr.get(),
+    /*
+     * binder gives us read-only mappings we can't use with mobicore; the
+     * connector copies the input into memory already mapped to the trustlet
+     */
+    ret = TEE_RSASign(keyBlob, keyBlobLength, data, dataLength, signedDataPtr.get(),
 			(uint32_t *)signedDataLength, TEE_RSA_NODIGEST_NOPADDING);
-    free(tmpData);
     if (ret != TEE_ERR_NONE) {
         ALOGE("TEE_RSASign() is failed: %d", ret);
         return -1;
@@ -403,6 +799,28 @@ static int exynos_km_sign_data(const keymaster0_device_t*,
     return 0;
 }
 
+static int verify_data_ec(const keymaster_ec_sign_params_t* sign_params,
+        const uint8_t* keyBlob, const size_t keyBlobLength,
+        const uint8_t* signedData, const size_t signedDataLength,
+        const uint8_t* signature, const size_t signatureLength) {
+    bool result;
+    teeResult_t ret = TEE_ERR_NONE;
+
+    if (sign_params->digest_type != DIGEST_NONE) {
+        ALOGE("Cannot handle digest type %d", sign_params->digest_type);
+        return -1;
+    }
+
+    ret = TEE_ECVerify(keyBlob + sizeof(ec_blob_magic), keyBlobLength - sizeof(ec_blob_magic),
+                       signedData, signedDataLength, signature, signatureLength, &result);
+    if (ret != TEE_ERR_NONE) {
+        ALOGE("TEE_ECVerify() is failed: %d", ret);
+        return -1;
+    }
+
+    return (result == true) ? 0 : -1;
+}
+
 static int exynos_km_verify_data(const keymaster0_device_t*,
         const void* params,
         const uint8_t* keyBlob, const size_t keyBlobLength,
@@ -416,6 +834,10 @@ static int exynos_km_verify_data(const keymaster0_device_t*,
         return -1;
     }
 
+    if (is_ec_blob(keyBlob, keyBlobLength))
+        return verify_data_ec((const keymaster_ec_sign_params_t*) params, keyBlob, keyBlobLength,
+                              signedData, signedDataLength, signature, signatureLength);
+
     keymaster_rsa_sign_params_t* sign_params = (keymaster_rsa_sign_params_t*) params;
     if (sign_params->digest_type != DIGEST_NONE) {
         ALOGE("Cannot handle digest type %d", sign_params->digest_type);
@@ -428,14 +850,8 @@ static int exynos_km_verify_data(const keymaster0_device_t*,
         return -1;
     }
 
-    void *tmpSignedData = malloc(signedDataLength);
-    memcpy(tmpSignedData, signedData, signedDataLength);
-    void *tmpSig = malloc(signatureLength);
-    memcpy(tmpSig, signature, signatureLength);
-    ret = TEE_RSAVerify(keyBlob, keyBlobLength, (const uint8_t*)tmpSignedData, signedDataLength, (const uint8_t *)tmpSig,
+    ret = TEE_RSAVerify(keyBlob, keyBlobLength, signedData, signedDataLength, signature,
 			signatureLength, TEE_RSA_NODIGEST_NOPADDING, &result);
-    free(tmpSignedData);
-    free(tmpSig);
     if (ret != TEE_ERR_NONE) {
         ALOGE("TEE_RSAVerify() is failed: %d", ret);
         return -1;
@@ -467,13 +883,14 @@ static int exynos_km_open(const hw_module_t* module, const char* name,
     dev->common.module = (struct hw_module_t*) module;
     dev->common.close = exynos_km_close;
 
-    dev->flags = 0;
+    /* older trustlets have no EC commands */
+    dev->flags = TEE_ECSupported() ? KEYMASTER_SUPPORTS_EC : 0;
 
     dev->generate_keypair = exynos_km_generate_keypair;
     dev->import_keypair = exynos_km_import_keypair;
     dev->get_keypair_public = exynos_km_get_keypair_public;
-    dev->delete_keypair = NULL;
-    dev->delete_all = NULL;
+    dev->delete_keypair = exynos_km_delete_keypair;
+    dev->delete_all = exynos_km_delete_all;
     dev->sign_data = exynos_km_sign_data;
     dev->verify_data = exynos_km_verify_data;
 
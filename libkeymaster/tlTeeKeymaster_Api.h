@@ -47,6 +47,23 @@
 #define CMD_ID_TEE_HMAC_VERIFY        6
 #define CMD_ID_TEE_KEY_IMPORT         7
 #define CMD_ID_TEE_GET_PUB_KEY        8
+#define CMD_ID_TEE_RSA_SIGN_BATCH     9
+#define CMD_ID_TEE_RSA_VERIFY_BATCH   10
+#define CMD_ID_TEE_HMAC_SIGN_BATCH    11
+#define CMD_ID_TEE_HMAC_VERIFY_BATCH  12
+#define CMD_ID_TEE_EC_GEN_KEY_PAIR    13
+#define CMD_ID_TEE_EC_SIGN            14
+#define CMD_ID_TEE_EC_VERIFY          15
+#define CMD_ID_TEE_EC_KEY_IMPORT      16
+#define CMD_ID_TEE_EC_GET_PUB_KEY     17
+#define CMD_ID_TEE_RSA_DIGEST_INIT    18
+#define CMD_ID_TEE_RSA_DIGEST_UPDATE  19
+#define CMD_ID_TEE_RSA_DIGEST_FINAL   20
+#define CMD_ID_TEE_RSA_DIGEST_ABORT   21
+#define CMD_ID_TEE_HMAC_INIT          22
+#define CMD_ID_TEE_HMAC_UPDATE        23
+#define CMD_ID_TEE_HMAC_FINAL         24
+#define CMD_ID_TEE_HMAC_ABORT         25
 /*... add more command ids when needed */
 
 
@@ -198,7 +215,7 @@ typedef struct {
 } rsakeymeta_t;
 
 /**
- *  Key import data structure
+ *  Key import data structure, of RSA and EC keys
  */
 typedef struct {
     uint32_t     keydata;           /**< Key data buffer */
@@ -222,6 +239,177 @@ typedef struct {
 } getpubkey_t;
 
 
+/**
+ * Batch entry, one per message of a batch sign or verify command.
+ * The batch buffer starts with the entry table; the messages and
+ * signatures follow it:
+ *
+ * |-- entry 0 --|-- ... --|-- entry n-1 --|-- messages and signatures --|
+ *
+ * Offsets are from the start of the batch buffer.
+ */
+typedef struct {
+    uint32_t plainoffset;       /**< Offset of plaintext data */
+    uint32_t plaindatalen;      /**< Length of plaintext data */
+    uint32_t signatureoffset;   /**< Offset of signature data */
+    uint32_t signaturedatalen;  /**< Length of signature data buffer / signature */
+    uint32_t result;            /**< Return code of the entry (provided by the trustlet) */
+    uint32_t validity;          /**< Signature validity, verify only (provided by the trustlet) */
+} batchentry_t;
+
+
+/**
+ *  Batch sign / verify data structure
+ */
+typedef struct {
+    uint32_t keydata;           /**< Key data buffer */
+    uint32_t keydatalen;        /**< Length of key data buffer */
+    uint32_t batchdata;         /**< Batch buffer */
+    uint32_t batchdatalen;      /**< Length of batch buffer */
+    uint32_t count;             /**< Number of entries */
+    uint32_t algorithm;         /**< RSA signing algorithm or HMAC digest */
+} signbatch_t;
+
+
+/**
+ * Generate EC key data
+ * Response data contains generated EC key pair data wrapped as secure object
+ */
+typedef struct {
+    uint32_t curve;          /**< Curve, e.g. NIST P-256 */
+    uint32_t keydata;        /**< Key data buffer passed by TLC  */
+    uint32_t keydatalen;     /**< Length of key data buffer */
+    uint32_t solen;          /**< Secure object length  (of key data) (provided by the trustlet)  */
+} ecgenkey_t;
+
+
+/**
+ *  ECDSA sign data structure
+ */
+typedef struct {
+    uint32_t keydata;           /**< Key data buffer */
+    uint32_t keydatalen;        /**< Length of key data buffer */
+    uint32_t plaindata;         /**< Digest to be signed */
+    uint32_t plaindatalen;      /**< Length of digest */
+    uint32_t signaturedata;     /**< Signature data buffer (DER encoded ECDSA-Sig-Value) */
+    uint32_t signaturedatalen;  /**< Length of signature data buffer */
+} ecsign_t;
+
+
+/**
+ *  ECDSA signature verify data structure
+ */
+typedef struct {
+    uint32_t keydata;           /**< Key data buffer */
+    uint32_t keydatalen;        /**< Length of key data buffer */
+    uint32_t plaindata;         /**< Signed digest */
+    uint32_t plaindatalen;      /**< Length of digest */
+    uint32_t signaturedata;     /**< Signature data buffer (DER encoded ECDSA-Sig-Value) */
+    uint32_t signaturedatalen;  /**< Length of signature data buffer */
+    bool     validity;          /**< Signature validity */
+} ecverify_t;
+
+
+/**
+ * EC key metadata
+ *
+ * EC key data is wrapped as below:
+ *
+ * |-- Key metadata --|-- Public point (uncompressed) --|-- Private value --|
+ */
+typedef struct {
+    uint32_t     curve;         /**< Curve, e.g. NIST P-256 */
+    uint32_t     lenpub;        /**< Public point length */
+    uint32_t     lenpriv;       /**< Private value length */
+} eckeymeta_t;
+
+
+/**
+ *  Get EC public key data structure
+ */
+typedef struct {
+    uint32_t keydata;           /**< Key data buffer */
+    uint32_t keydatalen;        /**< Length of key data buffer */
+    uint32_t curve;             /**< Curve (provided by the trustlet) */
+    uint32_t point;             /**< Public point, uncompressed */
+    uint32_t pointlen;          /**< Public point length */
+} ecgetpubkey_t;
+
+
+/**
+ * Streamed RSA sign / verify
+ *
+ * INIT unwraps the key and starts the digest of an operation, UPDATE
+ * feeds it message data and FINAL pads and signs or verifies the digest.
+ * An operation lives in the trustlet instance of the session it was
+ * started on. It ends with FINAL, ABORT or any error.
+ */
+typedef struct {
+    uint32_t keydata;           /**< Key data buffer */
+    uint32_t keydatalen;        /**< Length of key data buffer */
+    uint32_t algorithm;         /**< Signing algorithm, one with a digest */
+    uint32_t verify;            /**< 0 to sign, 1 to verify */
+    uint32_t handle;            /**< Operation handle (provided by the trustlet) */
+} rsadigestinit_t;
+
+
+/**
+ *  Streamed RSA sign / verify message data
+ */
+typedef struct {
+    uint32_t handle;            /**< Operation handle */
+    uint32_t plaindata;         /**< Plaintext data buffer */
+    uint32_t plaindatalen;      /**< Length of plaintext data buffer */
+} rsadigestupdate_t;
+
+
+/**
+ *  Streamed RSA sign / verify result, also used by ABORT
+ */
+typedef struct {
+    uint32_t handle;            /**< Operation handle */
+    uint32_t signaturedata;     /**< Signature data buffer */
+    uint32_t signaturedatalen;  /**< Length of signature data buffer / signature */
+    bool     validity;          /**< Signature validity, verify only */
+} rsadigestfinal_t;
+
+
+/**
+ * Streamed HMAC sign / verify
+ *
+ * Same life cycle as the streamed RSA operations: INIT unwraps the key,
+ * UPDATE feeds message data and FINAL returns or checks the HMAC.
+ */
+typedef struct {
+    uint32_t keydata;           /**< Key data buffer */
+    uint32_t keydatalen;        /**< Length of key data buffer */
+    uint32_t digest;            /**< Digest algorithm */
+    uint32_t verify;            /**< 0 to sign, 1 to verify */
+    uint32_t handle;            /**< Operation handle (provided by the trustlet) */
+} hmacinit_t;
+
+
+/**
+ *  Streamed HMAC message data
+ */
+typedef struct {
+    uint32_t handle;            /**< Operation handle */
+    uint32_t plaindata;         /**< Plaintext data buffer */
+    uint32_t plaindatalen;      /**< Length of plaintext data buffer */
+} hmacupdate_t;
+
+
+/**
+ *  Streamed HMAC result, also used by ABORT
+ */
+typedef struct {
+    uint32_t handle;            /**< Operation handle */
+    uint32_t signaturedata;     /**< Signature data buffer */
+    uint32_t signaturedatalen;  /**< Length of signature data buffer / signature */
+    bool     validity;          /**< Signature validity, verify only */
+} hmacfinal_t;
+
+
 /**
  * TCI message data.
  */
@@ -240,6 +428,17 @@ typedef struct {
         hmacverify_t hmacverify;
         keyimport_t  keyimport;
         getpubkey_t  getpubkey;
+        signbatch_t  signbatch;
+        ecgenkey_t   ecgenkey;
+        ecsign_t     ecsign;
+        ecverify_t   ecverify;
+        ecgetpubkey_t ecgetpubkey;
+        rsadigestinit_t   rsadigestinit;
+        rsadigestupdate_t rsadigestupdate;
+        rsadigestfinal_t  rsadigestfinal;
+        hmacinit_t        hmacinit;
+        hmacupdate_t      hmacupdate;
+        hmacfinal_t       hmacfinal;
     };
 
 } tciMessage_t, *tciMessage_ptr;
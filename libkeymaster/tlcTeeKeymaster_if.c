@@ -30,8 +30,15 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 
 #include "MobiCoreDriverApi.h"
 #include "tlTeeKeymaster_Api.h"
@@ -43,10 +50,168 @@
 static const uint32_t gDeviceId = MC_DEVICE_ID_DEFAULT;
 static const mcUuid_t gUuid = TEE_KEYMASTER_TL_UUID;
 
+/* Sessions kept open to the trustlet between requests, at most */
+#define TEE_SESSION_POOL_SIZE   4
+/* Idle time after which an open session is closed */
+#define TEE_SESSION_IDLE_MS     5000
+/* Requests waiting for a session, at most, and for how long by default */
+#define TEE_QUEUE_SIZE          32
+#define TEE_QUEUE_WAIT_MS       5000
+/* Clients whose last turn is remembered for fairness */
+#define TEE_CLIENT_SLOTS        16
+/* Bulk buffer mapped to the trustlet for the life of a session */
+#define TEE_BULK_ARENA_SIZE     (32 * 1024)
+#define TEE_BULK_ALIGN          8
+/* Messages of one batch sign or verify command */
+#define TEE_BATCH_MAX_ITEMS     64
+/* message data per streamed update; two fit the arena */
+#define TEE_STREAM_CHUNK        (TEE_BULK_ARENA_SIZE / 2)
+
+typedef struct {
+    mcSessionHandle_t   handle;
+    tciMessage_ptr      pTci;       /* TCI WSM, allocated with the session */
+    bool                open;
+    bool                busy;       /* lent to a request or being set up */
+    uint64_t            lastUsed;   /* ms, CLOCK_MONOTONIC */
+    uint8_t*            pArena;     /* NULL if it could not be set up */
+    mcBulkMap_t         arenaMap;
+    uint32_t            arenaUsed;  /* bytes handed out to the request */
+} teeSession_t;
+
+/* Request buffer as seen by the trustlet */
+typedef struct {
+    uint8_t*            pNormal;    /* normal world address */
+    uint32_t            sAddr;      /* secure world address */
+    uint32_t            len;
+    void*               pTemp;      /* if not taken from the arena */
+    mcBulkMap_t         map;
+} teeBulk_t;
+
+/* Streamed sign or verify operation, see TEE_RSASignInit */
+struct teeRsaOperation {
+    teeSession_t*       pSession;   /* pinned until the operation ends */
+    uint32_t            handle;     /* of the operation in the trustlet */
+    bool                verify;
+    teeResult_t         result;     /* first failure of TEE_RSAUpdate */
+};
+
+/* Streamed HMAC operation, see TEE_HMACSignInit */
+struct teeHmacOperation {
+    teeSession_t*       pSession;   /* pinned until the operation ends */
+    uint32_t            handle;     /* of the operation in the trustlet */
+    bool                verify;
+    teeResult_t         result;     /* first failure of TEE_HMACUpdate */
+};
+
+/* Writes the update command of a streamed operation for one chunk */
+typedef void (*TEE_StreamFill_t)(
+    tciMessage_ptr      pTci,
+    uint32_t            handle,
+    uint32_t            sAddr,
+    uint32_t            len);
+
+/* Request waiting for a session */
+typedef struct teeWaiter {
+    struct teeWaiter*   pNext;
+    uint32_t            clientId;
+    teeSession_t*       pSession;   /* given by TEE_Dispatch, maybe not open */
+    pthread_cond_t      cond;
+} teeWaiter_t;
+
+typedef struct {
+    uint32_t            clientId;
+    uint64_t            lastTurn;   /* 0 if the slot is unused */
+} teeClient_t;
+
+static pthread_mutex_t  gPoolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   gPoolCond = PTHREAD_COND_INITIALIZER;
+static teeSession_t     gPool[TEE_SESSION_POOL_SIZE];
+static uint32_t         gDeviceRefs;    /* open sessions, guarded by gPoolLock */
+static bool             gReaperRunning;
+/* sessions the TEE lets us open, learnt when opening one fails */
+static uint32_t         gSessionLimit = TEE_SESSION_POOL_SIZE;
+static teeWaiter_t*     gWaiters;       /* in arrival order */
+static uint32_t         gWaiterCount;
+static teeClient_t      gClients[TEE_CLIENT_SLOTS];
+static uint64_t         gTurn;
+static pthread_key_t    gClientKey;
+static pthread_key_t    gTimeoutKey;
+static pthread_once_t   gThreadKeyOnce = PTHREAD_ONCE_INIT;
+/* The trustlet does not know the batch commands; only ever set */
+static volatile bool    gBatchUnsupported;
+/* Whether the trustlet knows the EC commands: -1 until it has answered */
+static volatile int     gEcSupported = -1;
+
+static uint64_t TEE_NowMs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* CLOCK_REALTIME time 'ms' from now, for pthread_cond_timedwait */
+static void TEE_AbsTime(uint64_t ms, struct timespec *ts)
+{
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec  += ms / 1000;
+    ts->tv_nsec += (ms % 1000) * 1000000;
+    if (ts->tv_nsec >= 1000000000)
+    {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+}
+
+static void TEE_ThreadKeyInit(void)
+{
+    pthread_key_create(&gClientKey, NULL);
+    pthread_key_create(&gTimeoutKey, NULL);
+}
+
+void TEE_SetClientId(
+    uint32_t clientId
+){
+    pthread_once(&gThreadKeyOnce, TEE_ThreadKeyInit);
+    /* stored plus one, as NULL means not set */
+    pthread_setspecific(gClientKey, (void *)((uintptr_t)clientId + 1));
+}
+
+/* client of the calling thread, the thread itself by default */
+static uint32_t TEE_GetClientId(void)
+{
+    uintptr_t id;
+
+    pthread_once(&gThreadKeyOnce, TEE_ThreadKeyInit);
+    id = (uintptr_t)pthread_getspecific(gClientKey);
+
+    return id ? (uint32_t)(id - 1) : (uint32_t)syscall(__NR_gettid);
+}
+
+void TEE_SetQueueTimeout(
+    uint32_t timeoutMs
+){
+    pthread_once(&gThreadKeyOnce, TEE_ThreadKeyInit);
+    pthread_setspecific(gTimeoutKey, (void *)(uintptr_t)timeoutMs);
+}
+
+/* how long a request of the calling thread may wait for a session */
+static uint32_t TEE_GetQueueTimeout(void)
+{
+    uintptr_t ms;
+
+    pthread_once(&gThreadKeyOnce, TEE_ThreadKeyInit);
+    ms = (uintptr_t)pthread_getspecific(gTimeoutKey);
+
+    return ms ? (uint32_t)ms : TEE_QUEUE_WAIT_MS;
+}
+
 /**
  * TEE_Open
  *
- * Open session to the TEE Keymaster trustlet
+ * Open session to the TEE Keymaster trustlet. The MobiCore device stays
+ * open as long as any session of the pool is open.
  *
  * @param  pSessionHandle  [out] Return pointer to the session handle
  */
@@ -55,6 +220,7 @@ static tciMessage_ptr TEE_Open(
 ){
     tciMessage_ptr pTci = NULL;
     mcResult_t     mcRet;
+    bool           deviceRef = false;
 
     do
     {
@@ -70,18 +236,26 @@ static tciMessage_ptr TEE_Open(
         bzero(pSessionHandle, sizeof(mcSessionHandle_t));
 
         /* Open MobiCore device */
-        mcRet = mcOpenDevice(gDeviceId);
+        pthread_mutex_lock(&gPoolLock);
+        mcRet = MC_DRV_OK;
+        if (gDeviceRefs == 0)
+            mcRet = mcOpenDevice(gDeviceId);
+        if (MC_DRV_OK == mcRet)
+            gDeviceRefs++;
+        pthread_mutex_unlock(&gPoolLock);
         if (MC_DRV_OK != mcRet)
         {
             LOG_E("TEE_Open(): mcOpenDevice returned: %d\n", mcRet);
             break;
         }
+        deviceRef = true;
 
         /* Allocating WSM for TCI */
         mcRet = mcMallocWsm(gDeviceId, 0, sizeof(tciMessage_t), (uint8_t **) &pTci, 0);
         if (MC_DRV_OK != mcRet)
         {
             LOG_E("TEE_Open(): mcMallocWsm returned: %d\n", mcRet);
+            pTci = NULL;
             break;
         }
 
@@ -94,11 +268,21 @@ static tciMessage_ptr TEE_Open(
         if (MC_DRV_OK != mcRet)
         {
             LOG_E("TEE_Open(): mcOpenSession returned: %d\n", mcRet);
+            mcFreeWsm(gDeviceId, (uint8_t *) pTci);
+            pTci = NULL;
             break;
         }
 
     } while (false);
 
+    if (!pTci && deviceRef)
+    {
+        pthread_mutex_lock(&gPoolLock);
+        if (--gDeviceRefs == 0)
+            mcCloseDevice(gDeviceId);
+        pthread_mutex_unlock(&gPoolLock);
+    }
+
     //LOG_I("TEE_Open(): returning pointer to TCI buffer: 0x%.8x\n", pTci);
 
     return pTci;
@@ -111,11 +295,12 @@ static tciMessage_ptr TEE_Open(
  * Close session to the TEE Keymaster trustlet
  *
  * @param  sessionHandle  [in] Session handle
+ * @param  pTci           [in] TCI buffer of the session
  */
 static void TEE_Close(
-    mcSessionHandle_t *pSessionHandle
+    mcSessionHandle_t *pSessionHandle,
+    tciMessage_ptr     pTci
 ){
-    teeResult_t   ret = TEE_ERR_NONE;
     mcResult_t    mcRet;
 
     do {
@@ -132,22 +317,600 @@ static void TEE_Close(
         if (MC_DRV_OK != mcRet)
         {
             LOG_E("TEE_Close(): mcCloseSession returned: %d\n", mcRet);
-            ret = TEE_ERR_SESSION;
-            break;
         }
 
-        /* Close MobiCore device */
-        mcRet = mcCloseDevice(gDeviceId);
+        mcRet = mcFreeWsm(gDeviceId, (uint8_t *) pTci);
         if (MC_DRV_OK != mcRet)
         {
-            LOG_E("TEE_Close(): mcCloseDevice returned: %d\n", mcRet);
-            ret = TEE_ERR_MC_DEVICE;
+            LOG_E("TEE_Close(): mcFreeWsm returned: %d\n", mcRet);
+        }
+
+        /* Close MobiCore device with the last session */
+        pthread_mutex_lock(&gPoolLock);
+        if (--gDeviceRefs == 0)
+        {
+            mcRet = mcCloseDevice(gDeviceId);
+            if (MC_DRV_OK != mcRet)
+            {
+                LOG_E("TEE_Close(): mcCloseDevice returned: %d\n", mcRet);
+            }
         }
+        pthread_mutex_unlock(&gPoolLock);
 
     } while (false);
 }
 
 
+/**
+ * TEE_ArenaCreate
+ *
+ * Sets up the bulk arena of a new session. The arena is page aligned and
+ * mapped to the trustlet once, so requests only copy their input into it.
+ * A session without an arena still works, mapping every buffer per call.
+ *
+ * @param  pSession  [in] Open session
+ */
+static void TEE_ArenaCreate(
+    teeSession_t *pSession
+){
+    void       *pArena;
+    mcResult_t  mcRet;
+
+    pSession->pArena = NULL;
+    pSession->arenaUsed = 0;
+
+    pArena = mmap(NULL, TEE_BULK_ARENA_SIZE, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == pArena)
+    {
+        LOG_W("TEE_ArenaCreate(): mmap failed\n");
+        return;
+    }
+
+    mcRet = mcMap(&pSession->handle, pArena, TEE_BULK_ARENA_SIZE, &pSession->arenaMap);
+    if (MC_DRV_OK != mcRet)
+    {
+        LOG_W("TEE_ArenaCreate(): mcMap returned: %d\n", mcRet);
+        munmap(pArena, TEE_BULK_ARENA_SIZE);
+        return;
+    }
+
+    pSession->pArena = (uint8_t *) pArena;
+}
+
+
+/**
+ * TEE_DestroySession
+ *
+ * Releases the arena of a session and closes it. The caller owns the
+ * session, i.e. it is marked busy.
+ *
+ * @param  pSession  [in] Open session
+ */
+static void TEE_DestroySession(
+    teeSession_t *pSession
+){
+    mcResult_t mcRet;
+
+    if (pSession->pArena)
+    {
+        mcRet = mcUnmap(&pSession->handle, pSession->pArena, &pSession->arenaMap);
+        if (MC_DRV_OK != mcRet)
+        {
+            /* the trustlet may still reach it; leak rather than reuse */
+            LOG_E("TEE_DestroySession(): mcUnmap returned: %d\n", mcRet);
+        }
+        else
+        {
+            munmap(pSession->pArena, TEE_BULK_ARENA_SIZE);
+        }
+        pSession->pArena = NULL;
+    }
+
+    TEE_Close(&pSession->handle, pSession->pTci);
+}
+
+
+/**
+ * TEE_FindSession
+ *
+ * Reserves an idle open session or, if the TEE allows one more session,
+ * a free slot to open one in. Called with gPoolLock held.
+ */
+static teeSession_t *TEE_FindSession(void)
+{
+    teeSession_t *pFree = NULL;
+    uint32_t      inUse = 0;
+    int           i;
+
+    for (i = 0; i < TEE_SESSION_POOL_SIZE; i++)
+    {
+        teeSession_t *pSession = &gPool[i];
+
+        if (pSession->open && !pSession->busy)
+        {
+            pSession->busy = true;
+            return pSession;
+        }
+
+        if (pSession->open || pSession->busy)
+            inUse++;
+        else if (!pFree)
+            pFree = pSession;
+    }
+
+    if (pFree && (inUse < gSessionLimit))
+    {
+        pFree->busy = true;
+        return pFree;
+    }
+
+    return NULL;
+}
+
+
+/**
+ * TEE_ClientTurn
+ *
+ * Remembers that a client got a session. Called with gPoolLock held.
+ */
+static void TEE_ClientTurn(
+    uint32_t clientId
+){
+    teeClient_t *pClient = &gClients[0];
+    int          i;
+
+    for (i = 0; i < TEE_CLIENT_SLOTS; i++)
+    {
+        if (gClients[i].lastTurn && gClients[i].clientId == clientId)
+        {
+            pClient = &gClients[i];
+            break;
+        }
+        if (gClients[i].lastTurn < pClient->lastTurn)
+            pClient = &gClients[i];
+    }
+
+    pClient->clientId = clientId;
+    pClient->lastTurn = ++gTurn;
+}
+
+
+/**
+ * TEE_PickWaiter
+ *
+ * Takes the next request off the queue: the oldest request of the client
+ * that was served least recently, so that a busy client cannot starve the
+ * others. Called with gPoolLock held and a non-empty queue.
+ */
+static teeWaiter_t *TEE_PickWaiter(void)
+{
+    teeWaiter_t **ppBest = &gWaiters;
+    uint64_t      bestTurn = UINT64_MAX;
+    teeWaiter_t **pp;
+    teeWaiter_t  *pWaiter;
+    int           i;
+
+    for (pp = &gWaiters; *pp; pp = &(*pp)->pNext)
+    {
+        uint64_t turn = 0;
+
+        for (i = 0; i < TEE_CLIENT_SLOTS; i++)
+        {
+            if (gClients[i].lastTurn && gClients[i].clientId == (*pp)->clientId)
+            {
+                turn = gClients[i].lastTurn;
+                break;
+            }
+        }
+
+        if (turn < bestTurn)
+        {
+            bestTurn = turn;
+            ppBest = pp;
+        }
+    }
+
+    pWaiter = *ppBest;
+    *ppBest = pWaiter->pNext;
+    gWaiterCount--;
+
+    return pWaiter;
+}
+
+
+/**
+ * TEE_Dispatch
+ *
+ * Hands the sessions that have become available to waiting requests.
+ * Called with gPoolLock held.
+ */
+static void TEE_Dispatch(void)
+{
+    while (gWaiters)
+    {
+        teeSession_t *pSession = TEE_FindSession();
+        teeWaiter_t  *pWaiter;
+
+        if (!pSession)
+            break;
+
+        pWaiter = TEE_PickWaiter();
+        TEE_ClientTurn(pWaiter->clientId);
+        pWaiter->pSession = pSession;
+        pthread_cond_signal(&pWaiter->cond);
+    }
+}
+
+
+/**
+ * TEE_SessionReaper
+ *
+ * Closes the sessions that have not been used for TEE_SESSION_IDLE_MS and
+ * exits once no session is open.
+ */
+static void *TEE_SessionReaper(
+    void *arg
+){
+    (void)arg;
+
+    pthread_mutex_lock(&gPoolLock);
+
+    for (;;)
+    {
+        uint64_t now = TEE_NowMs();
+        uint64_t next = 0;
+        bool     anyOpen = false;
+        int      i;
+
+        for (i = 0; i < TEE_SESSION_POOL_SIZE; i++)
+        {
+            teeSession_t *pSession = &gPool[i];
+
+            if (!pSession->open)
+                continue;
+
+            anyOpen = true;
+            if (pSession->busy)
+                continue;
+
+            if (now - pSession->lastUsed >= TEE_SESSION_IDLE_MS)
+            {
+                /* keep the slot reserved while the session is closed */
+                pSession->busy = true;
+                pthread_mutex_unlock(&gPoolLock);
+                TEE_DestroySession(pSession);
+                pthread_mutex_lock(&gPoolLock);
+                pSession->open = false;
+                pSession->busy = false;
+                pSession->pTci = NULL;
+                TEE_Dispatch();
+                /* the pool may have changed meanwhile */
+                now = TEE_NowMs();
+                i = -1;
+                next = 0;
+                anyOpen = false;
+                continue;
+            }
+
+            if (!next || pSession->lastUsed + TEE_SESSION_IDLE_MS < next)
+                next = pSession->lastUsed + TEE_SESSION_IDLE_MS;
+        }
+
+        if (!anyOpen)
+            break;
+
+        {
+            struct timespec ts;
+
+            TEE_AbsTime(next ? next - now : TEE_SESSION_IDLE_MS, &ts);
+            pthread_cond_timedwait(&gPoolCond, &gPoolLock, &ts);
+        }
+    }
+
+    /* the TEE may have more sessions to spare by the next time */
+    gSessionLimit = TEE_SESSION_POOL_SIZE;
+    gReaperRunning = false;
+    pthread_mutex_unlock(&gPoolLock);
+
+    return NULL;
+}
+
+
+/**
+ * TEE_AcquireSession
+ *
+ * Lends a session of the pool to the caller. An idle session is taken, or
+ * a new one opened while the TEE allows; otherwise the request is queued
+ * for at most the timeout of the calling thread, see TEE_SetQueueTimeout().
+ * Queued requests are served round robin across clients, see
+ * TEE_SetClientId().
+ *
+ * @param  ppSession  [out] Session to be given back with TEE_ReleaseSession
+ */
+static teeResult_t TEE_AcquireSession(
+    teeSession_t **ppSession
+){
+    teeSession_t *pSession = NULL;
+    uint32_t      clientId = TEE_GetClientId();
+    uint32_t      timeoutMs = TEE_GetQueueTimeout();
+    uint32_t      openCount;
+    int           i;
+
+    *ppSession = NULL;
+
+    pthread_mutex_lock(&gPoolLock);
+
+    for (;;)
+    {
+        /* queued requests go first */
+        pSession = gWaiters ? NULL : TEE_FindSession();
+        if (pSession)
+        {
+            TEE_ClientTurn(clientId);
+        }
+        else
+        {
+            teeWaiter_t     waiter;
+            teeWaiter_t   **pp;
+            struct timespec ts;
+
+            if (gWaiterCount >= TEE_QUEUE_SIZE)
+            {
+                pthread_mutex_unlock(&gPoolLock);
+                LOG_W("TEE_AcquireSession(): %d requests queued already\n", TEE_QUEUE_SIZE);
+                return TEE_ERR_BUSY;
+            }
+
+            waiter.pNext = NULL;
+            waiter.clientId = clientId;
+            waiter.pSession = NULL;
+            pthread_cond_init(&waiter.cond, NULL);
+            for (pp = &gWaiters; *pp; pp = &(*pp)->pNext)
+                ;
+            *pp = &waiter;
+            gWaiterCount++;
+
+            TEE_AbsTime(timeoutMs, &ts);
+            while (!waiter.pSession)
+            {
+                if ((ETIMEDOUT == pthread_cond_timedwait(&waiter.cond, &gPoolLock, &ts)) &&
+                    !waiter.pSession)
+                {
+                    break;
+                }
+            }
+
+            pthread_cond_destroy(&waiter.cond);
+
+            if (!waiter.pSession)
+            {
+                for (pp = &gWaiters; *pp != &waiter; pp = &(*pp)->pNext)
+                    ;
+                *pp = waiter.pNext;
+                gWaiterCount--;
+                pthread_mutex_unlock(&gPoolLock);
+                LOG_W("TEE_AcquireSession(): no session within %u ms\n", timeoutMs);
+                return TEE_ERR_TIMEOUT;
+            }
+
+            pSession = waiter.pSession;
+        }
+
+        if (pSession->open)
+            break;
+
+        /* open a new session into the free slot */
+        pthread_mutex_unlock(&gPoolLock);
+        pSession->pTci = TEE_Open(&pSession->handle);
+        if (pSession->pTci)
+            TEE_ArenaCreate(pSession);
+        pthread_mutex_lock(&gPoolLock);
+
+        if (pSession->pTci)
+        {
+            pSession->open = true;
+            break;
+        }
+
+        pSession->busy = false;
+
+        openCount = 0;
+        for (i = 0; i < TEE_SESSION_POOL_SIZE; i++)
+        {
+            if (gPool[i].open)
+                openCount++;
+        }
+
+        if (!openCount)
+        {
+            TEE_Dispatch();
+            pthread_mutex_unlock(&gPoolLock);
+            return TEE_ERR_SESSION;
+        }
+
+        /* the TEE allows no more sessions; share the open ones */
+        if (gSessionLimit > openCount)
+        {
+            LOG_W("TEE_AcquireSession(): TEE allows %u sessions\n", openCount);
+            gSessionLimit = openCount;
+        }
+    }
+
+    if (!gReaperRunning)
+    {
+        pthread_t      thread;
+        pthread_attr_t attr;
+
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&thread, &attr, TEE_SessionReaper, NULL) == 0)
+            gReaperRunning = true;
+        else
+            LOG_W("TEE_AcquireSession(): idle sessions will not be reclaimed\n");
+        pthread_attr_destroy(&attr);
+    }
+
+    pthread_mutex_unlock(&gPoolLock);
+
+    *ppSession = pSession;
+
+    return TEE_ERR_NONE;
+}
+
+
+/**
+ * TEE_ArenaReset
+ *
+ * Reclaims the arena space handed out by TEE_BulkGet, wiping it so no key
+ * material of the request is left behind.
+ *
+ * @param  pSession  [in] Session of the request
+ */
+static void TEE_ArenaReset(
+    teeSession_t   *pSession
+){
+    if (pSession->pArena && pSession->arenaUsed)
+        bzero(pSession->pArena, pSession->arenaUsed);
+    pSession->arenaUsed = 0;
+}
+
+
+/**
+ * TEE_ReleaseSession
+ *
+ * Gives a session back to the pool, or to the next queued request. A
+ * session whose request failed while talking to the trustlet may still
+ * hold mappings or be out of sync with the trustlet, so it is closed
+ * instead.
+ *
+ * @param  pSession  [in] Session from TEE_AcquireSession, may be NULL
+ * @param  result    [in] Result of the request
+ */
+static void TEE_ReleaseSession(
+    teeSession_t *pSession,
+    teeResult_t   result
+){
+    if (!pSession)
+        return;
+
+    TEE_ArenaReset(pSession);
+
+    if ((TEE_ERR_MAP == result) || (TEE_ERR_NOTIFICATION == result))
+    {
+        TEE_DestroySession(pSession);
+        pthread_mutex_lock(&gPoolLock);
+        pSession->open = false;
+        pSession->pTci = NULL;
+    }
+    else
+    {
+        pthread_mutex_lock(&gPoolLock);
+        pSession->lastUsed = TEE_NowMs();
+    }
+
+    pSession->busy = false;
+    TEE_Dispatch();
+    pthread_mutex_unlock(&gPoolLock);
+}
+
+
+/**
+ * TEE_BulkGet
+ *
+ * Gives the trustlet access to a request buffer. It is carved out of the
+ * arena of the session if it fits, else a temporary buffer is allocated
+ * and mapped for the call. The content of pSrc, if any, is copied in.
+ *
+ * @param  pSession  [in]  Session of the request
+ * @param  pBulk     [out] Buffer, to be given back with TEE_BulkPut
+ * @param  pSrc      [in]  Initial content, NULL for an output buffer
+ * @param  len       [in]  Buffer length
+ */
+static bool TEE_BulkGet(
+    teeSession_t   *pSession,
+    teeBulk_t      *pBulk,
+    const uint8_t  *pSrc,
+    uint32_t        len
+){
+    uint32_t   offset = (pSession->arenaUsed + TEE_BULK_ALIGN - 1) & ~(TEE_BULK_ALIGN - 1);
+    mcResult_t mcRet;
+
+    bzero(pBulk, sizeof(teeBulk_t));
+    pBulk->len = len;
+
+    if (pSession->pArena && (offset <= TEE_BULK_ARENA_SIZE) &&
+        (len <= TEE_BULK_ARENA_SIZE - offset))
+    {
+        pBulk->pNormal = pSession->pArena + offset;
+        pBulk->sAddr = (uint32_t)pSession->arenaMap.sVirtualAddr + offset;
+        pSession->arenaUsed = offset + len;
+    }
+    else
+    {
+        /* mcMap does not take empty buffers */
+        pBulk->pTemp = malloc(len ? len : 1);
+        if (!pBulk->pTemp)
+        {
+            LOG_E("TEE_BulkGet(): cannot allocate %u bytes\n", len);
+            return false;
+        }
+
+        mcRet = mcMap(&pSession->handle, pBulk->pTemp, len ? len : 1, &pBulk->map);
+        if (MC_DRV_OK != mcRet)
+        {
+            LOG_E("TEE_BulkGet(): mcMap returned: %d\n", mcRet);
+            free(pBulk->pTemp);
+            pBulk->pTemp = NULL;
+            return false;
+        }
+
+        pBulk->pNormal = (uint8_t *) pBulk->pTemp;
+        pBulk->sAddr = (uint32_t)pBulk->map.sVirtualAddr;
+    }
+
+    if (pSrc && len)
+        memcpy(pBulk->pNormal, pSrc, len);
+
+    return true;
+}
+
+
+/**
+ * TEE_BulkPut
+ *
+ * Gives back a buffer of TEE_BulkGet. Arena space is reclaimed with the
+ * session in TEE_ReleaseSession; only a temporary buffer is unmapped here.
+ *
+ * @param  pSession  [in] Session of the request, may be NULL
+ * @param  pBulk     [in] Buffer, may be unused
+ */
+static bool TEE_BulkPut(
+    teeSession_t   *pSession,
+    teeBulk_t      *pBulk
+){
+    mcResult_t mcRet;
+
+    if (!pSession || !pBulk->pTemp)
+        return true;
+
+    bzero(pBulk->pTemp, pBulk->len);
+
+    mcRet = mcUnmap(&pSession->handle, pBulk->pTemp, &pBulk->map);
+    pBulk->pTemp = NULL;
+    if (MC_DRV_OK != mcRet)
+    {
+        /* the trustlet may still reach it; leak rather than reuse */
+        LOG_E("TEE_BulkPut(): mcUnmap returned: %d\n", mcRet);
+        return false;
+    }
+
+    free(pBulk->pNormal);
+
+    return true;
+}
+
+
 /**
  * TEE_RSAGenerateKeyPair
  *
@@ -170,21 +933,20 @@ teeResult_t TEE_RSAGenerateKeyPair(
 ){
     teeResult_t         ret = TEE_ERR_NONE;
     tciMessage_ptr      pTci = NULL;
-    mcSessionHandle_t   sessionHandle;
+    teeSession_t*       pSession = NULL;
     mcBulkMap_t         mapInfo;
     mcResult_t          mcRet;
 
     do {
 
-        /* Open session to the trustlet */
-        pTci = TEE_Open(&sessionHandle);
-        if (!pTci) {
-            ret = TEE_ERR_MEMORY;
+        /* Borrow a session to the trustlet */
+        ret = TEE_AcquireSession(&pSession);
+        if (TEE_ERR_NONE != ret)
             break;
-        }
+        pTci = pSession->pTci;
 
         /* Map memory to the secure world */
-        mcRet = mcMap(&sessionHandle, keyData, keyDataLength, &mapInfo);
+        mcRet = mcMap(&pSession->handle, keyData, keyDataLength, &mapInfo);
         if (MC_DRV_OK != mcRet) {
             ret = TEE_ERR_MAP;
             break;
@@ -199,7 +961,7 @@ teeResult_t TEE_RSAGenerateKeyPair(
         pTci->rsagenkey.exponent    = exponent;
 
         /* Notify the trustlet */
-        mcRet = mcNotify(&sessionHandle);
+        mcRet = mcNotify(&pSession->handle);
         if (MC_DRV_OK != mcRet)
         {
             ret = TEE_ERR_NOTIFICATION;
@@ -207,14 +969,14 @@ teeResult_t TEE_RSAGenerateKeyPair(
         }
 
         /* Wait for response from the trustlet */
-        if (MC_DRV_OK != mcWaitNotification(&sessionHandle, MC_INFINITE_TIMEOUT))
+        if (MC_DRV_OK != mcWaitNotification(&pSession->handle, MC_INFINITE_TIMEOUT))
         {
             ret = TEE_ERR_NOTIFICATION;
             break;
         }
 
         /* Unmap memory */
-        mcRet = mcUnmap(&sessionHandle, keyData, &mapInfo);
+        mcRet = mcUnmap(&pSession->handle, keyData, &mapInfo);
         if (MC_DRV_OK != mcRet)
         {
             ret = TEE_ERR_MAP;
@@ -234,8 +996,8 @@ teeResult_t TEE_RSAGenerateKeyPair(
 
     } while (false);
 
-    /* Close session to the trustlet */
-    TEE_Close(&sessionHandle);
+    /* Return the session to the pool */
+    TEE_ReleaseSession(pSession, ret);
 
     LOG_I("TEE_RSAGenerateKeyPair(): returning: 0x%.8x\n", ret);
 
@@ -267,55 +1029,49 @@ teeResult_t TEE_RSASign(
 ){
     teeResult_t        ret = TEE_ERR_NONE;
     tciMessage_ptr     pTci = NULL;
-    mcSessionHandle_t  sessionHandle;
-    mcBulkMap_t        keyMapInfo;
-    mcBulkMap_t        plainMapInfo;
-    mcBulkMap_t        signatureMapInfo;
+    teeSession_t*      pSession = NULL;
+    teeBulk_t          keyBulk;
+    teeBulk_t          plainBulk;
+    teeBulk_t          signatureBulk;
+    uint32_t           signatureBufLength = *signatureDataLength;
     mcResult_t         mcRet;
 
-    do {
-
-        /* Open session to the trustlet */
-        pTci = TEE_Open(&sessionHandle);
-        if (!pTci) {
-            ret = TEE_ERR_MEMORY;
-            break;
-        }
+    bzero(&keyBulk, sizeof(keyBulk));
+    bzero(&plainBulk, sizeof(plainBulk));
+    bzero(&signatureBulk, sizeof(signatureBulk));
 
-        /* Map memory to the secure world */
-        mcRet = mcMap(&sessionHandle, (void*)keyData, keyDataLength, &keyMapInfo);
-        if (MC_DRV_OK != mcRet) {
-            ret = TEE_ERR_MAP;
-            break;
-        }
+    do {
 
-        mcRet = mcMap(&sessionHandle, (void*)plainData, plainDataLength, &plainMapInfo);
-        if (MC_DRV_OK != mcRet) {
-            ret = TEE_ERR_MAP;
+        /* Borrow a session to the trustlet */
+        ret = TEE_AcquireSession(&pSession);
+        if (TEE_ERR_NONE != ret)
             break;
-        }
+        pTci = pSession->pTci;
 
-        mcRet = mcMap(&sessionHandle, (void*)signatureData, *signatureDataLength, &signatureMapInfo);
-        if (MC_DRV_OK != mcRet) {
+        /* Copy the input to memory shared with the secure world */
+        if (!TEE_BulkGet(pSession, &keyBulk, keyData, keyDataLength) ||
+            !TEE_BulkGet(pSession, &plainBulk, plainData, plainDataLength) ||
+            !TEE_BulkGet(pSession, &signatureBulk, NULL, signatureBufLength))
+        {
             ret = TEE_ERR_MAP;
             break;
         }
 
         /* Update TCI buffer */
         pTci->command.header.commandId = CMD_ID_TEE_RSA_SIGN;
-        pTci->rsasign.keydata = (uint32_t)keyMapInfo.sVirtualAddr;
+        pTci->rsasign.keydata = keyBulk.sAddr;
         pTci->rsasign.keydatalen = keyDataLength;
 
-        pTci->rsasign.plaindata = (uint32_t)plainMapInfo.sVirtualAddr;
+        pTci->rsasign.plaindata = plainBulk.sAddr;
         pTci->rsasign.plaindatalen = plainDataLength;
 
-        pTci->rsasign.signaturedata = (uint32_t)signatureMapInfo.sVirtualAddr;
-        pTci->rsasign.signaturedatalen = *signatureDataLength;
+        pTci->rsasign.signaturedata = signatureBulk.sAddr;
+        pTci->rsasign.signaturedatalen = signatureBufLength;
 
         pTci->rsasign.algorithm = algorithm;
 
         /* Notify the trustlet */
-        mcRet = mcNotify(&sessionHandle);
+        mcRet = mcNotify(&pSession->handle);
         if (MC_DRV_OK != mcRet)
         {
             ret = TEE_ERR_NOTIFICATION;
@@ -323,49 +1079,41 @@ teeResult_t TEE_RSASign(
         }
 
         /* Wait for response from the trustlet */
-        if (MC_DRV_OK != mcWaitNotification(&sessionHandle, MC_INFINITE_TIMEOUT))
+        if (MC_DRV_OK != mcWaitNotification(&pSession->handle, MC_INFINITE_TIMEOUT))
         {
             ret = TEE_ERR_NOTIFICATION;
             break;
         }
 
-        /* Unmap memory */
-        mcRet = mcUnmap(&sessionHandle, (void*)keyData, &keyMapInfo);
-        if (MC_DRV_OK != mcRet)
+        if (RET_OK != pTci->response.header.returnCode)
         {
-            ret = TEE_ERR_MAP;
+            LOG_E("TEE_RSASign(): TEE Keymaster trustlet returned: 0x%.8x\n",
+                        pTci->response.header.returnCode);
+            ret = TEE_ERR_FAIL;
             break;
         }
 
-        mcRet = mcUnmap(&sessionHandle, (void*)plainData, &plainMapInfo);
-        if (MC_DRV_OK != mcRet)
+        /* Retrieve signature data */
+        if (pTci->rsasign.signaturedatalen > signatureBufLength)
         {
-            ret = TEE_ERR_MAP;
+            ret = TEE_ERR_BUFFER_TOO_SMALL;
             break;
         }
-
-        mcRet = mcUnmap(&sessionHandle, (void*)signatureData, &signatureMapInfo);
-        if (MC_DRV_OK != mcRet)
-        {
-            ret = TEE_ERR_MAP;
-            break;
-        }
-
-        if (RET_OK != pTci->response.header.returnCode)
-        {
-            LOG_E("TEE_RSASign(): TEE Keymaster trustlet returned: 0x%.8x\n",
-                        pTci->response.header.returnCode);
-            ret = TEE_ERR_FAIL;
-            break;
-        }
-
-        /* Retrieve signature data length */
-        *signatureDataLength = pTci->rsasign.signaturedatalen;
+        *signatureDataLength = pTci->rsasign.signaturedatalen;
+        memcpy(signatureData, signatureBulk.pNormal, *signatureDataLength);
 
     } while (false);
 
-    /* Close session to the trustlet */
-    TEE_Close(&sessionHandle);
+    /* Unmap memory not taken from the arena */
+    if (!TEE_BulkPut(pSession, &keyBulk))
+        ret = TEE_ERR_MAP;
+    if (!TEE_BulkPut(pSession, &plainBulk))
+        ret = TEE_ERR_MAP;
+    if (!TEE_BulkPut(pSession, &signatureBulk))
+        ret = TEE_ERR_MAP;
+
+    /* Return the session to the pool */
+    TEE_ReleaseSession(pSession, ret);
 
     LOG_I("TEE_RSASign(): returning: 0x%.8x\n", ret);
 
@@ -399,56 +1147,49 @@ teeResult_t TEE_RSAVerify(
 ){
     teeResult_t        ret = TEE_ERR_NONE;
     tciMessage_ptr     pTci = NULL;
-    mcSessionHandle_t  sessionHandle;
-    mcBulkMap_t        keyMapInfo;
-    mcBulkMap_t        plainMapInfo;
-    mcBulkMap_t        signatureMapInfo;
+    teeSession_t*      pSession = NULL;
+    teeBulk_t          keyBulk;
+    teeBulk_t          plainBulk;
+    teeBulk_t          signatureBulk;
     mcResult_t         mcRet;
 
-    do {
-
-        /* Open session to the trustlet */
-        pTci = TEE_Open(&sessionHandle);
-        if (!pTci) {
-            ret = TEE_ERR_MEMORY;
-            break;
-        }
+    bzero(&keyBulk, sizeof(keyBulk));
+    bzero(&plainBulk, sizeof(plainBulk));
+    bzero(&signatureBulk, sizeof(signatureBulk));
 
-        /* Map memory to the secure world */
-        mcRet = mcMap(&sessionHandle, (void*)keyData, keyDataLength, &keyMapInfo);
-        if (MC_DRV_OK != mcRet) {
-            ret = TEE_ERR_MAP;
-            break;
-        }
+    do {
 
-        mcRet = mcMap(&sessionHandle, (void*)plainData, plainDataLength, &plainMapInfo);
-        if (MC_DRV_OK != mcRet) {
-            ret = TEE_ERR_MAP;
+        /* Borrow a session to the trustlet */
+        ret = TEE_AcquireSession(&pSession);
+        if (TEE_ERR_NONE != ret)
             break;
-        }
+        pTci = pSession->pTci;
 
-        mcRet = mcMap(&sessionHandle, (void*)signatureData, signatureDataLength, &signatureMapInfo);
-        if (MC_DRV_OK != mcRet) {
+        /* Copy the input to memory shared with the secure world */
+        if (!TEE_BulkGet(pSession, &keyBulk, keyData, keyDataLength) ||
+            !TEE_BulkGet(pSession, &plainBulk, plainData, plainDataLength) ||
+            !TEE_BulkGet(pSession, &signatureBulk, signatureData, signatureDataLength))
+        {
             ret = TEE_ERR_MAP;
             break;
         }
 
         /* Update TCI buffer */
         pTci->command.header.commandId = CMD_ID_TEE_RSA_VERIFY;
-        pTci->rsaverify.keydata = (uint32_t)keyMapInfo.sVirtualAddr;
+        pTci->rsaverify.keydata = keyBulk.sAddr;
         pTci->rsaverify.keydatalen = keyDataLength;
 
-        pTci->rsaverify.plaindata = (uint32_t)plainMapInfo.sVirtualAddr;
+        pTci->rsaverify.plaindata = plainBulk.sAddr;
         pTci->rsaverify.plaindatalen = plainDataLength;
 
-        pTci->rsaverify.signaturedata = (uint32_t)signatureMapInfo.sVirtualAddr;
+        pTci->rsaverify.signaturedata = signatureBulk.sAddr;
         pTci->rsaverify.signaturedatalen = signatureDataLength;
 
         pTci->rsaverify.algorithm = algorithm;
         pTci->rsaverify.validity = false;
 
         /* Notify the trustlet */
-        mcRet = mcNotify(&sessionHandle);
+        mcRet = mcNotify(&pSession->handle);
         if (MC_DRV_OK != mcRet)
         {
             ret = TEE_ERR_NOTIFICATION;
@@ -456,34 +1197,12 @@ teeResult_t TEE_RSAVerify(
         }
 
         /* Wait for response from the trustlet */
-        if (MC_DRV_OK != mcWaitNotification(&sessionHandle, MC_INFINITE_TIMEOUT))
+        if (MC_DRV_OK != mcWaitNotification(&pSession->handle, MC_INFINITE_TIMEOUT))
         {
             ret = TEE_ERR_NOTIFICATION;
             break;
         }
 
-        /* Unmap memory */
-        mcRet = mcUnmap(&sessionHandle, (void*)keyData, &keyMapInfo);
-        if (MC_DRV_OK != mcRet)
-        {
-            ret = TEE_ERR_MAP;
-            break;
-        }
-
-        mcRet = mcUnmap(&sessionHandle, (void*)plainData, &plainMapInfo);
-        if (MC_DRV_OK != mcRet)
-        {
-            ret = TEE_ERR_MAP;
-            break;
-        }
-
-        mcRet = mcUnmap(&sessionHandle, (void*)signatureData, &signatureMapInfo);
-        if (MC_DRV_OK != mcRet)
-        {
-            ret = TEE_ERR_MAP;
-            break;
-        }
-
         if (RET_OK != pTci->response.header.returnCode)
         {
             LOG_E("TEE_RSAVerify(): TEE Keymaster trustlet returned: 0x%.8x\n",
@@ -496,8 +1215,16 @@ teeResult_t TEE_RSAVerify(
 
     } while (false);
 
-    /* Close session to the trustlet */
-    TEE_Close(&sessionHandle);
+    /* Unmap memory not taken from the arena */
+    if (!TEE_BulkPut(pSession, &keyBulk))
+        ret = TEE_ERR_MAP;
+    if (!TEE_BulkPut(pSession, &plainBulk))
+        ret = TEE_ERR_MAP;
+    if (!TEE_BulkPut(pSession, &signatureBulk))
+        ret = TEE_ERR_MAP;
+
+    /* Return the session to the pool */
+    TEE_ReleaseSession(pSession, ret);
 
     LOG_I("TEE_RSAVerify(): returning: 0x%.8x\n", ret);
 
@@ -506,294 +1233,1740 @@ teeResult_t TEE_RSAVerify(
 
 
 /**
- * TEE_HMACKeyGenerate
+ * TEE_CallStart
  *
- * Generates random key for HMAC calculation and returns key data as wrapped object
- * (key is encrypted)
+ * Hands the command in the TCI of a session to the trustlet. The TCI must
+ * be left alone until TEE_CallEnd.
  *
- * @param  keyData        [out] Pointer to key data
- * @param  keyDataLength  [in]  Key data buffer length
- * @param  soLen          [out] Key data secure object length
+ * @param  pSession  [in] Session with the command in its TCI
  */
-teeResult_t TEE_HMACKeyGenerate(
-    uint8_t*  keyData,
-    uint32_t  keyDataLength,
-    uint32_t* soLen
+static teeResult_t TEE_CallStart(
+    teeSession_t   *pSession
 ){
-    teeResult_t        ret = TEE_ERR_NONE;
-    tciMessage_ptr     pTci = NULL;
-    mcSessionHandle_t  sessionHandle;
-    mcBulkMap_t        keyMapInfo;
-    mcResult_t         mcRet;
+    if (MC_DRV_OK != mcNotify(&pSession->handle))
+        return TEE_ERR_NOTIFICATION;
 
-    do {
+    return TEE_ERR_NONE;
+}
 
-        /* Open session to the trustlet */
-        pTci = TEE_Open(&sessionHandle);
-        if (!pTci) {
-            ret = TEE_ERR_MEMORY;
-            break;
-        }
 
-        /* Map memory to the secure world */
-        mcRet = mcMap(&sessionHandle, (void*)keyData, keyDataLength, &keyMapInfo);
-        if (MC_DRV_OK != mcRet) {
-            ret = TEE_ERR_MAP;
-            break;
-        }
+/**
+ * TEE_CallEnd
+ *
+ * Waits for the answer of the trustlet to a command of TEE_CallStart.
+ *
+ * @param  pSession  [in] Session with the command in its TCI
+ * @param  pName     [in] Caller, for the log
+ */
+static teeResult_t TEE_CallEnd(
+    teeSession_t   *pSession,
+    const char     *pName
+){
+    tciMessage_ptr pTci = pSession->pTci;
 
-        /* Update TCI buffer */
-        pTci->command.header.commandId = CMD_ID_TEE_HMAC_GEN_KEY;
-        pTci->hmacgenkey.keydata = (uint32_t)keyMapInfo.sVirtualAddr;
-        pTci->hmacgenkey.keydatalen = keyDataLength;
+    if (MC_DRV_OK != mcWaitNotification(&pSession->handle, MC_INFINITE_TIMEOUT))
+        return TEE_ERR_NOTIFICATION;
 
-        /* Notify the trustlet */
-        mcRet = mcNotify(&sessionHandle);
-        if (MC_DRV_OK != mcRet)
-        {
-            ret = TEE_ERR_NOTIFICATION;
-            break;
-        }
+    if (RET_OK != pTci->response.header.returnCode)
+    {
+        LOG_E("%s(): TEE Keymaster trustlet returned: 0x%.8x\n",
+                    pName, pTci->response.header.returnCode);
+        return TEE_ERR_FAIL;
+    }
 
-        /* Wait for response from the trustlet */
-        if (MC_DRV_OK != mcWaitNotification(&sessionHandle, MC_INFINITE_TIMEOUT))
-        {
-            ret = TEE_ERR_NOTIFICATION;
-            break;
-        }
+    return TEE_ERR_NONE;
+}
 
-        /* Unmap memory */
-        mcRet = mcUnmap(&sessionHandle, (void*)keyData, &keyMapInfo);
-        if (MC_DRV_OK != mcRet)
+
+/**
+ * TEE_Call
+ *
+ * Runs the command in the TCI of a session and waits for the answer of
+ * the trustlet.
+ *
+ * @param  pSession  [in] Session with the command in its TCI
+ * @param  pName     [in] Caller, for the log
+ */
+static teeResult_t TEE_Call(
+    teeSession_t   *pSession,
+    const char     *pName
+){
+    teeResult_t ret = TEE_CallStart(pSession);
+
+    if (TEE_ERR_NONE != ret)
+        return ret;
+
+    return TEE_CallEnd(pSession, pName);
+}
+
+
+/**
+ * TEE_StreamData
+ *
+ * Passes the message data of a streamed operation to the trustlet in
+ * chunks of half the arena. The next chunk is copied to one half while
+ * the trustlet reads the other, so large messages cost no more memory
+ * than the arena and the copy overlaps the work of the trustlet. The
+ * trustlet drops the operation if a chunk fails.
+ *
+ * @param  pSession  [in] Session pinned by the operation
+ * @param  handle    [in] Operation handle in the trustlet
+ * @param  fill      [in] Writes the update command for a chunk
+ * @param  pData     [in] Message data
+ * @param  len       [in] Message data length
+ * @param  pName     [in] Caller, for the log
+ */
+static teeResult_t TEE_StreamData(
+    teeSession_t       *pSession,
+    uint32_t            handle,
+    TEE_StreamFill_t    fill,
+    const uint8_t      *pData,
+    uint32_t            len,
+    const char         *pName
+){
+    teeResult_t    ret = TEE_ERR_NONE;
+    teeBulk_t      bulk[2];
+    uint32_t       chunk = (len < TEE_STREAM_CHUNK) ? len : TEE_STREAM_CHUNK;
+    uint32_t       next;
+    uint32_t       done = 0;
+    int            cur = 0;
+
+    bzero(bulk, sizeof(bulk));
+
+    do {
+
+        /* a message that fits one chunk needs no second buffer */
+        if (!TEE_BulkGet(pSession, &bulk[0], pData, chunk) ||
+            ((len > chunk) && !TEE_BulkGet(pSession, &bulk[1], NULL, TEE_STREAM_CHUNK)))
         {
             ret = TEE_ERR_MAP;
             break;
         }
 
-        if (RET_OK != pTci->response.header.returnCode)
+        while (done < len)
         {
-            LOG_E("TEE_RSAVerify(): TEE Keymaster trustlet returned: 0x%.8x\n",
-                        pTci->response.header.returnCode);
-            ret = TEE_ERR_FAIL;
-        }
+            fill(pSession->pTci, handle, bulk[cur].sAddr, chunk);
 
-        /* Update secure object length */
-        *soLen =  pTci->hmacgenkey.solen;
+            ret = TEE_CallStart(pSession);
+            if (TEE_ERR_NONE != ret)
+                break;
 
-    }while (false);
+            /* Copy the next chunk while the trustlet works on this one */
+            done += chunk;
+            next = len - done;
+            if (next > TEE_STREAM_CHUNK)
+                next = TEE_STREAM_CHUNK;
+            if (next)
+                memcpy(bulk[cur ^ 1].pNormal, pData + done, next);
 
-    /* Close session to the trustlet */
-    TEE_Close(&sessionHandle);
+            ret = TEE_CallEnd(pSession, pName);
+            if (TEE_ERR_NONE != ret)
+                break;
 
-    LOG_I("TEE_HMACKeyGenerate(): returning: 0x%.8x\n", ret);
+            chunk = next;
+            cur ^= 1;
+        }
+
+    } while (false);
+
+    /* Unmap memory not taken from the arena */
+    if (!TEE_BulkPut(pSession, &bulk[0]))
+        ret = TEE_ERR_MAP;
+    if (!TEE_BulkPut(pSession, &bulk[1]))
+        ret = TEE_ERR_MAP;
+    TEE_ArenaReset(pSession);
 
     return ret;
 }
 
+
 /**
- * TEE_HMACSign
+ * TEE_RSAUpdateFill
  *
- * Signs given plain data and returns HMAC signature data
+ * TEE_StreamFill_t of the streamed RSA operations
+ */
+static void TEE_RSAUpdateFill(
+    tciMessage_ptr     pTci,
+    uint32_t           handle,
+    uint32_t           sAddr,
+    uint32_t           len
+){
+    pTci->command.header.commandId = CMD_ID_TEE_RSA_DIGEST_UPDATE;
+    pTci->rsadigestupdate.handle = handle;
+    pTci->rsadigestupdate.plaindata = sAddr;
+    pTci->rsadigestupdate.plaindatalen = len;
+}
+
+
+/**
+ * TEE_RSAOpInit
  *
- * @param  keyData          [in]  Pointer to key data buffer
- * @param  keyDataLength    [in]  Key data buffer length
- * @param  plainData        [in]  Pointer to plain data to be signed
- * @param  plainDataLength  [in]  Plain data length
- * @param  signatureData    [out] Pointer to signature data
- * @param  signatureDataLength  [out] Signature data length
- * @param  digest           [in]  Digest type
+ * Starts a streamed sign or verify operation on a session of its own.
  */
-teeResult_t TEE_HMACSign(
-    const uint8_t*  keyData,
-    const uint32_t  keyDataLength,
-    const uint8_t*  plainData,
-    const uint32_t  plainDataLength,
-    uint8_t*        signatureData,
-    uint32_t*       signatureDataLength,
-    teeDigest_t     digest
+static teeResult_t TEE_RSAOpInit(
+    const uint8_t*        keyData,
+    const uint32_t        keyDataLength,
+    teeRsaSigAlg_t        algorithm,
+    bool                  verify,
+    teeRsaOperation_t**   operation
 ){
     teeResult_t        ret = TEE_ERR_NONE;
     tciMessage_ptr     pTci = NULL;
-    mcSessionHandle_t  sessionHandle;
-    mcBulkMap_t        keyMapInfo;
-    mcBulkMap_t        plainMapInfo;
-    mcBulkMap_t        signatureMapInfo;
-    mcResult_t         mcRet;
+    teeRsaOperation_t* pOp = NULL;
+    teeBulk_t          keyBulk;
+
+    bzero(&keyBulk, sizeof(keyBulk));
 
     do {
 
-        /* Open session to the trustlet */
-        pTci = TEE_Open(&sessionHandle);
-        if (!pTci) {
-            ret = TEE_ERR_MEMORY;
+        if (!operation)
+        {
+            ret = TEE_ERR_INVALID_BUFFER;
             break;
         }
+        *operation = NULL;
 
-        /* Map memory to the secure world */
-        mcRet = mcMap(&sessionHandle, (void*)keyData, keyDataLength, &keyMapInfo);
-        if (MC_DRV_OK != mcRet) {
-            ret = TEE_ERR_MAP;
+        /* raw RSA leaves nothing to digest */
+        if (TEE_RSA_NODIGEST_NOPADDING == algorithm)
+        {
+            ret = TEE_ERR_NOT_IMPLEMENTED;
             break;
         }
 
-        mcRet = mcMap(&sessionHandle, (void*)plainData, plainDataLength, &plainMapInfo);
-        if (MC_DRV_OK != mcRet) {
-            ret = TEE_ERR_MAP;
+        pOp = (teeRsaOperation_t *) calloc(1, sizeof(teeRsaOperation_t));
+        if (!pOp)
+        {
+            ret = TEE_ERR_MEMORY;
             break;
         }
+        pOp->verify = verify;
 
-        mcRet = mcMap(&sessionHandle, (void*)signatureData, *signatureDataLength, &signatureMapInfo);
-        if (MC_DRV_OK != mcRet) {
+        /* Borrow a session to the trustlet, kept until the operation ends */
+        ret = TEE_AcquireSession(&pOp->pSession);
+        if (TEE_ERR_NONE != ret)
+            break;
+        pTci = pOp->pSession->pTci;
+
+        /* Copy the key to memory shared with the secure world */
+        if (!TEE_BulkGet(pOp->pSession, &keyBulk, keyData, keyDataLength))
+        {
             ret = TEE_ERR_MAP;
             break;
         }
 
         /* Update TCI buffer */
-        pTci->command.header.commandId = CMD_ID_TEE_HMAC_SIGN;
-        pTci->hmacsign.keydata = (uint32_t)keyMapInfo.sVirtualAddr;
-        pTci->hmacsign.keydatalen = keyDataLength;
-
-        pTci->hmacsign.plaindata = (uint32_t)plainMapInfo.sVirtualAddr;
-        pTci->hmacsign.plaindatalen = plainDataLength;
-
-        pTci->hmacsign.signaturedata = (uint32_t)signatureMapInfo.sVirtualAddr;
-        pTci->hmacsign.signaturedatalen = *signatureDataLength;
+        pTci->command.header.commandId = CMD_ID_TEE_RSA_DIGEST_INIT;
+        pTci->rsadigestinit.keydata = keyBulk.sAddr;
+        pTci->rsadigestinit.keydatalen = keyDataLength;
+        pTci->rsadigestinit.algorithm = algorithm;
+        pTci->rsadigestinit.verify = verify ? 1 : 0;
 
-        pTci->hmacsign.digest = digest;
-
-        /* Notify the trustlet */
-        mcRet = mcNotify(&sessionHandle);
-        if (MC_DRV_OK != mcRet)
-        {
-            ret = TEE_ERR_NOTIFICATION;
+        ret = TEE_Call(pOp->pSession, "TEE_RSAOpInit");
+        if (TEE_ERR_NONE != ret)
             break;
-        }
 
-        /* Wait for response from the trustlet */
-        if (MC_DRV_OK != mcWaitNotification(&sessionHandle, MC_INFINITE_TIMEOUT))
-        {
-            ret = TEE_ERR_NOTIFICATION;
-            break;
-        }
+        pOp->handle = pTci->rsadigestinit.handle;
 
-        /* Unmap memory */
-        mcRet = mcUnmap(&sessionHandle, (void*)keyData, &keyMapInfo);
-        if (MC_DRV_OK != mcRet)
-        {
-            ret = TEE_ERR_MAP;
-            break;
-        }
+    } while (false);
 
-        mcRet = mcUnmap(&sessionHandle, (void*)plainData, &plainMapInfo);
-        if (MC_DRV_OK != mcRet)
-        {
+    if (pOp)
+    {
+        /* Unmap memory not taken from the arena */
+        if (!TEE_BulkPut(pOp->pSession, &keyBulk))
             ret = TEE_ERR_MAP;
-            break;
-        }
 
-        mcRet = mcUnmap(&sessionHandle, (void*)signatureData, &signatureMapInfo);
-        if (MC_DRV_OK != mcRet)
+        if (TEE_ERR_NONE == ret)
         {
-            ret = TEE_ERR_MAP;
-            break;
+            TEE_ArenaReset(pOp->pSession);
+            *operation = pOp;
         }
-
-        if (RET_OK != pTci->response.header.returnCode)
+        else
         {
-            LOG_E("TEE_HMACSign(): TEE Keymaster trustlet returned: 0x%.8x\n",
-                        pTci->response.header.returnCode);
-            ret = TEE_ERR_FAIL;
-            break;
+            TEE_ReleaseSession(pOp->pSession, ret);
+            free(pOp);
         }
+    }
 
-        /* Retrieve signature data length */
-        *signatureDataLength = pTci->hmacsign.signaturedatalen;
+    LOG_I("TEE_RSAOpInit(): returning: 0x%.8x\n", ret);
 
-    } while (false);
+    return ret;
+}
 
-    /* Close session to the trustlet */
-    TEE_Close(&sessionHandle);
 
-    LOG_I("TEE_HMACSign(): returning: 0x%.8x\n", ret);
+/**
+ * TEE_RSAOpEnd
+ *
+ * Hands back the session of an operation and frees it
+ */
+static void TEE_RSAOpEnd(
+    teeRsaOperation_t*    pOp,
+    teeResult_t           result
+){
+    /* an earlier failure may have left the session unusable */
+    if (TEE_ERR_NONE != pOp->result)
+        result = pOp->result;
 
-    return ret;
+    TEE_ReleaseSession(pOp->pSession, result);
+    free(pOp);
 }
 
 
 /**
- * TEE_HMACVerify
+ * TEE_RSASignInit
  *
- * Verifies given data HMAC key data and return status
+ * Starts signing a message given in pieces with TEE_RSAUpdate
  *
- * @param  plainData        [in]  Pointer to plain data to be signed
- * @param  plainDataLength  [in]  Plain data length
- * @param  signatureData    [in]  Pointer to signed data
- * @param  signatureData    [in]  Plain  data length
- * @param  digest           [in]  Digest type
- * @param  validity         [out] Signature validity
+ * @param  keyData          [in]  Pointer to key data buffer
+ * @param  keyDataLength    [in]  Key data buffer length
+ * @param  algorithm        [in]  RSA signature algorithm, one with a digest
+ * @param  operation        [out] Operation
  */
-teeResult_t TEE_HMACVerify(
-    const uint8_t*  keyData,
-    const uint32_t  keyDataLength,
-    const uint8_t*  plainData,
-    const uint32_t  plainDataLength,
-    const uint8_t*  signatureData,
-    const uint32_t  signatureDataLength,
-    teeDigest_t     digest,
-    bool            *validity
+teeResult_t TEE_RSASignInit(
+    const uint8_t*        keyData,
+    const uint32_t        keyDataLength,
+    teeRsaSigAlg_t        algorithm,
+    teeRsaOperation_t**   operation
 ){
-    teeResult_t        ret = TEE_ERR_NONE;
-    tciMessage_ptr     pTci = NULL;
-    mcSessionHandle_t  sessionHandle;
-    mcBulkMap_t        keyMapInfo;
-    mcBulkMap_t        plainMapInfo;
-    mcBulkMap_t        signatureMapInfo;
-    mcResult_t         mcRet;
-
-    do {
+    return TEE_RSAOpInit(keyData, keyDataLength, algorithm, false, operation);
+}
 
-        /* Open session to the trustlet */
-        pTci = TEE_Open(&sessionHandle);
-        if (!pTci) {
-            ret = TEE_ERR_MEMORY;
-            break;
-        }
 
-        /* Map memory to the secure world */
-        mcRet = mcMap(&sessionHandle, (void*)keyData, keyDataLength, &keyMapInfo);
-        if (MC_DRV_OK != mcRet) {
-            ret = TEE_ERR_MAP;
-            break;
+/**
+ * TEE_RSAVerifyInit
+ *
+ * Starts verifying the signature of a message given in pieces with
+ * TEE_RSAUpdate
+ *
+ * @param  keyData          [in]  Pointer to key data buffer
+ * @param  keyDataLength    [in]  Key data buffer length
+ * @param  algorithm        [in]  RSA signature algorithm, one with a digest
+ * @param  operation        [out] Operation
+ */
+teeResult_t TEE_RSAVerifyInit(
+    const uint8_t*        keyData,
+    const uint32_t        keyDataLength,
+    teeRsaSigAlg_t        algorithm,
+    teeRsaOperation_t**   operation
+){
+    return TEE_RSAOpInit(keyData, keyDataLength, algorithm, true, operation);
+}
+
+
+/**
+ * TEE_RSAUpdate
+ *
+ * Adds message data to a sign or verify operation, see TEE_StreamData.
+ *
+ * @param  operation        [in]  Operation
+ * @param  plainData        [in]  Pointer to message data
+ * @param  plainDataLength  [in]  Message data length
+ */
+teeResult_t TEE_RSAUpdate(
+    teeRsaOperation_t*    operation,
+    const uint8_t*        plainData,
+    const uint32_t        plainDataLength
+){
+    teeResult_t        ret;
+
+    if (!operation)
+        return TEE_ERR_INVALID_BUFFER;
+    if (TEE_ERR_NONE != operation->result)
+        return operation->result;
+
+    ret = TEE_StreamData(operation->pSession, operation->handle, TEE_RSAUpdateFill,
+                         plainData, plainDataLength, "TEE_RSAUpdate");
+
+    /* the trustlet has dropped the operation */
+    operation->result = ret;
+
+    LOG_I("TEE_RSAUpdate(): returning: 0x%.8x\n", ret);
+
+    return ret;
+}
+
+
+/**
+ * TEE_RSASignFinal
+ *
+ * Returns the signature of the message and ends the operation
+ *
+ * @param  operation        [in]  Operation
+ * @param  signatureData    [out] Pointer to signature data
+ * @param  signatureDataLength  [in/out] Signature buffer / data length
+ */
+teeResult_t TEE_RSASignFinal(
+    teeRsaOperation_t*    operation,
+    uint8_t*              signatureData,
+    uint32_t*             signatureDataLength
+){
+    teeResult_t        ret = TEE_ERR_NONE;
+    tciMessage_ptr     pTci;
+    teeBulk_t          signatureBulk;
+    uint32_t           signatureBufLength;
+
+    if (!operation)
+        return TEE_ERR_INVALID_BUFFER;
+
+    bzero(&signatureBulk, sizeof(signatureBulk));
+    pTci = operation->pSession->pTci;
+
+    do {
+
+        if (TEE_ERR_NONE != operation->result)
+        {
+            ret = operation->result;
+            break;
+        }
+
+        if (operation->verify)
+        {
+            TEE_RSAAbort(operation);
+            return TEE_ERR_INVALID_BUFFER;
+        }
+
+        signatureBufLength = *signatureDataLength;
+        if (!TEE_BulkGet(operation->pSession, &signatureBulk, NULL, signatureBufLength))
+        {
+            ret = TEE_ERR_MAP;
+            break;
+        }
+
+        /* Update TCI buffer */
+        pTci->command.header.commandId = CMD_ID_TEE_RSA_DIGEST_FINAL;
+        pTci->rsadigestfinal.handle = operation->handle;
+        pTci->rsadigestfinal.signaturedata = signatureBulk.sAddr;
+        pTci->rsadigestfinal.signaturedatalen = signatureBufLength;
+
+        ret = TEE_Call(operation->pSession, "TEE_RSASignFinal");
+        if (TEE_ERR_NONE != ret)
+            break;
+
+        /* Retrieve signature data */
+        if (pTci->rsadigestfinal.signaturedatalen > signatureBufLength)
+        {
+            ret = TEE_ERR_BUFFER_TOO_SMALL;
+            break;
+        }
+        *signatureDataLength = pTci->rsadigestfinal.signaturedatalen;
+        memcpy(signatureData, signatureBulk.pNormal, *signatureDataLength);
+
+    } while (false);
+
+    /* Unmap memory not taken from the arena */
+    if (!TEE_BulkPut(operation->pSession, &signatureBulk))
+        ret = TEE_ERR_MAP;
+
+    TEE_RSAOpEnd(operation, ret);
+
+    LOG_I("TEE_RSASignFinal(): returning: 0x%.8x\n", ret);
+
+    return ret;
+}
+
+
+/**
+ * TEE_RSAVerifyFinal
+ *
+ * Verifies the signature of the message and ends the operation
+ *
+ * @param  operation        [in]  Operation
+ * @param  signatureData    [in]  Pointer to signature data
+ * @param  signatureDataLength  [in]  Signature data length
+ * @param  validity         [out] Signature validity
+ */
+teeResult_t TEE_RSAVerifyFinal(
+    teeRsaOperation_t*    operation,
+    const uint8_t*        signatureData,
+    const uint32_t        signatureDataLength,
+    bool                  *validity
+){
+    teeResult_t        ret = TEE_ERR_NONE;
+    tciMessage_ptr     pTci;
+    teeBulk_t          signatureBulk;
+
+    if (!operation)
+        return TEE_ERR_INVALID_BUFFER;
+
+    bzero(&signatureBulk, sizeof(signatureBulk));
+    pTci = operation->pSession->pTci;
+
+    do {
+
+        if (TEE_ERR_NONE != operation->result)
+        {
+            ret = operation->result;
+            break;
+        }
+
+        if (!operation->verify)
+        {
+            TEE_RSAAbort(operation);
+            return TEE_ERR_INVALID_BUFFER;
+        }
+
+        if (!TEE_BulkGet(operation->pSession, &signatureBulk, signatureData, signatureDataLength))
+        {
+            ret = TEE_ERR_MAP;
+            break;
+        }
+
+        /* Update TCI buffer */
+        pTci->command.header.commandId = CMD_ID_TEE_RSA_DIGEST_FINAL;
+        pTci->rsadigestfinal.handle = operation->handle;
+        pTci->rsadigestfinal.signaturedata = signatureBulk.sAddr;
+        pTci->rsadigestfinal.signaturedatalen = signatureDataLength;
+        pTci->rsadigestfinal.validity = false;
+
+        ret = TEE_Call(operation->pSession, "TEE_RSAVerifyFinal");
+        if (TEE_ERR_NONE != ret)
+            break;
+
+        *validity = pTci->rsadigestfinal.validity;
+
+    } while (false);
+
+    /* Unmap memory not taken from the arena */
+    if (!TEE_BulkPut(operation->pSession, &signatureBulk))
+        ret = TEE_ERR_MAP;
+
+    TEE_RSAOpEnd(operation, ret);
+
+    LOG_I("TEE_RSAVerifyFinal(): returning: 0x%.8x\n", ret);
+
+    return ret;
+}
+
+
+/**
+ * TEE_RSAAbort
+ *
+ * Ends a sign or verify operation without a result
+ *
+ * @param  operation        [in]  Operation, may be NULL
+ */
+void TEE_RSAAbort(
+    teeRsaOperation_t*    operation
+){
+    teeResult_t        ret = TEE_ERR_NONE;
+    tciMessage_ptr     pTci;
+
+    if (!operation)
+        return;
+
+    /* after a failure the trustlet holds nothing */
+    if (TEE_ERR_NONE == operation->result)
+    {
+        pTci = operation->pSession->pTci;
+        pTci->command.header.commandId = CMD_ID_TEE_RSA_DIGEST_ABORT;
+        pTci->rsadigestfinal.handle = operation->handle;
+
+        ret = TEE_Call(operation->pSession, "TEE_RSAAbort");
+    }
+
+    TEE_RSAOpEnd(operation, ret);
+}
+
+
+/**
+ * TEE_HMACKeyGenerate
+ *
+ * Generates random key for HMAC calculation and returns key data as wrapped object
+ * (key is encrypted)
+ *
+ * @param  keyData        [out] Pointer to key data
+ * @param  keyDataLength  [in]  Key data buffer length
+ * @param  soLen          [out] Key data secure object length
+ */
+teeResult_t TEE_HMACKeyGenerate(
+    uint8_t*  keyData,
+    uint32_t  keyDataLength,
+    uint32_t* soLen
+){
+    teeResult_t        ret = TEE_ERR_NONE;
+    tciMessage_ptr     pTci = NULL;
+    teeSession_t*      pSession = NULL;
+    mcBulkMap_t        keyMapInfo;
+    mcResult_t         mcRet;
+
+    do {
+
+        /* Borrow a session to the trustlet */
+        ret = TEE_AcquireSession(&pSession);
+        if (TEE_ERR_NONE != ret)
+            break;
+        pTci = pSession->pTci;
+
+        /* Map memory to the secure world */
+        mcRet = mcMap(&pSession->handle, (void*)keyData, keyDataLength, &keyMapInfo);
+        if (MC_DRV_OK != mcRet) {
+            ret = TEE_ERR_MAP;
+            break;
+        }
+
+        /* Update TCI buffer */
+        pTci->command.header.commandId = CMD_ID_TEE_HMAC_GEN_KEY;
+        pTci->hmacgenkey.keydata = (uint32_t)keyMapInfo.sVirtualAddr;
+        pTci->hmacgenkey.keydatalen = keyDataLength;
+
+        /* Notify the trustlet */
+        mcRet = mcNotify(&pSession->handle);
+        if (MC_DRV_OK != mcRet)
+        {
+            ret = TEE_ERR_NOTIFICATION;
+            break;
+        }
+
+        /* Wait for response from the trustlet */
+        if (MC_DRV_OK != mcWaitNotification(&pSession->handle, MC_INFINITE_TIMEOUT))
+        {
+            ret = TEE_ERR_NOTIFICATION;
+            break;
+        }
+
+        /* Unmap memory */
+        mcRet = mcUnmap(&pSession->handle, (void*)keyData, &keyMapInfo);
+        if (MC_DRV_OK != mcRet)
+        {
+            ret = TEE_ERR_MAP;
+            break;
+        }
+
+        if (RET_OK != pTci->response.header.returnCode)
+        {
+            LOG_E("TEE_RSAVerify(): TEE Keymaster trustlet returned: 0x%.8x\n",
+                        pTci->response.header.returnCode);
+            ret = TEE_ERR_FAIL;
+        }
+
+        /* Update secure object length */
+        *soLen =  pTci->hmacgenkey.solen;
+
+    }while (false);
+
+    /* Return the session to the pool */
+    TEE_ReleaseSession(pSession, ret);
+
+    LOG_I("TEE_HMACKeyGenerate(): returning: 0x%.8x\n", ret);
+
+    return ret;
+}
+
+/**
+ * TEE_HMACSign
+ *
+ * Signs given plain data and returns HMAC signature data
+ *
+ * @param  keyData          [in]  Pointer to key data buffer
+ * @param  keyDataLength    [in]  Key data buffer length
+ * @param  plainData        [in]  Pointer to plain data to be signed
+ * @param  plainDataLength  [in]  Plain data length
+ * @param  signatureData    [out] Pointer to signature data
+ * @param  signatureDataLength  [out] Signature data length
+ * @param  digest           [in]  Digest type
+ */
+teeResult_t TEE_HMACSign(
+    const uint8_t*  keyData,
+    const uint32_t  keyDataLength,
+    const uint8_t*  plainData,
+    const uint32_t  plainDataLength,
+    uint8_t*        signatureData,
+    uint32_t*       signatureDataLength,
+    teeDigest_t     digest
+){
+    teeResult_t        ret = TEE_ERR_NONE;
+    tciMessage_ptr     pTci = NULL;
+    teeSession_t*      pSession = NULL;
+    teeBulk_t          keyBulk;
+    teeBulk_t          plainBulk;
+    teeBulk_t          signatureBulk;
+    uint32_t           signatureBufLength = *signatureDataLength;
+    mcResult_t         mcRet;
+
+    bzero(&keyBulk, sizeof(keyBulk));
+    bzero(&plainBulk, sizeof(plainBulk));
+    bzero(&signatureBulk, sizeof(signatureBulk));
+
+    do {
+
+        /* Borrow a session to the trustlet */
+        ret = TEE_AcquireSession(&pSession);
+        if (TEE_ERR_NONE != ret)
+            break;
+        pTci = pSession->pTci;
+
+        /* Copy the input to memory shared with the secure world */
+        if (!TEE_BulkGet(pSession, &keyBulk, keyData, keyDataLength) ||
+            !TEE_BulkGet(pSession, &plainBulk, plainData, plainDataLength) ||
+            !TEE_BulkGet(pSession, &signatureBulk, NULL, signatureBufLength))
+        {
+            ret = TEE_ERR_MAP;
+            break;
+        }
+
+        /* Update TCI buffer */
+        pTci->command.header.commandId = CMD_ID_TEE_HMAC_SIGN;
+        pTci->hmacsign.keydata = keyBulk.sAddr;
+        pTci->hmacsign.keydatalen = keyDataLength;
+
+        pTci->hmacsign.plaindata = plainBulk.sAddr;
+        pTci->hmacsign.plaindatalen = plainDataLength;
+
+        pTci->hmacsign.signaturedata = signatureBulk.sAddr;
+        pTci->hmacsign.signaturedatalen = signatureBufLength;
+
+        pTci->hmacsign.digest = digest;
+
+        /* Notify the trustlet */
+        mcRet = mcNotify(&pSession->handle);
+        if (MC_DRV_OK != mcRet)
+        {
+            ret = TEE_ERR_NOTIFICATION;
+            break;
+        }
+
+        /* Wait for response from the trustlet */
+        if (MC_DRV_OK != mcWaitNotification(&pSession->handle, MC_INFINITE_TIMEOUT))
+        {
+            ret = TEE_ERR_NOTIFICATION;
+            break;
+        }
+
+        if (RET_OK != pTci->response.header.returnCode)
+        {
+            LOG_E("TEE_HMACSign(): TEE Keymaster trustlet returned: 0x%.8x\n",
+                        pTci->response.header.returnCode);
+            ret = TEE_ERR_FAIL;
+            break;
+        }
+
+        /* Retrieve signature data */
+        if (pTci->hmacsign.signaturedatalen > signatureBufLength)
+        {
+            ret = TEE_ERR_BUFFER_TOO_SMALL;
+            break;
+        }
+        *signatureDataLength = pTci->hmacsign.signaturedatalen;
+        memcpy(signatureData, signatureBulk.pNormal, *signatureDataLength);
+
+    } while (false);
+
+    /* Unmap memory not taken from the arena */
+    if (!TEE_BulkPut(pSession, &keyBulk))
+        ret = TEE_ERR_MAP;
+    if (!TEE_BulkPut(pSession, &plainBulk))
+        ret = TEE_ERR_MAP;
+    if (!TEE_BulkPut(pSession, &signatureBulk))
+        ret = TEE_ERR_MAP;
+
+    /* Return the session to the pool */
+    TEE_ReleaseSession(pSession, ret);
+
+    LOG_I("TEE_HMACSign(): returning: 0x%.8x\n", ret);
+
+    return ret;
+}
+
+
+/**
+ * TEE_HMACVerify
+ *
+ * Verifies given data HMAC key data and return status
+ *
+ * @param  plainData        [in]  Pointer to plain data to be signed
+ * @param  plainDataLength  [in]  Plain data length
+ * @param  signatureData    [in]  Pointer to signed data
+ * @param  signatureData    [in]  Plain  data length
+ * @param  digest           [in]  Digest type
+ * @param  validity         [out] Signature validity
+ */
+teeResult_t TEE_HMACVerify(
+    const uint8_t*  keyData,
+    const uint32_t  keyDataLength,
+    const uint8_t*  plainData,
+    const uint32_t  plainDataLength,
+    const uint8_t*  signatureData,
+    const uint32_t  signatureDataLength,
+    teeDigest_t     digest,
+    bool            *validity
+){
+    teeResult_t        ret = TEE_ERR_NONE;
+    tciMessage_ptr     pTci = NULL;
+    teeSession_t*      pSession = NULL;
+    teeBulk_t          keyBulk;
+    teeBulk_t          plainBulk;
+    teeBulk_t          signatureBulk;
+    mcResult_t         mcRet;
+
+    bzero(&keyBulk, sizeof(keyBulk));
+    bzero(&plainBulk, sizeof(plainBulk));
+    bzero(&signatureBulk, sizeof(signatureBulk));
+
+    do {
+
+        /* Borrow a session to the trustlet */
+        ret = TEE_AcquireSession(&pSession);
+        if (TEE_ERR_NONE != ret)
+            break;
+        pTci = pSession->pTci;
+
+        /* Copy the input to memory shared with the secure world */
+        if (!TEE_BulkGet(pSession, &keyBulk, keyData, keyDataLength) ||
+            !TEE_BulkGet(pSession, &plainBulk, plainData, plainDataLength) ||
+            !TEE_BulkGet(pSession, &signatureBulk, signatureData, signatureDataLength))
+        {
+            ret = TEE_ERR_MAP;
+            break;
+        }
+
+        /* Update TCI buffer */
+        pTci->command.header.commandId = CMD_ID_TEE_HMAC_VERIFY;
+        pTci->hmacverify.keydata = keyBulk.sAddr;
+        pTci->hmacverify.keydatalen = keyDataLength;
+
+        pTci->hmacverify.plaindata = plainBulk.sAddr;
+        pTci->hmacverify.plaindatalen = plainDataLength;
+
+        pTci->hmacverify.signaturedata = signatureBulk.sAddr;
+        pTci->hmacverify.signaturedatalen = signatureDataLength;
+
+        pTci->hmacverify.digest = digest;
+        pTci->hmacverify.validity = false;
+
+        /* Notify the trustlet */
+        mcRet = mcNotify(&pSession->handle);
+        if (MC_DRV_OK != mcRet)
+        {
+            ret = TEE_ERR_NOTIFICATION;
+            break;
+        }
+
+        /* Wait for response from the trustlet */
+        if (MC_DRV_OK != mcWaitNotification(&pSession->handle, MC_INFINITE_TIMEOUT))
+        {
+            ret = TEE_ERR_NOTIFICATION;
+            break;
+        }
+
+        if (RET_OK != pTci->response.header.returnCode)
+        {
+            LOG_E("TEE_HMACVerify(): TEE Keymaster trustlet returned: 0x%.8x\n",
+                        pTci->response.header.returnCode);
+            ret = TEE_ERR_FAIL;
+            break;
+        }
+
+        *validity =  pTci->hmacverify.validity;
+
+    } while (false);
+
+    /* Unmap memory not taken from the arena */
+    if (!TEE_BulkPut(pSession, &keyBulk))
+        ret = TEE_ERR_MAP;
+    if (!TEE_BulkPut(pSession, &plainBulk))
+        ret = TEE_ERR_MAP;
+    if (!TEE_BulkPut(pSession, &signatureBulk))
+        ret = TEE_ERR_MAP;
+
+    /* Return the session to the pool */
+    TEE_ReleaseSession(pSession, ret);
+
+    LOG_I("TEE_HMACVerify(): returning: 0x%.8x\n", ret);
+
+    return ret;
+}
+
+
+/**
+ * TEE_HMACUpdateFill
+ *
+ * TEE_StreamFill_t of the streamed HMAC operations
+ */
+static void TEE_HMACUpdateFill(
+    tciMessage_ptr     pTci,
+    uint32_t           handle,
+    uint32_t           sAddr,
+    uint32_t           len
+){
+    pTci->command.header.commandId = CMD_ID_TEE_HMAC_UPDATE;
+    pTci->hmacupdate.handle = handle;
+    pTci->hmacupdate.plaindata = sAddr;
+    pTci->hmacupdate.plaindatalen = len;
+}
+
+
+/**
+ * TEE_HMACOpInit
+ *
+ * Starts a streamed HMAC operation on a session of its own.
+ */
+static teeResult_t TEE_HMACOpInit(
+    const uint8_t*        keyData,
+    const uint32_t        keyDataLength,
+    teeDigest_t           digest,
+    bool                  verify,
+    teeHmacOperation_t**  operation
+){
+    teeResult_t         ret = TEE_ERR_NONE;
+    tciMessage_ptr      pTci = NULL;
+    teeHmacOperation_t* pOp = NULL;
+    teeBulk_t           keyBulk;
+
+    bzero(&keyBulk, sizeof(keyBulk));
+
+    do {
+
+        if (!operation)
+        {
+            ret = TEE_ERR_INVALID_BUFFER;
+            break;
+        }
+        *operation = NULL;
+
+        pOp = (teeHmacOperation_t *) calloc(1, sizeof(teeHmacOperation_t));
+        if (!pOp)
+        {
+            ret = TEE_ERR_MEMORY;
+            break;
+        }
+        pOp->verify = verify;
+
+        /* Borrow a session to the trustlet, kept until the operation ends */
+        ret = TEE_AcquireSession(&pOp->pSession);
+        if (TEE_ERR_NONE != ret)
+            break;
+        pTci = pOp->pSession->pTci;
+
+        /* Copy the key to memory shared with the secure world */
+        if (!TEE_BulkGet(pOp->pSession, &keyBulk, keyData, keyDataLength))
+        {
+            ret = TEE_ERR_MAP;
+            break;
+        }
+
+        /* Update TCI buffer */
+        pTci->command.header.commandId = CMD_ID_TEE_HMAC_INIT;
+        pTci->hmacinit.keydata = keyBulk.sAddr;
+        pTci->hmacinit.keydatalen = keyDataLength;
+        pTci->hmacinit.digest = digest;
+        pTci->hmacinit.verify = verify ? 1 : 0;
+
+        ret = TEE_Call(pOp->pSession, "TEE_HMACOpInit");
+        if (TEE_ERR_NONE != ret)
+            break;
+
+        pOp->handle = pTci->hmacinit.handle;
+
+    } while (false);
+
+    if (pOp)
+    {
+        /* Unmap memory not taken from the arena */
+        if (!TEE_BulkPut(pOp->pSession, &keyBulk))
+            ret = TEE_ERR_MAP;
+
+        if (TEE_ERR_NONE == ret)
+        {
+            TEE_ArenaReset(pOp->pSession);
+            *operation = pOp;
+        }
+        else
+        {
+            TEE_ReleaseSession(pOp->pSession, ret);
+            free(pOp);
+        }
+    }
+
+    LOG_I("TEE_HMACOpInit(): returning: 0x%.8x\n", ret);
+
+    return ret;
+}
+
+
+/**
+ * TEE_HMACOpEnd
+ *
+ * Hands back the session of an operation and frees it
+ */
+static void TEE_HMACOpEnd(
+    teeHmacOperation_t*   pOp,
+    teeResult_t           result
+){
+    /* an earlier failure may have left the session unusable */
+    if (TEE_ERR_NONE != pOp->result)
+        result = pOp->result;
+
+    TEE_ReleaseSession(pOp->pSession, result);
+    free(pOp);
+}
+
+
+/**
+ * TEE_HMACSignInit
+ *
+ * Starts computing the HMAC of a message given in pieces with
+ * TEE_HMACUpdate
+ *
+ * @param  keyData          [in]  Pointer to key data buffer
+ * @param  keyDataLength    [in]  Key data buffer length
+ * @param  digest           [in]  Digest type
+ * @param  operation        [out] Operation
+ */
+teeResult_t TEE_HMACSignInit(
+    const uint8_t*        keyData,
+    const uint32_t        keyDataLength,
+    teeDigest_t           digest,
+    teeHmacOperation_t**  operation
+){
+    return TEE_HMACOpInit(keyData, keyDataLength, digest, false, operation);
+}
+
+
+/**
+ * TEE_HMACVerifyInit
+ *
+ * Starts verifying the HMAC of a message given in pieces with
+ * TEE_HMACUpdate
+ *
+ * @param  keyData          [in]  Pointer to key data buffer
+ * @param  keyDataLength    [in]  Key data buffer length
+ * @param  digest           [in]  Digest type
+ * @param  operation        [out] Operation
+ */
+teeResult_t TEE_HMACVerifyInit(
+    const uint8_t*        keyData,
+    const uint32_t        keyDataLength,
+    teeDigest_t           digest,
+    teeHmacOperation_t**  operation
+){
+    return TEE_HMACOpInit(keyData, keyDataLength, digest, true, operation);
+}
+
+
+/**
+ * TEE_HMACUpdate
+ *
+ * Adds message data to an HMAC operation, see TEE_StreamData.
+ *
+ * @param  operation        [in]  Operation
+ * @param  plainData        [in]  Pointer to message data
+ * @param  plainDataLength  [in]  Message data length
+ */
+teeResult_t TEE_HMACUpdate(
+    teeHmacOperation_t*   operation,
+    const uint8_t*        plainData,
+    const uint32_t        plainDataLength
+){
+    teeResult_t        ret;
+
+    if (!operation)
+        return TEE_ERR_INVALID_BUFFER;
+    if (TEE_ERR_NONE != operation->result)
+        return operation->result;
+
+    ret = TEE_StreamData(operation->pSession, operation->handle, TEE_HMACUpdateFill,
+                         plainData, plainDataLength, "TEE_HMACUpdate");
+
+    /* the trustlet has dropped the operation */
+    operation->result = ret;
+
+    LOG_I("TEE_HMACUpdate(): returning: 0x%.8x\n", ret);
+
+    return ret;
+}
+
+
+/**
+ * TEE_HMACSignFinal
+ *
+ * Returns the HMAC of the message and ends the operation
+ *
+ * @param  operation        [in]  Operation
+ * @param  signatureData    [out] Pointer to signature data
+ * @param  signatureDataLength  [in/out] Signature buffer / data length
+ */
+teeResult_t TEE_HMACSignFinal(
+    teeHmacOperation_t*   operation,
+    uint8_t*              signatureData,
+    uint32_t*             signatureDataLength
+){
+    teeResult_t        ret = TEE_ERR_NONE;
+    tciMessage_ptr     pTci;
+    teeBulk_t          signatureBulk;
+    uint32_t           signatureBufLength;
+
+    if (!operation)
+        return TEE_ERR_INVALID_BUFFER;
+
+    bzero(&signatureBulk, sizeof(signatureBulk));
+    pTci = operation->pSession->pTci;
+
+    do {
+
+        if (TEE_ERR_NONE != operation->result)
+        {
+            ret = operation->result;
+            break;
+        }
+
+        if (operation->verify)
+        {
+            TEE_HMACAbort(operation);
+            return TEE_ERR_INVALID_BUFFER;
+        }
+
+        signatureBufLength = *signatureDataLength;
+        if (!TEE_BulkGet(operation->pSession, &signatureBulk, NULL, signatureBufLength))
+        {
+            ret = TEE_ERR_MAP;
+            break;
+        }
+
+        /* Update TCI buffer */
+        pTci->command.header.commandId = CMD_ID_TEE_HMAC_FINAL;
+        pTci->hmacfinal.handle = operation->handle;
+        pTci->hmacfinal.signaturedata = signatureBulk.sAddr;
+        pTci->hmacfinal.signaturedatalen = signatureBufLength;
+
+        ret = TEE_Call(operation->pSession, "TEE_HMACSignFinal");
+        if (TEE_ERR_NONE != ret)
+            break;
+
+        /* Retrieve signature data */
+        if (pTci->hmacfinal.signaturedatalen > signatureBufLength)
+        {
+            ret = TEE_ERR_BUFFER_TOO_SMALL;
+            break;
+        }
+        *signatureDataLength = pTci->hmacfinal.signaturedatalen;
+        memcpy(signatureData, signatureBulk.pNormal, *signatureDataLength);
+
+    } while (false);
+
+    /* Unmap memory not taken from the arena */
+    if (!TEE_BulkPut(operation->pSession, &signatureBulk))
+        ret = TEE_ERR_MAP;
+
+    TEE_HMACOpEnd(operation, ret);
+
+    LOG_I("TEE_HMACSignFinal(): returning: 0x%.8x\n", ret);
+
+    return ret;
+}
+
+
+/**
+ * TEE_HMACVerifyFinal
+ *
+ * Verifies the HMAC of the message and ends the operation
+ *
+ * @param  operation        [in]  Operation
+ * @param  signatureData    [in]  Pointer to signature data
+ * @param  signatureDataLength  [in]  Signature data length
+ * @param  validity         [out] Signature validity
+ */
+teeResult_t TEE_HMACVerifyFinal(
+    teeHmacOperation_t*   operation,
+    const uint8_t*        signatureData,
+    const uint32_t        signatureDataLength,
+    bool                  *validity
+){
+    teeResult_t        ret = TEE_ERR_NONE;
+    tciMessage_ptr     pTci;
+    teeBulk_t          signatureBulk;
+
+    if (!operation)
+        return TEE_ERR_INVALID_BUFFER;
+
+    bzero(&signatureBulk, sizeof(signatureBulk));
+    pTci = operation->pSession->pTci;
+
+    do {
+
+        if (TEE_ERR_NONE != operation->result)
+        {
+            ret = operation->result;
+            break;
+        }
+
+        if (!operation->verify)
+        {
+            TEE_HMACAbort(operation);
+            return TEE_ERR_INVALID_BUFFER;
+        }
+
+        if (!TEE_BulkGet(operation->pSession, &signatureBulk, signatureData, signatureDataLength))
+        {
+            ret = TEE_ERR_MAP;
+            break;
+        }
+
+        /* Update TCI buffer */
+        pTci->command.header.commandId = CMD_ID_TEE_HMAC_FINAL;
+        pTci->hmacfinal.handle = operation->handle;
+        pTci->hmacfinal.signaturedata = signatureBulk.sAddr;
+        pTci->hmacfinal.signaturedatalen = signatureDataLength;
+        pTci->hmacfinal.validity = false;
+
+        ret = TEE_Call(operation->pSession, "TEE_HMACVerifyFinal");
+        if (TEE_ERR_NONE != ret)
+            break;
+
+        *validity = pTci->hmacfinal.validity;
+
+    } while (false);
+
+    /* Unmap memory not taken from the arena */
+    if (!TEE_BulkPut(operation->pSession, &signatureBulk))
+        ret = TEE_ERR_MAP;
+
+    TEE_HMACOpEnd(operation, ret);
+
+    LOG_I("TEE_HMACVerifyFinal(): returning: 0x%.8x\n", ret);
+
+    return ret;
+}
+
+
+/**
+ * TEE_HMACAbort
+ *
+ * Ends an HMAC operation without a result
+ *
+ * @param  operation        [in]  Operation, may be NULL
+ */
+void TEE_HMACAbort(
+    teeHmacOperation_t*   operation
+){
+    teeResult_t        ret = TEE_ERR_NONE;
+    tciMessage_ptr     pTci;
+
+    if (!operation)
+        return;
+
+    /* after a failure the trustlet holds nothing */
+    if (TEE_ERR_NONE == operation->result)
+    {
+        pTci = operation->pSession->pTci;
+        pTci->command.header.commandId = CMD_ID_TEE_HMAC_ABORT;
+        pTci->hmacfinal.handle = operation->handle;
+
+        ret = TEE_Call(operation->pSession, "TEE_HMACAbort");
+    }
+
+    TEE_HMACOpEnd(operation, ret);
+}
+
+
+/**
+ * TEE_KeyImport
+ *
+ * Imports key data and returns key data as secure object
+ *
+ * Key data needs to be in the following format
+ *
+ * RSA key data:
+ * |--key metadata--|--public modulus--|--public exponent--|--private exponent--|
+ *
+ * RSA CRT key data:
+ * |--key metadata--|--public modulus--|--public exponent--|--P--|--Q--|--DP--|--DQ--|--Qinv--|
+ *
+ * Where:
+ * P:     secret prime factor
+ * Q:     secret prime factor
+ * DP:    d mod (p-1)
+ * DQ:    d mod (q-1)
+ * Qinv:  q^-1 mod p
+ *
+ * @param  keyData          [in]  Pointer to key data
+ * @param  keyDataLength    [in]  Key data length
+ * @param  soData           [out] Pointer to wrapped key data
+ * @param  soDataLength     [out] Wrapped key data length
+ */
+teeResult_t TEE_KeyImport(
+    const uint8_t*  keyData,
+    const uint32_t  keyDataLength,
+    uint8_t*        soData,
+    uint32_t*       soDataLength
+){
+    teeResult_t         ret = TEE_ERR_NONE;
+    tciMessage_ptr      pTci = NULL;
+    teeSession_t*       pSession = NULL;
+    mcBulkMap_t         keyMapInfo;
+    mcBulkMap_t         soMapInfo;
+    mcResult_t          mcRet;
+
+    do {
+
+        /* Borrow a session to the trustlet */
+        ret = TEE_AcquireSession(&pSession);
+        if (TEE_ERR_NONE != ret)
+            break;
+        pTci = pSession->pTci;
+
+        /* Map memory to the secure world */
+        mcRet = mcMap(&pSession->handle, (void*)keyData, keyDataLength, &keyMapInfo);
+        if (MC_DRV_OK != mcRet) {
+            ret = TEE_ERR_MAP;
+            break;
+        }
+
+        mcRet = mcMap(&pSession->handle, (void*)soData, *soDataLength, &soMapInfo);
+        if (MC_DRV_OK != mcRet) {
+            ret = TEE_ERR_MAP;
+            break;
+        }
+
+        /* Update TCI buffer */
+        pTci->command.header.commandId = CMD_ID_TEE_KEY_IMPORT;
+        pTci->keyimport.keydata        = (uint32_t)keyMapInfo.sVirtualAddr;
+        pTci->keyimport.keydatalen     = keyDataLength;
+        pTci->keyimport.sodata         = (uint32_t)soMapInfo.sVirtualAddr;
+        pTci->keyimport.sodatalen      = *soDataLength;
+
+        /* Notify the trustlet */
+        mcRet = mcNotify(&pSession->handle);
+        if (MC_DRV_OK != mcRet)
+        {
+            ret = TEE_ERR_NOTIFICATION;
+            break;
+        }
+
+        /* Wait for response from the trustlet */
+        if (MC_DRV_OK != mcWaitNotification(&pSession->handle, MC_INFINITE_TIMEOUT))
+        {
+            ret = TEE_ERR_NOTIFICATION;
+            break;
+        }
+
+        /* Unmap memory */
+        mcRet = mcUnmap(&pSession->handle, (void*)keyData, &keyMapInfo);
+        if (MC_DRV_OK != mcRet)
+        {
+            ret = TEE_ERR_MAP;
+            break;
+        }
+
+        mcRet = mcUnmap(&pSession->handle, (void*)soData, &soMapInfo);
+        if (MC_DRV_OK != mcRet)
+        {
+            ret = TEE_ERR_MAP;
+            break;
+        }
+
+        if (RET_OK != pTci->response.header.returnCode)
+        {
+            LOG_E("TEE_KeyWrap(): TEE Keymaster trustlet returned: 0x%.8x\n",
+                        pTci->response.header.returnCode);
+            ret = TEE_ERR_FAIL;
+            break;
+        }
+
+        /* Update secure object length */
+        *soDataLength =  pTci->keyimport.sodatalen;
+
+    } while (false);
+
+    /* Return the session to the pool */
+    TEE_ReleaseSession(pSession, ret);
+
+    LOG_I("TEE_KeyWrap(): returning: 0x%.8x\n", ret);
+
+    return ret;
+}
+
+
+/** * TEE_GetPubKey
+ *
+ * Retrieves public key daya (modulus and exponent) from wrapped key data
+ *
+ * @param  keyData          [in]  Pointer to key data
+ * @param  keyDataLength    [in]  Key data length
+ * @param  modulus          [out] Pointer to public key modulus data
+ * @param  modulusLength    [out] Modulus data length
+ * @param  exponent         [out] Pointer to public key exponent data
+ * @param  exponentLength   [out] Exponent data length
+ */
+teeResult_t TEE_GetPubKey(
+    const uint8_t*  keyData,
+    const uint32_t  keyDataLength,
+    uint8_t*        modulus,
+    uint32_t*       modulusLength,
+    uint8_t*        exponent,
+    uint32_t*       exponentLength
+){
+    teeResult_t         ret = TEE_ERR_NONE;
+    tciMessage_ptr      pTci = NULL;
+    teeSession_t*       pSession = NULL;
+    mcBulkMap_t         keyMapInfo;
+    mcBulkMap_t         modMapInfo;
+    mcBulkMap_t         expMapInfo;
+    mcResult_t          mcRet;
+
+    do {
+
+        /* Borrow a session to the trustlet */
+        ret = TEE_AcquireSession(&pSession);
+        if (TEE_ERR_NONE != ret)
+            break;
+        pTci = pSession->pTci;
+
+        /* Map memory to the secure world */
+        mcRet = mcMap(&pSession->handle, (void*)keyData, keyDataLength, &keyMapInfo);
+        if (MC_DRV_OK != mcRet) {
+            ret = TEE_ERR_MAP;
+            break;
         }
 
-        mcRet = mcMap(&sessionHandle, (void*)plainData, plainDataLength, &plainMapInfo);
+        mcRet = mcMap(&pSession->handle, (void*)modulus, *modulusLength, &modMapInfo);
         if (MC_DRV_OK != mcRet) {
             ret = TEE_ERR_MAP;
             break;
         }
 
-        mcRet = mcMap(&sessionHandle, (void*)signatureData, signatureDataLength, &signatureMapInfo);
+        mcRet = mcMap(&pSession->handle, (void*)exponent, *exponentLength, &expMapInfo);
         if (MC_DRV_OK != mcRet) {
             ret = TEE_ERR_MAP;
             break;
         }
 
         /* Update TCI buffer */
-        pTci->command.header.commandId = CMD_ID_TEE_HMAC_VERIFY;
-        pTci->hmacverify.keydata = (uint32_t)keyMapInfo.sVirtualAddr;
-        pTci->hmacverify.keydatalen = keyDataLength;
+        pTci->command.header.commandId = CMD_ID_TEE_GET_PUB_KEY;
+        pTci->getpubkey.keydata        = (uint32_t)keyMapInfo.sVirtualAddr;
+        pTci->getpubkey.keydatalen     = keyDataLength;
+        pTci->getpubkey.modulus        = (uint32_t)modMapInfo.sVirtualAddr;
+        pTci->getpubkey.moduluslen     = *modulusLength;
+        pTci->getpubkey.exponent       = (uint32_t)expMapInfo.sVirtualAddr;
+        pTci->getpubkey.exponentlen    = *exponentLength;
 
-        pTci->hmacverify.plaindata = (uint32_t)plainMapInfo.sVirtualAddr;
-        pTci->hmacverify.plaindatalen = plainDataLength;
+        /* Notify the trustlet */
+        mcRet = mcNotify(&pSession->handle);
+        if (MC_DRV_OK != mcRet)
+        {
+            ret = TEE_ERR_NOTIFICATION;
+            break;
+        }
 
-        pTci->hmacverify.signaturedata = (uint32_t)signatureMapInfo.sVirtualAddr;
-        pTci->hmacverify.signaturedatalen = signatureDataLength;
+        /* Wait for response from the trustlet */
+        if (MC_DRV_OK != mcWaitNotification(&pSession->handle, MC_INFINITE_TIMEOUT))
+        {
+            ret = TEE_ERR_NOTIFICATION;
+            break;
+        }
 
-        pTci->hmacverify.digest = digest;
-        pTci->hmacverify.validity = false;
+        /* Unmap memory */
+        mcRet = mcUnmap(&pSession->handle, (void*)keyData, &keyMapInfo);
+        if (MC_DRV_OK != mcRet)
+        {
+            ret = TEE_ERR_MAP;
+            break;
+        }
+
+        mcRet = mcUnmap(&pSession->handle, (void*)modulus, &modMapInfo);
+        if (MC_DRV_OK != mcRet)
+        {
+            ret = TEE_ERR_MAP;
+            break;
+        }
+
+        mcRet = mcUnmap(&pSession->handle, (void*)exponent, &expMapInfo);
+        if (MC_DRV_OK != mcRet)
+        {
+            ret = TEE_ERR_MAP;
+            break;
+        }
+
+        if (RET_OK != pTci->response.header.returnCode)
+        {
+            LOG_E("TEE_GetPubKey(): TEE Keymaster trustlet returned: 0x%.8x\n",
+                        pTci->response.header.returnCode);
+            ret = TEE_ERR_FAIL;
+            break;
+        }
+
+        /* Update  modulus and exponent lengths */
+        *modulusLength =   pTci->getpubkey.moduluslen;
+        *exponentLength =   pTci->getpubkey.exponentlen;
+
+    } while (false);
+
+    /* Return the session to the pool */
+    TEE_ReleaseSession(pSession, ret);
+
+    LOG_I("TEE_GetPubKey(): returning: 0x%.8x\n", ret);
+
+    return ret;
+}
+
+
+/**
+ * TEE_ECGenerateKeyPair
+ *
+ * Generates EC key pair and returns key pair data as wrapped object
+ *
+ * @param  curve          [in]  Curve
+ * @param  keyData        [in]  Pointer to the key data buffer
+ * @param  keyDataLength  [in]  Key data buffer length
+ * @param  soLen          [out] Key data secure object length
+ */
+teeResult_t TEE_ECGenerateKeyPair(
+    teeEcCurve_t    curve,
+    uint8_t*        keyData,
+    uint32_t        keyDataLength,
+    uint32_t*       soLen
+){
+    teeResult_t        ret = TEE_ERR_NONE;
+    tciMessage_ptr     pTci = NULL;
+    teeSession_t*      pSession = NULL;
+    teeBulk_t          keyBulk;
+    mcResult_t         mcRet;
+
+    bzero(&keyBulk, sizeof(keyBulk));
+
+    do {
+
+        /* Borrow a session to the trustlet */
+        ret = TEE_AcquireSession(&pSession);
+        if (TEE_ERR_NONE != ret)
+            break;
+        pTci = pSession->pTci;
+
+        if (!TEE_BulkGet(pSession, &keyBulk, NULL, keyDataLength))
+        {
+            ret = TEE_ERR_MAP;
+            break;
+        }
+
+        /* Update TCI buffer */
+        pTci->command.header.commandId = CMD_ID_TEE_EC_GEN_KEY_PAIR;
+        pTci->ecgenkey.curve        = curve;
+        pTci->ecgenkey.keydata      = keyBulk.sAddr;
+        pTci->ecgenkey.keydatalen   = keyDataLength;
+
+        /* Notify the trustlet */
+        mcRet = mcNotify(&pSession->handle);
+        if (MC_DRV_OK != mcRet)
+        {
+            ret = TEE_ERR_NOTIFICATION;
+            break;
+        }
+
+        /* Wait for response from the trustlet */
+        if (MC_DRV_OK != mcWaitNotification(&pSession->handle, MC_INFINITE_TIMEOUT))
+        {
+            ret = TEE_ERR_NOTIFICATION;
+            break;
+        }
+
+        if (RET_OK != pTci->response.header.returnCode)
+        {
+            LOG_E("TEE_ECGenerateKeyPair(): TEE Keymaster trustlet returned: 0x%.8x\n",
+                        pTci->response.header.returnCode);
+            ret = TEE_ERR_FAIL;
+            break;
+        }
+
+        /* Retrieve the secure object */
+        if (pTci->ecgenkey.solen > keyDataLength)
+        {
+            ret = TEE_ERR_BUFFER_TOO_SMALL;
+            break;
+        }
+        *soLen = pTci->ecgenkey.solen;
+        memcpy(keyData, keyBulk.pNormal, *soLen);
+
+    } while (false);
+
+    /* Unmap memory not taken from the arena */
+    if (!TEE_BulkPut(pSession, &keyBulk))
+        ret = TEE_ERR_MAP;
+
+    /* Return the session to the pool */
+    TEE_ReleaseSession(pSession, ret);
+
+    LOG_I("TEE_ECGenerateKeyPair(): returning: 0x%.8x\n", ret);
+
+    return ret;
+}
+
+
+/**
+ * TEE_ECSign
+ *
+ * Signs given digest with ECDSA and returns the DER encoded signature
+ *
+ * @param  keyData          [in]  Pointer to key data buffer
+ * @param  keyDataLength    [in]  Key data buffer length
+ * @param  digestData       [in]  Pointer to digest to be signed
+ * @param  digestDataLength [in]  Digest length
+ * @param  signatureData    [out] Pointer to signature data
+ * @param  signatureDataLength  [in/out] Signature buffer / data length
+ */
+teeResult_t TEE_ECSign(
+    const uint8_t*  keyData,
+    const uint32_t  keyDataLength,
+    const uint8_t*  digestData,
+    const uint32_t  digestDataLength,
+    uint8_t*        signatureData,
+    uint32_t*       signatureDataLength
+){
+    teeResult_t        ret = TEE_ERR_NONE;
+    tciMessage_ptr     pTci = NULL;
+    teeSession_t*      pSession = NULL;
+    teeBulk_t          keyBulk;
+    teeBulk_t          digestBulk;
+    teeBulk_t          signatureBulk;
+    uint32_t           signatureBufLength = *signatureDataLength;
+    mcResult_t         mcRet;
+
+    bzero(&keyBulk, sizeof(keyBulk));
+    bzero(&digestBulk, sizeof(digestBulk));
+    bzero(&signatureBulk, sizeof(signatureBulk));
+
+    do {
+
+        /* Borrow a session to the trustlet */
+        ret = TEE_AcquireSession(&pSession);
+        if (TEE_ERR_NONE != ret)
+            break;
+        pTci = pSession->pTci;
+
+        /* Copy the input to memory shared with the secure world */
+        if (!TEE_BulkGet(pSession, &keyBulk, keyData, keyDataLength) ||
+            !TEE_BulkGet(pSession, &digestBulk, digestData, digestDataLength) ||
+            !TEE_BulkGet(pSession, &signatureBulk, NULL, signatureBufLength))
+        {
+            ret = TEE_ERR_MAP;
+            break;
+        }
+
+        /* Update TCI buffer */
+        pTci->command.header.commandId = CMD_ID_TEE_EC_SIGN;
+        pTci->ecsign.keydata = keyBulk.sAddr;
+        pTci->ecsign.keydatalen = keyDataLength;
+
+        pTci->ecsign.plaindata = digestBulk.sAddr;
+        pTci->ecsign.plaindatalen = digestDataLength;
+
+        pTci->ecsign.signaturedata = signatureBulk.sAddr;
+        pTci->ecsign.signaturedatalen = signatureBufLength;
+
+        /* Notify the trustlet */
+        mcRet = mcNotify(&pSession->handle);
+        if (MC_DRV_OK != mcRet)
+        {
+            ret = TEE_ERR_NOTIFICATION;
+            break;
+        }
+
+        /* Wait for response from the trustlet */
+        if (MC_DRV_OK != mcWaitNotification(&pSession->handle, MC_INFINITE_TIMEOUT))
+        {
+            ret = TEE_ERR_NOTIFICATION;
+            break;
+        }
+
+        if (RET_OK != pTci->response.header.returnCode)
+        {
+            LOG_E("TEE_ECSign(): TEE Keymaster trustlet returned: 0x%.8x\n",
+                        pTci->response.header.returnCode);
+            ret = TEE_ERR_FAIL;
+            break;
+        }
+
+        /* Retrieve signature data */
+        if (pTci->ecsign.signaturedatalen > signatureBufLength)
+        {
+            ret = TEE_ERR_BUFFER_TOO_SMALL;
+            break;
+        }
+        *signatureDataLength = pTci->ecsign.signaturedatalen;
+        memcpy(signatureData, signatureBulk.pNormal, *signatureDataLength);
+
+    } while (false);
+
+    /* Unmap memory not taken from the arena */
+    if (!TEE_BulkPut(pSession, &keyBulk))
+        ret = TEE_ERR_MAP;
+    if (!TEE_BulkPut(pSession, &digestBulk))
+        ret = TEE_ERR_MAP;
+    if (!TEE_BulkPut(pSession, &signatureBulk))
+        ret = TEE_ERR_MAP;
+
+    /* Return the session to the pool */
+    TEE_ReleaseSession(pSession, ret);
+
+    LOG_I("TEE_ECSign(): returning: 0x%.8x\n", ret);
+
+    return ret;
+}
+
+
+/**
+ * TEE_ECVerify
+ *
+ * Verifies given DER encoded ECDSA signature of a digest and return status
+ *
+ * @param  keyData          [in]  Pointer to key data buffer
+ * @param  keyDataLength    [in]  Key data buffer length
+ * @param  digestData       [in]  Pointer to signed digest
+ * @param  digestDataLength [in]  Digest length
+ * @param  signatureData    [in]  Pointer to signature data
+ * @param  signatureDataLength  [in]  Signature data length
+ * @param  validity         [out] Signature validity
+ */
+teeResult_t TEE_ECVerify(
+    const uint8_t*  keyData,
+    const uint32_t  keyDataLength,
+    const uint8_t*  digestData,
+    const uint32_t  digestDataLength,
+    const uint8_t*  signatureData,
+    const uint32_t  signatureDataLength,
+    bool            *validity
+){
+    teeResult_t        ret = TEE_ERR_NONE;
+    tciMessage_ptr     pTci = NULL;
+    teeSession_t*      pSession = NULL;
+    teeBulk_t          keyBulk;
+    teeBulk_t          digestBulk;
+    teeBulk_t          signatureBulk;
+    mcResult_t         mcRet;
+
+    bzero(&keyBulk, sizeof(keyBulk));
+    bzero(&digestBulk, sizeof(digestBulk));
+    bzero(&signatureBulk, sizeof(signatureBulk));
+
+    do {
+
+        /* Borrow a session to the trustlet */
+        ret = TEE_AcquireSession(&pSession);
+        if (TEE_ERR_NONE != ret)
+            break;
+        pTci = pSession->pTci;
+
+        /* Copy the input to memory shared with the secure world */
+        if (!TEE_BulkGet(pSession, &keyBulk, keyData, keyDataLength) ||
+            !TEE_BulkGet(pSession, &digestBulk, digestData, digestDataLength) ||
+            !TEE_BulkGet(pSession, &signatureBulk, signatureData, signatureDataLength))
+        {
+            ret = TEE_ERR_MAP;
+            break;
+        }
+
+        /* Update TCI buffer */
+        pTci->command.header.commandId = CMD_ID_TEE_EC_VERIFY;
+        pTci->ecverify.keydata = keyBulk.sAddr;
+        pTci->ecverify.keydatalen = keyDataLength;
+
+        pTci->ecverify.plaindata = digestBulk.sAddr;
+        pTci->ecverify.plaindatalen = digestDataLength;
+
+        pTci->ecverify.signaturedata = signatureBulk.sAddr;
+        pTci->ecverify.signaturedatalen = signatureDataLength;
+
+        pTci->ecverify.validity = false;
 
         /* Notify the trustlet */
-        mcRet = mcNotify(&sessionHandle);
+        mcRet = mcNotify(&pSession->handle);
         if (MC_DRV_OK != mcRet)
         {
             ret = TEE_ERR_NOTIFICATION;
@@ -801,124 +2974,194 @@ teeResult_t TEE_HMACVerify(
         }
 
         /* Wait for response from the trustlet */
-        if (MC_DRV_OK != mcWaitNotification(&sessionHandle, MC_INFINITE_TIMEOUT))
+        if (MC_DRV_OK != mcWaitNotification(&pSession->handle, MC_INFINITE_TIMEOUT))
         {
             ret = TEE_ERR_NOTIFICATION;
             break;
-        }
+        }
+
+        if (RET_OK != pTci->response.header.returnCode)
+        {
+            LOG_E("TEE_ECVerify(): TEE Keymaster trustlet returned: 0x%.8x\n",
+                        pTci->response.header.returnCode);
+            ret = TEE_ERR_FAIL;
+            break;
+        }
+
+        *validity =  pTci->ecverify.validity;
+
+    } while (false);
+
+    /* Unmap memory not taken from the arena */
+    if (!TEE_BulkPut(pSession, &keyBulk))
+        ret = TEE_ERR_MAP;
+    if (!TEE_BulkPut(pSession, &digestBulk))
+        ret = TEE_ERR_MAP;
+    if (!TEE_BulkPut(pSession, &signatureBulk))
+        ret = TEE_ERR_MAP;
+
+    /* Return the session to the pool */
+    TEE_ReleaseSession(pSession, ret);
+
+    LOG_I("TEE_ECVerify(): returning: 0x%.8x\n", ret);
+
+    return ret;
+}
+
+
+/**
+ * TEE_ECKeyImport
+ *
+ * Imports EC key data and returns key data as secure object
+ *
+ * @param  keyData          [in]  Pointer to key data
+ * @param  keyDataLength    [in]  Key data length
+ * @param  soData           [out] Pointer to wrapped key data
+ * @param  soDataLength     [in/out] Wrapped key data buffer / data length
+ */
+teeResult_t TEE_ECKeyImport(
+    const uint8_t*  keyData,
+    const uint32_t  keyDataLength,
+    uint8_t*        soData,
+    uint32_t*       soDataLength
+){
+    teeResult_t        ret = TEE_ERR_NONE;
+    tciMessage_ptr     pTci = NULL;
+    teeSession_t*      pSession = NULL;
+    teeBulk_t          keyBulk;
+    teeBulk_t          soBulk;
+    uint32_t           soBufLength = *soDataLength;
+    mcResult_t         mcRet;
+
+    bzero(&keyBulk, sizeof(keyBulk));
+    bzero(&soBulk, sizeof(soBulk));
+
+    do {
+
+        /* Borrow a session to the trustlet */
+        ret = TEE_AcquireSession(&pSession);
+        if (TEE_ERR_NONE != ret)
+            break;
+        pTci = pSession->pTci;
 
-        /* Unmap memory */
-        mcRet = mcUnmap(&sessionHandle, (void*)keyData, &keyMapInfo);
-        if (MC_DRV_OK != mcRet)
+        /* Copy the input to memory shared with the secure world */
+        if (!TEE_BulkGet(pSession, &keyBulk, keyData, keyDataLength) ||
+            !TEE_BulkGet(pSession, &soBulk, NULL, soBufLength))
         {
             ret = TEE_ERR_MAP;
             break;
         }
 
-        mcRet = mcUnmap(&sessionHandle, (void*)plainData, &plainMapInfo);
+        /* Update TCI buffer */
+        pTci->command.header.commandId = CMD_ID_TEE_EC_KEY_IMPORT;
+        pTci->keyimport.keydata        = keyBulk.sAddr;
+        pTci->keyimport.keydatalen     = keyDataLength;
+        pTci->keyimport.sodata         = soBulk.sAddr;
+        pTci->keyimport.sodatalen      = soBufLength;
+
+        /* Notify the trustlet */
+        mcRet = mcNotify(&pSession->handle);
         if (MC_DRV_OK != mcRet)
         {
-            ret = TEE_ERR_MAP;
+            ret = TEE_ERR_NOTIFICATION;
             break;
         }
 
-        mcRet = mcUnmap(&sessionHandle, (void*)signatureData, &signatureMapInfo);
-        if (MC_DRV_OK != mcRet)
+        /* Wait for response from the trustlet */
+        if (MC_DRV_OK != mcWaitNotification(&pSession->handle, MC_INFINITE_TIMEOUT))
         {
-            ret = TEE_ERR_MAP;
+            ret = TEE_ERR_NOTIFICATION;
             break;
         }
 
         if (RET_OK != pTci->response.header.returnCode)
         {
-            LOG_E("TEE_HMACVerify(): TEE Keymaster trustlet returned: 0x%.8x\n",
+            LOG_E("TEE_ECKeyImport(): TEE Keymaster trustlet returned: 0x%.8x\n",
                         pTci->response.header.returnCode);
             ret = TEE_ERR_FAIL;
             break;
         }
 
-        *validity =  pTci->hmacverify.validity;
+        /* Retrieve the secure object */
+        if (pTci->keyimport.sodatalen > soBufLength)
+        {
+            ret = TEE_ERR_BUFFER_TOO_SMALL;
+            break;
+        }
+        *soDataLength = pTci->keyimport.sodatalen;
+        memcpy(soData, soBulk.pNormal, *soDataLength);
 
     } while (false);
 
-    /* Close session to the trustlet */
-    TEE_Close(&sessionHandle);
+    /* Unmap memory not taken from the arena */
+    if (!TEE_BulkPut(pSession, &keyBulk))
+        ret = TEE_ERR_MAP;
+    if (!TEE_BulkPut(pSession, &soBulk))
+        ret = TEE_ERR_MAP;
 
-    LOG_I("TEE_HMACVerify(): returning: 0x%.8x\n", ret);
+    /* Return the session to the pool */
+    TEE_ReleaseSession(pSession, ret);
+
+    LOG_I("TEE_ECKeyImport(): returning: 0x%.8x\n", ret);
 
     return ret;
 }
 
 
 /**
- * TEE_KeyImport
- *
- * Imports key data and returns key data as secure object
- *
- * Key data needs to be in the following format
- *
- * RSA key data:
- * |--key metadata--|--public modulus--|--public exponent--|--private exponent--|
- *
- * RSA CRT key data:
- * |--key metadata--|--public modulus--|--public exponent--|--P--|--Q--|--DP--|--DQ--|--Qinv--|
+ * TEE_ECGetPubKey
  *
- * Where:
- * P:     secret prime factor
- * Q:     secret prime factor
- * DP:    d mod (p-1)
- * DQ:    d mod (q-1)
- * Qinv:  q^-1 mod p
+ * Retrieves the curve and public point from wrapped EC key data
  *
  * @param  keyData          [in]  Pointer to key data
  * @param  keyDataLength    [in]  Key data length
- * @param  soData           [out] Pointer to wrapped key data
- * @param  soDataLength     [out] Wrapped key data length
+ * @param  curve            [out] Curve of the key
+ * @param  point            [out] Pointer to public point, uncompressed
+ * @param  pointLength      [in/out] Public point buffer / data length
  */
-teeResult_t TEE_KeyImport(
+teeResult_t TEE_ECGetPubKey(
     const uint8_t*  keyData,
     const uint32_t  keyDataLength,
-    uint8_t*        soData,
-    uint32_t*       soDataLength
+    teeEcCurve_t*   curve,
+    uint8_t*        point,
+    uint32_t*       pointLength
 ){
-    teeResult_t         ret = TEE_ERR_NONE;
-    tciMessage_ptr      pTci = NULL;
-    mcSessionHandle_t   sessionHandle;
-    mcBulkMap_t         keyMapInfo;
-    mcBulkMap_t         soMapInfo;
-    mcResult_t          mcRet;
+    teeResult_t        ret = TEE_ERR_NONE;
+    tciMessage_ptr     pTci = NULL;
+    teeSession_t*      pSession = NULL;
+    teeBulk_t          keyBulk;
+    teeBulk_t          pointBulk;
+    uint32_t           pointBufLength = *pointLength;
+    mcResult_t         mcRet;
 
-    do {
+    bzero(&keyBulk, sizeof(keyBulk));
+    bzero(&pointBulk, sizeof(pointBulk));
 
-        /* Open session to the trustlet */
-        pTci = TEE_Open(&sessionHandle);
-        if (!pTci) {
-            ret = TEE_ERR_MEMORY;
-            break;
-        }
+    do {
 
-        /* Map memory to the secure world */
-        mcRet = mcMap(&sessionHandle, (void*)keyData, keyDataLength, &keyMapInfo);
-        if (MC_DRV_OK != mcRet) {
-            ret = TEE_ERR_MAP;
+        /* Borrow a session to the trustlet */
+        ret = TEE_AcquireSession(&pSession);
+        if (TEE_ERR_NONE != ret)
             break;
-        }
+        pTci = pSession->pTci;
 
-        mcRet = mcMap(&sessionHandle, (void*)soData, *soDataLength, &soMapInfo);
-        if (MC_DRV_OK != mcRet) {
+        /* Copy the input to memory shared with the secure world */
+        if (!TEE_BulkGet(pSession, &keyBulk, keyData, keyDataLength) ||
+            !TEE_BulkGet(pSession, &pointBulk, NULL, pointBufLength))
+        {
             ret = TEE_ERR_MAP;
             break;
         }
 
         /* Update TCI buffer */
-        pTci->command.header.commandId = CMD_ID_TEE_KEY_IMPORT;
-        pTci->keyimport.keydata        = (uint32_t)keyMapInfo.sVirtualAddr;
-        pTci->keyimport.keydatalen     = keyDataLength;
-        pTci->keyimport.sodata         = (uint32_t)soMapInfo.sVirtualAddr;
-        pTci->keyimport.sodatalen      = *soDataLength;
+        pTci->command.header.commandId = CMD_ID_TEE_EC_GET_PUB_KEY;
+        pTci->ecgetpubkey.keydata   = keyBulk.sAddr;
+        pTci->ecgetpubkey.keydatalen = keyDataLength;
+        pTci->ecgetpubkey.point     = pointBulk.sAddr;
+        pTci->ecgetpubkey.pointlen  = pointBufLength;
 
         /* Notify the trustlet */
-        mcRet = mcNotify(&sessionHandle);
+        mcRet = mcNotify(&pSession->handle);
         if (MC_DRV_OK != mcRet)
         {
             ret = TEE_ERR_NOTIFICATION;
@@ -926,115 +3169,299 @@ teeResult_t TEE_KeyImport(
         }
 
         /* Wait for response from the trustlet */
-        if (MC_DRV_OK != mcWaitNotification(&sessionHandle, MC_INFINITE_TIMEOUT))
+        if (MC_DRV_OK != mcWaitNotification(&pSession->handle, MC_INFINITE_TIMEOUT))
         {
             ret = TEE_ERR_NOTIFICATION;
             break;
         }
 
-        /* Unmap memory */
-        mcRet = mcUnmap(&sessionHandle, (void*)keyData, &keyMapInfo);
-        if (MC_DRV_OK != mcRet)
+        if (RET_OK != pTci->response.header.returnCode)
         {
-            ret = TEE_ERR_MAP;
+            LOG_E("TEE_ECGetPubKey(): TEE Keymaster trustlet returned: 0x%.8x\n",
+                        pTci->response.header.returnCode);
+            ret = TEE_ERR_FAIL;
             break;
         }
 
-        mcRet = mcUnmap(&sessionHandle, (void*)soData, &soMapInfo);
-        if (MC_DRV_OK != mcRet)
+        /* Retrieve curve and public point */
+        if (pTci->ecgetpubkey.pointlen > pointBufLength)
         {
-            ret = TEE_ERR_MAP;
+            ret = TEE_ERR_BUFFER_TOO_SMALL;
             break;
         }
+        *curve = (teeEcCurve_t)pTci->ecgetpubkey.curve;
+        *pointLength = pTci->ecgetpubkey.pointlen;
+        memcpy(point, pointBulk.pNormal, *pointLength);
 
-        if (RET_OK != pTci->response.header.returnCode)
+    } while (false);
+
+    /* Unmap memory not taken from the arena */
+    if (!TEE_BulkPut(pSession, &keyBulk))
+        ret = TEE_ERR_MAP;
+    if (!TEE_BulkPut(pSession, &pointBulk))
+        ret = TEE_ERR_MAP;
+
+    /* Return the session to the pool */
+    TEE_ReleaseSession(pSession, ret);
+
+    LOG_I("TEE_ECGetPubKey(): returning: 0x%.8x\n", ret);
+
+    return ret;
+}
+
+
+/**
+ * TEE_ECSupported
+ *
+ * Sends EC_GET_PUB_KEY without key data. A trustlet with the EC commands
+ * refuses the empty key; one without them answers RET_ERR_UNKNOWN_CMD.
+ */
+bool TEE_ECSupported(void)
+{
+    teeResult_t        ret = TEE_ERR_NONE;
+    tciMessage_ptr     pTci = NULL;
+    teeSession_t*      pSession = NULL;
+    uint32_t           returnCode;
+
+    if (gEcSupported >= 0)
+        return gEcSupported;
+
+    do {
+
+        /* Borrow a session to the trustlet */
+        ret = TEE_AcquireSession(&pSession);
+        if (TEE_ERR_NONE != ret)
+            break;
+        pTci = pSession->pTci;
+
+        /* Update TCI buffer */
+        pTci->command.header.commandId = CMD_ID_TEE_EC_GET_PUB_KEY;
+        pTci->ecgetpubkey.keydata    = 0;
+        pTci->ecgetpubkey.keydatalen = 0;
+        pTci->ecgetpubkey.point      = 0;
+        pTci->ecgetpubkey.pointlen   = 0;
+
+        /* Notify the trustlet and wait for its answer */
+        ret = TEE_CallStart(pSession);
+        if (TEE_ERR_NONE != ret)
+            break;
+        if (MC_DRV_OK != mcWaitNotification(&pSession->handle, MC_INFINITE_TIMEOUT))
         {
-            LOG_E("TEE_KeyWrap(): TEE Keymaster trustlet returned: 0x%.8x\n",
-                        pTci->response.header.returnCode);
-            ret = TEE_ERR_FAIL;
+            ret = TEE_ERR_NOTIFICATION;
             break;
         }
 
-        /* Update secure object length */
-        *soDataLength =  pTci->keyimport.sodatalen;
+        returnCode = pTci->response.header.returnCode;
+        gEcSupported = (RET_ERR_UNKNOWN_CMD != returnCode);
+        if (!gEcSupported)
+            LOG_W("TEE_ECSupported(): trustlet has no EC commands\n");
 
     } while (false);
 
-    /* Close session to the trustlet */
-    TEE_Close(&sessionHandle);
+    /* Return the session to the pool */
+    TEE_ReleaseSession(pSession, ret);
 
-    LOG_I("TEE_KeyWrap(): returning: 0x%.8x\n", ret);
+    LOG_I("TEE_ECSupported(): returning: 0x%.8x\n", ret);
 
-    return ret;
+    /* a trustlet that could not be asked is not taken to know EC */
+    return (gEcSupported > 0);
 }
 
 
-/** * TEE_GetPubKey
+/**
+ * TEE_BatchLength
  *
- * Retrieves public key daya (modulus and exponent) from wrapped key data
+ * Lays out the batch buffer of a batch command: the entry table, then the
+ * message and signature buffer of every item.
  *
- * @param  keyData          [in]  Pointer to key data
- * @param  keyDataLength    [in]  Key data length
- * @param  modulus          [out] Pointer to public key modulus data
- * @param  modulusLength    [out] Modulus data length
- * @param  exponent         [out] Pointer to public key exponent data
- * @param  exponentLength   [out] Exponent data length
+ * @param  items     [in]  Messages
+ * @param  count     [in]  Number of items
+ * @param  entries   [out] Entry table to fill in, NULL to only get the length
+ * @param  length    [out] Batch buffer length
  */
-teeResult_t TEE_GetPubKey(
-    const uint8_t*  keyData,
-    const uint32_t  keyDataLength,
-    uint8_t*        modulus,
-    uint32_t*       modulusLength,
-    uint8_t*        exponent,
-    uint32_t*       exponentLength
+static bool TEE_BatchLength(
+    const teeBatchItem_t*  items,
+    uint32_t               count,
+    batchentry_t*          entries,
+    uint32_t*              length
 ){
-    teeResult_t         ret = TEE_ERR_NONE;
-    tciMessage_ptr      pTci = NULL;
-    mcSessionHandle_t   sessionHandle;
-    mcBulkMap_t         keyMapInfo;
-    mcBulkMap_t         modMapInfo;
-    mcBulkMap_t         expMapInfo;
-    mcResult_t          mcRet;
+    uint32_t offset = count * sizeof(batchentry_t);
+    uint32_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        uint32_t dataLength = items[i].dataLength;
+        uint32_t signatureLength = items[i].signatureLength;
+
+        /* bounded, so the layout cannot overflow */
+        if ((dataLength > UINT16_MAX) || (signatureLength > UINT16_MAX))
+            return false;
+
+        if (entries)
+        {
+            entries[i].plainoffset = offset;
+            entries[i].plaindatalen = dataLength;
+        }
+        offset += (dataLength + TEE_BULK_ALIGN - 1) & ~(TEE_BULK_ALIGN - 1);
+
+        if (entries)
+        {
+            entries[i].signatureoffset = offset;
+            entries[i].signaturedatalen = signatureLength;
+            entries[i].result = RET_OK;
+            entries[i].validity = false;
+        }
+        offset += (signatureLength + TEE_BULK_ALIGN - 1) & ~(TEE_BULK_ALIGN - 1);
+    }
+
+    *length = offset;
+
+    return true;
+}
+
+
+/**
+ * TEE_BatchOneByOne
+ *
+ * Serves a batch with one trustlet call per message, for trustlets
+ * without the batch commands.
+ */
+static void TEE_BatchOneByOne(
+    uint32_t         commandId,
+    const uint8_t*   keyData,
+    uint32_t         keyDataLength,
+    teeBatchItem_t*  items,
+    uint32_t         count,
+    uint32_t         algorithm
+){
+    uint32_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        teeBatchItem_t *pItem = &items[i];
+
+        switch (commandId)
+        {
+        case CMD_ID_TEE_RSA_SIGN_BATCH:
+            pItem->result = TEE_RSASign(keyData, keyDataLength,
+                                        pItem->data, pItem->dataLength,
+                                        pItem->signature, &pItem->signatureLength,
+                                        (teeRsaSigAlg_t)algorithm);
+            break;
+        case CMD_ID_TEE_RSA_VERIFY_BATCH:
+            pItem->result = TEE_RSAVerify(keyData, keyDataLength,
+                                          pItem->data, pItem->dataLength,
+                                          pItem->signature, pItem->signatureLength,
+                                          (teeRsaSigAlg_t)algorithm, &pItem->validity);
+            break;
+        case CMD_ID_TEE_HMAC_SIGN_BATCH:
+            pItem->result = TEE_HMACSign(keyData, keyDataLength,
+                                         pItem->data, pItem->dataLength,
+                                         pItem->signature, &pItem->signatureLength,
+                                         (teeDigest_t)algorithm);
+            break;
+        default:
+            pItem->result = TEE_HMACVerify(keyData, keyDataLength,
+                                           pItem->data, pItem->dataLength,
+                                           pItem->signature, pItem->signatureLength,
+                                           (teeDigest_t)algorithm, &pItem->validity);
+            break;
+        }
+    }
+}
+
+
+/**
+ * TEE_Batch
+ *
+ * Sends the messages of a batch sign or verify request to the trustlet
+ * in one bulk buffer, with a single notification. Falls back to one call
+ * per message if the trustlet does not know the command.
+ *
+ * @param  commandId        [in]  CMD_ID_TEE_*_BATCH
+ * @param  keyData          [in]  Pointer to key data buffer
+ * @param  keyDataLength    [in]  Key data buffer length
+ * @param  items            [in/out] Messages
+ * @param  count            [in]  Number of items
+ * @param  algorithm        [in]  RSA signature algorithm or digest type
+ */
+static teeResult_t TEE_Batch(
+    uint32_t         commandId,
+    const uint8_t*   keyData,
+    uint32_t         keyDataLength,
+    teeBatchItem_t*  items,
+    uint32_t         count,
+    uint32_t         algorithm
+){
+    teeResult_t        ret = TEE_ERR_NONE;
+    tciMessage_ptr     pTci = NULL;
+    teeSession_t*      pSession = NULL;
+    teeBulk_t          keyBulk;
+    teeBulk_t          batchBulk;
+    batchentry_t*      pEntry;
+    uint32_t           batchLength;
+    bool               sign = (CMD_ID_TEE_RSA_SIGN_BATCH == commandId) ||
+                              (CMD_ID_TEE_HMAC_SIGN_BATCH == commandId);
+    bool               oneByOne = false;
+    uint32_t           i;
+    mcResult_t         mcRet;
+
+    bzero(&keyBulk, sizeof(keyBulk));
+    bzero(&batchBulk, sizeof(batchBulk));
 
     do {
 
-        /* Open session to the trustlet */
-        pTci = TEE_Open(&sessionHandle);
-        if (!pTci) {
-            ret = TEE_ERR_MEMORY;
+        if ((0 == count) || (count > TEE_BATCH_MAX_ITEMS) || !items ||
+            !TEE_BatchLength(items, count, NULL, &batchLength))
+        {
+            ret = TEE_ERR_INVALID_BUFFER;
             break;
         }
 
-        /* Map memory to the secure world */
-        mcRet = mcMap(&sessionHandle, (void*)keyData, keyDataLength, &keyMapInfo);
-        if (MC_DRV_OK != mcRet) {
-            ret = TEE_ERR_MAP;
+        if (gBatchUnsupported)
+        {
+            oneByOne = true;
             break;
         }
 
-        mcRet = mcMap(&sessionHandle, (void*)modulus, *modulusLength, &modMapInfo);
-        if (MC_DRV_OK != mcRet) {
-            ret = TEE_ERR_MAP;
+        /* Borrow a session to the trustlet */
+        ret = TEE_AcquireSession(&pSession);
+        if (TEE_ERR_NONE != ret)
             break;
-        }
+        pTci = pSession->pTci;
 
-        mcRet = mcMap(&sessionHandle, (void*)exponent, *exponentLength, &expMapInfo);
-        if (MC_DRV_OK != mcRet) {
+        /* Lay out all messages in one buffer shared with the secure world */
+        if (!TEE_BulkGet(pSession, &keyBulk, keyData, keyDataLength) ||
+            !TEE_BulkGet(pSession, &batchBulk, NULL, batchLength))
+        {
             ret = TEE_ERR_MAP;
             break;
         }
 
+        pEntry = (batchentry_t *) batchBulk.pNormal;
+        TEE_BatchLength(items, count, pEntry, &batchLength);
+        for (i = 0; i < count; i++)
+        {
+            memcpy(batchBulk.pNormal + pEntry[i].plainoffset,
+                   items[i].data, items[i].dataLength);
+            if (!sign)
+                memcpy(batchBulk.pNormal + pEntry[i].signatureoffset,
+                       items[i].signature, items[i].signatureLength);
+        }
+
         /* Update TCI buffer */
-        pTci->command.header.commandId = CMD_ID_TEE_GET_PUB_KEY;
-        pTci->getpubkey.keydata        = (uint32_t)keyMapInfo.sVirtualAddr;
-        pTci->getpubkey.keydatalen     = keyDataLength;
-        pTci->getpubkey.modulus        = (uint32_t)modMapInfo.sVirtualAddr;
-        pTci->getpubkey.moduluslen     = *modulusLength;
-        pTci->getpubkey.exponent       = (uint32_t)expMapInfo.sVirtualAddr;
-        pTci->getpubkey.exponentlen    = *exponentLength;
+        pTci->command.header.commandId = commandId;
+        pTci->signbatch.keydata = keyBulk.sAddr;
+        pTci->signbatch.keydatalen = keyDataLength;
+
+        pTci->signbatch.batchdata = batchBulk.sAddr;
+        pTci->signbatch.batchdatalen = batchLength;
+        pTci->signbatch.count = count;
+
+        pTci->signbatch.algorithm = algorithm;
 
         /* Notify the trustlet */
-        mcRet = mcNotify(&sessionHandle);
+        mcRet = mcNotify(&pSession->handle);
         if (MC_DRV_OK != mcRet)
         {
             ret = TEE_ERR_NOTIFICATION;
@@ -1042,52 +3469,168 @@ teeResult_t TEE_GetPubKey(
         }
 
         /* Wait for response from the trustlet */
-        if (MC_DRV_OK != mcWaitNotification(&sessionHandle, MC_INFINITE_TIMEOUT))
+        if (MC_DRV_OK != mcWaitNotification(&pSession->handle, MC_INFINITE_TIMEOUT))
         {
             ret = TEE_ERR_NOTIFICATION;
             break;
         }
 
-        /* Unmap memory */
-        mcRet = mcUnmap(&sessionHandle, (void*)keyData, &keyMapInfo);
-        if (MC_DRV_OK != mcRet)
-        {
-            ret = TEE_ERR_MAP;
-            break;
-        }
-
-        mcRet = mcUnmap(&sessionHandle, (void*)modulus, &modMapInfo);
-        if (MC_DRV_OK != mcRet)
-        {
-            ret = TEE_ERR_MAP;
-            break;
-        }
-
-        mcRet = mcUnmap(&sessionHandle, (void*)exponent, &expMapInfo);
-        if (MC_DRV_OK != mcRet)
+        if (RET_ERR_UNKNOWN_CMD == pTci->response.header.returnCode)
         {
-            ret = TEE_ERR_MAP;
+            LOG_W("TEE_Batch(): trustlet has no batch commands, signing one by one\n");
+            gBatchUnsupported = true;
+            oneByOne = true;
             break;
         }
 
         if (RET_OK != pTci->response.header.returnCode)
         {
-            LOG_E("TEE_GetPubKey(): TEE Keymaster trustlet returned: 0x%.8x\n",
+            LOG_E("TEE_Batch(): TEE Keymaster trustlet returned: 0x%.8x\n",
                         pTci->response.header.returnCode);
             ret = TEE_ERR_FAIL;
             break;
         }
 
-        /* Update  modulus and exponent lengths */
-        *modulusLength =   pTci->getpubkey.moduluslen;
-        *exponentLength =   pTci->getpubkey.exponentlen;
+        /* Retrieve the result of every message */
+        for (i = 0; i < count; i++)
+        {
+            teeBatchItem_t *pItem = &items[i];
+
+            if (RET_OK != pEntry[i].result)
+            {
+                LOG_E("TEE_Batch(): message %u: trustlet returned: 0x%.8x\n",
+                            i, pEntry[i].result);
+                pItem->result = TEE_ERR_FAIL;
+                continue;
+            }
+
+            pItem->result = TEE_ERR_NONE;
+            if (!sign)
+            {
+                pItem->validity = pEntry[i].validity;
+                continue;
+            }
+
+            if (pEntry[i].signaturedatalen > pItem->signatureLength)
+            {
+                pItem->result = TEE_ERR_BUFFER_TOO_SMALL;
+                continue;
+            }
+            pItem->signatureLength = pEntry[i].signaturedatalen;
+            memcpy(pItem->signature, batchBulk.pNormal + pEntry[i].signatureoffset,
+                   pItem->signatureLength);
+        }
 
     } while (false);
 
-    /* Close session to the trustlet */
-    TEE_Close(&sessionHandle);
+    /* Unmap memory not taken from the arena */
+    if (!TEE_BulkPut(pSession, &keyBulk))
+        ret = TEE_ERR_MAP;
+    if (!TEE_BulkPut(pSession, &batchBulk))
+        ret = TEE_ERR_MAP;
 
-    LOG_I("TEE_GetPubKey(): returning: 0x%.8x\n", ret);
+    /* Return the session to the pool */
+    TEE_ReleaseSession(pSession, ret);
+
+    if (oneByOne && (TEE_ERR_NONE == ret))
+        TEE_BatchOneByOne(commandId, keyData, keyDataLength, items, count, algorithm);
+
+    LOG_I("TEE_Batch(): returning: 0x%.8x\n", ret);
 
     return ret;
 }
+
+
+/**
+ * TEE_RSASignBatch
+ *
+ * Signs given messages with one key in a single trustlet call
+ *
+ * @param  keyData          [in]  Pointer to key data buffer
+ * @param  keyDataLength    [in]  Key data buffer length
+ * @param  items            [in/out] Messages and their signatures
+ * @param  count            [in]  Number of items
+ * @param  algorithm        [in]  RSA signature algorithm
+ */
+teeResult_t TEE_RSASignBatch(
+    const uint8_t*   keyData,
+    const uint32_t   keyDataLength,
+    teeBatchItem_t*  items,
+    const uint32_t   count,
+    teeRsaSigAlg_t   algorithm
+){
+    return TEE_Batch(CMD_ID_TEE_RSA_SIGN_BATCH, keyData, keyDataLength,
+                     items, count, algorithm);
+}
+
+
+/**
+ * TEE_RSAVerifyBatch
+ *
+ * Verifies given messages and signatures with one key in a single
+ * trustlet call
+ *
+ * @param  keyData          [in]  Pointer to key data buffer
+ * @param  keyDataLength    [in]  Key data buffer length
+ * @param  items            [in/out] Messages, signatures and their validity
+ * @param  count            [in]  Number of items
+ * @param  algorithm        [in]  RSA signature algorithm
+ */
+teeResult_t TEE_RSAVerifyBatch(
+    const uint8_t*   keyData,
+    const uint32_t   keyDataLength,
+    teeBatchItem_t*  items,
+    const uint32_t   count,
+    teeRsaSigAlg_t   algorithm
+){
+    return TEE_Batch(CMD_ID_TEE_RSA_VERIFY_BATCH, keyData, keyDataLength,
+                     items, count, algorithm);
+}
+
+
+/**
+ * TEE_HMACSignBatch
+ *
+ * Computes the HMAC of given messages with one key in a single trustlet
+ * call
+ *
+ * @param  keyData          [in]  Pointer to key data buffer
+ * @param  keyDataLength    [in]  Key data buffer length
+ * @param  items            [in/out] Messages and their signatures
+ * @param  count            [in]  Number of items
+ * @param  digest           [in]  Digest type
+ */
+teeResult_t TEE_HMACSignBatch(
+    const uint8_t*   keyData,
+    const uint32_t   keyDataLength,
+    teeBatchItem_t*  items,
+    const uint32_t   count,
+    teeDigest_t      digest
+){
+    return TEE_Batch(CMD_ID_TEE_HMAC_SIGN_BATCH, keyData, keyDataLength,
+                     items, count, digest);
+}
+
+
+/**
+ * TEE_HMACVerifyBatch
+ *
+ * Verifies the HMAC of given messages with one key in a single trustlet
+ * call
+ *
+ * @param  keyData          [in]  Pointer to key data buffer
+ * @param  keyDataLength    [in]  Key data buffer length
+ * @param  items            [in/out] Messages, signatures and their validity
+ * @param  count            [in]  Number of items
+ * @param  digest           [in]  Digest type
+ */
+teeResult_t TEE_HMACVerifyBatch(
+    const uint8_t*   keyData,
+    const uint32_t   keyDataLength,
+    teeBatchItem_t*  items,
+    const uint32_t   count,
+    teeDigest_t      digest
+){
+    return TEE_Batch(CMD_ID_TEE_HMAC_VERIFY_BATCH, keyData, keyDataLength,
+                     items, count, digest);
+}
@@ -60,7 +60,9 @@ typedef enum
     TEE_ERR_MC_DEVICE        = 6,
     TEE_ERR_NOTIFICATION     = 7,
     TEE_ERR_MEMORY           = 8,
-    TEE_ERR_MAP              = 9
+    TEE_ERR_MAP              = 9,
+    TEE_ERR_BUSY             = 10,  /* too many requests queued */
+    TEE_ERR_TIMEOUT          = 11   /* no session became free in time */
     /* more can be added as required */
 } teeResult_t;
 
@@ -82,9 +84,21 @@ typedef enum
     TEE_RSA_SHA256_PSS            = 4, /**< SHA-256 digest and PSS padding */
     TEE_RSA_SHA1_PSS              = 5, /**< SHA-256 digest and PSS padding */
     TEE_RSA_NODIGEST_NOPADDING    = 6, /**< No digest and padding */
+    TEE_RSA_SHA256_PKCS1          = 7, /**< SHA-256 digest, padded according to the PKCS#1 (v1.5) scheme */
 } teeRsaSigAlg_t;
 
 
+/* Supported EC curves */
+typedef enum
+{
+    TEE_ECC_CURVE_NIST_P192       = 1, /**< NIST P-192 */
+    TEE_ECC_CURVE_NIST_P224       = 2, /**< NIST P-224 */
+    TEE_ECC_CURVE_NIST_P256       = 3, /**< NIST P-256 */
+    TEE_ECC_CURVE_NIST_P384       = 4, /**< NIST P-384 */
+    TEE_ECC_CURVE_NIST_P521       = 5, /**< NIST P-521 */
+} teeEcCurve_t;
+
+
 /* Digest types */
 typedef enum
 {
@@ -131,6 +145,69 @@ typedef struct {
     uint32_t     rfulen;       /**< Reserved for future use */
 } teeRsaKeyMeta_t;
 
+/**
+ * EC key metadata (curve, public point/private value lengths)
+ */
+typedef struct {
+    uint32_t     curve;         /**< Curve, teeEcCurve_t */
+    uint32_t     lenpub;        /**< Public point length (uncompressed) */
+    uint32_t     lenpriv;       /**< Private value length */
+} teeEcKeyMeta_t;
+
+
+/**
+ * Streamed RSA sign or verify operation, see TEE_RSASignInit
+ */
+typedef struct teeRsaOperation teeRsaOperation_t;
+
+
+/**
+ * Streamed HMAC sign or verify operation, see TEE_HMACSignInit
+ */
+typedef struct teeHmacOperation teeHmacOperation_t;
+
+
+/**
+ * Message of a batch sign or verify request
+ */
+typedef struct {
+    const uint8_t*  data;            /**< Message */
+    uint32_t        dataLength;      /**< Message length */
+    uint8_t*        signature;       /**< Signature; output of sign, input of verify */
+    uint32_t        signatureLength; /**< Signature length; buffer length on input of sign */
+    teeResult_t     result;          /**< Result of the message */
+    bool            validity;        /**< Signature validity, verify only */
+} teeBatchItem_t;
+
+
+/**
+ * TEE_SetClientId
+ *
+ * Requests waiting for a trustlet session are served round robin across
+ * clients, and by default every thread is a client of its own, so a
+ * thread making many requests does not hold up the others. Threads that
+ * act for the same client may share an identifier to be served as one;
+ * the keymaster HAL does not, as it is not told who its caller is.
+ *
+ * @param  clientId  [in]  Client identifier
+ */
+void TEE_SetClientId(
+    uint32_t clientId);
+
+
+/**
+ * TEE_SetQueueTimeout
+ *
+ * Sets how long the requests of the calling thread wait for a trustlet
+ * session when all are in use before failing with TEE_ERR_TIMEOUT.
+ * 0 restores the default of 5 s.
+ *
+ * @param  timeoutMs  [in]  Timeout in milliseconds
+ */
+void TEE_SetQueueTimeout(
+    uint32_t timeoutMs);
+
+
 /**
  * TEE_RSAGenerateKeyPair
  *
@@ -200,6 +277,144 @@ teeResult_t TEE_RSAVerify(
     bool            *validity);
 
 
+/**
+ * TEE_RSASignBatch
+ *
+ * Signs given messages with one key in a single trustlet call. The result
+ * of every message is returned in its item; the return value only tells
+ * whether the batch could be processed.
+ *
+ * @param  keyData          [in]  Pointer to key data buffer
+ * @param  keyDataLength    [in]  Key data buffer length
+ * @param  items            [in/out] Messages and their signatures
+ * @param  count            [in]  Number of items
+ * @param  algorithm        [in]  RSA signature algorithm
+ */
+teeResult_t TEE_RSASignBatch(
+    const uint8_t*   keyData,
+    const uint32_t   keyDataLength,
+    teeBatchItem_t*  items,
+    const uint32_t   count,
+    teeRsaSigAlg_t   algorithm);
+
+
+/**
+ * TEE_RSAVerifyBatch
+ *
+ * Verifies given messages and signatures with one RSA key in a single
+ * trustlet call. See TEE_RSASignBatch.
+ *
+ * @param  keyData          [in]  Pointer to key data buffer
+ * @param  keyDataLength    [in]  Key data buffer length
+ * @param  items            [in/out] Messages, signatures and their validity
+ * @param  count            [in]  Number of items
+ * @param  algorithm        [in]  RSA signature algorithm
+ */
+teeResult_t TEE_RSAVerifyBatch(
+    const uint8_t*   keyData,
+    const uint32_t   keyDataLength,
+    teeBatchItem_t*  items,
+    const uint32_t   count,
+    teeRsaSigAlg_t   algorithm);
+
+
+/**
+ * TEE_RSASignInit
+ *
+ * Starts signing a message given in pieces with TEE_RSAUpdate. The
+ * trustlet digests the message and pads the digest. The operation holds a
+ * trustlet session until it is ended by TEE_RSASignFinal or TEE_RSAAbort.
+ *
+ * @param  keyData          [in]  Pointer to key data buffer
+ * @param  keyDataLength    [in]  Key data buffer length
+ * @param  algorithm        [in]  RSA signature algorithm, one with a digest
+ * @param  operation        [out] Operation
+ */
+teeResult_t TEE_RSASignInit(
+    const uint8_t*        keyData,
+    const uint32_t        keyDataLength,
+    teeRsaSigAlg_t        algorithm,
+    teeRsaOperation_t**   operation);
+
+
+/**
+ * TEE_RSAVerifyInit
+ *
+ * Starts verifying the signature of a message given in pieces with
+ * TEE_RSAUpdate. See TEE_RSASignInit; the operation is ended by
+ * TEE_RSAVerifyFinal or TEE_RSAAbort.
+ *
+ * @param  keyData          [in]  Pointer to key data buffer
+ * @param  keyDataLength    [in]  Key data buffer length
+ * @param  algorithm        [in]  RSA signature algorithm, one with a digest
+ * @param  operation        [out] Operation
+ */
+teeResult_t TEE_RSAVerifyInit(
+    const uint8_t*        keyData,
+    const uint32_t        keyDataLength,
+    teeRsaSigAlg_t        algorithm,
+    teeRsaOperation_t**   operation);
+
+
+/**
+ * TEE_RSAUpdate
+ *
+ * Adds message data to a sign or verify operation. After a failure the
+ * operation can only be ended.
+ *
+ * @param  operation        [in]  Operation
+ * @param  plainData        [in]  Pointer to message data
+ * @param  plainDataLength  [in]  Message data length
+ */
+teeResult_t TEE_RSAUpdate(
+    teeRsaOperation_t*    operation,
+    const uint8_t*        plainData,
+    const uint32_t        plainDataLength);
+
+
+/**
+ * TEE_RSASignFinal
+ *
+ * Returns the signature of the message and ends the operation
+ *
+ * @param  operation        [in]  Operation
+ * @param  signatureData    [out] Pointer to signature data
+ * @param  signatureDataLength  [in/out] Signature buffer / data length
+ */
+teeResult_t TEE_RSASignFinal(
+    teeRsaOperation_t*    operation,
+    uint8_t*              signatureData,
+    uint32_t*             signatureDataLength);
+
+
+/**
+ * TEE_RSAVerifyFinal
+ *
+ * Verifies the signature of the message and ends the operation
+ *
+ * @param  operation        [in]  Operation
+ * @param  signatureData    [in]  Pointer to signature data
+ * @param  signatureDataLength  [in]  Signature data length
+ * @param  validity         [out] Signature validity
+ */
+teeResult_t TEE_RSAVerifyFinal(
+    teeRsaOperation_t*    operation,
+    const uint8_t*        signatureData,
+    const uint32_t        signatureDataLength,
+    bool                  *validity);
+
+
+/**
+ * TEE_RSAAbort
+ *
+ * Ends a sign or verify operation without a result
+ *
+ * @param  operation        [in]  Operation, may be NULL
+ */
+void TEE_RSAAbort(
+    teeRsaOperation_t*    operation);
+
+
 /**
  * TEE_HMACKeyGenerate
  *
@@ -264,6 +479,144 @@ teeResult_t TEE_HMACVerify(
     bool            *validity);
 
 
+/**
+ * TEE_HMACSignBatch
+ *
+ * Computes the HMAC of given messages with one key in a single trustlet
+ * call. See TEE_RSASignBatch.
+ *
+ * @param  keyData          [in]  Pointer to key data buffer
+ * @param  keyDataLength    [in]  Key data buffer length
+ * @param  items            [in/out] Messages and their signatures
+ * @param  count            [in]  Number of items
+ * @param  digest           [in]  Digest type
+ */
+teeResult_t TEE_HMACSignBatch(
+    const uint8_t*   keyData,
+    const uint32_t   keyDataLength,
+    teeBatchItem_t*  items,
+    const uint32_t   count,
+    teeDigest_t      digest);
+
+
+/**
+ * TEE_HMACVerifyBatch
+ *
+ * Verifies the HMAC of given messages with one key in a single trustlet
+ * call. See TEE_RSASignBatch.
+ *
+ * @param  keyData          [in]  Pointer to key data buffer
+ * @param  keyDataLength    [in]  Key data buffer length
+ * @param  items            [in/out] Messages, signatures and their validity
+ * @param  count            [in]  Number of items
+ * @param  digest           [in]  Digest type
+ */
+teeResult_t TEE_HMACVerifyBatch(
+    const uint8_t*   keyData,
+    const uint32_t   keyDataLength,
+    teeBatchItem_t*  items,
+    const uint32_t   count,
+    teeDigest_t      digest);
+
+
+/**
+ * TEE_HMACSignInit
+ *
+ * Starts computing the HMAC of a message given in pieces with
+ * TEE_HMACUpdate, so a large message need not be held in one buffer. The
+ * operation holds a trustlet session until it is ended by
+ * TEE_HMACSignFinal or TEE_HMACAbort.
+ *
+ * @param  keyData          [in]  Pointer to key data buffer
+ * @param  keyDataLength    [in]  Key data buffer length
+ * @param  digest           [in]  Digest type
+ * @param  operation        [out] Operation
+ */
+teeResult_t TEE_HMACSignInit(
+    const uint8_t*        keyData,
+    const uint32_t        keyDataLength,
+    teeDigest_t           digest,
+    teeHmacOperation_t**  operation);
+
+
+/**
+ * TEE_HMACVerifyInit
+ *
+ * Starts verifying the HMAC of a message given in pieces with
+ * TEE_HMACUpdate. The operation is ended by TEE_HMACVerifyFinal or
+ * TEE_HMACAbort.
+ *
+ * @param  keyData          [in]  Pointer to key data buffer
+ * @param  keyDataLength    [in]  Key data buffer length
+ * @param  digest           [in]  Digest type
+ * @param  operation        [out] Operation
+ */
+teeResult_t TEE_HMACVerifyInit(
+    const uint8_t*        keyData,
+    const uint32_t        keyDataLength,
+    teeDigest_t           digest,
+    teeHmacOperation_t**  operation);
+
+
+/**
+ * TEE_HMACUpdate
+ *
+ * Adds message data to an HMAC operation. After a failure the operation
+ * can only be ended.
+ *
+ * @param  operation        [in]  Operation
+ * @param  plainData        [in]  Pointer to message data
+ * @param  plainDataLength  [in]  Message data length
+ */
+teeResult_t TEE_HMACUpdate(
+    teeHmacOperation_t*   operation,
+    const uint8_t*        plainData,
+    const uint32_t        plainDataLength);
+
+
+/**
+ * TEE_HMACSignFinal
+ *
+ * Returns the HMAC of the message and ends the operation
+ *
+ * @param  operation        [in]  Operation
+ * @param  signatureData    [out] Pointer to signature data
+ * @param  signatureDataLength  [in/out] Signature buffer / data length
+ */
+teeResult_t TEE_HMACSignFinal(
+    teeHmacOperation_t*   operation,
+    uint8_t*              signatureData,
+    uint32_t*             signatureDataLength);
+
+
+/**
+ * TEE_HMACVerifyFinal
+ *
+ * Verifies the HMAC of the message and ends the operation
+ *
+ * @param  operation        [in]  Operation
+ * @param  signatureData    [in]  Pointer to signature data
+ * @param  signatureDataLength  [in]  Signature data length
+ * @param  validity         [out] Signature validity
+ */
+teeResult_t TEE_HMACVerifyFinal(
+    teeHmacOperation_t*   operation,
+    const uint8_t*        signatureData,
+    const uint32_t        signatureDataLength,
+    bool                  *validity);
+
+
+/**
+ * TEE_HMACAbort
+ *
+ * Ends an HMAC operation without a result
+ *
+ * @param  operation        [in]  Operation, may be NULL
+ */
+void TEE_HMACAbort(
+    teeHmacOperation_t*   operation);
+
+
 /**
  * TEE_KeyImport
  *
@@ -317,6 +670,116 @@ teeResult_t TEE_GetPubKey(
     uint32_t*       exponentLength);
 
 
+/**
+ * TEE_ECGenerateKeyPair
+ *
+ * Generates EC key pair and returns key pair data as wrapped object
+ *
+ * @param  curve          [in]  Curve
+ * @param  keyData        [in]  Pointer to the key data buffer
+ * @param  keyDataLength  [in]  Key data buffer length
+ * @param  soLen          [out] Key data secure object length
+ */
+teeResult_t TEE_ECGenerateKeyPair(
+    teeEcCurve_t    curve,
+    uint8_t*        keyData,
+    uint32_t        keyDataLength,
+    uint32_t*       soLen);
+
+
+/**
+ * TEE_ECSign
+ *
+ * Signs given digest with ECDSA and returns the DER encoded signature
+ *
+ * @param  keyData          [in]  Pointer to key data buffer
+ * @param  keyDataLength    [in]  Key data buffer length
+ * @param  digestData       [in]  Pointer to digest to be signed
+ * @param  digestDataLength [in]  Digest length
+ * @param  signatureData    [out] Pointer to signature data
+ * @param  signatureDataLength  [in/out] Signature buffer / data length
+ */
+teeResult_t TEE_ECSign(
+    const uint8_t*  keyData,
+    const uint32_t  keyDataLength,
+    const uint8_t*  digestData,
+    const uint32_t  digestDataLength,
+    uint8_t*        signatureData,
+    uint32_t*       signatureDataLength);
+
+
+/**
+ * TEE_ECVerify
+ *
+ * Verifies given DER encoded ECDSA signature of a digest and return status
+ *
+ * @param  keyData          [in]  Pointer to key data buffer
+ * @param  keyDataLength    [in]  Key data buffer length
+ * @param  digestData       [in]  Pointer to signed digest
+ * @param  digestDataLength [in]  Digest length
+ * @param  signatureData    [in]  Pointer to signature data
+ * @param  signatureDataLength  [in]  Signature data length
+ * @param  validity         [out] Signature validity
+ */
+teeResult_t TEE_ECVerify(
+    const uint8_t*  keyData,
+    const uint32_t  keyDataLength,
+    const uint8_t*  digestData,
+    const uint32_t  digestDataLength,
+    const uint8_t*  signatureData,
+    const uint32_t  signatureDataLength,
+    bool            *validity);
+
+
+/**
+ * TEE_ECKeyImport
+ *
+ * Imports EC key data and returns key data as secure object
+ *
+ * Key data needs to be in the following format
+ *
+ * |--key metadata--|--public point (uncompressed)--|--private value--|
+ *
+ * @param  keyData          [in]  Pointer to key data
+ * @param  keyDataLength    [in]  Key data length
+ * @param  soData           [out] Pointer to wrapped key data
+ * @param  soDataLength     [in/out] Wrapped key data buffer / data length
+ */
+teeResult_t TEE_ECKeyImport(
+    const uint8_t*  keyData,
+    const uint32_t  keyDataLength,
+    uint8_t*        soData,
+    uint32_t*       soDataLength);
+
+
+/**
+ * TEE_ECGetPubKey
+ *
+ * Retrieves the curve and public point from wrapped EC key data
+ *
+ * @param  keyData          [in]  Pointer to key data
+ * @param  keyDataLength    [in]  Key data length
+ * @param  curve            [out] Curve of the key
+ * @param  point            [out] Pointer to public point, uncompressed
+ * @param  pointLength      [in/out] Public point buffer / data length
+ */
+teeResult_t TEE_ECGetPubKey(
+    const uint8_t*  keyData,
+    const uint32_t  keyDataLength,
+    teeEcCurve_t*   curve,
+    uint8_t*        point,
+    uint32_t*       pointLength);
+
+
+/**
+ * TEE_ECSupported
+ *
+ * Tells whether the trustlet knows the EC commands. Asked once, with an
+ * empty EC_GET_PUB_KEY, and remembered once the trustlet has answered.
+ */
+bool TEE_ECSupported(void);
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      libscaler-dmabuf.cpp
+ * \brief     source file for the registry of dma-bufs given to the scalers
+ */
+#include <cstring>
+
+#include "libscaler-common.h"
+#include "libscaler-dmabuf.h"
+
+CScalerDmaBufCache::CScalerDmaBufCache()
+    : m_ulClock(0), m_nNextHandle(1)
+{
+    memset(m_Entry, 0, sizeof(m_Entry));
+    memset(&m_Stats, 0, sizeof(m_Stats));
+    pthread_mutex_init(&m_mtxLock, NULL);
+}
+
+CScalerDmaBufCache::~CScalerDmaBufCache()
+{
+    pthread_mutex_destroy(&m_mtxLock);
+}
+
+CScalerDmaBufCache &CScalerDmaBufCache::Get()
+{
+    static CScalerDmaBufCache cache;
+
+    return cache;
+}
+
+CScalerDmaBufCache::Entry *CScalerDmaBufCache::Find(int fd, unsigned int size)
+{
+    for (int i = 0; i < SC_DMABUF_CACHE_SIZE; i++) {
+        if (m_Entry[i].valid && (m_Entry[i].fd == fd) &&
+                (m_Entry[i].size == size))
+            return &m_Entry[i];
+    }
+
+    return NULL;
+}
+
+unsigned int CScalerDmaBufCache::Lookup(int fd, unsigned int size, bool *hit)
+{
+    pthread_mutex_lock(&m_mtxLock);
+
+    m_Stats.lookups++;
+    m_ulClock++;
+
+    Entry *entry = Find(fd, size);
+    bool found = (entry != NULL);
+    if (found) {
+        m_Stats.hits++;
+    } else {
+        m_Stats.misses++;
+
+        entry = &m_Entry[0];
+        for (int i = 1; (i < SC_DMABUF_CACHE_SIZE) && entry->valid; i++) {
+            if (!m_Entry[i].valid || (m_Entry[i].last_used < entry->last_used))
+                entry = &m_Entry[i];
+        }
+
+        if (entry->valid)
+            m_Stats.evictions++;
+        else
+            m_Stats.entries++;
+
+        entry->fd = fd;
+        entry->size = size;
+        entry->handle = m_nNextHandle++;
+        if (m_nNextHandle == 0)
+            m_nNextHandle = 1;
+        entry->valid = true;
+    }
+
+    entry->last_used = m_ulClock;
+
+    unsigned int handle = entry->handle;
+    if (hit)
+        *hit = found;
+
+    pthread_mutex_unlock(&m_mtxLock);
+
+    return handle;
+}
+
+void CScalerDmaBufCache::Invalidate(int fd)
+{
+    pthread_mutex_lock(&m_mtxLock);
+
+    for (int i = 0; i < SC_DMABUF_CACHE_SIZE; i++) {
+        if (m_Entry[i].valid && (m_Entry[i].fd == fd)) {
+            m_Entry[i].valid = false;
+            m_Stats.entries--;
+            m_Stats.invalidations++;
+        }
+    }
+
+    pthread_mutex_unlock(&m_mtxLock);
+}
+void CScalerDmaBufCache::InvalidateAll()
+{
+    pthread_mutex_lock(&m_mtxLock);
+
+    for (int i = 0; i < SC_DMABUF_CACHE_SIZE; i++) {
+        if (m_Entry[i].valid) {
+            m_Entry[i].valid = false;
+            m_Stats.invalidations++;
+        }
+    }
+    m_Stats.entries = 0;
+
+    pthread_mutex_unlock(&m_mtxLock);
+}
+
+void CScalerDmaBufCache::GetStats(ScalerDmaBufStats *stats)
+{
+    pthread_mutex_lock(&m_mtxLock);
+
+    *stats = m_Stats;
+
+    pthread_mutex_unlock(&m_mtxLock);
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      libscaler-dmabuf.h
+ * \brief     header file for the registry of dma-bufs given to the scalers
+ */
+
+#ifndef _LIBSCALER_DMABUF_H_
+#define _LIBSCALER_DMABUF_H_
+
+#include <pthread.h>
+
+#define SC_DMABUF_CACHE_SIZE 32
+
+struct ScalerDmaBufStats {
+    unsigned long lookups;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+    unsigned long invalidations;
+    unsigned int entries;
+};
+
+/*
+ * Remembers the dma-bufs passed to the scalers by their fd number and
+ * plane size, the way the V4L2 path keys its buffer slots, and gives each a
+ * handle that stays the same as long as the buffer is in the registry. A
+ * lookup is no system call.
+ *
+ * The m2m1shot driver takes plain fds and imports and maps them for every
+ * task; no ioctl accepts a handle yet. Until there is one the registry
+ * measures how often swapchain buffers come back, i.e. how much a driver
+ * side import cache would save.
+ *
+ * An fd number may be reused for another buffer once the first is closed,
+ * so users that close, free or reallocate a buffer call Invalidate() with
+ * its fd. The least recently used entry is evicted when the registry is
+ * full.
+ */
+class CScalerDmaBufCache {
+    struct Entry {
+        int fd;
+        unsigned int size;
+        unsigned int handle;
+        unsigned long last_used;
+        bool valid;
+    };
+
+    Entry m_Entry[SC_DMABUF_CACHE_SIZE];
+    unsigned long m_ulClock;
+    unsigned int m_nNextHandle;
+    ScalerDmaBufStats m_Stats;
+    pthread_mutex_t m_mtxLock;
+
+    Entry *Find(int fd, unsigned int size);
+
+public:
+    CScalerDmaBufCache();
+    ~CScalerDmaBufCache();
+
+    // returns the handle of the buffer, never 0
+    unsigned int Lookup(int fd, unsigned int size, bool *hit = NULL);
+    // forgets every buffer seen with fd
+    void Invalidate(int fd);
+    void InvalidateAll();
+    void GetStats(ScalerDmaBufStats *stats);
+
+    // the registry shared by every scaler of the process
+    static CScalerDmaBufCache &Get();
+};
+
+#endif //_LIBSCALER_DMABUF_H_
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      libscaler-m2m1shot-batch.h
+ * \brief     header file for batched submission to the m2m1shot scalers
+ */
+
+#ifndef _LIBSCALER_M2M1SHOT_BATCH_H_
+#define _LIBSCALER_M2M1SHOT_BATCH_H_
+
+#include <pthread.h>
+
+#include <exynos_scaler.h>
+
+// m2m1shot_scaler0 ~ m2m1shot_scaler4
+#define SC_M2M1SHOT_MAX_INSTANCES 5
+
+struct ScalerM2M1SHOTImage {
+    unsigned int width;
+    unsigned int height;
+    unsigned int v4l2_fmt;
+    unsigned int crop_left;
+    unsigned int crop_top;
+    unsigned int crop_width;
+    unsigned int crop_height;
+    void *addr[SC_NUM_OF_PLANES];
+    int mem_type;               // V4L2_MEMORY_DMABUF or V4L2_MEMORY_USERPTR
+};
+
+struct ScalerM2M1SHOTTask {
+    ScalerM2M1SHOTImage src;
+    ScalerM2M1SHOTImage dst;
+    int rot;
+    int hflip;
+    int vflip;
+
+    // filled by CScalerM2M1SHOTBatch::Run()
+    int result;                 // 0 or -errno
+    int instance;               // m2m1shot_scaler that processed the task
+    unsigned long long wait_ns; // from Run() until a scaler picked it up
+    unsigned long long process_ns;
+    unsigned int dmabuf_hits;   // planes already in the dma-buf registry
+    unsigned int dmabuf_misses;
+};
+
+/*
+ * Runs a set of independent m2m1shot tasks, e.g. the layers of a frame, on
+ * every m2m1shot_scaler instance that could be opened. Each instance has a
+ * worker thread that pulls the next task, so the tasks of one Run() are
+ * processed in parallel and back to back without a round-trip per task to
+ * the caller.
+ */
+class CScalerM2M1SHOTBatch {
+    struct Worker {
+        CScalerM2M1SHOTBatch *batch;
+        pthread_t thread;
+        int fd;
+        int instance;
+        bool running;
+    };
+
+    Worker m_Worker[SC_M2M1SHOT_MAX_INSTANCES];
+    int m_nWorkers;
+    int m_nRunning;
+
+    pthread_mutex_t m_mtxRun;   // serializes Run()
+    pthread_mutex_t m_mtxLock;  // protects the fields below
+    pthread_cond_t m_condWork;
+    pthread_cond_t m_condDone;
+    ScalerM2M1SHOTTask *m_pTasks;
+    unsigned int m_nTasks;
+    unsigned int m_nNext;
+    unsigned int m_nPending;
+    unsigned long long m_ullSubmitted;
+    bool m_bExit;
+
+    void RunTask(Worker &w, ScalerM2M1SHOTTask &t);
+    static void *WorkerMain(void *arg);
+
+public:
+    CScalerM2M1SHOTBatch();
+    ~CScalerM2M1SHOTBatch();
+
+    bool Valid() { return m_nWorkers > 0; }
+    int GetInstances() { return m_nWorkers; }
+
+    // returns false if any of the tasks failed; see ScalerM2M1SHOTTask.result
+    bool Run(ScalerM2M1SHOTTask *tasks, unsigned int count);
+
+    // to be called before a dma-buf fd given to Run() is closed or reused
+    static void InvalidateDmaBuf(int fd);
+};
+
+#endif //_LIBSCALER_M2M1SHOT_BATCH_H_
@@ -26,6 +26,8 @@
  *   Create
  */
 #include <cstring>
+#include <cerrno>
+#include <ctime>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
@@ -33,126 +35,73 @@
 #include <linux/videodev2.h>
 
 #include <exynos_scaler.h>
+#include <exynos_format_desc.h>
 
 #include "libscaler-common.h"
 #include "libscaler-m2m1shot.h"
+#include "libscaler-m2m1shot-batch.h"
+#include "libscaler-dmabuf.h"
 
 using namespace std;
 
 const char dev_base_name[] = "/dev/m2m1shot_scaler";
 #define DEVBASE_NAME_LEN 20
 
-struct PixFormat {
-    unsigned int pixfmt;
-    char planes;
-    char bit_pp[3];
-};
-
-const static PixFormat g_pixfmt_table[] = {
-    {V4L2_PIX_FMT_RGB32,        1, {32, 0, 0}, },
-    {V4L2_PIX_FMT_BGR32,        1, {32, 0, 0}, },
-    {V4L2_PIX_FMT_RGB565,       1, {16, 0, 0}, },
-    {V4L2_PIX_FMT_RGB555X,      1, {16, 0, 0}, },
-    {V4L2_PIX_FMT_RGB444,       1, {16, 0, 0}, },
-    {V4L2_PIX_FMT_YUYV,         1, {16, 0, 0}, },
-    {V4L2_PIX_FMT_YVYU,         1, {16, 0, 0}, },
-    {V4L2_PIX_FMT_UYVY,         1, {16, 0, 0}, },
-    {V4L2_PIX_FMT_NV16,         1, {16, 0, 0}, },
-    {V4L2_PIX_FMT_NV61,         1, {16, 0, 0}, },
-    {V4L2_PIX_FMT_YUV420,       1, {12, 0, 0}, },
-    {V4L2_PIX_FMT_YVU420,       1, {12, 0, 0}, },
-    {V4L2_PIX_FMT_NV12M,        2, {8, 4, 0}, },
-    {V4L2_PIX_FMT_NV21M,        2, {8, 4, 0}, },
-    {v4l2_fourcc('V', 'M', '1', '2'), 2, {8, 4, 0}, },
-    {V4L2_PIX_FMT_NV12,         1, {12, 0, 0}, },
-    {V4L2_PIX_FMT_NV21,         1, {12, 0, 0}, },
-    {v4l2_fourcc('N', 'M', '2', '1'), 2, {8, 4, 0}, },
-    {V4L2_PIX_FMT_YUV420M,      3, {8, 2, 2}, },
-    {V4L2_PIX_FMT_YVU420M,      3, {8, 2, 2}, },
-    {V4L2_PIX_FMT_NV24,         1, {24, 0, 0}, },
-    {V4L2_PIX_FMT_NV42,         1, {24, 0, 0}, },
-};
-
-
-CScalerM2M1SHOT::CScalerM2M1SHOT(int devid, int drm) : m_iFD(-1)
+static int sc_m2m1shot_open(int devid)
 {
     char devname[DEVBASE_NAME_LEN + 2]; // basenamelen + id + null
+    int fd;
 
-    if ((devid < 0) || (devid > 4)) { // instance number must be between 0 ~ 3
+    if ((devid < 0) || (devid >= SC_M2M1SHOT_MAX_INSTANCES)) {
         SC_LOGE("Invalid device instance ID %d", devid);
-        return;
+        return -1;
     }
 
     strncpy(devname, dev_base_name, DEVBASE_NAME_LEN);
     devname[DEVBASE_NAME_LEN] = devid + '0';
     devname[DEVBASE_NAME_LEN + 1] = '\0';
 
-    memset(&m_task, 0, sizeof(m_task));
-
-    m_iFD = open(devname, O_RDWR);
-    if (m_iFD < 0) {
+    fd = open(devname, O_RDWR);
+    if (fd < 0)
         SC_LOGERR("Failed to open '%s'", devname);
-    } else {
-        // default 3 planes not to miss any buffer address
-        m_task.buf_out.num_planes = 3;
-        m_task.buf_cap.num_planes = 3;
-    }
-}
 
-CScalerM2M1SHOT::~CScalerM2M1SHOT()
-{
-    if (m_iFD >= 0)
-        close(m_iFD);
+    return fd;
 }
 
-bool CScalerM2M1SHOT::CScalerM2M1SHOT::Run()
+static bool sc_m2m1shot_set_format(m2m1shot_pix_format &fmt,
+        m2m1shot_buffer &buf, unsigned int width, unsigned int height,
+        unsigned int v4l2_fmt)
 {
-    int ret;
-
-    ret = ioctl(m_iFD, M2M1SHOT_IOC_PROCESS, &m_task);
-    if (ret < 0) {
-        SC_LOGERR("Failed to process the given M2M1SHOT task");
-        return false;
-    }
-
-    return true;
-}
-
-bool CScalerM2M1SHOT::SetFormat(m2m1shot_pix_format &fmt, m2m1shot_buffer &buf,
-        unsigned int width, unsigned int height, unsigned int v4l2_fmt) {
-    const PixFormat *pixfmt = NULL;
+    const ExynosFmtDesc *desc = exynos_fmt_find(v4l2_fmt);
+    ExynosFmtLayout layout;
 
     fmt.width = width;
     fmt.height = height;
     fmt.fmt = v4l2_fmt;
 
-    for (size_t i = 0; i < ARRSIZE(g_pixfmt_table); i++) {
-        if (g_pixfmt_table[i].pixfmt == v4l2_fmt) {
-            pixfmt = &g_pixfmt_table[i];
-            break;
-        }
-    }
-
-    if (!pixfmt) {
+    if (!desc) {
         SC_LOGE("Format %#x is not supported", v4l2_fmt);
         return false;
     }
 
-    for (int i = 0; i < pixfmt->planes; i++) {
-        if (((pixfmt->bit_pp[i] * width) % 8) != 0) {
+    exynos_fmt_get_layout(desc, width, height, &layout);
+
+    for (int i = 0; i < desc->planes; i++) {
+        if (((exynos_fmt_plane_bpp(desc, i) * width) % 8) != 0) {
             SC_LOGE("Plane %d of format %#x must have even width", i, v4l2_fmt);
             return false;
         }
-        buf.plane[i].len = (pixfmt->bit_pp[i] * width * height) / 8;
+        buf.plane[i].len = layout.plane_size[i];
     }
 
-    buf.num_planes = pixfmt->planes;
+    buf.num_planes = desc->planes;
 
     return true;
 }
 
-bool CScalerM2M1SHOT::SetCrop(m2m1shot_pix_format &fmt,
-        unsigned int l, unsigned int t, unsigned int w, unsigned int h) {
+static bool sc_m2m1shot_set_crop(m2m1shot_pix_format &fmt,
+        unsigned int l, unsigned int t, unsigned int w, unsigned int h)
+{
     if (fmt.width <= l) {
         SC_LOGE("crop left %d is larger than image width %d", l, fmt.width);
         return false;
@@ -178,12 +127,28 @@ bool CScalerM2M1SHOT::SetCrop(m2m1shot_pix_format &fmt,
     return true;
 }
 
-bool CScalerM2M1SHOT::SetAddr(
-                m2m1shot_buffer &buf, void *addr[SC_NUM_OF_PLANES], int mem_type) {
+/*
+ * The dma-bufs are looked up in the registry by fd and plane length, so the
+ * format is set first. hits and misses, if given, count the lookups.
+ */
+static bool sc_m2m1shot_set_addr(m2m1shot_buffer &buf,
+        void *addr[SC_NUM_OF_PLANES], int mem_type,
+        unsigned int *hits = NULL, unsigned int *misses = NULL)
+{
     if (mem_type == V4L2_MEMORY_DMABUF) {
+        CScalerDmaBufCache &cache = CScalerDmaBufCache::Get();
+
         buf.type = M2M1SHOT_BUFFER_DMABUF;
-        for (int i = 0; i < buf.num_planes; i++)
+        for (int i = 0; i < buf.num_planes; i++) {
+            bool hit;
+
             buf.plane[i].fd = reinterpret_cast<int>(addr[i]);
+            cache.Lookup(buf.plane[i].fd, buf.plane[i].len, &hit);
+            if (hit && hits)
+                (*hits)++;
+            else if (!hit && misses)
+                (*misses)++;
+        }
     } else if (mem_type == V4L2_MEMORY_USERPTR) {
         buf.type = M2M1SHOT_BUFFER_USERPTR;
         for (int i = 0; i < buf.num_planes; i++)
@@ -196,7 +161,9 @@ bool CScalerM2M1SHOT::SetAddr(
     return true;
 }
 
-bool CScalerM2M1SHOT::SetRotate(int rot, int hflip, int vflip) {
+static bool sc_m2m1shot_set_rotate(m2m1shot_operation &op,
+        int rot, int hflip, int vflip)
+{
     if ((rot % 90) != 0) {
         SC_LOGE("Rotation degree %d must be multiple of 90", rot);
         return false;
@@ -206,12 +173,248 @@ bool CScalerM2M1SHOT::SetRotate(int rot, int hflip, int vflip) {
     if (rot < 0)
         rot = 360 + rot;
 
-    m_task.op.rotate = rot;
-    m_task.op.op &= ~(M2M1SHOT_OP_FLIP_HORI | M2M1SHOT_OP_FLIP_VIRT);
+    op.rotate = rot;
+    op.op &= ~(M2M1SHOT_OP_FLIP_HORI | M2M1SHOT_OP_FLIP_VIRT);
     if (hflip)
-        m_task.op.op |= M2M1SHOT_OP_FLIP_HORI;
+        op.op |= M2M1SHOT_OP_FLIP_HORI;
     if (vflip)
-        m_task.op.op |= M2M1SHOT_OP_FLIP_VIRT;
+        op.op |= M2M1SHOT_OP_FLIP_VIRT;
 
     return true;
 }
+
+CScalerM2M1SHOT::CScalerM2M1SHOT(int devid, int drm) : m_iFD(-1)
+{
+    memset(&m_task, 0, sizeof(m_task));
+
+    m_iFD = sc_m2m1shot_open(devid);
+    if (m_iFD >= 0) {
+        // default 3 planes not to miss any buffer address
+        m_task.buf_out.num_planes = 3;
+        m_task.buf_cap.num_planes = 3;
+    }
+}
+
+CScalerM2M1SHOT::~CScalerM2M1SHOT()
+{
+    if (m_iFD >= 0)
+        close(m_iFD);
+}
+
+bool CScalerM2M1SHOT::CScalerM2M1SHOT::Run()
+{
+    int ret;
+
+    ret = ioctl(m_iFD, M2M1SHOT_IOC_PROCESS, &m_task);
+    if (ret < 0) {
+        SC_LOGERR("Failed to process the given M2M1SHOT task");
+        return false;
+    }
+
+    return true;
+}
+
+bool CScalerM2M1SHOT::SetFormat(m2m1shot_pix_format &fmt, m2m1shot_buffer &buf,
+        unsigned int width, unsigned int height, unsigned int v4l2_fmt) {
+    return sc_m2m1shot_set_format(fmt, buf, width, height, v4l2_fmt);
+}
+
+bool CScalerM2M1SHOT::SetCrop(m2m1shot_pix_format &fmt,
+        unsigned int l, unsigned int t, unsigned int w, unsigned int h) {
+    return sc_m2m1shot_set_crop(fmt, l, t, w, h);
+}
+
+bool CScalerM2M1SHOT::SetAddr(
+                m2m1shot_buffer &buf, void *addr[SC_NUM_OF_PLANES], int mem_type) {
+    return sc_m2m1shot_set_addr(buf, addr, mem_type);
+}
+
+bool CScalerM2M1SHOT::SetRotate(int rot, int hflip, int vflip) {
+    return sc_m2m1shot_set_rotate(m_task.op, rot, hflip, vflip);
+}
+
+static unsigned long long sc_m2m1shot_now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int sc_m2m1shot_process(int fd, ScalerM2M1SHOTTask &t)
+{
+    m2m1shot task;
+
+    memset(&task, 0, sizeof(task));
+    t.dmabuf_hits = 0;
+    t.dmabuf_misses = 0;
+
+    if (!sc_m2m1shot_set_format(task.fmt_out, task.buf_out,
+                t.src.width, t.src.height, t.src.v4l2_fmt) ||
+        !sc_m2m1shot_set_crop(task.fmt_out, t.src.crop_left, t.src.crop_top,
+                t.src.crop_width, t.src.crop_height) ||
+        !sc_m2m1shot_set_addr(task.buf_out, t.src.addr, t.src.mem_type,
+                &t.dmabuf_hits, &t.dmabuf_misses) ||
+        !sc_m2m1shot_set_format(task.fmt_cap, task.buf_cap,
+                t.dst.width, t.dst.height, t.dst.v4l2_fmt) ||
+        !sc_m2m1shot_set_crop(task.fmt_cap, t.dst.crop_left, t.dst.crop_top,
+                t.dst.crop_width, t.dst.crop_height) ||
+        !sc_m2m1shot_set_addr(task.buf_cap, t.dst.addr, t.dst.mem_type,
+                &t.dmabuf_hits, &t.dmabuf_misses) ||
+        !sc_m2m1shot_set_rotate(task.op, t.rot, t.hflip, t.vflip))
+        return -EINVAL;
+
+    if (ioctl(fd, M2M1SHOT_IOC_PROCESS, &task) < 0) {
+        int err = errno;
+        SC_LOGERR("Failed to process the given M2M1SHOT task");
+        return -err;
+    }
+
+    return 0;
+}
+
+CScalerM2M1SHOTBatch::CScalerM2M1SHOTBatch()
+    : m_nWorkers(0), m_nRunning(0), m_pTasks(NULL), m_nTasks(0), m_nNext(0), m_nPending(0),
+      m_ullSubmitted(0), m_bExit(false)
+{
+    pthread_mutex_init(&m_mtxRun, NULL);
+    pthread_mutex_init(&m_mtxLock, NULL);
+    pthread_cond_init(&m_condWork, NULL);
+    pthread_cond_init(&m_condDone, NULL);
+
+    for (int i = 0; i < SC_M2M1SHOT_MAX_INSTANCES; i++) {
+        Worker &w = m_Worker[m_nWorkers];
+
+        w.fd = sc_m2m1shot_open(i);
+        if (w.fd < 0)
+            continue;
+
+        w.batch = this;
+        w.instance = i;
+        w.running = false;
+        m_nWorkers++;
+    }
+
+    /*
+     * With a single instance there is nothing to spread: the caller runs the
+     * tasks back to back itself and no thread is started.
+     */
+    if (m_nWorkers < 2)
+        return;
+
+    for (int i = 0; i < m_nWorkers; i++) {
+        if (pthread_create(&m_Worker[i].thread, NULL, WorkerMain,
+                    &m_Worker[i]) != 0) {
+            SC_LOGE("Failed to create the worker of m2m1shot_scaler%d",
+                    m_Worker[i].instance);
+            continue;
+        }
+        m_Worker[i].running = true;
+        m_nRunning++;
+    }
+}
+
+CScalerM2M1SHOTBatch::~CScalerM2M1SHOTBatch()
+{
+    pthread_mutex_lock(&m_mtxLock);
+    m_bExit = true;
+    pthread_cond_broadcast(&m_condWork);
+    pthread_mutex_unlock(&m_mtxLock);
+
+    for (int i = 0; i < m_nWorkers; i++) {
+        if (m_Worker[i].running)
+            pthread_join(m_Worker[i].thread, NULL);
+        close(m_Worker[i].fd);
+    }
+
+    pthread_cond_destroy(&m_condDone);
+    pthread_cond_destroy(&m_condWork);
+    pthread_mutex_destroy(&m_mtxLock);
+    pthread_mutex_destroy(&m_mtxRun);
+}
+
+void CScalerM2M1SHOTBatch::RunTask(Worker &w, ScalerM2M1SHOTTask &t)
+{
+    unsigned long long start = sc_m2m1shot_now_ns();
+
+    t.result = sc_m2m1shot_process(w.fd, t);
+    t.instance = w.instance;
+    t.wait_ns = start - m_ullSubmitted;
+    t.process_ns = sc_m2m1shot_now_ns() - start;
+}
+
+void *CScalerM2M1SHOTBatch::WorkerMain(void *arg)
+{
+    Worker &w = *reinterpret_cast<Worker *>(arg);
+    CScalerM2M1SHOTBatch *batch = w.batch;
+
+    pthread_mutex_lock(&batch->m_mtxLock);
+    while (true) {
+        while (!batch->m_bExit && (batch->m_nNext >= batch->m_nTasks))
+            pthread_cond_wait(&batch->m_condWork, &batch->m_mtxLock);
+
+        if (batch->m_bExit)
+            break;
+
+        ScalerM2M1SHOTTask &t = batch->m_pTasks[batch->m_nNext++];
+        pthread_mutex_unlock(&batch->m_mtxLock);
+
+        batch->RunTask(w, t);
+
+        pthread_mutex_lock(&batch->m_mtxLock);
+        if (--batch->m_nPending == 0)
+            pthread_cond_signal(&batch->m_condDone);
+    }
+    pthread_mutex_unlock(&batch->m_mtxLock);
+
+    return NULL;
+}
+
+void CScalerM2M1SHOTBatch::InvalidateDmaBuf(int fd)
+{
+    CScalerDmaBufCache::Get().Invalidate(fd);
+}
+
+bool CScalerM2M1SHOTBatch::Run(ScalerM2M1SHOTTask *tasks, unsigned int count)
+{
+    bool ok = true;
+
+    if (m_nWorkers == 0) {
+        SC_LOGE("No m2m1shot scaler instance is available");
+        return false;
+    }
+
+    pthread_mutex_lock(&m_mtxRun);
+
+    m_ullSubmitted = sc_m2m1shot_now_ns();
+
+    if ((m_nRunning < 2) || (count == 1)) {
+        for (unsigned int i = 0; i < count; i++)
+            RunTask(m_Worker[0], tasks[i]);
+    } else {
+        pthread_mutex_lock(&m_mtxLock);
+        m_pTasks = tasks;
+        m_nTasks = count;
+        m_nNext = 0;
+        m_nPending = count;
+        pthread_cond_broadcast(&m_condWork);
+
+        while (m_nPending > 0)
+            pthread_cond_wait(&m_condDone, &m_mtxLock);
+
+        m_pTasks = NULL;
+        m_nTasks = 0;
+        m_nNext = 0;
+        pthread_mutex_unlock(&m_mtxLock);
+    }
+
+    pthread_mutex_unlock(&m_mtxRun);
+
+    for (unsigned int i = 0; i < count; i++) {
+        if (tasks[i].result < 0)
+            ok = false;
+    }
+
+    return ok;
+}
@@ -0,0 +1,754 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      libscaler-swscaler.cpp
+ * \brief     source file for the software reference scaler
+ */
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+
+#include <linux/videodev2.h>
+
+#include <exynos_format_desc.h>
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "libscaler-common.h"
+#include "libscaler-swscaler.h"
+
+#define SW_FILTER_BITS  14
+#define SW_PHASES       64
+#define SW_MAX_TAPS     32
+
+enum {
+    SW_PACKED_RGB32,    // R, G, B, A or B, G, R, A
+    SW_PACKED_RGB16,    // RGB565, RGB555X, RGB444
+    SW_PACKED_YUV422,   // two pixels in four bytes
+    SW_SEMIPLANAR,      // Y and interleaved CbCr
+    SW_PLANAR,          // Y, Cb and Cr
+};
+
+struct SwPixFormat {
+    unsigned int pixfmt;
+    uint8_t layout;
+    uint8_t hshift;     // chroma subsampling
+    uint8_t vshift;
+    uint8_t swap;       // BGR or CrCb order
+    uint8_t order[4];   // SW_PACKED_YUV422: offsets of Y0, U, Y1, V
+};
+
+const static SwPixFormat g_sw_pixfmt_table[] = {
+    {V4L2_PIX_FMT_RGB32,   SW_PACKED_RGB32,  0, 0, 0, {0, 0, 0, 0}, },
+    {V4L2_PIX_FMT_BGR32,   SW_PACKED_RGB32,  0, 0, 1, {0, 0, 0, 0}, },
+    {V4L2_PIX_FMT_RGB565,  SW_PACKED_RGB16,  0, 0, 0, {0, 0, 0, 0}, },
+    {V4L2_PIX_FMT_RGB555X, SW_PACKED_RGB16,  0, 0, 0, {0, 0, 0, 0}, },
+    {V4L2_PIX_FMT_RGB444,  SW_PACKED_RGB16,  0, 0, 0, {0, 0, 0, 0}, },
+    {V4L2_PIX_FMT_YUYV,    SW_PACKED_YUV422, 1, 0, 0, {0, 1, 2, 3}, },
+    {V4L2_PIX_FMT_YVYU,    SW_PACKED_YUV422, 1, 0, 0, {0, 3, 2, 1}, },
+    {V4L2_PIX_FMT_UYVY,    SW_PACKED_YUV422, 1, 0, 0, {1, 0, 3, 2}, },
+    {V4L2_PIX_FMT_NV16,    SW_SEMIPLANAR,    1, 0, 0, {0, 0, 0, 0}, },
+    {V4L2_PIX_FMT_NV61,    SW_SEMIPLANAR,    1, 0, 1, {0, 0, 0, 0}, },
+    {V4L2_PIX_FMT_YUV420,  SW_PLANAR,        1, 1, 0, {0, 0, 0, 0}, },
+    {V4L2_PIX_FMT_YVU420,  SW_PLANAR,        1, 1, 1, {0, 0, 0, 0}, },
+    {V4L2_PIX_FMT_NV12M,   SW_SEMIPLANAR,    1, 1, 0, {0, 0, 0, 0}, },
+    {V4L2_PIX_FMT_NV21M,   SW_SEMIPLANAR,    1, 1, 1, {0, 0, 0, 0}, },
+    {V4L2_PIX_FMT_NV12,    SW_SEMIPLANAR,    1, 1, 0, {0, 0, 0, 0}, },
+    {V4L2_PIX_FMT_NV21,    SW_SEMIPLANAR,    1, 1, 1, {0, 0, 0, 0}, },
+    {v4l2_fourcc('N', 'M', '2', '1'), SW_SEMIPLANAR, 1, 1, 1, {0, 0, 0, 0}, },
+    {V4L2_PIX_FMT_YUV420M, SW_PLANAR,        1, 1, 0, {0, 0, 0, 0}, },
+    {V4L2_PIX_FMT_YVU420M, SW_PLANAR,        1, 1, 1, {0, 0, 0, 0}, },
+    {V4L2_PIX_FMT_NV24,    SW_SEMIPLANAR,    0, 0, 0, {0, 0, 0, 0}, },
+    {V4L2_PIX_FMT_NV42,    SW_SEMIPLANAR,    0, 0, 1, {0, 0, 0, 0}, },
+};
+
+struct SwPlane {
+    uint8_t *base;
+    unsigned int stride;
+};
+
+static inline uint8_t sw_clamp(int v)
+{
+    return (v < 0) ? 0 : ((v > 255) ? 255 : v);
+}
+
+static inline bool sw_is_rgb(const SwPixFormat *fmt)
+{
+    return (fmt->layout == SW_PACKED_RGB32) || (fmt->layout == SW_PACKED_RGB16);
+}
+
+static void sw_get_planes(const ExynosFmtDesc *desc, unsigned int width,
+        unsigned int height, void * const addr[SC_NUM_OF_PLANES],
+        SwPlane plane[SC_NUM_OF_PLANES])
+{
+    ExynosFmtLayout layout;
+
+    memset(plane, 0, sizeof(SwPlane) * SC_NUM_OF_PLANES);
+
+    // the same layout the hardware scalers are given buffers for
+    exynos_fmt_get_layout(desc, width, height, &layout);
+    for (unsigned int c = 0; c < desc->components; c++) {
+        plane[c].base = reinterpret_cast<uint8_t *>(addr[layout.plane[c]]) +
+                        layout.offset[c];
+        plane[c].stride = layout.stride[c];
+    }
+}
+
+/*
+ * Unpacks w pixels of row y starting at x0 into {R, G, B, A} or {Y, U, V, A}.
+ * Subsampled chroma is replicated.
+ */
+static void sw_read_row(const SwPixFormat *fmt, const SwPlane *plane,
+        unsigned int x0, unsigned int y, unsigned int w, uint8_t *out)
+{
+    const uint8_t *p = plane[0].base + y * plane[0].stride;
+    const uint8_t *c = NULL;
+    int u_off = fmt->swap ? 1 : 0;
+
+    switch (fmt->layout) {
+    case SW_PACKED_RGB32:
+        for (unsigned int x = x0; x < x0 + w; x++, out += 4) {
+            const uint8_t *s = p + x * 4;
+            out[0] = fmt->swap ? s[2] : s[0];
+            out[1] = s[1];
+            out[2] = fmt->swap ? s[0] : s[2];
+            out[3] = s[3];
+        }
+        break;
+    case SW_PACKED_RGB16:
+        for (unsigned int x = x0; x < x0 + w; x++, out += 4) {
+            const uint8_t *s = p + x * 2;
+            unsigned int v;
+            if (fmt->pixfmt == V4L2_PIX_FMT_RGB565) {
+                v = s[0] | (s[1] << 8);
+                out[0] = ((v >> 11) & 0x1f) * 255 / 31;
+                out[1] = ((v >> 5) & 0x3f) * 255 / 63;
+                out[2] = (v & 0x1f) * 255 / 31;
+            } else if (fmt->pixfmt == V4L2_PIX_FMT_RGB555X) {
+                v = (s[0] << 8) | s[1];
+                out[0] = ((v >> 10) & 0x1f) * 255 / 31;
+                out[1] = ((v >> 5) & 0x1f) * 255 / 31;
+                out[2] = (v & 0x1f) * 255 / 31;
+            } else {
+                v = s[0] | (s[1] << 8);
+                out[0] = ((v >> 8) & 0xf) * 17;
+                out[1] = ((v >> 4) & 0xf) * 17;
+                out[2] = (v & 0xf) * 17;
+            }
+            out[3] = 255;
+        }
+        break;
+    case SW_PACKED_YUV422:
+        for (unsigned int x = x0; x < x0 + w; x++, out += 4) {
+            const uint8_t *s = p + (x & ~1) * 2;
+            out[0] = s[fmt->order[(x & 1) ? 2 : 0]];
+            out[1] = s[fmt->order[1]];
+            out[2] = s[fmt->order[3]];
+            out[3] = 255;
+        }
+        break;
+    case SW_SEMIPLANAR:
+        c = plane[1].base + (y >> fmt->vshift) * plane[1].stride;
+        for (unsigned int x = x0; x < x0 + w; x++, out += 4) {
+            const uint8_t *s = c + (x >> fmt->hshift) * 2;
+            out[0] = p[x];
+            out[1] = s[u_off];
+            out[2] = s[1 - u_off];
+            out[3] = 255;
+        }
+        break;
+    case SW_PLANAR: {
+        const uint8_t *cb = plane[1 + u_off].base +
+                            (y >> fmt->vshift) * plane[1 + u_off].stride;
+        const uint8_t *cr = plane[2 - u_off].base +
+                            (y >> fmt->vshift) * plane[2 - u_off].stride;
+        for (unsigned int x = x0; x < x0 + w; x++, out += 4) {
+            out[0] = p[x];
+            out[1] = cb[x >> fmt->hshift];
+            out[2] = cr[x >> fmt->hshift];
+            out[3] = 255;
+        }
+        break;
+    }
+    }
+}
+
+static void sw_write_pixel(const SwPixFormat *fmt, uint8_t *p,
+        const uint8_t *in)
+{
+    unsigned int v;
+
+    if (fmt->layout == SW_PACKED_RGB32) {
+        p[0] = fmt->swap ? in[2] : in[0];
+        p[1] = in[1];
+        p[2] = fmt->swap ? in[0] : in[2];
+        p[3] = in[3];
+    } else if (fmt->pixfmt == V4L2_PIX_FMT_RGB565) {
+        v = ((in[0] >> 3) << 11) | ((in[1] >> 2) << 5) | (in[2] >> 3);
+        p[0] = v & 0xff;
+        p[1] = v >> 8;
+    } else if (fmt->pixfmt == V4L2_PIX_FMT_RGB555X) {
+        v = ((in[0] >> 3) << 10) | ((in[1] >> 3) << 5) | (in[2] >> 3);
+        p[0] = v >> 8;
+        p[1] = v & 0xff;
+    } else {
+        v = ((in[0] >> 4) << 8) | ((in[1] >> 4) << 4) | (in[2] >> 4);
+        p[0] = v & 0xff;
+        p[1] = v >> 8;
+    }
+}
+
+/*
+ * Packs the w x h pixels of in into the crop rectangle at (x0, y0). The
+ * chroma of a subsampled block is the average of its pixels in the crop.
+ */
+static void sw_write_frame(const SwPixFormat *fmt, const SwPlane *plane,
+        unsigned int x0, unsigned int y0, unsigned int w, unsigned int h,
+        const uint8_t *in)
+{
+    int u_off = fmt->swap ? 1 : 0;
+
+    if (sw_is_rgb(fmt)) {
+        unsigned int bpp = (fmt->layout == SW_PACKED_RGB32) ? 4 : 2;
+        for (unsigned int y = 0; y < h; y++) {
+            uint8_t *p = plane[0].base + (y0 + y) * plane[0].stride + x0 * bpp;
+            for (unsigned int x = 0; x < w; x++, p += bpp, in += 4)
+                sw_write_pixel(fmt, p, in);
+        }
+        return;
+    }
+
+    for (unsigned int y = 0; y < h; y++) {
+        const uint8_t *s = in + y * w * 4;
+        uint8_t *p = plane[0].base + (y0 + y) * plane[0].stride;
+        for (unsigned int x = x0; x < x0 + w; x++, s += 4) {
+            if (fmt->layout == SW_PACKED_YUV422)
+                p[(x & ~1) * 2 + fmt->order[(x & 1) ? 2 : 0]] = s[0];
+            else
+                p[x] = s[0];
+        }
+    }
+
+    unsigned int hs = fmt->hshift;
+    unsigned int vs = fmt->vshift;
+    for (unsigned int cy = y0 >> vs; cy <= (y0 + h - 1) >> vs; cy++) {
+        for (unsigned int cx = x0 >> hs; cx <= (x0 + w - 1) >> hs; cx++) {
+            unsigned int sum[2] = {0, 0};
+            unsigned int n = 0;
+
+            for (unsigned int y = cy << vs; y < ((cy + 1) << vs); y++) {
+                if ((y < y0) || (y >= y0 + h))
+                    continue;
+                for (unsigned int x = cx << hs; x < ((cx + 1) << hs); x++) {
+                    if ((x < x0) || (x >= x0 + w))
+                        continue;
+                    const uint8_t *s = in + ((y - y0) * w + (x - x0)) * 4;
+                    sum[0] += s[1];
+                    sum[1] += s[2];
+                    n++;
+                }
+            }
+
+            uint8_t cb = (sum[0] + n / 2) / n;
+            uint8_t cr = (sum[1] + n / 2) / n;
+
+            if (fmt->layout == SW_PACKED_YUV422) {
+                uint8_t *p = plane[0].base + cy * plane[0].stride + cx * 4;
+                p[fmt->order[1]] = cb;
+                p[fmt->order[3]] = cr;
+            } else if (fmt->layout == SW_SEMIPLANAR) {
+                uint8_t *p = plane[1].base + cy * plane[1].stride + cx * 2;
+                p[u_off] = cb;
+                p[1 - u_off] = cr;
+            } else {
+                plane[1 + u_off].base[cy * plane[1 + u_off].stride + cx] = cb;
+                plane[2 - u_off].base[cy * plane[2 - u_off].stride + cx] = cr;
+            }
+        }
+    }
+}
+
+// BT.601 limited range, the default of the scaler hardware
+static void sw_yuv_to_rgb(uint8_t *buf, size_t pixels)
+{
+    for (size_t i = 0; i < pixels; i++, buf += 4) {
+        int c = 298 * (buf[0] - 16) + 128;
+        int d = buf[1] - 128;
+        int e = buf[2] - 128;
+        buf[0] = sw_clamp((c + 409 * e) >> 8);
+        buf[1] = sw_clamp((c - 100 * d - 208 * e) >> 8);
+        buf[2] = sw_clamp((c + 516 * d) >> 8);
+    }
+}
+
+static void sw_rgb_to_yuv(uint8_t *buf, size_t pixels)
+{
+    for (size_t i = 0; i < pixels; i++, buf += 4) {
+        int r = buf[0], g = buf[1], b = buf[2];
+        buf[0] = sw_clamp(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        buf[1] = sw_clamp(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+        buf[2] = sw_clamp(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+}
+
+struct SwFilter {
+    unsigned int taps;
+    int *start;             // first source sample of each output sample
+    const int16_t **coef;   // phase of each output sample
+    int16_t *table;         // SW_PHASES x taps
+};
+
+static double sw_cubic(double x)
+{
+    // Catmull-Rom
+    x = fabs(x);
+    if (x < 1.0)
+        return 1.5 * x * x * x - 2.5 * x * x + 1.0;
+    if (x < 2.0)
+        return -0.5 * x * x * x + 2.5 * x * x - 4.0 * x + 2.0;
+    return 0.0;
+}
+
+static void sw_free_filter(SwFilter &flt)
+{
+    free(flt.start);
+    free(flt.coef);
+    free(flt.table);
+    memset(&flt, 0, sizeof(flt));
+}
+
+static bool sw_build_filter(SwFilter &flt, unsigned int src, unsigned int dst)
+{
+    double scale = static_cast<double>(src) / dst;
+    double fs = (scale > 1.0) ? scale : 1.0;
+
+    // the kernel is stretched by the downscaling ratio to low-pass the input
+    flt.taps = 4 * static_cast<unsigned int>(ceil(fs));
+    if (flt.taps > SW_MAX_TAPS) {
+        flt.taps = SW_MAX_TAPS;
+        fs = SW_MAX_TAPS / 4;
+    }
+
+    flt.start = reinterpret_cast<int *>(malloc(sizeof(int) * dst));
+    flt.coef = reinterpret_cast<const int16_t **>(
+                    malloc(sizeof(int16_t *) * dst));
+    flt.table = reinterpret_cast<int16_t *>(
+                    malloc(sizeof(int16_t) * SW_PHASES * flt.taps));
+    if (!flt.start || !flt.coef || !flt.table) {
+        SC_LOGE("Failed to allocate the filter of %u taps", flt.taps);
+        sw_free_filter(flt);
+        return false;
+    }
+
+    int center = flt.taps / 2 - 1;
+    for (int p = 0; p < SW_PHASES; p++) {
+        int16_t *c = flt.table + p * flt.taps;
+        double w[SW_MAX_TAPS];
+        double sum = 0.0;
+        int total = 0;
+
+        for (unsigned int k = 0; k < flt.taps; k++) {
+            w[k] = sw_cubic((static_cast<int>(k) - center -
+                             static_cast<double>(p) / SW_PHASES) / fs);
+            sum += w[k];
+        }
+
+        for (unsigned int k = 0; k < flt.taps; k++) {
+            c[k] = static_cast<int16_t>(
+                        floor(w[k] / sum * (1 << SW_FILTER_BITS) + 0.5));
+            total += c[k];
+        }
+
+        // keep the DC gain exact
+        c[(p < SW_PHASES / 2) ? center : center + 1] +=
+                                        (1 << SW_FILTER_BITS) - total;
+    }
+
+    for (unsigned int i = 0; i < dst; i++) {
+        double pos = (i + 0.5) * scale - 0.5;
+        int base = static_cast<int>(floor(pos));
+        int phase = static_cast<int>(floor((pos - base) * SW_PHASES + 0.5));
+
+        if (phase == SW_PHASES) {
+            phase = 0;
+            base++;
+        }
+
+        flt.start[i] = base - center;
+        flt.coef[i] = flt.table + phase * flt.taps;
+    }
+
+    return true;
+}
+
+static void sw_hscale(const SwFilter &flt, const uint8_t *src,
+        unsigned int sw, uint8_t *dst, unsigned int dw)
+{
+    for (unsigned int x = 0; x < dw; x++, dst += 4) {
+        const int16_t *c = flt.coef[x];
+        int acc[4];
+
+        for (int ch = 0; ch < 4; ch++)
+            acc[ch] = 1 << (SW_FILTER_BITS - 1);
+
+        for (unsigned int k = 0; k < flt.taps; k++) {
+            int sx = flt.start[x] + k;
+            if (sx < 0)
+                sx = 0;
+            else if (sx >= static_cast<int>(sw))
+                sx = sw - 1;
+
+            const uint8_t *s = src + sx * 4;
+            for (int ch = 0; ch < 4; ch++)
+                acc[ch] += c[k] * s[ch];
+        }
+
+        for (int ch = 0; ch < 4; ch++)
+            dst[ch] = sw_clamp(acc[ch] >> SW_FILTER_BITS);
+    }
+}
+
+static void sw_vscale_row(const uint8_t * const *rows, const int16_t *coef,
+        unsigned int taps, uint8_t *dst, unsigned int len)
+{
+    unsigned int i = 0;
+
+#if defined(__ARM_NEON__)
+    for (; i + 8 <= len; i += 8) {
+        int32x4_t lo = vdupq_n_s32(1 << (SW_FILTER_BITS - 1));
+        int32x4_t hi = lo;
+
+        for (unsigned int k = 0; k < taps; k++) {
+            int16x8_t s = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(rows[k] + i)));
+            lo = vmlal_n_s16(lo, vget_low_s16(s), coef[k]);
+            hi = vmlal_n_s16(hi, vget_high_s16(s), coef[k]);
+        }
+
+        int16x8_t r = vcombine_s16(vqshrn_n_s32(lo, SW_FILTER_BITS),
+                                   vqshrn_n_s32(hi, SW_FILTER_BITS));
+        vst1_u8(dst + i, vqmovun_s16(r));
+    }
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+
+    // taps is a multiple of 4, so they are consumed in pairs by pmaddwd
+    for (; i + 8 <= len; i += 8) {
+        __m128i lo = _mm_set1_epi32(1 << (SW_FILTER_BITS - 1));
+        __m128i hi = lo;
+
+        for (unsigned int k = 0; k < taps; k += 2) {
+            __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64(
+                    reinterpret_cast<const __m128i *>(rows[k] + i)), zero);
+            __m128i b = _mm_unpacklo_epi8(_mm_loadl_epi64(
+                    reinterpret_cast<const __m128i *>(rows[k + 1] + i)), zero);
+            // coef[k] in the low and coef[k + 1] in the high 16 bits
+            __m128i c = _mm_set1_epi32(static_cast<int>(
+                    static_cast<uint16_t>(coef[k]) |
+                    (static_cast<uint32_t>(static_cast<uint16_t>(coef[k + 1])) << 16)));
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), c));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), c));
+        }
+
+        __m128i r = _mm_packs_epi32(_mm_srai_epi32(lo, SW_FILTER_BITS),
+                                    _mm_srai_epi32(hi, SW_FILTER_BITS));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + i),
+                         _mm_packus_epi16(r, r));
+    }
+#endif
+
+    for (; i < len; i++) {
+        int acc = 1 << (SW_FILTER_BITS - 1);
+        for (unsigned int k = 0; k < taps; k++)
+            acc += coef[k] * rows[k][i];
+        dst[i] = sw_clamp(acc >> SW_FILTER_BITS);
+    }
+}
+
+static bool sw_scale(const uint8_t *src, unsigned int sw, unsigned int sh,
+        uint8_t *tmp, uint8_t *dst, unsigned int dw, unsigned int dh)
+{
+    SwFilter hflt, vflt;
+    const uint8_t *rows[SW_MAX_TAPS];
+
+    memset(&hflt, 0, sizeof(hflt));
+    memset(&vflt, 0, sizeof(vflt));
+
+    if (sw == dw) {
+        tmp = const_cast<uint8_t *>(src);
+    } else {
+        if (!sw_build_filter(hflt, sw, dw))
+            return false;
+        for (unsigned int y = 0; y < sh; y++)
+            sw_hscale(hflt, src + y * sw * 4, sw, tmp + y * dw * 4, dw);
+        sw_free_filter(hflt);
+    }
+
+    if (sh == dh) {
+        memcpy(dst, tmp, dw * dh * 4);
+        return true;
+    }
+
+    if (!sw_build_filter(vflt, sh, dh))
+        return false;
+
+    for (unsigned int y = 0; y < dh; y++) {
+        for (unsigned int k = 0; k < vflt.taps; k++) {
+            int sy = vflt.start[y] + k;
+            if (sy < 0)
+                sy = 0;
+            else if (sy >= static_cast<int>(sh))
+                sy = sh - 1;
+            rows[k] = tmp + sy * dw * 4;
+        }
+        sw_vscale_row(rows, vflt.coef[y], vflt.taps, dst + y * dw * 4, dw * 4);
+    }
+
+    sw_free_filter(vflt);
+
+    return true;
+}
+
+/*
+ * Writes the sw x sh frame src flipped and then rotated clockwise by rot
+ * degrees into dst.
+ */
+static void sw_rotate(const uint8_t *src, unsigned int sw, unsigned int sh,
+        int rot, bool hflip, bool vflip, uint8_t *dst)
+{
+    const uint32_t *s = reinterpret_cast<const uint32_t *>(src);
+    uint32_t *d = reinterpret_cast<uint32_t *>(dst);
+    unsigned int dw = ((rot == 90) || (rot == 270)) ? sh : sw;
+    unsigned int dh = ((rot == 90) || (rot == 270)) ? sw : sh;
+
+    for (unsigned int y = 0; y < dh; y++) {
+        for (unsigned int x = 0; x < dw; x++) {
+            unsigned int sx, sy;
+
+            switch (rot) {
+            case 90:
+                sx = y;
+                sy = sh - 1 - x;
+                break;
+            case 180:
+                sx = sw - 1 - x;
+                sy = sh - 1 - y;
+                break;
+            case 270:
+                sx = sw - 1 - y;
+                sy = x;
+                break;
+            default:
+                sx = x;
+                sy = y;
+                break;
+            }
+
+            if (hflip)
+                sx = sw - 1 - sx;
+            if (vflip)
+                sy = sh - 1 - sy;
+
+            *d++ = s[sy * sw + sx];
+        }
+    }
+}
+
+CScalerSW::CScalerSW()
+{
+    memset(&m_frmSrc, 0, sizeof(m_frmSrc));
+    memset(&m_frmDst, 0, sizeof(m_frmDst));
+    m_nRotDegree = 0;
+    m_bHFlip = false;
+    m_bVFlip = false;
+    m_pBuf[0] = m_pBuf[1] = NULL;
+    m_szBuf[0] = m_szBuf[1] = 0;
+}
+
+CScalerSW::~CScalerSW()
+{
+    free(m_pBuf[0]);
+    free(m_pBuf[1]);
+}
+
+bool CScalerSW::SetFormat(FrameInfo &frm, unsigned int width,
+        unsigned int height, unsigned int v4l2_fmt)
+{
+    const SwPixFormat *fmt = NULL;
+    const ExynosFmtDesc *desc;
+
+    for (size_t i = 0; i < ARRSIZE(g_sw_pixfmt_table); i++) {
+        if (g_sw_pixfmt_table[i].pixfmt == v4l2_fmt) {
+            fmt = &g_sw_pixfmt_table[i];
+            break;
+        }
+    }
+
+    desc = exynos_fmt_find(v4l2_fmt);
+    if (!fmt || !desc) {
+        SC_LOGE("Format %#x is not supported", v4l2_fmt);
+        return false;
+    }
+
+    if ((width == 0) || (height == 0)) {
+        SC_LOGE("Invalid image size %ux%u", width, height);
+        return false;
+    }
+
+    frm.fmt = fmt;
+    frm.desc = desc;
+    frm.width = width;
+    frm.height = height;
+    frm.crop_left = 0;
+    frm.crop_top = 0;
+    frm.crop_width = width;
+    frm.crop_height = height;
+
+    return true;
+}
+
+bool CScalerSW::SetCrop(FrameInfo &frm, unsigned int l, unsigned int t,
+        unsigned int w, unsigned int h)
+{
+    if ((w == 0) || (h == 0)) {
+        SC_LOGE("Invalid crop size %ux%u", w, h);
+        return false;
+    }
+    if (frm.width < (l + w)) {
+        SC_LOGE("crop width %d@%d  exceeds image width %d", w, l, frm.width);
+        return false;
+    }
+    if (frm.height < (t + h)) {
+        SC_LOGE("crop height %d@%d  exceeds image height %d", h, t, frm.height);
+        return false;
+    }
+
+    frm.crop_left = l;
+    frm.crop_top = t;
+    frm.crop_width = w;
+    frm.crop_height = h;
+
+    return true;
+}
+
+bool CScalerSW::SetAddr(FrameInfo &frm, void *addr[SC_NUM_OF_PLANES],
+        int mem_type)
+{
+    if (mem_type != V4L2_MEMORY_USERPTR) {
+        SC_LOGE("Buffer type %d is not supported", mem_type);
+        return false;
+    }
+
+    for (int i = 0; i < SC_NUM_OF_PLANES; i++)
+        frm.addr[i] = addr[i];
+
+    return true;
+}
+
+bool CScalerSW::SetRotate(int rot, int hflip, int vflip)
+{
+    if ((rot % 90) != 0) {
+        SC_LOGE("Rotation degree %d must be multiple of 90", rot);
+        return false;
+    }
+
+    rot = rot % 360;
+    if (rot < 0)
+        rot = 360 + rot;
+
+    m_nRotDegree = rot;
+    m_bHFlip = !!hflip;
+    m_bVFlip = !!vflip;
+
+    return true;
+}
+
+uint8_t *CScalerSW::GetBuffer(int idx, size_t len)
+{
+    if (m_szBuf[idx] < len) {
+        uint8_t *buf = reinterpret_cast<uint8_t *>(realloc(m_pBuf[idx], len));
+        if (!buf) {
+            SC_LOGE("Failed to allocate %zu bytes of scratch buffer", len);
+            return NULL;
+        }
+        m_pBuf[idx] = buf;
+        m_szBuf[idx] = len;
+    }
+
+    return m_pBuf[idx];
+}
+
+bool CScalerSW::Run()
+{
+    SwPlane src[SC_NUM_OF_PLANES], dst[SC_NUM_OF_PLANES];
+
+    if (!m_frmSrc.fmt || !m_frmDst.fmt || !m_frmSrc.addr[0] ||
+            !m_frmDst.addr[0]) {
+        SC_LOGE("Format or buffer is not configured");
+        return false;
+    }
+
+    bool swap = (m_nRotDegree == 90) || (m_nRotDegree == 270);
+    unsigned int sw = m_frmSrc.crop_width;
+    unsigned int sh = m_frmSrc.crop_height;
+    unsigned int dw = swap ? m_frmDst.crop_height : m_frmDst.crop_width;
+    unsigned int dh = swap ? m_frmDst.crop_width : m_frmDst.crop_height;
+    size_t max_w = (sw > dw) ? sw : dw;
+    size_t max_h = (sh > dh) ? sh : dh;
+
+    // one frame of the source crop and one of the scaled image side by side
+    uint8_t *buf0 = GetBuffer(0, max_w * max_h * 4);
+    uint8_t *buf1 = GetBuffer(1, max_w * max_h * 4 * 2);
+    if (!buf0 || !buf1)
+        return false;
+
+    sw_get_planes(m_frmSrc.desc, m_frmSrc.width, m_frmSrc.height,
+                  m_frmSrc.addr, src);
+    sw_get_planes(m_frmDst.desc, m_frmDst.width, m_frmDst.height,
+                  m_frmDst.addr, dst);
+
+    for (unsigned int y = 0; y < sh; y++)
+        sw_read_row(m_frmSrc.fmt, src, m_frmSrc.crop_left,
+                    m_frmSrc.crop_top + y, sw, buf0 + y * sw * 4);
+
+    // buf0 holds the source crop, buf1 the intermediate and scaled frames
+    uint8_t *tmp = buf1;
+    uint8_t *scaled = buf1 + max_w * max_h * 4;
+    if (!sw_scale(buf0, sw, sh, tmp, scaled, dw, dh))
+        return false;
+
+    uint8_t *out = scaled;
+    if ((m_nRotDegree != 0) || m_bHFlip || m_bVFlip) {
+        sw_rotate(scaled, dw, dh, m_nRotDegree, m_bHFlip, m_bVFlip, buf0);
+        out = buf0;
+    }
+
+    size_t pixels = static_cast<size_t>(dw) * dh;
+    if (sw_is_rgb(m_frmSrc.fmt) && !sw_is_rgb(m_frmDst.fmt))
+        sw_rgb_to_yuv(out, pixels);
+    else if (!sw_is_rgb(m_frmSrc.fmt) && sw_is_rgb(m_frmDst.fmt))
+        sw_yuv_to_rgb(out, pixels);
+
+    sw_write_frame(m_frmDst.fmt, dst, m_frmDst.crop_left, m_frmDst.crop_top,
+                   m_frmDst.crop_width, m_frmDst.crop_height, out);
+
+    return true;
+}
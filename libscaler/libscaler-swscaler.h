@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      libscaler-swscaler.h
+ * \brief     header file for the software reference scaler
+ */
+
+#ifndef _LIBSCALER_SWSCALER_H_
+#define _LIBSCALER_SWSCALER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <exynos_scaler.h>
+
+struct SwPixFormat;
+struct ExynosFmtDesc;
+
+/*
+ * CPU implementation of the scaler operations of CScalerV4L2 and
+ * CScalerM2M1SHOT: polyphase scaling, crop, rotation, flip and BT.601
+ * YUV <-> RGB conversion of the formats the m2m1shot scaler accepts.
+ * It needs no device node, so it serves as the golden reference for the
+ * hardware output and as a fallback when no scaler instance is free.
+ * Only USERPTR buffers are accepted.
+ *
+ * The arithmetic is fixed point and the NEON/SSE2 paths produce the very
+ * same output as the plain C path.
+ */
+class CScalerSW {
+    struct FrameInfo {
+        const SwPixFormat *fmt;
+        const ExynosFmtDesc *desc;
+        unsigned int width;
+        unsigned int height;
+        unsigned int crop_left;
+        unsigned int crop_top;
+        unsigned int crop_width;
+        unsigned int crop_height;
+        void *addr[SC_NUM_OF_PLANES];
+    };
+
+    FrameInfo m_frmSrc;
+    FrameInfo m_frmDst;
+    int m_nRotDegree;
+    bool m_bHFlip;
+    bool m_bVFlip;
+
+    // scratch frames reused across Run() calls
+    uint8_t *m_pBuf[2];
+    size_t m_szBuf[2];
+
+    bool SetFormat(FrameInfo &frm, unsigned int width, unsigned int height,
+                   unsigned int v4l2_fmt);
+    bool SetCrop(FrameInfo &frm, unsigned int l, unsigned int t,
+                 unsigned int w, unsigned int h);
+    bool SetAddr(FrameInfo &frm, void *addr[SC_NUM_OF_PLANES], int mem_type);
+    uint8_t *GetBuffer(int idx, size_t len);
+
+public:
+    CScalerSW();
+    ~CScalerSW();
+
+    bool SetSrcFormat(unsigned int width, unsigned int height,
+                      unsigned int v4l2_fmt) {
+        return SetFormat(m_frmSrc, width, height, v4l2_fmt);
+    }
+    bool SetDstFormat(unsigned int width, unsigned int height,
+                      unsigned int v4l2_fmt) {
+        return SetFormat(m_frmDst, width, height, v4l2_fmt);
+    }
+    bool SetSrcCrop(unsigned int l, unsigned int t,
+                    unsigned int w, unsigned int h) {
+        return SetCrop(m_frmSrc, l, t, w, h);
+    }
+    bool SetDstCrop(unsigned int l, unsigned int t,
+                    unsigned int w, unsigned int h) {
+        return SetCrop(m_frmDst, l, t, w, h);
+    }
+    bool SetSrcAddr(void *addr[SC_NUM_OF_PLANES], int mem_type) {
+        return SetAddr(m_frmSrc, addr, mem_type);
+    }
+    bool SetDstAddr(void *addr[SC_NUM_OF_PLANES], int mem_type) {
+        return SetAddr(m_frmDst, addr, mem_type);
+    }
+
+    // rot is clockwise; hflip mirrors left-right and vflip top-bottom
+    bool SetRotate(int rot, int hflip, int vflip);
+    bool Run();
+};
+
+#endif //_LIBSCALER_SWSCALER_H_
@@ -28,9 +28,162 @@
 
 #include <cstring>
 #include <cstdlib>
+#include <pthread.h>
 
 #include "libscaler-v4l2.h"
 
+/*
+ * Buffer slots of a queue. videobuf2 keeps the dma-buf of a buffer index
+ * attached and mapped until a different buffer is queued at that index,
+ * so queuing the same gralloc buffer at the same index skips the import
+ * and the IOMMU map. Buffers are matched to slots by their address or fd
+ * and the least recently used slot is given to a buffer not seen before.
+ *
+ * FrameInfo is declared in libscaler-v4l2.h, so the slots are kept here
+ * keyed by the address of the FrameInfo they belong to.
+ */
+#define SC_V4L2_BUF_SLOTS 4
+
+struct ScBufSlot {
+    unsigned long long key[SC_NUM_OF_PLANES];
+    unsigned long last_used;
+    bool valid;
+};
+
+struct ScBufRing {
+    const void *owner;
+    ScBufRing *next;
+    unsigned int count;
+    unsigned long clock;
+    unsigned long hits;
+    unsigned long misses;
+    ScBufSlot slot[SC_V4L2_BUF_SLOTS];
+};
+
+static pthread_mutex_t g_mtxBufRing = PTHREAD_MUTEX_INITIALIZER;
+static ScBufRing *g_pBufRing;
+
+static ScBufRing *sc_v4l2_find_ring(const void *owner, bool create)
+{
+    ScBufRing *ring;
+
+    for (ring = g_pBufRing; ring != NULL; ring = ring->next) {
+        if (ring->owner == owner)
+            return ring;
+    }
+
+    if (!create)
+        return NULL;
+
+    ring = static_cast<ScBufRing *>(calloc(1, sizeof(*ring)));
+    if (ring == NULL)
+        return NULL;
+
+    ring->owner = owner;
+    ring->next = g_pBufRing;
+    g_pBufRing = ring;
+
+    return ring;
+}
+
+// called with the slot count granted by REQBUFS; 0 drops every mapping
+static void sc_v4l2_reset_ring(const void *owner, unsigned int count)
+{
+    pthread_mutex_lock(&g_mtxBufRing);
+
+    ScBufRing *ring = sc_v4l2_find_ring(owner, count > 0);
+    if (ring != NULL) {
+        ring->count = (count > SC_V4L2_BUF_SLOTS) ? SC_V4L2_BUF_SLOTS : count;
+        memset(ring->slot, 0, sizeof(ring->slot));
+    }
+
+    pthread_mutex_unlock(&g_mtxBufRing);
+}
+
+static void sc_v4l2_free_ring(const void *owner)
+{
+    pthread_mutex_lock(&g_mtxBufRing);
+
+    for (ScBufRing **pp = &g_pBufRing; *pp != NULL; pp = &(*pp)->next) {
+        ScBufRing *ring = *pp;
+        if (ring->owner == owner) {
+            SC_LOGD("buffer slots: %lu hits, %lu misses",
+                    ring->hits, ring->misses);
+            *pp = ring->next;
+            free(ring);
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&g_mtxBufRing);
+}
+
+/*
+ * A dma-buf is keyed by its fd number and the plane size, without a system
+ * call. The number may be reused by another buffer, but videobuf2 compares
+ * the dma-buf itself on QBUF and imports the new one when it differs, so a
+ * stale match costs the import it meant to save and never a wrong mapping.
+ */
+static unsigned long long sc_v4l2_buf_key(void *addr, unsigned long size,
+                                          unsigned int memory)
+{
+    if (memory == V4L2_MEMORY_DMABUF) {
+        unsigned int fd = reinterpret_cast<int>(addr);
+
+        return (static_cast<unsigned long long>(fd) << 32) |
+                static_cast<unsigned int>(size);
+    }
+
+    return reinterpret_cast<unsigned long>(addr);
+}
+
+static unsigned int sc_v4l2_get_slot(const void *owner,
+        void * const addr[SC_NUM_OF_PLANES],
+        const unsigned long size[SC_NUM_OF_PLANES], unsigned int num_planes,
+        unsigned int memory)
+{
+    unsigned long long key[SC_NUM_OF_PLANES];
+    unsigned int idx = 0;
+
+    memset(key, 0, sizeof(key));
+    for (unsigned int i = 0; (i < num_planes) && (i < SC_NUM_OF_PLANES); i++)
+        key[i] = sc_v4l2_buf_key(addr[i], size[i], memory);
+
+    pthread_mutex_lock(&g_mtxBufRing);
+
+    ScBufRing *ring = sc_v4l2_find_ring(owner, false);
+    if ((ring == NULL) || (ring->count == 0)) {
+        pthread_mutex_unlock(&g_mtxBufRing);
+        return 0;
+    }
+
+    ring->clock++;
+
+    for (unsigned int i = 0; i < ring->count; i++) {
+        ScBufSlot *slot = &ring->slot[i];
+        if (slot->valid && !memcmp(slot->key, key, sizeof(key))) {
+            slot->last_used = ring->clock;
+            ring->hits++;
+            pthread_mutex_unlock(&g_mtxBufRing);
+            return i;
+        }
+
+        if (!ring->slot[idx].valid)
+            continue;
+        if (!slot->valid || (slot->last_used < ring->slot[idx].last_used))
+            idx = i;
+    }
+
+    memcpy(ring->slot[idx].key, key, sizeof(key));
+    ring->slot[idx].last_used = ring->clock;
+    ring->slot[idx].valid = true;
+    ring->misses++;
+
+    pthread_mutex_unlock(&g_mtxBufRing);
+
+    return idx;
+}
+
 void CScalerV4L2::Initialize(int instance)
 {
     snprintf(m_cszNode, SC_MAX_NODENAME, SC_DEV_NODE "%d", SC_NODE(instance));
@@ -83,6 +236,9 @@ CScalerV4L2::CScalerV4L2(int instance, int allow_drm)
 
 CScalerV4L2::~CScalerV4L2()
 {
+    sc_v4l2_free_ring(&m_frmSrc);
+    sc_v4l2_free_ring(&m_frmDst);
+
     if (m_fdScaler >= 0)
         close(m_fdScaler);
 
@@ -192,6 +348,7 @@ bool CScalerV4L2::ResetDevice(FrameInfo &frm)
             return false;
         }
 
+        sc_v4l2_reset_ring(&frm, 0);
         ClearFlag(frm.flags, SCFF_REQBUFS);
     }
 
@@ -282,7 +439,8 @@ bool CScalerV4L2::QBuf(FrameInfo &frm, int *pfdReleaseFence)
 
     buffer.type   = frm.type;
     buffer.memory = frm.memory;
-    buffer.index  = 0;
+    buffer.index  = sc_v4l2_get_slot(&frm, frm.addr, frm.out_plane_size,
+                                     frm.out_num_planes, frm.memory);
     buffer.length = frm.out_num_planes;
 
     if (pfdReleaseFence) {
@@ -335,13 +493,20 @@ bool CScalerV4L2::ReqBufs(FrameInfo &frm)
 
     reqbufs.type    = frm.type;
     reqbufs.memory  = frm.memory;
-    reqbufs.count   = 1;
+    reqbufs.count   = SC_V4L2_BUF_SLOTS;
 
     if (exynos_v4l2_reqbufs(m_fdScaler, &reqbufs) < 0) {
         SC_LOGERR("Failed to REQBUFS for the %s", frm.name);
         return false;
     }
 
+    if (reqbufs.count == 0) {
+        SC_LOGE("No buffer is granted by REQBUFS for the %s", frm.name);
+        return false;
+    }
+
+    sc_v4l2_reset_ring(&frm, reqbufs.count);
+
     SetFlag(frm.flags, SCFF_REQBUFS);
 
     SC_LOGD("Successfully REQBUFS for the %s", frm.name);
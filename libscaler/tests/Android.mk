@@ -0,0 +1,39 @@
+# Copyright (C) 2014 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH := $(call my-dir)
+
+include $(CLEAR_VARS)
+
+# the m2m1shot nodes are faked by wrapping open(), ioctl() and close()
+LOCAL_MODULE := libscaler_unittest
+LOCAL_SRC_FILES := \
+	../libscaler-dmabuf.cpp \
+	../libscaler-m2m1shot.cpp \
+	../libscaler-swscaler.cpp \
+	m2m1shot_batch_test.cpp \
+	swscaler_test.cpp
+LOCAL_C_INCLUDES := \
+	$(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr/include \
+	$(LOCAL_PATH)/.. \
+	$(LOCAL_PATH)/../../include \
+	$(TOP)/hardware/samsung_slsi/exynos/include
+LOCAL_STATIC_LIBRARIES := libutils liblog libcutils
+LOCAL_LDFLAGS := -Wl,--wrap=open -Wl,--wrap=ioctl -Wl,--wrap=close
+LOCAL_LDLIBS := -lpthread -lrt
+LOCAL_MODULE_TAGS := optional
+# the dma-buf fds travel in pointers, as on the device
+LOCAL_MULTILIB := 32
+
+include $(BUILD_HOST_NATIVE_TEST)
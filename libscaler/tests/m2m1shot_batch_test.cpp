@@ -0,0 +1,326 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      m2m1shot_batch_test.cpp
+ * \brief     unit test of CScalerM2M1SHOTBatch against fake m2m1shot nodes
+ *
+ * open(), ioctl() and close() are wrapped at link time: the nodes
+ * /dev/m2m1shot_scaler0 ~ N-1 are backed by /dev/null, and
+ * M2M1SHOT_IOC_PROCESS takes a little time and records which node and
+ * thread processed the task.
+ */
+
+#include <cerrno>
+#include <cstdarg>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <linux/videodev2.h>
+
+#include <exynos_scaler.h>
+
+#include "libscaler-common.h"
+#include "libscaler-m2m1shot-batch.h"
+
+#define FAKE_PROCESS_US     5000
+/* a task whose destination is this wide fails in the driver */
+#define FAKE_FAIL_WIDTH     24
+
+extern "C" int __real_open(const char *path, int flags, ...);
+extern "C" int __real_ioctl(int fd, int request, ...);
+extern "C" int __real_close(int fd);
+
+static const char fake_base_name[] = "/dev/m2m1shot_scaler";
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static int g_instances;                     // nodes that can be opened
+static int g_node_fd[SC_M2M1SHOT_MAX_INSTANCES];
+static int g_processed[SC_M2M1SHOT_MAX_INSTANCES];
+static int g_active;                        // ioctls in progress
+static int g_max_active;
+static int g_other_thread;                  // ioctls off the test thread
+static pthread_t g_test_thread;
+
+static int fake_instance(int fd)
+{
+    for (int i = 0; i < SC_M2M1SHOT_MAX_INSTANCES; i++) {
+        if (g_node_fd[i] == fd)
+            return i;
+    }
+
+    return -1;
+}
+
+extern "C" int __wrap_open(const char *path, int flags, ...)
+{
+    mode_t mode = 0;
+
+    if (flags & O_CREAT) {
+        va_list ap;
+        va_start(ap, flags);
+        mode = va_arg(ap, int);
+        va_end(ap);
+    }
+
+    if (strncmp(path, fake_base_name, sizeof(fake_base_name) - 1) != 0)
+        return __real_open(path, flags, mode);
+
+    int id = atoi(path + sizeof(fake_base_name) - 1);
+    if (id >= g_instances) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    int fd = __real_open("/dev/null", O_RDWR);
+    pthread_mutex_lock(&g_lock);
+    g_node_fd[id] = fd;
+    pthread_mutex_unlock(&g_lock);
+
+    return fd;
+}
+
+extern "C" int __wrap_ioctl(int fd, int request, ...)
+{
+    va_list ap;
+    void *arg;
+
+    va_start(ap, request);
+    arg = va_arg(ap, void *);
+    va_end(ap);
+
+    pthread_mutex_lock(&g_lock);
+    int id = fake_instance(fd);
+    pthread_mutex_unlock(&g_lock);
+
+    if (id < 0 || request != (int)M2M1SHOT_IOC_PROCESS)
+        return __real_ioctl(fd, request, arg);
+
+    m2m1shot *task = static_cast<m2m1shot *>(arg);
+
+    pthread_mutex_lock(&g_lock);
+    g_active++;
+    if (g_active > g_max_active)
+        g_max_active = g_active;
+    if (!pthread_equal(pthread_self(), g_test_thread))
+        g_other_thread++;
+    pthread_mutex_unlock(&g_lock);
+
+    usleep(FAKE_PROCESS_US);
+
+    pthread_mutex_lock(&g_lock);
+    g_active--;
+    g_processed[id]++;
+    pthread_mutex_unlock(&g_lock);
+
+    if (task->fmt_cap.width == FAKE_FAIL_WIDTH) {
+        errno = EIO;
+        return -1;
+    }
+
+    return 0;
+}
+
+extern "C" int __wrap_close(int fd)
+{
+    pthread_mutex_lock(&g_lock);
+    int id = fake_instance(fd);
+    if (id >= 0)
+        g_node_fd[id] = -1;
+    pthread_mutex_unlock(&g_lock);
+
+    return __real_close(fd);
+}
+
+class M2M1SHOTBatchTest : public ::testing::Test {
+protected:
+    static const unsigned int kWidth = 64;
+    static const unsigned int kHeight = 32;
+
+    char m_src[kWidth * kHeight * 4];
+    char m_dst[kWidth * kHeight * 4];
+
+    void Reset(int instances) {
+        g_instances = instances;
+        for (int i = 0; i < SC_M2M1SHOT_MAX_INSTANCES; i++) {
+            g_node_fd[i] = -1;
+            g_processed[i] = 0;
+        }
+        g_active = 0;
+        g_max_active = 0;
+        g_other_thread = 0;
+        g_test_thread = pthread_self();
+    }
+
+    void SetImage(ScalerM2M1SHOTImage &img, unsigned int width, char *buf) {
+        memset(&img, 0, sizeof(img));
+        img.width = width;
+        img.height = kHeight;
+        img.v4l2_fmt = V4L2_PIX_FMT_RGB32;
+        img.crop_width = width;
+        img.crop_height = kHeight;
+        img.addr[0] = buf;
+        img.mem_type = V4L2_MEMORY_USERPTR;
+    }
+
+    void SetTasks(ScalerM2M1SHOTTask *tasks, unsigned int count) {
+        memset(tasks, 0, sizeof(*tasks) * count);
+        for (unsigned int i = 0; i < count; i++) {
+            SetImage(tasks[i].src, kWidth, m_src);
+            SetImage(tasks[i].dst, kWidth / 2, m_dst);
+            tasks[i].result = 1;
+            tasks[i].instance = -1;
+        }
+    }
+
+    int Processed() {
+        int sum = 0;
+        for (int i = 0; i < SC_M2M1SHOT_MAX_INSTANCES; i++)
+            sum += g_processed[i];
+        return sum;
+    }
+};
+
+TEST_F(M2M1SHOTBatchTest, NoInstance)
+{
+    ScalerM2M1SHOTTask task;
+
+    Reset(0);
+    CScalerM2M1SHOTBatch batch;
+    SetTasks(&task, 1);
+
+    EXPECT_FALSE(batch.Valid());
+    EXPECT_FALSE(batch.Run(&task, 1));
+    EXPECT_EQ(0, Processed());
+}
+
+TEST_F(M2M1SHOTBatchTest, SingleInstanceRunsInline)
+{
+    ScalerM2M1SHOTTask tasks[4];
+
+    Reset(1);
+    CScalerM2M1SHOTBatch batch;
+    SetTasks(tasks, 4);
+
+    ASSERT_TRUE(batch.Valid());
+    EXPECT_EQ(1, batch.GetInstances());
+    EXPECT_TRUE(batch.Run(tasks, 4));
+
+    for (unsigned int i = 0; i < 4; i++) {
+        EXPECT_EQ(0, tasks[i].result);
+        EXPECT_EQ(0, tasks[i].instance);
+        EXPECT_GE(tasks[i].process_ns, FAKE_PROCESS_US * 1000ULL);
+    }
+    EXPECT_EQ(4, g_processed[0]);
+    EXPECT_EQ(0, g_other_thread);
+    EXPECT_EQ(1, g_max_active);
+}
+
+TEST_F(M2M1SHOTBatchTest, WorkersSpreadTheTasks)
+{
+    const unsigned int count = 12;
+    ScalerM2M1SHOTTask tasks[count];
+
+    Reset(3);
+    CScalerM2M1SHOTBatch batch;
+    SetTasks(tasks, count);
+
+    ASSERT_EQ(3, batch.GetInstances());
+    EXPECT_TRUE(batch.Run(tasks, count));
+
+    int used = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        EXPECT_EQ(0, tasks[i].result);
+        ASSERT_GE(tasks[i].instance, 0);
+        ASSERT_LT(tasks[i].instance, 3);
+    }
+    for (int i = 0; i < 3; i++) {
+        if (g_processed[i] > 0)
+            used++;
+    }
+
+    EXPECT_EQ((int)count, Processed());
+    EXPECT_EQ((int)count, g_other_thread);
+    EXPECT_GT(used, 1);
+    EXPECT_GT(g_max_active, 1);
+
+    // the pool is reusable
+    SetTasks(tasks, count);
+    EXPECT_TRUE(batch.Run(tasks, count));
+    EXPECT_EQ((int)count * 2, Processed());
+}
+
+TEST_F(M2M1SHOTBatchTest, FailuresAreReportedPerTask)
+{
+    ScalerM2M1SHOTTask tasks[6];
+
+    Reset(2);
+    CScalerM2M1SHOTBatch batch;
+    SetTasks(tasks, 6);
+
+    // refused by the driver
+    SetImage(tasks[1].dst, FAKE_FAIL_WIDTH, m_dst);
+    // refused before the driver: crop out of the image
+    tasks[4].src.crop_left = kWidth;
+
+    EXPECT_FALSE(batch.Run(tasks, 6));
+
+    for (unsigned int i = 0; i < 6; i++) {
+        if (i == 1)
+            EXPECT_EQ(-EIO, tasks[i].result);
+        else if (i == 4)
+            EXPECT_EQ(-EINVAL, tasks[i].result);
+        else
+            EXPECT_EQ(0, tasks[i].result);
+    }
+    EXPECT_EQ(5, Processed());
+}
+
+TEST_F(M2M1SHOTBatchTest, DmaBufsAreLookedUpOnce)
+{
+    ScalerM2M1SHOTTask tasks[2];
+    const int src_fd = 100, dst_fd = 101;
+
+    Reset(1);
+    CScalerM2M1SHOTBatch batch;
+    SetTasks(tasks, 2);
+    for (unsigned int i = 0; i < 2; i++) {
+        tasks[i].src.mem_type = V4L2_MEMORY_DMABUF;
+        tasks[i].src.addr[0] = reinterpret_cast<void *>(src_fd);
+        tasks[i].dst.mem_type = V4L2_MEMORY_DMABUF;
+        tasks[i].dst.addr[0] = reinterpret_cast<void *>(dst_fd);
+    }
+    CScalerM2M1SHOTBatch::InvalidateDmaBuf(src_fd);
+    CScalerM2M1SHOTBatch::InvalidateDmaBuf(dst_fd);
+
+    EXPECT_TRUE(batch.Run(tasks, 2));
+    EXPECT_EQ(0U, tasks[0].dmabuf_hits);
+    EXPECT_EQ(2U, tasks[0].dmabuf_misses);
+    EXPECT_EQ(2U, tasks[1].dmabuf_hits);
+    EXPECT_EQ(0U, tasks[1].dmabuf_misses);
+
+    // the source fd was closed and reused
+    CScalerM2M1SHOTBatch::InvalidateDmaBuf(src_fd);
+    EXPECT_TRUE(batch.Run(tasks, 1));
+    EXPECT_EQ(1U, tasks[0].dmabuf_hits);
+    EXPECT_EQ(1U, tasks[0].dmabuf_misses);
+}
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      swscaler_test.cpp
+ * \brief     unit test of the CPU reference scaler
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <linux/videodev2.h>
+
+#include "libscaler-swscaler.h"
+
+using namespace std;
+
+class SwScalerTest : public ::testing::Test {
+protected:
+    CScalerSW m_sc;
+
+    // RGB32 image whose every pixel tells where it comes from
+    static vector<uint8_t> Pattern(unsigned int w, unsigned int h) {
+        vector<uint8_t> img(w * h * 4);
+
+        for (unsigned int y = 0; y < h; y++) {
+            for (unsigned int x = 0; x < w; x++) {
+                uint8_t *p = &img[(y * w + x) * 4];
+                p[0] = x * 7;
+                p[1] = y * 11;
+                p[2] = (x + y) * 3;
+                p[3] = 255;
+            }
+        }
+
+        return img;
+    }
+
+    bool Run(unsigned int sw, unsigned int sh, unsigned int sfmt, void *src,
+             unsigned int dw, unsigned int dh, unsigned int dfmt, void *dst,
+             int rot = 0, int hflip = 0, int vflip = 0) {
+        void *saddr[SC_NUM_OF_PLANES] = { src, NULL, NULL };
+        void *daddr[SC_NUM_OF_PLANES] = { dst, NULL, NULL };
+
+        return m_sc.SetSrcFormat(sw, sh, sfmt) &&
+               m_sc.SetSrcCrop(0, 0, sw, sh) &&
+               m_sc.SetSrcAddr(saddr, V4L2_MEMORY_USERPTR) &&
+               m_sc.SetDstFormat(dw, dh, dfmt) &&
+               m_sc.SetDstCrop(0, 0, dw, dh) &&
+               m_sc.SetDstAddr(daddr, V4L2_MEMORY_USERPTR) &&
+               m_sc.SetRotate(rot, hflip, vflip) &&
+               m_sc.Run();
+    }
+
+    static int MaxDiff(const vector<uint8_t> &a, const vector<uint8_t> &b) {
+        int diff = 0;
+
+        for (size_t i = 0; i < a.size() && i < b.size(); i++) {
+            int d = abs(static_cast<int>(a[i]) - static_cast<int>(b[i]));
+            if (d > diff)
+                diff = d;
+        }
+
+        return diff;
+    }
+};
+
+TEST_F(SwScalerTest, SameSizeCopiesExactly)
+{
+    vector<uint8_t> src = Pattern(40, 24);
+    vector<uint8_t> dst(src.size());
+
+    ASSERT_TRUE(Run(40, 24, V4L2_PIX_FMT_RGB32, &src[0],
+                    40, 24, V4L2_PIX_FMT_RGB32, &dst[0]));
+    EXPECT_EQ(src, dst);
+}
+
+TEST_F(SwScalerTest, FlatImageStaysFlat)
+{
+    vector<uint8_t> src(64 * 48 * 4);
+    vector<uint8_t> up(150 * 90 * 4);
+    vector<uint8_t> down(17 * 13 * 4);
+
+    for (size_t i = 0; i < src.size(); i += 4) {
+        src[i] = 200;
+        src[i + 1] = 100;
+        src[i + 2] = 30;
+        src[i + 3] = 255;
+    }
+
+    ASSERT_TRUE(Run(64, 48, V4L2_PIX_FMT_RGB32, &src[0],
+                    150, 90, V4L2_PIX_FMT_RGB32, &up[0]));
+    ASSERT_TRUE(Run(64, 48, V4L2_PIX_FMT_RGB32, &src[0],
+                    17, 13, V4L2_PIX_FMT_RGB32, &down[0]));
+
+    for (size_t i = 0; i < up.size(); i += 4) {
+        ASSERT_EQ(200, up[i]);
+        ASSERT_EQ(100, up[i + 1]);
+        ASSERT_EQ(30, up[i + 2]);
+    }
+    for (size_t i = 0; i < down.size(); i += 4) {
+        ASSERT_EQ(200, down[i]);
+        ASSERT_EQ(100, down[i + 1]);
+        ASSERT_EQ(30, down[i + 2]);
+    }
+}
+
+TEST_F(SwScalerTest, RotatesClockwise)
+{
+    const unsigned int w = 20, h = 12;
+    vector<uint8_t> src = Pattern(w, h);
+    vector<uint8_t> dst(src.size());
+
+    ASSERT_TRUE(Run(w, h, V4L2_PIX_FMT_RGB32, &src[0],
+                    h, w, V4L2_PIX_FMT_RGB32, &dst[0], 90));
+
+    // the left column of the source is the top row of the result
+    for (unsigned int y = 0; y < h; y++) {
+        for (unsigned int x = 0; x < w; x++) {
+            const uint8_t *s = &src[(y * w + x) * 4];
+            const uint8_t *d = &dst[(x * h + (h - 1 - y)) * 4];
+            ASSERT_EQ(0, memcmp(s, d, 3)) << "at " << x << "," << y;
+        }
+    }
+}
+
+TEST_F(SwScalerTest, FlipsLeftRight)
+{
+    const unsigned int w = 16, h = 8;
+    vector<uint8_t> src = Pattern(w, h);
+    vector<uint8_t> dst(src.size());
+
+    ASSERT_TRUE(Run(w, h, V4L2_PIX_FMT_RGB32, &src[0],
+                    w, h, V4L2_PIX_FMT_RGB32, &dst[0], 0, 1, 0));
+
+    for (unsigned int y = 0; y < h; y++) {
+        for (unsigned int x = 0; x < w; x++) {
+            ASSERT_EQ(0, memcmp(&src[(y * w + x) * 4],
+                                &dst[(y * w + (w - 1 - x)) * 4], 3));
+        }
+    }
+}
+
+TEST_F(SwScalerTest, YuvRoundTripIsClose)
+{
+    const unsigned int w = 32, h = 16;
+    vector<uint8_t> src(w * h * 4);
+    vector<uint8_t> yuv(w * h * 2);
+    vector<uint8_t> back(src.size());
+
+    // smooth enough for 4:2:0 chroma to survive
+    for (unsigned int y = 0; y < h; y++) {
+        for (unsigned int x = 0; x < w; x++) {
+            uint8_t *p = &src[(y * w + x) * 4];
+            p[0] = 60 + x * 2;
+            p[1] = 90 + y * 3;
+            p[2] = 120;
+            p[3] = 255;
+        }
+    }
+
+    ASSERT_TRUE(Run(w, h, V4L2_PIX_FMT_RGB32, &src[0],
+                    w, h, V4L2_PIX_FMT_NV12, &yuv[0]));
+    ASSERT_TRUE(Run(w, h, V4L2_PIX_FMT_NV12, &yuv[0],
+                    w, h, V4L2_PIX_FMT_RGB32, &back[0]));
+
+    for (size_t i = 3; i < back.size(); i += 4)
+        back[i] = 255;
+    EXPECT_LE(MaxDiff(src, back), 8);
+}
+
+TEST_F(SwScalerTest, RejectsWhatItCannotDo)
+{
+    void *addr[SC_NUM_OF_PLANES] = { NULL, NULL, NULL };
+
+    EXPECT_FALSE(m_sc.SetSrcFormat(64, 32, V4L2_PIX_FMT_NV12MT_16X16));
+    EXPECT_FALSE(m_sc.SetSrcAddr(addr, V4L2_MEMORY_DMABUF));
+    EXPECT_FALSE(m_sc.SetRotate(45, 0, 0));
+}